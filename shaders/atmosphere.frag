@@ -0,0 +1,225 @@
+#version 460 core
+
+// Lookups into a planet's precomputed atmosphere tables (src/sky/atmosphere.h),
+// linked into the surface and sky programs as a second fragment shader. The
+// table layouts and parameterizations are those of src/sky/atmosphereTables.cpp.
+// Positions are in km relative to the planet centre, see GetAtmospherePosition.
+
+layout (std140, binding = 2) uniform AtmosphereData {
+    vec4 atmosphereCenter;      // xyz: planet centre in world space, w: world units per km
+    vec4 atmosphereRadii;       // x: bottom, y: top (km), z: mu_s min, w: Mie g
+    vec4 rayleighScattering;    // w: sun angular radius
+    vec4 mieScattering;
+    vec4 solarIrradiance;       // w: exposure
+};
+
+layout (binding = 4) uniform sampler2D transmittanceTexture;
+layout (binding = 5) uniform sampler3D scatteringTexture;
+layout (binding = 6) uniform sampler2D irradianceTexture;
+
+const int TRANSMITTANCE_WIDTH = 256;
+const int TRANSMITTANCE_HEIGHT = 64;
+const int SCATTERING_R_SIZE = 32;
+const int SCATTERING_MU_SIZE = 128;
+const int SCATTERING_MU_S_SIZE = 32;
+const int SCATTERING_NU_SIZE = 8;
+const int IRRADIANCE_WIDTH = 64;
+const int IRRADIANCE_HEIGHT = 16;
+const float PI = 3.14159265358979;
+
+float ClampCosine(float mu) {
+    return clamp(mu, -1.0, 1.0);
+}
+
+float SafeSqrt(float a) {
+    return sqrt(max(a, 0.0));
+}
+
+float ClampRadius(float r) {
+    return clamp(r, atmosphereRadii.x, atmosphereRadii.y);
+}
+
+float CoordFromUnitRange(float x, int size) {
+    return 0.5 / float(size) + x * (1.0 - 1.0 / float(size));
+}
+
+float DistanceToTop(float r, float mu) {
+    float top = atmosphereRadii.y;
+    return max(0.0, -r * mu + SafeSqrt(r * r * (mu * mu - 1.0) + top * top));
+}
+
+bool RayIntersectsGround(float r, float mu) {
+    float bottom = atmosphereRadii.x;
+    return mu < 0.0 && r * r * (mu * mu - 1.0) + bottom * bottom >= 0.0;
+}
+
+float RayleighPhase(float nu) {
+    return 3.0 / (16.0 * PI) * (1.0 + nu * nu);
+}
+
+float MiePhase(float g, float nu) {
+    float k = 3.0 / (8.0 * PI) * (1.0 - g * g) / (2.0 + g * g);
+    return k * (1.0 + nu * nu) / pow(1.0 + g * g - 2.0 * g * nu, 1.5);
+}
+
+vec3 GetTransmittanceToTop(float r, float mu) {
+    float bottom = atmosphereRadii.x, top = atmosphereRadii.y;
+    float H = sqrt(top * top - bottom * bottom);
+    float rho = SafeSqrt(r * r - bottom * bottom);
+    float dMin = top - r;
+    float dMax = rho + H;
+    float xMu = dMax > dMin ? (DistanceToTop(r, mu) - dMin) / (dMax - dMin) : 0.0;
+    vec2 uv = vec2(CoordFromUnitRange(xMu, TRANSMITTANCE_WIDTH), CoordFromUnitRange(rho / H, TRANSMITTANCE_HEIGHT));
+    return texture(transmittanceTexture, uv).rgb;
+}
+
+// Along a ray of length d, the ratio of the two transmittances to the top
+vec3 GetTransmittance(float r, float mu, float d, bool rayIntersectsGround) {
+    float rD = ClampRadius(sqrt(d * d + 2.0 * r * mu * d + r * r));
+    float muD = ClampCosine((r * mu + d) / rD);
+    if (rayIntersectsGround) {
+        return min(GetTransmittanceToTop(rD, -muD) / GetTransmittanceToTop(r, -mu), vec3(1.0));
+    }
+    return min(GetTransmittanceToTop(r, mu) / GetTransmittanceToTop(rD, muD), vec3(1.0));
+}
+
+vec3 GetTransmittanceToSun(float r, float muS) {
+    float sinThetaH = atmosphereRadii.x / r;
+    float cosThetaH = -SafeSqrt(1.0 - sinThetaH * sinThetaH);
+    float sunRadius = rayleighScattering.w;
+    return GetTransmittanceToTop(r, muS) *
+           smoothstep(-sinThetaH * sunRadius, sinThetaH * sunRadius, muS - cosThetaH);
+}
+
+// Rayleigh plus multiple scattering, and single Mie rebuilt from its red channel
+vec3 GetCombinedScattering(float r, float mu, float muS, float nu, bool rayIntersectsGround, out vec3 singleMie) {
+    float bottom = atmosphereRadii.x, top = atmosphereRadii.y;
+    float H = sqrt(top * top - bottom * bottom);
+    float rho = SafeSqrt(r * r - bottom * bottom);
+    float uR = CoordFromUnitRange(rho / H, SCATTERING_R_SIZE);
+
+    float rMu = r * mu;
+    float discriminant = rMu * rMu - r * r + bottom * bottom;
+    float uMu;
+    if (rayIntersectsGround) {
+        float d = -rMu - SafeSqrt(discriminant);
+        float dMin = r - bottom;
+        float dMax = rho;
+        uMu = 0.5 - 0.5 * CoordFromUnitRange(dMax == dMin ? 0.0 : (d - dMin) / (dMax - dMin), SCATTERING_MU_SIZE / 2);
+    } else {
+        float d = -rMu + SafeSqrt(discriminant + H * H);
+        float dMin = top - r;
+        float dMax = rho + H;
+        uMu = 0.5 + 0.5 * CoordFromUnitRange((d - dMin) / (dMax - dMin), SCATTERING_MU_SIZE / 2);
+    }
+
+    float dMin = top - bottom;
+    float dMax = H;
+    float a = (DistanceToTop(bottom, muS) - dMin) / (dMax - dMin);
+    float A = (DistanceToTop(bottom, atmosphereRadii.z) - dMin) / (dMax - dMin);
+    float uMuS = CoordFromUnitRange(max(1.0 - a / A, 0.0) / (1.0 + a), SCATTERING_MU_S_SIZE);
+    float uNu = (nu + 1.0) * 0.5;
+
+    float texCoordX = uNu * float(SCATTERING_NU_SIZE - 1);
+    float texX = floor(texCoordX);
+    float lerp = texCoordX - texX;
+    vec3 uvw0 = vec3((texX + uMuS) / float(SCATTERING_NU_SIZE), uMu, uR);
+    vec3 uvw1 = vec3((texX + 1.0 + uMuS) / float(SCATTERING_NU_SIZE), uMu, uR);
+    vec4 combined = texture(scatteringTexture, uvw0) * (1.0 - lerp) + texture(scatteringTexture, uvw1) * lerp;
+
+    singleMie = combined.r > 0.0
+        ? combined.rgb * combined.a / combined.r * (rayleighScattering.r / mieScattering.r) * (mieScattering.rgb / rayleighScattering.rgb)
+        : vec3(0.0);
+    return combined.rgb;
+}
+
+vec3 GetAtmospherePosition(vec3 worldPosition) {
+    return (worldPosition - atmosphereCenter.xyz) / atmosphereCenter.w;
+}
+
+// Light scattered towards the camera along a ray that leaves the atmosphere
+vec3 GetSkyRadiance(vec3 camera, vec3 viewRay, vec3 sunDirection, out vec3 transmittance) {
+    float top = atmosphereRadii.y;
+    float r = length(camera);
+    float rMu = dot(camera, viewRay);
+    float distanceToTop = -rMu - sqrt(rMu * rMu - r * r + top * top);
+    // From space, start where the ray enters the atmosphere
+    if (distanceToTop > 0.0) {
+        camera = camera + viewRay * distanceToTop;
+        r = top;
+        rMu += distanceToTop;
+    } else if (r > top) {
+        transmittance = vec3(1.0);
+        return vec3(0.0);
+    }
+    float mu = rMu / r;
+    float muS = dot(camera, sunDirection) / r;
+    float nu = dot(viewRay, sunDirection);
+    bool rayIntersectsGround = RayIntersectsGround(r, mu);
+
+    transmittance = rayIntersectsGround ? vec3(0.0) : GetTransmittanceToTop(r, mu);
+    vec3 singleMie;
+    vec3 scattering = GetCombinedScattering(r, mu, muS, nu, rayIntersectsGround, singleMie);
+    return scattering * RayleighPhase(nu) + singleMie * MiePhase(atmosphereRadii.w, nu);
+}
+
+// Light scattered towards the camera between it and a point, as the
+// difference of the scattering to the boundary seen from both ends
+vec3 GetSkyRadianceToPoint(vec3 camera, vec3 point, vec3 sunDirection, out vec3 transmittance) {
+    float top = atmosphereRadii.y;
+    vec3 viewRay = normalize(point - camera);
+    float r = length(camera);
+    float rMu = dot(camera, viewRay);
+    float distanceToTop = -rMu - sqrt(rMu * rMu - r * r + top * top);
+    if (distanceToTop > 0.0) {
+        camera = camera + viewRay * distanceToTop;
+        r = top;
+        rMu += distanceToTop;
+    }
+    float mu = rMu / r;
+    float muS = dot(camera, sunDirection) / r;
+    float nu = dot(viewRay, sunDirection);
+    float d = length(point - camera);
+    bool rayIntersectsGround = RayIntersectsGround(r, mu);
+
+    transmittance = GetTransmittance(r, mu, d, rayIntersectsGround);
+    vec3 singleMie;
+    vec3 scattering = GetCombinedScattering(r, mu, muS, nu, rayIntersectsGround, singleMie);
+
+    float rP = ClampRadius(sqrt(d * d + 2.0 * r * mu * d + r * r));
+    float muP = ClampCosine((r * mu + d) / rP);
+    float muSP = ClampCosine((r * muS + d * nu) / rP);
+    vec3 singleMieP;
+    vec3 scatteringP = GetCombinedScattering(rP, muP, muSP, nu, rayIntersectsGround, singleMieP);
+
+    scattering = max(scattering - transmittance * scatteringP, vec3(0.0));
+    singleMie = max(singleMie - transmittance * singleMieP, vec3(0.0));
+    // The Mie difference is unstable with the sun just below the horizon
+    singleMie *= smoothstep(0.0, 0.01, muS);
+    return scattering * RayleighPhase(nu) + singleMie * MiePhase(atmosphereRadii.w, nu);
+}
+
+// Direct sun and sky irradiance on a surface at point with the given normal.
+// The sky part is tabulated for a horizontal surface and scaled by how much
+// of the sky the normal still sees.
+vec3 GetSunAndSkyIrradiance(vec3 point, vec3 normal, vec3 sunDirection, out vec3 skyIrradiance) {
+    float bottom = atmosphereRadii.x, top = atmosphereRadii.y;
+    float r = ClampRadius(length(point));
+    vec3 up = normalize(point);
+    float muS = dot(up, sunDirection);
+    vec2 uv = vec2(CoordFromUnitRange(muS * 0.5 + 0.5, IRRADIANCE_WIDTH),
+                   CoordFromUnitRange((r - bottom) / (top - bottom), IRRADIANCE_HEIGHT));
+    skyIrradiance = texture(irradianceTexture, uv).rgb * (1.0 + dot(normal, up)) * 0.5;
+    return solarIrradiance.rgb * GetTransmittanceToSun(r, muS) * max(dot(normal, sunDirection), 0.0);
+}
+
+// Radiance of the sun's disc along viewRay, zero outside it
+vec3 GetSunDiscRadiance(vec3 viewRay, vec3 sunDirection) {
+    float sunRadius = rayleighScattering.w;
+    if (dot(viewRay, sunDirection) < cos(sunRadius)) return vec3(0.0);
+    return solarIrradiance.rgb / (PI * sunRadius * sunRadius);
+}
+
+vec3 ToneMapAtmosphere(vec3 radiance) {
+    return pow(vec3(1.0) - exp(-radiance * solarIrradiance.w), vec3(1.0 / 2.2));
+}
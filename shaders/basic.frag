@@ -3,15 +3,80 @@
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoord;
+in vec3 DetailCoord;    // xy: within the patch, z: NormalAtlas layer or -1
+in vec3 LocalPos;
 
-uniform vec3 lightPos;
-uniform vec3 lightColor;
-uniform vec3 viewPos;
-uniform vec3 objectColor;
+layout (std140, binding = 0) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 viewPos;
+    vec4 viewport;      // xy: target size in pixels, z: tessellated edge length in pixels
+};
+
+layout (std140, binding = 1) uniform ObjectData {
+    mat4 model;
+    mat4 normalMatrix;
+    vec4 objectColor;
+    vec4 surface;       // x: radius before displacement, y: 1 with an atmosphere bound, z: virtual texture levels
+};
+
+// Per-patch normal maps (NormalAtlas), one layer per patch: rg the tangent-space
+// normal, b the height, a the cube face / 5
+layout (binding = 1) uniform sampler2DArray normalAtlas;
+
+// d CubeFacePosition / du per face (terrain/cubeMapping.h), the tangent frame's reference
+const vec3 FACE_TANGENTS[6] = vec3[](vec3(1.0, 0.0, 0.0), vec3(-1.0, 0.0, 0.0), vec3(0.0, 0.0, -1.0),
+                                     vec3(0.0, 0.0, 1.0), vec3(1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0));
 
 out vec4 FragColor;
 
+// shaders/atmosphere.frag
+vec3 GetAtmospherePosition(vec3 worldPosition);
+vec3 GetSunAndSkyIrradiance(vec3 point, vec3 normal, vec3 sunDirection, out vec3 skyIrradiance);
+vec3 GetSkyRadianceToPoint(vec3 camera, vec3 point, vec3 sunDirection, out vec3 transmittance);
+vec3 ToneMapAtmosphere(vec3 radiance);
+
+// shaders/virtualTexture.frag
+vec4 SampleVirtualTexture(vec3 direction, float levelCount);
+
+// The patch's baked normal where it has one, the interpolated vertex normal otherwise
+vec3 SurfaceNormal() {
+    if (DetailCoord.z < 0.0) return normalize(Normal);
+    // Layer samples sit on the patch edges, shift onto texel centres
+    float size = float(textureSize(normalAtlas, 0).x);
+    vec2 uv = (DetailCoord.xy * (size - 1.0) + 0.5) / size;
+    vec4 texel = texture(normalAtlas, vec3(uv, DetailCoord.z));
+    // The frame NormalAtlas baked in: radial up, the face's u axis flattened onto the plane around it
+    vec3 up = normalize(LocalPos);
+    vec3 faceTangent = FACE_TANGENTS[int(texel.a * 5.0 + 0.5)];
+    vec3 tangent = normalize(faceTangent - up * dot(faceTangent, up));
+    vec3 bitangent = cross(up, tangent);
+    vec2 slope = texel.rg * 2.0 - 1.0;
+    vec3 normal = slope.x * tangent + slope.y * bitangent + sqrt(max(1.0 - dot(slope, slope), 0.0)) * up;
+    return normalize(mat3(normalMatrix) * normal);
+}
+
 void main() {
+    vec3 albedo = objectColor.rgb;
+    if (surface.z > 0.0) {
+        vec4 page = SampleVirtualTexture(LocalPos, surface.z);
+        if (page.a > 0.0) albedo = page.rgb;
+    }
+
+    if (surface.y > 0.0) {
+        // Lambertian ground under the sun and sky, seen through the air in between
+        vec3 toSun = normalize(lightPos.xyz - lightPos.w * FragPos);
+        vec3 point = GetAtmospherePosition(FragPos);
+        vec3 skyIrradiance;
+        vec3 sunIrradiance = GetSunAndSkyIrradiance(point, SurfaceNormal(), toSun, skyIrradiance);
+        vec3 radiance = albedo / 3.14159265 * (sunIrradiance + skyIrradiance);
+        vec3 transmittance;
+        vec3 inscatter = GetSkyRadianceToPoint(GetAtmospherePosition(viewPos.xyz), point, toSun, transmittance);
+        FragColor = vec4(ToneMapAtmosphere(radiance * transmittance + inscatter), 1.0);
+        return;
+    }
     // Temporarily very bright for debugging visibility
-    FragColor = vec4(objectColor * 2.0, 1.0); // Make it twice as bright
+    FragColor = vec4(albedo * 2.0, 1.0); // Make it twice as bright
 }
\ No newline at end of file
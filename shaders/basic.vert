@@ -3,20 +3,39 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in vec3 aDetailCoord;    // xy: within the patch, z: NormalAtlas layer or -1
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Per-frame data, updated once per frame (FrameUniforms in uniformBuffer.h)
+layout (std140, binding = 0) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 viewPos;
+    vec4 viewport;      // xy: target size in pixels, z: tessellated edge length in pixels
+};
+
+// Per-object data, one range of a shared buffer per draw (ObjectUniforms in uniformBuffer.h)
+layout (std140, binding = 1) uniform ObjectData {
+    mat4 model;
+    mat4 normalMatrix;
+    vec4 objectColor;
+    vec4 surface;       // x: radius before displacement, y: 1 with an atmosphere bound, z: virtual texture levels
+};
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoord;
+out vec3 DetailCoord;
+out vec3 LocalPos;       // planet-local, for the virtual texture
 
 void main() {
     vec4 worldPos = model * vec4(aPos, 1.0);
     gl_Position = projection * view * worldPos;
     
     FragPos = vec3(worldPos);
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    Normal = mat3(normalMatrix) * aNormal;
     TexCoord = aTexCoord;
+    DetailCoord = aDetailCoord;
+    LocalPos = aPos;
 }
\ No newline at end of file
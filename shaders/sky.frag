@@ -0,0 +1,30 @@
+#version 460 core
+
+in vec3 ViewRay;
+
+layout (std140, binding = 0) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 viewPos;
+    vec4 viewport;      // xy: target size in pixels, z: tessellated edge length in pixels
+};
+
+out vec4 FragColor;
+
+// shaders/atmosphere.frag
+vec3 GetAtmospherePosition(vec3 worldPosition);
+vec3 GetSkyRadiance(vec3 camera, vec3 viewRay, vec3 sunDirection, out vec3 transmittance);
+vec3 GetSunDiscRadiance(vec3 viewRay, vec3 sunDirection);
+vec3 ToneMapAtmosphere(vec3 radiance);
+
+void main() {
+    vec3 viewRay = normalize(ViewRay);
+    vec3 toSun = normalize(lightPos.xyz - lightPos.w * viewPos.xyz);
+    vec3 transmittance;
+    vec3 radiance = GetSkyRadiance(GetAtmospherePosition(viewPos.xyz), viewRay, toSun, transmittance);
+    radiance += GetSunDiscRadiance(viewRay, toSun) * transmittance;
+    // Alpha scales what is already behind, the stars fade out under a bright sky
+    FragColor = vec4(ToneMapAtmosphere(radiance), dot(transmittance, vec3(1.0 / 3.0)));
+}
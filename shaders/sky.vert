@@ -0,0 +1,13 @@
+#version 460 core
+
+uniform mat4 u_inverseViewProjection;   // of the view without the camera translation
+
+out vec3 ViewRay;
+
+void main() {
+    // One triangle covering the viewport on the far plane, no vertex buffer
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+    vec4 direction = u_inverseViewProjection * vec4(position, 1.0, 1.0);
+    ViewRay = direction.xyz / direction.w;
+    gl_Position = vec4(position, 1.0, 1.0);
+}
@@ -0,0 +1,23 @@
+#version 460 core
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec3 Color;
+
+layout (std140, binding = 0) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 viewPos;
+    vec4 viewport;      // xy: target size in pixels, z: tessellated edge length in pixels
+};
+
+out vec4 FragColor;
+
+void main() {
+    // Rocks share a handful of meshes, the light is what tells them apart
+    vec3 toLight = normalize(lightPos.xyz - lightPos.w * FragPos);
+    float diffuse = max(dot(normalize(Normal), toLight), 0.0);
+    FragColor = vec4(Color * lightColor.rgb * (0.2 + 0.8 * diffuse), 1.0);
+}
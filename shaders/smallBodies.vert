@@ -0,0 +1,57 @@
+#version 460 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 3) in uint aInstance;    // visible list entry written by shaders/smallBodies.comp
+
+layout (std140, binding = 0) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 viewPos;
+    vec4 viewport;      // xy: target size in pixels, z: tessellated edge length in pixels
+};
+
+struct SmallBody {
+    vec4 orbit;     // x: radius, y: phase, z: angular speed, w: height above the ring plane
+    vec4 shape;     // x: scale, y: spin rate, z: spin axis seed
+    vec4 color;
+};
+
+layout (std430, binding = 0) readonly buffer Instances {
+    SmallBody bodies[];
+};
+
+uniform vec3 u_center;
+uniform float u_time;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec3 Color;
+
+// Must match OrbitPosition in shaders/smallBodies.comp
+vec3 OrbitPosition(vec4 orbit) {
+    float angle = orbit.y + orbit.z * u_time;
+    return u_center + vec3(cos(angle) * orbit.x, orbit.w, sin(angle) * orbit.x);
+}
+
+// Rodrigues rotation about a unit axis
+vec3 Rotate(vec3 v, vec3 axis, float angle) {
+    float c = cos(angle);
+    float s = sin(angle);
+    return v * c + cross(axis, v) * s + axis * dot(axis, v) * (1.0 - c);
+}
+
+void main() {
+    SmallBody body = bodies[aInstance];
+    vec3 axis = normalize(vec3(sin(body.shape.z * 1.3), cos(body.shape.z * 0.7), sin(body.shape.z * 2.1) + 0.01));
+    float angle = body.shape.y * u_time;
+
+    vec3 worldPos = OrbitPosition(body.orbit) + Rotate(aPos, axis, angle) * body.shape.x;
+    gl_Position = projection * view * vec4(worldPos, 1.0);
+
+    FragPos = worldPos;
+    Normal = Rotate(aNormal, axis, angle);
+    Color = body.color.rgb;
+}
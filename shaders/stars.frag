@@ -0,0 +1,15 @@
+#version 460 core
+
+in vec3 Color;
+in float Brightness;
+
+out vec4 FragColor;
+
+void main() {
+    // Round, soft-edged points
+    vec2 offset = gl_PointCoord * 2.0 - 1.0;
+    float falloff = 1.0 - smoothstep(0.3, 1.0, dot(offset, offset));
+    float alpha = Brightness * falloff;
+    if (alpha <= 0.0) discard;
+    FragColor = vec4(Color * alpha, 1.0);
+}
@@ -0,0 +1,41 @@
+#version 460 core
+
+layout (location = 0) in vec3 aDirection;
+layout (location = 1) in float aMagnitude;
+layout (location = 2) in float aColorIndex;     // B-V
+
+layout (std140, binding = 0) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 viewPos;
+    vec4 viewport;      // xy: target size in pixels, z: tessellated edge length in pixels
+};
+
+uniform float u_magnitudeLimit;
+
+out vec3 Color;
+out float Brightness;
+
+// Rough blackbody tint from the B-V colour index
+vec3 StarColor(float bv) {
+    float t = clamp((bv + 0.4) / 2.4, 0.0, 1.0);
+    vec3 blue = vec3(0.62, 0.72, 1.0);
+    vec3 white = vec3(1.0, 0.97, 0.92);
+    vec3 red = vec3(1.0, 0.62, 0.38);
+    return t < 0.3 ? mix(blue, white, t / 0.3) : mix(white, red, (t - 0.3) / 0.7);
+}
+
+void main() {
+    // Stars sit at infinity: rotation only, and pinned to the far plane
+    vec4 clip = projection * vec4(mat3(view) * aDirection, 1.0);
+    gl_Position = clip.xyww;
+
+    // Stars fade in over the last three magnitudes above the limit, and only
+    // the brightest grow past a pixel
+    float headroom = u_magnitudeLimit - aMagnitude;
+    gl_PointSize = clamp(1.0 + (headroom - 3.0) * 0.5, 1.0, 6.0);
+    Brightness = clamp(headroom / 3.0 + 0.05, 0.0, 1.0);
+    Color = StarColor(aColorIndex);
+}
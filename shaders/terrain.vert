@@ -0,0 +1,19 @@
+#version 460 core
+
+// Patch corners straight through to the tessellation stages (TessControlPoint in cubesphere.h)
+layout (location = 0) in vec3 aCubePos;
+layout (location = 1) in vec2 aFaceUV;
+layout (location = 2) in float aHeightLayer;
+layout (location = 3) in float aNormalLayer;
+
+out vec3 vCubePos;
+out vec2 vFaceUV;
+out float vHeightLayer;
+out float vNormalLayer;
+
+void main() {
+    vCubePos = aCubePos;
+    vFaceUV = aFaceUV;
+    vHeightLayer = aHeightLayer;
+    vNormalLayer = aNormalLayer;
+}
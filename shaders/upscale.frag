@@ -0,0 +1,32 @@
+#version 460 core
+
+in vec2 TexCoord;
+
+uniform sampler2D u_scene;
+uniform vec2 u_uvScale;
+uniform vec2 u_texelSize;   // of the scene target
+uniform float u_sharpness;  // 0 = plain bilinear
+
+out vec4 FragColor;
+
+void main() {
+    // Stay inside the rendered part, the rest of the target is stale
+    vec2 lo = 0.5 * u_texelSize;
+    vec2 hi = u_uvScale - 0.5 * u_texelSize;
+    vec2 uv = clamp(TexCoord, lo, hi);
+    vec3 center = texture(u_scene, uv).rgb;
+    if (u_sharpness <= 0.0) {
+        FragColor = vec4(center, 1.0);
+        return;
+    }
+
+    // Unsharp mask over the cross neighbours, clamped to their range so edges do not ring
+    vec3 north = texture(u_scene, clamp(uv + vec2(0.0, u_texelSize.y), lo, hi)).rgb;
+    vec3 south = texture(u_scene, clamp(uv - vec2(0.0, u_texelSize.y), lo, hi)).rgb;
+    vec3 east = texture(u_scene, clamp(uv + vec2(u_texelSize.x, 0.0), lo, hi)).rgb;
+    vec3 west = texture(u_scene, clamp(uv - vec2(u_texelSize.x, 0.0), lo, hi)).rgb;
+    vec3 minimum = min(center, min(min(north, south), min(east, west)));
+    vec3 maximum = max(center, max(max(north, south), max(east, west)));
+    vec3 sharpened = center + (4.0 * center - north - south - east - west) * u_sharpness;
+    FragColor = vec4(clamp(sharpened, minimum, maximum), 1.0);
+}
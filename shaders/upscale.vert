@@ -0,0 +1,12 @@
+#version 460 core
+
+uniform vec2 u_uvScale;     // rendered part of the scene target
+
+out vec2 TexCoord;
+
+void main() {
+    // One triangle covering the viewport, no vertex buffer
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    TexCoord = position * u_uvScale;
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,24 @@
+#version 460 core
+
+// Virtual texture feedback pass: every pixel writes the surface page it
+// would sample (VirtualTexture::BeginFeedback), with shaders/virtualTexture.frag
+
+in vec3 LocalPos;
+
+layout (std140, binding = 1) uniform ObjectData {
+    mat4 model;
+    mat4 normalMatrix;
+    vec4 objectColor;
+    vec4 surface;       // x: radius before displacement, y: 1 with an atmosphere bound, z: virtual texture levels
+};
+
+// log2 of how much smaller the feedback target is than the frame
+uniform float u_levelBias;
+
+out uint FeedbackCode;
+
+uint VirtualFeedback(vec3 direction, float levelCount, float levelBias);
+
+void main() {
+    FeedbackCode = surface.z > 0.0 ? VirtualFeedback(LocalPos, surface.z, u_levelBias) : 0u;
+}
@@ -0,0 +1,93 @@
+#version 460 core
+
+// Lookups into a planet's virtual surface texture (src/terrain/virtualTexture.h),
+// linked into the surface programs as another fragment shader. Directions are
+// planet-local; the page pyramid is the cube-face quadtree of
+// src/terrain/cubeMapping.h with PAGE_SIZE texels per page edge.
+
+// Resident pages, each with a PAGE_BORDER texel border (AlbedoPageStride)
+layout (binding = 2) uniform sampler2D pageAtlas;
+// Per face (layer) and level (mip levelCount - 1 - level): slot x, slot y,
+// resident level, 255 where the page or an ancestor is resident
+layout (binding = 3) uniform usampler2DArray pageTable;
+
+const float PAGE_SIZE = 128.0;
+const float PAGE_BORDER = 1.0;
+
+// DirectionToCubeFace, also returning how far (u, v) move per pixel
+int VirtualFace(vec3 dir, out vec2 uv, out vec2 footprint) {
+    vec3 a = abs(dir);
+    vec3 dx = dFdx(dir);
+    vec3 dy = dFdy(dir);
+    int face;
+    float major;
+    vec2 minor;
+    vec3 sel;
+    if (a.z >= a.x && a.z >= a.y) {
+        face = dir.z > 0.0 ? 0 : 1;
+        major = dir.z;
+        minor = dir.xy;
+        sel = vec3(0.0, 0.0, 1.0);
+        uv = vec2(face == 0 ? dir.x : -dir.x, dir.y) / a.z;
+    } else if (a.x >= a.y) {
+        face = dir.x < 0.0 ? 2 : 3;
+        major = dir.x;
+        minor = dir.zy;
+        sel = vec3(1.0, 0.0, 0.0);
+        uv = vec2(face == 2 ? -dir.z : dir.z, dir.y) / a.x;
+    } else {
+        face = dir.y > 0.0 ? 4 : 5;
+        major = dir.y;
+        minor = dir.xz;
+        sel = vec3(0.0, 1.0, 0.0);
+        uv = vec2(dir.x, face == 4 ? -dir.z : dir.z) / a.y;
+    }
+    uv = clamp(uv * 0.5 + 0.5, 0.0, 1.0);
+
+    // d(minor / major), halved for the -1..1 to 0..1 remap; signs don't matter for the length
+    vec2 minorX = face < 2 ? dx.xy : (face < 4 ? dx.zy : dx.xz);
+    vec2 minorY = face < 2 ? dy.xy : (face < 4 ? dy.zy : dy.xz);
+    float majorX = dot(dx, sel);
+    float majorY = dot(dy, sel);
+    vec2 du = (minorX * major - minor * majorX) / (major * major) * 0.5;
+    vec2 dv = (minorY * major - minor * majorY) / (major * major) * 0.5;
+    footprint = vec2(length(du), length(dv));
+    return face;
+}
+
+// Quadtree level whose texels best match the pixel footprint, before streaming
+int VirtualLevel(vec2 footprint, float levelCount, float levelBias) {
+    float rho = max(max(footprint.x, footprint.y), 1e-12);
+    float level = floor(-log2(rho * PAGE_SIZE) + levelBias + 0.5);
+    return int(clamp(level, 0.0, levelCount - 1.0));
+}
+
+// Surface albedo for a planet-local direction, alpha 0 where nothing is resident
+vec4 SampleVirtualTexture(vec3 direction, float levelCount) {
+    vec2 uv;
+    vec2 footprint;
+    int face = VirtualFace(direction, uv, footprint);
+    int level = VirtualLevel(footprint, levelCount, 0.0);
+    float pages = float(1 << level);
+    ivec2 tile = min(ivec2(uv * pages), ivec2(pages - 1.0));
+    uvec4 entry = texelFetch(pageTable, ivec3(tile, face), int(levelCount) - 1 - level);
+    if (entry.a == 0u) return vec4(0.0);
+
+    // Position inside the finest resident ancestor, then inside its slot
+    float residentPages = float(1u << entry.b);
+    vec2 local = uv * residentPages - vec2(tile >> (level - int(entry.b)));
+    float stride = PAGE_SIZE + 2.0 * PAGE_BORDER;
+    vec2 texel = vec2(entry.rg) * stride + PAGE_BORDER + clamp(local, 0.0, 1.0) * PAGE_SIZE;
+    return vec4(textureLod(pageAtlas, texel / vec2(textureSize(pageAtlas, 0)), 0.0).rgb, 1.0);
+}
+
+// Page this pixel wants, encoded as VirtualTexture::ReadFeedback expects
+uint VirtualFeedback(vec3 direction, float levelCount, float levelBias) {
+    vec2 uv;
+    vec2 footprint;
+    int face = VirtualFace(direction, uv, footprint);
+    int level = VirtualLevel(footprint, levelCount, levelBias);
+    float pages = float(1 << level);
+    uvec2 tile = uvec2(min(ivec2(uv * pages), ivec2(pages - 1.0)));
+    return 0x80000000u | (uint(face) << 28) | (uint(level) << 24) | (tile.y << 12) | tile.x;
+}
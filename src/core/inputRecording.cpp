@@ -0,0 +1,163 @@
+#include "inputRecording.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const char RECORDING_MAGIC[4] = { 'S', 'E', 'I', 'R' };
+const uint32_t RECORDING_VERSION = 1;
+
+// Frame flags
+const uint16_t FLAG_FORWARD  = 1 << 0;
+const uint16_t FLAG_BACKWARD = 1 << 1;
+const uint16_t FLAG_LEFT     = 1 << 2;
+const uint16_t FLAG_RIGHT    = 1 << 3;
+const uint16_t FLAG_UP       = 1 << 4;
+const uint16_t FLAG_DOWN     = 1 << 5;
+const uint16_t FLAG_FAST     = 1 << 6;
+const uint16_t FLAG_ANALOG   = 1 << 7;     // mouse / scroll deltas follow
+const uint16_t FLAG_CAMERA   = 1 << 8;     // camera command follows
+
+const std::streamoff FRAME_COUNT_OFFSET = 4 + 4 + 8;
+
+// Values are stored little-endian, big-endian hosts reverse their bytes
+template <typename T>
+void WriteValue(std::ofstream& file, const T& value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    std::reverse(bytes, bytes + sizeof(T));
+#endif
+    file.write(bytes, sizeof(T));
+}
+
+template <typename T>
+bool ReadValue(std::ifstream& file, T& value) {
+    char bytes[sizeof(T)];
+    if (!file.read(bytes, sizeof(T))) return false;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    std::reverse(bytes, bytes + sizeof(T));
+#endif
+    std::memcpy(&value, bytes, sizeof(T));
+    return true;
+}
+
+}
+
+InputRecorder::~InputRecorder() {
+    Close();
+}
+
+bool InputRecorder::Open(const std::string& path, double stepRate) {
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_file) {
+        std::cerr << "Failed to open input recording " << path << std::endl;
+        return false;
+    }
+    m_frameCount = 0;
+    m_file.write(RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+    WriteValue(m_file, RECORDING_VERSION);
+    WriteValue(m_file, stepRate);
+    WriteValue(m_file, m_frameCount);
+    return true;
+}
+
+void InputRecorder::Record(const RecordedFrame& frame) {
+    if (!m_file.is_open()) return;
+    
+    const InputState& input = frame.input;
+    uint16_t flags = 0;
+    if (input.forward)  flags |= FLAG_FORWARD;
+    if (input.backward) flags |= FLAG_BACKWARD;
+    if (input.left)     flags |= FLAG_LEFT;
+    if (input.right)    flags |= FLAG_RIGHT;
+    if (input.up)       flags |= FLAG_UP;
+    if (input.down)     flags |= FLAG_DOWN;
+    if (input.fast)     flags |= FLAG_FAST;
+    if (input.mouseDeltaX != 0.0f || input.mouseDeltaY != 0.0f || input.scrollDelta != 0.0f) flags |= FLAG_ANALOG;
+    if (frame.hasCameraCommand) flags |= FLAG_CAMERA;
+    
+    WriteValue(m_file, frame.dt);
+    WriteValue(m_file, flags);
+    if (flags & FLAG_ANALOG) {
+        WriteValue(m_file, input.mouseDeltaX);
+        WriteValue(m_file, input.mouseDeltaY);
+        WriteValue(m_file, input.scrollDelta);
+    }
+    if (flags & FLAG_CAMERA) {
+        WriteValue(m_file, frame.cameraPosition.x);
+        WriteValue(m_file, frame.cameraPosition.y);
+        WriteValue(m_file, frame.cameraPosition.z);
+        WriteValue(m_file, frame.cameraYaw);
+        WriteValue(m_file, frame.cameraPitch);
+    }
+    m_frameCount++;
+}
+
+void InputRecorder::Close() {
+    if (!m_file.is_open()) return;
+    m_file.seekp(FRAME_COUNT_OFFSET);
+    WriteValue(m_file, m_frameCount);
+    m_file.close();
+}
+
+bool InputPlayback::Open(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open input recording " << path << std::endl;
+        return false;
+    }
+    
+    char magic[4];
+    uint32_t version = 0, frameCount = 0;
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, RECORDING_MAGIC, sizeof(magic)) != 0
+        || !ReadValue(file, version) || version != RECORDING_VERSION
+        || !ReadValue(file, m_stepRate) || !ReadValue(file, frameCount)) {
+        std::cerr << "Not a version " << RECORDING_VERSION << " input recording: " << path << std::endl;
+        return false;
+    }
+    
+    m_frames.clear();
+    m_frames.reserve(frameCount);
+    m_next = 0;
+    for (uint32_t i = 0; i < frameCount; ++i) {
+        RecordedFrame frame;
+        uint16_t flags = 0;
+        if (!ReadValue(file, frame.dt) || !ReadValue(file, flags)) break;
+        
+        InputState& input = frame.input;
+        input.forward  = (flags & FLAG_FORWARD) != 0;
+        input.backward = (flags & FLAG_BACKWARD) != 0;
+        input.left     = (flags & FLAG_LEFT) != 0;
+        input.right    = (flags & FLAG_RIGHT) != 0;
+        input.up       = (flags & FLAG_UP) != 0;
+        input.down     = (flags & FLAG_DOWN) != 0;
+        input.fast     = (flags & FLAG_FAST) != 0;
+        if ((flags & FLAG_ANALOG) && !(ReadValue(file, input.mouseDeltaX) && ReadValue(file, input.mouseDeltaY)
+                                       && ReadValue(file, input.scrollDelta))) {
+            break;
+        }
+        if (flags & FLAG_CAMERA) {
+            frame.hasCameraCommand = true;
+            if (!(ReadValue(file, frame.cameraPosition.x) && ReadValue(file, frame.cameraPosition.y)
+                  && ReadValue(file, frame.cameraPosition.z) && ReadValue(file, frame.cameraYaw)
+                  && ReadValue(file, frame.cameraPitch))) {
+                break;
+            }
+        }
+        m_frames.push_back(frame);
+    }
+    
+    if (m_frames.size() != frameCount) {
+        std::cerr << "Input recording " << path << " is truncated, playing " << m_frames.size()
+                  << " of " << frameCount << " frames" << std::endl;
+    }
+    return true;
+}
+
+bool InputPlayback::Next(RecordedFrame& frame) {
+    if (m_next >= m_frames.size()) return false;
+    frame = m_frames[m_next++];
+    return true;
+}
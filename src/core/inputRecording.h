@@ -0,0 +1,57 @@
+#pragma once
+
+#include "simulation.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// One rendered frame of input, as handed to the Simulation
+struct RecordedFrame {
+    double dt = 0.0;                    // seconds of simulated time this frame
+    InputState input;
+    bool hasCameraCommand = false;      // a UI teleport (Simulation::SetCamera) issued this frame
+    glm::dvec3 cameraPosition = glm::dvec3(0.0);
+    float cameraYaw = 0.0f;
+    float cameraPitch = 0.0f;
+};
+
+// Binary input log, little-endian:
+//   Header - magic "SEIR", version, simulation step rate, frame count
+//   Frames - dt (f64), flags (u16), then only what the flags say is present:
+//            mouse x/y and scroll (3 x f32), camera position (3 x f64) + yaw/pitch (2 x f32)
+// A quiet frame is 10 bytes, so an hour at 60 FPS is a couple of MB.
+class InputRecorder {
+public:
+    ~InputRecorder();
+    
+    bool Open(const std::string& path, double stepRate);
+    void Record(const RecordedFrame& frame);
+    // Writes the final frame count, also done on destruction
+    void Close();
+    
+    bool IsOpen() const { return m_file.is_open(); }
+    uint32_t GetFrameCount() const { return m_frameCount; }
+    
+private:
+    std::ofstream m_file;
+    uint32_t m_frameCount = 0;
+};
+
+// Reads a whole recording up front, so playback never touches the disk mid-run
+class InputPlayback {
+public:
+    bool Open(const std::string& path);
+    // Next frame in order, false once the recording is exhausted
+    bool Next(RecordedFrame& frame);
+    
+    size_t GetFrameCount() const { return m_frames.size(); }
+    size_t GetFrameIndex() const { return m_next; }
+    double GetStepRate() const { return m_stepRate; }
+    
+private:
+    std::vector<RecordedFrame> m_frames;
+    size_t m_next = 0;
+    double m_stepRate = 0.0;
+};
@@ -2,23 +2,43 @@
 #include <GLFW/glfw3.h>
 
 #include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "graphics/shader.h"
 #include "graphics/displayManager.h"
+#include "graphics/uniformBuffer.h"
+#include "graphics/framebuffer.h"
+#include "graphics/gpuTimer.h"
+#include "graphics/dynamicResolution.h"
+#include "graphics/occlusionCuller.h"
 #include "entities/camera.h"
-#include "entities/planet.h"
+#include "entities/planetManager.h"
+#include "entities/smallBodies.h"
+#include "sky/starField.h"
+#include "sky/atmosphere.h"
+#include "core/simulation.h"
+#include "core/inputRecording.h"
+#include "core/profiler.h"
+#include "core/memoryBudget.h"
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
 #include <vector>
 #include <memory>
 #include <algorithm>
-#include <unistd.h> // For usleep
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <string>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
@@ -35,9 +55,44 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
-// timing
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+// input gathered on the render thread and handed to the simulation each frame
+InputState frameInput;
+
+// terrain - height pyramids from tools/demConverter, looked up by planet name
+const char* TERRAIN_DIRECTORY = "assets/terrain";
+const float EARTH_RADIUS_METERS = 6371000.0f;
+const float TERRAIN_EXAGGERATION = 20.0f;  // real relief is invisible on a 25-unit Earth
+// surface colour - page pyramids from tools/albedoConverter, looked up by planet name
+const char* ALBEDO_DIRECTORY = "assets/albedo";
+
+// LOD prediction - how far ahead the quadtree is refined in the background
+float lodPredictionSeconds = 0.5f;
+bool lodPredictionEnabled = true;
+
+// GPU tessellation backend - CPU quadtree stops early, the GPU refines near the camera
+bool tessellationEnabled = false;
+float tessEdgePixels = 12.0f;   // target length of a tessellated edge on screen
+
+// star catalog from tools/starConverter, streamed by magnitude
+const char* STAR_CATALOG_PATH = "assets/stars/catalog.stars";
+float starMagnitudeLimit = 8.0f;
+
+// atmospheric scattering, tables cached per parameter set; the sun is a direction
+const char* ATMOSPHERE_CACHE_DIRECTORY = "atmosphere_cache";
+float sunAzimuth = 30.0f;       // degrees around +y from +x
+float sunElevation = 20.0f;     // degrees above the xz plane
+
+// surface queries
+const int RAY_BATCH_SIZE = 4096;
+double lastRayBatchMs = 0.0;
+int lastRayBatchHits = 0;
+
+// body index - the UI lists the nearest few, the near plane follows the nearest surface
+const size_t NEARBY_BODY_COUNT = 8;
+const float NEAR_PLANE_FRACTION = 0.5f;    // of the distance to the nearest surface
+const float MIN_NEAR_PLANE = 0.1f;
+const float MAX_NEAR_PLANE = 10.0f;
+const float FAR_PLANE = 1000.0f;
 
 // UI and controls
 bool wireframeMode = true;  // Start with wireframe to see LOD
@@ -47,10 +102,60 @@ bool mouseTogglePressed = false;
 bool uiMode = true;         // true = show UI, false = hide UI - start with UI visible
 bool uiTogglePressed = false;
 
-int main()
+// perf runs - see parseOptions
+struct RunOptions {
+    std::string recordPath;         // --record <file>: log every frame's input and dt
+    std::string replayPath;         // --replay <file>: drive the simulation from a log instead of the user
+    std::string timingPath = "replay_timing.csv";  // --timing <file>: per-frame CSV written during replay / headless runs
+    double fixedDt = 0.0;           // --fixed-dt <s>: replay every frame with this dt instead of the recorded one
+    bool fast = false;              // --fast: replay uncapped with vsync off
+    bool tessellation = false;      // --tessellation: start with the GPU tessellation backend
+    int headlessFrames = 0;         // --headless <frames>: render offscreen, no visible window, then exit
+    int hashEvery = 0;              // --hash-every <n>: hash the image every n frames (and the last one)
+    int asteroids = BeltParams().count;  // --asteroids <n>: rocks in the belt around the first planet, 0 for none
+    int gpuBudgetMB = 0;            // --gpu-budget <MB>: VRAM for planet data before planets out of use are evicted, 0 = no limit
+    int cpuBudgetMB = 0;            // --cpu-budget <MB>: the same for RAM
+    bool dynamicResolution = false; // --dynamic-resolution: scale the scene to hold the target frame time
+    bool occlusionCulling = true;   // --no-occlusion: draw every in-view patch, e.g. to compare image hashes
+};
+
+// headless runs - a fixed 60 Hz flight along HEADLESS_PATH unless a recording is replayed
+const double HEADLESS_DT = 1.0 / 60.0;
+
+// One line of the timing CSV, held back until its frame's GPU time is read
+struct TimingRow {
+    unsigned long long gpuFrame;    // GpuTimer::GetFrame() while the frame was drawn
+    int frame;
+    double dt;
+    double cpuMs;
+    double frameMs;
+    double gpuMs = -1.0;            // -1 until read back, and for frames whose queries were dropped
+    size_t triangles;
+    int leaves;
+    bool hashed;
+    uint64_t imageHash;
+};
+
+bool parseOptions(int argc, char** argv, RunOptions& options);
+void headlessCameraPath(double t, float planetRadius, glm::dvec3& position, float& yaw, float& pitch);
+uint64_t hashPixels(const std::vector<uint8_t>& pixels);
+void writeTimingRow(std::ostream& out, const TimingRow& row);
+
+int main(int argc, char** argv)
 {
+    RunOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return -1;
+    }
+    const bool replaying = !options.replayPath.empty();
+    const bool headless = options.headlessFrames > 0;
+    int gpuBudgetMB = options.gpuBudgetMB;
+    int cpuBudgetMB = options.cpuBudgetMB;
+    MemoryBudget::Get().SetBudget(MemoryKind::GPU, static_cast<size_t>(gpuBudgetMB) * 1024 * 1024);
+    MemoryBudget::Get().SetBudget(MemoryKind::CPU, static_cast<size_t>(cpuBudgetMB) * 1024 * 1024);
+    
     // Initialize display
-    DisplayManager::createDisplay();
+    DisplayManager::createDisplay(headless);
     
     GLFWwindow* window = DisplayManager::getWindow();
     if (!window) {
@@ -58,16 +163,37 @@ int main()
         return -1;
     }
     
+    // Compile any shaders missing from the program binary cache on a shared
+    // context while the rest of start-up runs
+    ShaderCache::Get().PrewarmAsync(window, {
+        { "shaders/basic.vert", "shaders/basic.frag", "shaders/atmosphere.frag", "shaders/virtualTexture.frag" },
+        { "shaders/terrain.vert", "shaders/terrain.tesc", "shaders/terrain.tese", "shaders/basic.frag", "shaders/atmosphere.frag",
+          "shaders/virtualTexture.frag" },
+        { "shaders/basic.vert", "shaders/virtualFeedback.frag", "shaders/virtualTexture.frag" },
+        { "shaders/terrain.vert", "shaders/terrain.tesc", "shaders/terrain.tese", "shaders/virtualFeedback.frag",
+          "shaders/virtualTexture.frag" },
+        { "shaders/smallBodies.comp" },
+        { "shaders/smallBodies.vert", "shaders/smallBodies.frag" },
+        { "shaders/stars.vert", "shaders/stars.frag" },
+        { "shaders/upscale.vert", "shaders/upscale.frag" },
+        { "shaders/occlusionPyramid.comp" },
+        { "shaders/occlusionCull.comp" },
+        { "shaders/sky.vert", "shaders/sky.frag", "shaders/atmosphere.frag" }
+    });
+    
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
     
     // Start in flight mode with cursor captured
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    if (headless) {
+        // Nobody to look at the UI; keep it out of the timings and the image hashes
+        mouseMode = false;
+        uiMode = false;
+    } else {
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
     
-    // Set 144 FPS limit
-    glfwSwapInterval(0); // Disable VSync for manual FPS control
-
     // configure global opengl state
     glEnable(GL_DEPTH_TEST);
     
@@ -100,10 +226,56 @@ int main()
     std::cout << "OpenGL Renderer: " << glGetString(GL_RENDERER) << std::endl;
     
     // build and compile shaders
-    Shader shaderProgram("shaders/basic.vert", "shaders/basic.frag");
+    Shader shaderProgram(std::vector<std::string>{
+        "shaders/basic.vert", "shaders/basic.frag", "shaders/atmosphere.frag", "shaders/virtualTexture.frag" });
+    shaderProgram.bindUniformBlock("FrameData", FRAME_BLOCK_BINDING);
+    shaderProgram.bindUniformBlock("ObjectData", OBJECT_BLOCK_BINDING);
+    shaderProgram.bindUniformBlock("AtmosphereData", ATMOSPHERE_BLOCK_BINDING);
+    // Virtual texture feedback, the same geometry writing page requests
+    Shader feedbackProgram(std::vector<std::string>{
+        "shaders/basic.vert", "shaders/virtualFeedback.frag", "shaders/virtualTexture.frag" });
+    feedbackProgram.bindUniformBlock("FrameData", FRAME_BLOCK_BINDING);
+    feedbackProgram.bindUniformBlock("ObjectData", OBJECT_BLOCK_BINDING);
+    std::unique_ptr<Shader> terrainProgram;
+    std::unique_ptr<Shader> terrainFeedbackProgram;
+    if (CubeSphere::IsTessellationSupported()) {
+        terrainProgram = std::make_unique<Shader>(std::vector<std::string>{
+            "shaders/terrain.vert", "shaders/terrain.tesc", "shaders/terrain.tese", "shaders/basic.frag", "shaders/atmosphere.frag",
+            "shaders/virtualTexture.frag" });
+        terrainProgram->bindUniformBlock("FrameData", FRAME_BLOCK_BINDING);
+        terrainProgram->bindUniformBlock("ObjectData", OBJECT_BLOCK_BINDING);
+        terrainProgram->bindUniformBlock("AtmosphereData", ATMOSPHERE_BLOCK_BINDING);
+        terrainFeedbackProgram = std::make_unique<Shader>(std::vector<std::string>{
+            "shaders/terrain.vert", "shaders/terrain.tesc", "shaders/terrain.tese", "shaders/virtualFeedback.frag",
+            "shaders/virtualTexture.frag" });
+        terrainFeedbackProgram->bindUniformBlock("FrameData", FRAME_BLOCK_BINDING);
+        terrainFeedbackProgram->bindUniformBlock("ObjectData", OBJECT_BLOCK_BINDING);
+    } else if (options.tessellation) {
+        std::cout << "Tessellation shaders unsupported, using the mesh backend" << std::endl;
+    }
+    tessellationEnabled = options.tessellation && terrainProgram;
+    Shader smallBodyCullProgram(std::vector<std::string>{ "shaders/smallBodies.comp" });
+    Shader smallBodyProgram("shaders/smallBodies.vert", "shaders/smallBodies.frag");
+    smallBodyProgram.bindUniformBlock("FrameData", FRAME_BLOCK_BINDING);
+    Shader starProgram("shaders/stars.vert", "shaders/stars.frag");
+    starProgram.bindUniformBlock("FrameData", FRAME_BLOCK_BINDING);
+    Shader upscaleProgram("shaders/upscale.vert", "shaders/upscale.frag");
+    Shader occlusionPyramidProgram(std::vector<std::string>{ "shaders/occlusionPyramid.comp" });
+    Shader occlusionCullProgram(std::vector<std::string>{ "shaders/occlusionCull.comp" });
+    Shader skyProgram(std::vector<std::string>{ "shaders/sky.vert", "shaders/sky.frag", "shaders/atmosphere.frag" });
+    skyProgram.bindUniformBlock("FrameData", FRAME_BLOCK_BINDING);
+    skyProgram.bindUniformBlock("AtmosphereData", ATMOSPHERE_BLOCK_BINDING);
+    ShaderCache::Get().FinishPrewarm();
+    std::cout << "Shader cache: " << ShaderCache::Get().GetHitCount() << " hits, "
+              << ShaderCache::Get().GetMissCount() << " compiled" << std::endl;
+
+    // Per-frame and per-object uniform blocks
+    UniformBuffer frameUniformBuffer(FRAME_BLOCK_BINDING, sizeof(FrameUniforms));
+    ObjectUniformBuffer objectUniformBuffer;
+    FrameUniforms frameUniforms;
 
     // Create just Earth for now
-    std::vector<std::unique_ptr<Planet>> planets;
+    std::vector<PlanetData> bodies;
     
     // Earth at origin with proper scale
     PlanetData earthData = {
@@ -113,7 +285,54 @@ int main()
         glm::vec3(0.3f, 0.6f, 1.0f),  // Blue color
         10.0f                   // Rotation speed: 10 degrees per second
     };
-    planets.push_back(std::make_unique<Planet>(earthData));
+    bodies.push_back(earthData);
+    PlanetManager planetManager(bodies);
+    const auto& planets = planetManager.GetPlanets();
+    for (size_t i = 0; i < planets.size(); ++i) {
+        // Headless runs stream on this thread, so the image hashes don't depend on worker timing
+        planets[i]->SetSynchronousStreaming(headless);
+        std::string terrainPath = std::string(TERRAIN_DIRECTORY) + "/" + bodies[i].name + ".tiles";
+        if (std::filesystem::exists(terrainPath)) {
+            planets[i]->EnableTerrain(terrainPath, bodies[i].radius / EARTH_RADIUS_METERS * TERRAIN_EXAGGERATION);
+        }
+        std::string albedoPath = std::string(ALBEDO_DIRECTORY) + "/" + bodies[i].name + ".pages";
+        if (std::filesystem::exists(albedoPath)) {
+            planets[i]->EnableSurfaceTexture(albedoPath);
+        }
+        planets[i]->EnableTileCache("tile_cache", static_cast<uint32_t>(i));
+        if (tessellationEnabled) {
+            planets[i]->SetTerrainBackend(TerrainBackend::TESSELLATION);
+        }
+        if (bodies[i].name == "Earth") {
+            planets[i]->EnableAtmosphere(AtmosphereParams::Earth(), ATMOSPHERE_CACHE_DIRECTORY);
+        }
+    }
+    std::vector<int> visibleBodies;
+    std::vector<int> nearbyBodies;
+    
+    // Asteroid belt around the first planet, instanced from shared meshes
+    SmallBodySystem smallBodies(planets.empty() ? glm::vec3(0.0f) : planets[0]->GetPosition());
+    if (options.asteroids > 0) {
+        BeltParams belt;
+        belt.count = options.asteroids;
+        smallBodies.AddBelt(belt, 1u);
+    }
+    bool smallBodiesEnabled = true;
+    
+    // Planet patches hidden behind last frame's depth are skipped
+    OcclusionCuller occlusionCuller;
+    bool occlusionCullingEnabled = options.occlusionCulling;
+
+    // Background stars, paged in from the catalog as the view turns
+    std::unique_ptr<StarField> stars;
+    if (std::filesystem::exists(STAR_CATALOG_PATH)) {
+        stars = std::make_unique<StarField>(STAR_CATALOG_PATH);
+        if (!stars->IsOpen()) {
+            stars.reset();
+        } else {
+            stars->SetSynchronous(headless);
+        }
+    }
     
     // Debug: Verify planet creation
     std::cout << "Created " << planets.size() << " planets" << std::endl;
@@ -122,18 +341,200 @@ int main()
         std::cout << "Earth position: " << planets[0]->GetPosition().x << ", " << planets[0]->GetPosition().y << ", " << planets[0]->GetPosition().z << std::endl;
     }
 
+    // Input recording and replay
+    InputRecorder recorder;
+    InputPlayback playback;
+    if (replaying) {
+        if (!playback.Open(options.replayPath)) {
+            return -1;
+        }
+        if (options.fast) {
+            FramePacer& pacer = DisplayManager::getFramePacer();
+            pacer.SetTargetFps(0.0);
+            pacer.SetVSyncMode(VSyncMode::OFF);
+        }
+        std::cout << "Replaying " << playback.GetFrameCount() << " frames from " << options.replayPath << std::endl;
+    }
+    
+    // Per-frame timing for replays and headless runs
+    const bool timed = replaying || headless;
+    std::ofstream timingFile;
+    std::vector<double> timedFrameMs;
+    std::vector<double> timedGpuMs;
+    std::unique_ptr<GpuTimer> gpuTimer;
+    std::deque<TimingRow> timingRows;
+    // Files the GPU times read since the last call under the frames that
+    // produced them, then writes the rows that are complete, in order. A row
+    // is final once its queries are read or LATENCY frames have passed.
+    auto flushTimingRows = [&](bool all) {
+        for (const GpuTimer::Result& result : gpuTimer->GetResults()) {
+            timedGpuMs.push_back(result.ms);
+            for (TimingRow& row : timingRows) {
+                if (row.gpuFrame == result.frame) row.gpuMs = result.ms;
+            }
+        }
+        while (!timingRows.empty()) {
+            const TimingRow& row = timingRows.front();
+            if (!all && row.gpuMs < 0.0 && row.gpuFrame + GpuTimer::LATENCY > gpuTimer->GetFrame()) break;
+            writeTimingRow(timingFile, row);
+            timingRows.pop_front();
+        }
+    };
+    if (timed) {
+        timingFile.open(options.timingPath);
+        if (!timingFile) {
+            std::cerr << "Failed to open timing file " << options.timingPath << std::endl;
+            return -1;
+        }
+        timingFile << "frame,dt,cpu_ms,frame_ms,gpu_ms,triangles,leaves,image_hash\n";
+        gpuTimer = std::make_unique<GpuTimer>();
+    }
+    
+    // Headless frames go to an offscreen target, read back only for hashing
+    std::unique_ptr<Framebuffer> offscreen;
+    std::vector<uint8_t> pixels;
+    uint64_t lastImageHash = 0;
+    if (headless) {
+        offscreen = std::make_unique<Framebuffer>(DisplayManager::getWidth(), DisplayManager::getHeight());
+        if (!offscreen->IsComplete()) {
+            return -1;
+        }
+        std::cout << "Headless: " << options.headlessFrames << " frames at "
+                  << offscreen->GetWidth() << "x" << offscreen->GetHeight() << std::endl;
+    }
+
+    // Dynamic resolution - the scene target is only allocated once the mode is first used.
+    // Off by default in headless runs: GPU timings would make the image hashes vary.
+    std::unique_ptr<DynamicResolution> dynamicResolution;
+    bool dynamicResolutionEnabled = options.dynamicResolution;
+
+    // Camera, rotation and orbits are stepped at a fixed rate on their own thread.
+    // Replays and headless runs step them on this thread instead, from the
+    // recorded (or fixed) dt; with the streaming above done synchronously too,
+    // the same headless run always produces the same frames.
+    const bool manualSimulation = replaying || headless;
+    double stepRate = replaying && playback.GetStepRate() > 0.0 ? playback.GetStepRate() : 120.0;
+    Simulation simulation(camera, bodies, stepRate);
+    if (!manualSimulation) {
+        simulation.Start();
+    }
+    SimulationState simState;
+    
+    if (!options.recordPath.empty() && recorder.Open(options.recordPath, simulation.GetStepRate())) {
+        std::cout << "Recording input to " << options.recordPath << std::endl;
+    }
+    
+    // UI camera moves are part of the recording; a replay ignores the live ones
+    // and re-issues the recorded ones instead
+    RecordedFrame frameRecord;
+    auto setCamera = [&](const glm::dvec3& position, float yaw, float pitch) {
+        if (replaying) return;
+        simulation.SetCamera(position, yaw, pitch);
+        frameRecord.hasCameraCommand = true;
+        frameRecord.cameraPosition = position;
+        frameRecord.cameraYaw = yaw;
+        frameRecord.cameraPitch = pitch;
+    };
+    
+    using clock = std::chrono::steady_clock;
+    auto lastFrameStart = clock::now();
+    int frameIndex = 0;
+
     // render loop
     while (!DisplayManager::isCloseRequested())
     {
-        // per-frame time logic
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        PROFILE_FRAME();
+        auto frameStart = clock::now();
+        double frameDt = std::chrono::duration<double>(frameStart - lastFrameStart).count();
+        lastFrameStart = frameStart;
+
+        if (headless && frameIndex >= options.headlessFrames) {
+            break;
+        }
+        if (gpuTimer) {
+            gpuTimer->Begin();
+        }
 
         // input
         processInput(window);
+        if (replaying) {
+            // Live movement is ignored; ESC and the view toggles still work
+            RecordedFrame replayed;
+            if (!playback.Next(replayed)) {
+                break;
+            }
+            frameRecord = replayed;
+            if (options.fixedDt > 0.0) {
+                frameRecord.dt = options.fixedDt;
+            }
+            simulation.SubmitInput(frameRecord.input);
+            simulation.Advance(frameRecord.dt);
+            // Applied by the next step, like a live UI click
+            if (frameRecord.hasCameraCommand) {
+                simulation.SetCamera(frameRecord.cameraPosition, frameRecord.cameraYaw, frameRecord.cameraPitch);
+                camera.ResetMotion();
+            }
+        } else if (headless) {
+            // Scripted flight: every frame is a camera command, applied by the step it triggers
+            frameRecord = RecordedFrame();
+            frameRecord.dt = HEADLESS_DT;
+            double t = options.headlessFrames > 1 ? static_cast<double>(frameIndex) / (options.headlessFrames - 1) : 0.0;
+            glm::dvec3 position;
+            float yaw, pitch;
+            headlessCameraPath(t, bodies[0].radius, position, yaw, pitch);
+            simulation.SetCamera(position, yaw, pitch);
+            simulation.Advance(frameRecord.dt);
+        } else {
+            simulation.SubmitInput(frameInput);
+            frameRecord = RecordedFrame();
+            frameRecord.dt = frameDt;
+            frameRecord.input = frameInput;
+        }
+        frameInput.mouseDeltaX = 0.0f;
+        frameInput.mouseDeltaY = 0.0f;
+        frameInput.scrollDelta = 0.0f;
 
-        // render - space background
+        // pick up the simulation state blended between its last two steps
+        simulation.GetInterpolatedState(simState);
+        camera.Position = simState.cameraPosition;
+        camera.Yaw = simState.cameraYaw;
+        camera.Pitch = simState.cameraPitch;
+        camera.Zoom = simState.cameraZoom;
+        camera.UpdateCameraVectors();
+        camera.TrackMotion(simState.time);
+        for (size_t i = 0; i < planets.size(); ++i) {
+            planets[i]->SetPosition(glm::vec3(simState.bodies[i].position));
+            planets[i]->SetRotation(simState.bodies[i].rotation);
+        }
+        planetManager.RefitBodies();
+        
+        // Nearest body by its bounding sphere, then the exact terrain below the camera
+        glm::vec3 cameraPos = glm::vec3(camera.Position);
+        int nearestBody = planetManager.FindNearestBody(cameraPos);
+        float nearestAltitude = nearestBody >= 0 ? planets[nearestBody]->GetAltitude(cameraPos) : FAR_PLANE;
+
+        // render - space background. With dynamic resolution the scene goes to a
+        // scaled target first and is upscaled into the output before the UI.
+        int outputWidth = 0, outputHeight = 0;
+        if (offscreen) {
+            outputWidth = offscreen->GetWidth();
+            outputHeight = offscreen->GetHeight();
+        } else {
+            glfwGetFramebufferSize(window, &outputWidth, &outputHeight);
+        }
+        const bool scaled = dynamicResolutionEnabled && outputWidth > 0 && outputHeight > 0;
+        if (scaled) {
+            if (!dynamicResolution) {
+                dynamicResolution = std::make_unique<DynamicResolution>(outputWidth, outputHeight);
+            }
+            double targetFps = DisplayManager::getFramePacer().GetTargetFps();
+            if (targetFps > 0.0) {
+                dynamicResolution->SetTargetFrameMs(1000.0 / targetFps);
+            }
+            dynamicResolution->BeginScene(outputWidth, outputHeight);
+        } else if (offscreen) {
+            offscreen->Bind();
+        }
         glClearColor(0.0f, 0.0f, 0.05f, 1.0f);  // Dark blue space background
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         
@@ -143,24 +544,34 @@ int main()
         // use shader
         shaderProgram.use();
         
-        // Set up matrices with proper near/far planes
+        // Set up matrices - the near plane pulls in as the nearest surface gets close
+        float nearPlane = std::clamp(nearestAltitude * NEAR_PLANE_FRACTION, MIN_NEAR_PLANE, MAX_NEAR_PLANE);
         glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), 
                                                (float)SCR_WIDTH / (float)SCR_HEIGHT, 
-                                               0.1f, 1000.0f); // Near: 0.1, Far: 1000
+                                               nearPlane, FAR_PLANE);
         glm::mat4 view = camera.GetViewMatrix();
         
-        // Set global uniforms
-        GLint projLoc = glGetUniformLocation(shaderProgram.ID, "projection");
-        GLint viewLoc = glGetUniformLocation(shaderProgram.ID, "view");
-        GLint lightPosLoc = glGetUniformLocation(shaderProgram.ID, "lightPos");
-        GLint lightColorLoc = glGetUniformLocation(shaderProgram.ID, "lightColor");
-        GLint viewPosLoc = glGetUniformLocation(shaderProgram.ID, "viewPos");
-        
-        glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        glUniform3f(lightPosLoc, 0.0f, 0.0f, 0.0f); // Sun at origin
-        glUniform3f(lightColorLoc, 1.0f, 1.0f, 0.9f); // Slightly warm white light
-        glUniform3fv(viewPosLoc, 1, glm::value_ptr(glm::vec3(camera.Position)));
+        // Set global uniforms - one upload for the whole frame
+        frameUniforms.view = view;
+        frameUniforms.projection = projection;
+        float azimuth = glm::radians(sunAzimuth), elevation = glm::radians(sunElevation);
+        glm::vec3 sunDirection(std::cos(elevation) * std::cos(azimuth), std::sin(elevation), std::cos(elevation) * std::sin(azimuth));
+        frameUniforms.lightPos = glm::vec4(sunDirection, 0.0f);         // Directional sun
+        frameUniforms.lightColor = glm::vec4(1.0f, 1.0f, 0.9f, 1.0f);   // Slightly warm white light
+        frameUniforms.viewPos = glm::vec4(glm::vec3(camera.Position), 1.0f);
+        int targetWidth = scaled ? dynamicResolution->GetRenderWidth() : outputWidth;
+        int targetHeight = scaled ? dynamicResolution->GetRenderHeight() : outputHeight;
+        frameUniforms.viewport = glm::vec4(static_cast<float>(targetWidth), static_cast<float>(targetHeight), tessEdgePixels, 0.0f);
+        frameUniformBuffer.Update(&frameUniforms, sizeof(FrameUniforms));
+
+        // Stars first, behind everything and without depth
+        if (stars) {
+            PROFILE_ZONE("Stars");
+            PROFILE_GPU_ZONE("Stars");
+            stars->Update(projection * glm::mat4(glm::mat3(view)), starMagnitudeLimit);
+            starProgram.use();
+            stars->Render(starProgram, starMagnitudeLimit);
+        }
         
         // Camera debug removed for cleaner output
         
@@ -169,13 +580,114 @@ int main()
         
         // Triangle removed - sphere is working!
         
-        for (auto& planet : planets) {
-            planet->Update(glm::vec3(camera.Position), deltaTime);
-            planet->Render(shaderProgram.ID, view, projection, glm::vec3(camera.Position));
+        // Bodies get their quadtree and GL resources when first seen, and lose them when long out of use
+        planetManager.CollectVisible(projection * view, visibleBodies);
+        planetManager.UpdateResidency(visibleBodies, nearestBody);
+        
+        glm::vec3 predictedCameraPos = lodPredictionEnabled
+            ? glm::vec3(camera.PredictPosition(lodPredictionSeconds)) : glm::vec3(camera.Position);
+        planetManager.UpdateLOD(cameraPos, predictedCameraPos);
+        
+        // Ground under the camera for the simulation's collision clamp. Bodies
+        // do not overlap, so only the nearest one can be under the camera.
+        {
+            PROFILE_ZONE("Ground Query");
+            std::vector<float> groundRadii(planets.size(), 0.0f);
+            if (nearestBody >= 0) {
+                float distance = glm::length(cameraPos - planets[nearestBody]->GetPosition());
+                groundRadii[nearestBody] = distance - nearestAltitude;
+            }
+            simulation.SubmitGroundRadii(groundRadii);
+        }
+        
+        // Per-object blocks go up in one upload, each draw only binds its range
+        objectUniformBuffer.Begin();
+        for (int body : visibleBodies) {
+            objectUniformBuffer.Push(planets[body]->GetObjectUniforms());
+        }
+        objectUniformBuffer.Upload();
+        if (occlusionCullingEnabled) {
+            PROFILE_ZONE("Occlusion Cull");
+            PROFILE_GPU_ZONE("Occlusion Cull");
+            occlusionCullProgram.use();
+            occlusionCuller.BeginCull(occlusionCullProgram, projection * view);
+            for (int body : visibleBodies) {
+                planets[body]->Cull(occlusionCullProgram);
+            }
+            occlusionCuller.EndCull();
+        }
+        for (size_t i = 0; i < visibleBodies.size(); ++i) {
+            Planet& planet = *planets[visibleBodies[i]];
+            if (planet.GetTerrainBackend() == TerrainBackend::TESSELLATION) {
+                terrainProgram->use();
+            } else {
+                shaderProgram.use();
+            }
+            planet.Render(objectUniformBuffer, static_cast<int>(i));
+        }
+        
+        // Small bodies: a compute pass culls and picks LODs, one indirect multi-draw
+        if (smallBodiesEnabled && smallBodies.GetInstanceCount() > 0) {
+            PROFILE_ZONE("Small Bodies");
+            PROFILE_GPU_ZONE("Small Bodies");
+            float pixelScale = targetHeight * 0.5f * projection[1][1];
+            float time = static_cast<float>(simState.time);
+            smallBodyCullProgram.use();
+            smallBodies.Cull(smallBodyCullProgram, projection * view, cameraPos, pixelScale, time);
+            smallBodyProgram.use();
+            smallBodies.Render(smallBodyProgram, time);
+        }
+        
+        // Sky where nothing was drawn, over the stars; leaves the depth alone
+        {
+            PROFILE_ZONE("Sky");
+            PROFILE_GPU_ZONE("Sky");
+            skyProgram.use();
+            glm::mat4 skyViewProjection = projection * glm::mat4(glm::mat3(view));
+            for (const auto& planet : planets) {
+                planet->RenderSky(skyProgram, skyViewProjection);
+            }
+        }
+        
+        // This frame's depth becomes next frame's occluders
+        if (occlusionCullingEnabled) {
+            PROFILE_ZONE("Occlusion Pyramid");
+            PROFILE_GPU_ZONE("Occlusion Pyramid");
+            occlusionPyramidProgram.use();
+            occlusionCuller.CaptureDepth(occlusionPyramidProgram, targetWidth, targetHeight, projection * view);
+        }
+        
+        // Which surface texture pages this frame wanted, read back a frame or two later
+        {
+            PROFILE_ZONE("Virtual Texture Feedback");
+            PROFILE_GPU_ZONE("Virtual Texture Feedback");
+            for (size_t i = 0; i < visibleBodies.size(); ++i) {
+                Planet& planet = *planets[visibleBodies[i]];
+                if (!planet.GetVirtualTexture()) continue;
+                Shader& program = planet.GetTerrainBackend() == TerrainBackend::TESSELLATION ? *terrainFeedbackProgram : feedbackProgram;
+                program.use();
+                planet.RenderFeedback(objectUniformBuffer, static_cast<int>(i), program, targetWidth, targetHeight);
+            }
+        }
+        
+        if (scaled) {
+            dynamicResolution->EndScene();
+            PROFILE_ZONE("Upscale");
+            PROFILE_GPU_ZONE("Upscale");
+            if (offscreen) {
+                offscreen->Bind();
+            } else {
+                Framebuffer::Unbind();
+                glViewport(0, 0, outputWidth, outputHeight);
+            }
+            upscaleProgram.use();
+            dynamicResolution->Present(upscaleProgram);
         }
 
         // Render ImGui
         if (uiMode) {
+            PROFILE_ZONE("UI");
+            PROFILE_GPU_ZONE("UI");
             ImGui_ImplOpenGL3_NewFrame();
             ImGui_ImplGlfw_NewFrame();
             ImGui::NewFrame();
@@ -194,61 +706,289 @@ int main()
                        camera.Front.x, camera.Front.y, camera.Front.z);
             
             // Quick positioning buttons
+            // Camera changes go through the simulation, which owns the camera state
             if (ImGui::Button("Reset Camera to Default")) {
-                camera.Position = glm::dvec3(50.0, 0.0, 0.0);
-                camera.Yaw = 180.0f;  // Look toward origin
-                camera.Pitch = 0.0f;
-                camera.UpdateCameraVectors();
+                setCamera(glm::dvec3(50.0, 0.0, 0.0), 180.0f, 0.0f);  // Look toward origin
+                camera.ResetMotion();  // a teleport is not velocity
             }
             ImGui::SameLine();
             if (ImGui::Button("Look at Origin")) {
                 // Calculate direction to origin
                 glm::dvec3 direction = glm::normalize(-camera.Position);
-                camera.Yaw = glm::degrees(atan2(direction.z, direction.x));
-                camera.Pitch = glm::degrees(asin(direction.y));
-                camera.UpdateCameraVectors();
+                setCamera(camera.Position,
+                          glm::degrees(atan2(direction.z, direction.x)),
+                          glm::degrees(asin(direction.y)));
             }
             
             if (ImGui::Button("Very Close to Earth")) {
-                camera.Position = glm::dvec3(27.0, 0.0, 0.0); // 2 units above 25 radius Earth surface
-                camera.Yaw = 180.0f;  // Look toward origin
-                camera.Pitch = 0.0f;
-                camera.UpdateCameraVectors();
+                // 2 units above the terrain along +X, looking back at the centre
+                glm::vec3 earthPos = planets[0]->GetPosition();
+                glm::vec3 ground = planets[0]->GetClosestSurfacePoint(earthPos + glm::vec3(1.0f, 0.0f, 0.0f));
+                setCamera(glm::dvec3(ground) + glm::dvec3(2.0, 0.0, 0.0), 180.0f, 0.0f);
+                camera.ResetMotion();
+            }
+            
+            // What the camera is looking at, straight down the view axis
+            RayHit lookHit;
+            int lookBody = planetManager.Raycast(cameraPos, camera.Front, FAR_PLANE, lookHit);
+            if (lookBody >= 0) {
+                ImGui::Text("Looking at %s: %.2f units away (LOD level %d)",
+                           planets[lookBody]->GetData().name.c_str(), lookHit.distance, lookHit.level);
+            } else {
+                ImGui::Text("Looking at: space");
             }
+            if (nearestBody >= 0) {
+                ImGui::Text("Altitude above %s: %.2f units (near plane %.2f)",
+                           planets[nearestBody]->GetData().name.c_str(), nearestAltitude, nearPlane);
+            }
+            const BodyBvh& bodyIndex = planetManager.GetBodyIndex();
+            ImGui::Text("Bodies: %zu, %zu drawn, index %zu nodes deep %d, %llu rebuilds",
+                       bodyIndex.GetBodyCount(), visibleBodies.size(), bodyIndex.GetNodeCount(),
+                       bodyIndex.GetDepth(), static_cast<unsigned long long>(bodyIndex.GetRebuildCount()));
+            ImGui::Text("Resident bodies: %zu (%llu built, %llu released)",
+                       planetManager.GetResidentCount(),
+                       static_cast<unsigned long long>(planetManager.GetMaterializeCount()),
+                       static_cast<unsigned long long>(planetManager.GetReleaseCount()));
+            if (ImGui::Checkbox("Occlusion culling", &occlusionCullingEnabled) && !occlusionCullingEnabled) {
+                // Re-enabling must not test against a pyramid from frames ago
+                occlusionCuller.Invalidate();
+            }
+            if (occlusionCullingEnabled) {
+                const OcclusionStats& culled = occlusionCuller.GetStats();
+                ImGui::SameLine();
+                ImGui::Text("%u of %u patches culled (%u frustum, %u occluded), %u triangles, %u/%u bodies occluded",
+                           culled.patchesFrustumCulled + culled.patchesOccluded, culled.patchesTested,
+                           culled.patchesFrustumCulled, culled.patchesOccluded, culled.trianglesCulled,
+                           culled.bodiesOccluded, culled.bodiesTested);
+            }
+            if (smallBodies.GetInstanceCount() > 0) {
+                const auto& drawn = smallBodies.GetVisibleCounts();
+                ImGui::Checkbox("Asteroid belt", &smallBodiesEnabled);
+                ImGui::SameLine();
+                ImGui::Text("%zu rocks, drawn by LOD %u/%u/%u/%u (%zu triangles, %.1f MB)",
+                           smallBodies.GetInstanceCount(), drawn[0], drawn[1], drawn[2], drawn[3],
+                           smallBodies.GetVisibleTriangles(), smallBodies.GetGpuBytes() / (1024.0 * 1024.0));
+            }
+            if (stars) {
+                ImGui::SliderFloat("Star magnitude limit", &starMagnitudeLimit, 0.0f, stars->GetFaintestMagnitude());
+                ImGui::Text("Stars: %zu of %llu drawn (to mag %.1f), %zu/%d nodes resident, %zu pending, %.1f MB",
+                           stars->GetDrawnStars(), static_cast<unsigned long long>(stars->GetCatalogStars()),
+                           stars->GetDrawnMagnitude(), stars->GetResidentNodes(), stars->GetSlotCount(),
+                           stars->GetPendingNodes(), stars->GetGpuBytes() / (1024.0 * 1024.0));
+            }
+            ImGui::SliderFloat("Sun azimuth", &sunAzimuth, 0.0f, 360.0f, "%.0f deg");
+            ImGui::SliderFloat("Sun elevation", &sunElevation, -90.0f, 90.0f, "%.0f deg");
+            for (const auto& planet : planets) {
+                Atmosphere* atmosphere = planet->GetAtmosphere();
+                if (!atmosphere) continue;
+                float exposure = atmosphere->GetExposure();
+                std::string label = planet->GetData().name + " exposure";
+                if (ImGui::SliderFloat(label.c_str(), &exposure, 1.0f, 40.0f, "%.1f")) {
+                    atmosphere->SetExposure(exposure);
+                }
+                ImGui::SameLine();
+                ImGui::Text("tables %s, %.1f MB", atmosphere->WasBaked() ? "baked" : "cached",
+                           atmosphere->GetGpuBytes() / (1024.0 * 1024.0));
+            }
+            if (ImGui::Button("Cast Ray Batch")) {
+                // A cone of rays around the view axis, as a picking / collision load test
+                std::vector<glm::vec3> origins(RAY_BATCH_SIZE, glm::vec3(camera.Position));
+                std::vector<glm::vec3> directions(RAY_BATCH_SIZE);
+                std::vector<RayHit> hits(RAY_BATCH_SIZE);
+                int side = static_cast<int>(std::sqrt(static_cast<float>(RAY_BATCH_SIZE)));
+                for (int i = 0; i < RAY_BATCH_SIZE; ++i) {
+                    float x = (static_cast<float>(i % side) / side - 0.5f) * 0.8f;
+                    float y = (static_cast<float>(i / side) / side - 0.5f) * 0.8f;
+                    directions[i] = glm::normalize(camera.Front + camera.Right * x + camera.Up * y);
+                }
+                auto start = std::chrono::steady_clock::now();
+                planets[0]->RaycastBatch(origins.data(), directions.data(), RAY_BATCH_SIZE, 1000.0f, hits.data());
+                lastRayBatchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                lastRayBatchHits = static_cast<int>(std::count_if(hits.begin(), hits.end(), [](const RayHit& hit) { return hit.hit; }));
+            }
+            ImGui::SameLine();
+            ImGui::Text("%d rays: %d hits in %.2f ms", RAY_BATCH_SIZE, lastRayBatchHits, lastRayBatchMs);
             
             ImGui::Separator();
             
-            // Planet information
-            int totalTriangles = 0;
-            int totalNodes = 0;
-            for (const auto& planet : planets) {
-                totalTriangles += planet->GetTriangleCount();
-                totalNodes += planet->GetActiveNodeCount();
+            // Memory every mesh buffer, node pool and cache has reported
+            MemoryBudget& memory = MemoryBudget::Get();
+            ImGui::Text("GPU memory: %.1f MB (peak %.1f MB), CPU memory: %.1f MB (peak %.1f MB)",
+                       memory.GetUsed(MemoryKind::GPU) / (1024.0 * 1024.0), memory.GetPeak(MemoryKind::GPU) / (1024.0 * 1024.0),
+                       memory.GetUsed(MemoryKind::CPU) / (1024.0 * 1024.0), memory.GetPeak(MemoryKind::CPU) / (1024.0 * 1024.0));
+            if (planetManager.IsBudgetUnmet()) {
+                ImGui::Text("Over budget by more than releasing planets frees");
+            }
+            if (ImGui::SliderInt("GPU budget (MB)", &gpuBudgetMB, 0, 4096, gpuBudgetMB > 0 ? "%d" : "unlimited")) {
+                memory.SetBudget(MemoryKind::GPU, static_cast<size_t>(gpuBudgetMB) * 1024 * 1024);
+            }
+            if (ImGui::SliderInt("CPU budget (MB)", &cpuBudgetMB, 0, 4096, cpuBudgetMB > 0 ? "%d" : "unlimited")) {
+                memory.SetBudget(MemoryKind::CPU, static_cast<size_t>(cpuBudgetMB) * 1024 * 1024);
+            }
+            ImGui::Text("Evicted: %llu planets, %.1f MB",
+                       static_cast<unsigned long long>(memory.GetEvictionCount()), memory.GetEvictedBytes() / (1024.0 * 1024.0));
+            std::vector<MemoryBudget::CategoryUsage> memoryCategories;
+            memory.GetCategories(memoryCategories);
+            for (const auto& category : memoryCategories) {
+                ImGui::Text("  %s %s: %.2f MB in %d (peak %.2f MB)",
+                           category.kind == MemoryKind::GPU ? "GPU" : "CPU", category.name.c_str(),
+                           category.bytes / (1024.0 * 1024.0), category.accounts, category.peakBytes / (1024.0 * 1024.0));
+            }
+            
+            ImGui::Separator();
+            
+            // Planet information for the bodies nearest the camera
+            QuadTreeStats totalStats = planetManager.GetTotalLODStats();
+            planetManager.FindNearestBodies(cameraPos, NEARBY_BODY_COUNT, nearbyBodies);
+            for (int body : nearbyBodies) {
+                const Planet* planet = planets[body].get();
+                const QuadTreeStats& lodStats = planet->GetLODStats();
                 
-                ImGui::Text("%s:", planet->GetData().name.c_str());
+                ImGui::Text("%s:%s", planet->GetData().name.c_str(), planet->IsResident() ? "" : " (not resident)");
                 ImGui::Text("  Radius: %.1f km", planet->GetRadiusKm());
                 ImGui::Text("  Distance: %.1f km", glm::length(planet->GetPosition()) / 1000.0);
-                ImGui::Text("  Triangles: %d", planet->GetTriangleCount());
-                ImGui::Text("  Nodes: %d", planet->GetActiveNodeCount());
+                if (planet->GetTerrainBackend() == TerrainBackend::TESSELLATION) {
+                    ImGui::Text("  Patches: %zu tessellated on the GPU (%.2f MB control points)",
+                               lodStats.vertices / 4, lodStats.gpuBytes / (1024.0 * 1024.0));
+                } else {
+                    ImGui::Text("  Triangles: %zu (%zu vertices, %.2f MB GPU)",
+                               lodStats.triangles, lodStats.vertices, lodStats.gpuBytes / (1024.0 * 1024.0));
+                }
+                ImGui::Text("  Nodes: %d leaves of %d (%.2f MB patches)",
+                           lodStats.leaves, lodStats.nodes, lodStats.patchBytes / (1024.0 * 1024.0));
+                if (const DemStreamer* terrain = planet->GetTerrain()) {
+                    ImGui::Text("  Terrain: %.1f MB resident, %zu tiles, %zu pending, %llu loaded, %llu evicted",
+                               terrain->GetResidentBytes() / (1024.0 * 1024.0), terrain->GetResidentTiles(),
+                               terrain->GetPendingTiles(),
+                               static_cast<unsigned long long>(terrain->GetTilesLoaded()),
+                               static_cast<unsigned long long>(terrain->GetTilesEvicted()));
+                }
+                if (const HeightAtlas* atlas = planet->GetHeightAtlas()) {
+                    ImGui::Text("  Height atlas: %zu/%d layers (%.2f MB), %llu uploads",
+                               atlas->GetResidentCount(), atlas->GetCapacity(), atlas->GetGpuBytes() / (1024.0 * 1024.0),
+                               static_cast<unsigned long long>(atlas->GetUploadCount()));
+                }
+                if (const NormalAtlas* atlas = planet->GetNormalAtlas()) {
+                    ImGui::Text("  Normal atlas: %zu/%d layers (%.2f MB), %zu baking, %llu bakes",
+                               atlas->GetResidentCount(), atlas->GetCapacity(), atlas->GetGpuBytes() / (1024.0 * 1024.0),
+                               atlas->GetPendingCount(), static_cast<unsigned long long>(atlas->GetBakeCount()));
+                }
+                if (const VirtualTexture* surface = planet->GetVirtualTexture()) {
+                    const AlbedoStreamer* pages = planet->GetSurfaceTexture();
+                    ImGui::Text("  Surface texture: %zu/%d pages (%.2f MB), %zu requested, %llu uploads; %.1f MB cached, %zu pending",
+                               surface->GetResidentCount(), surface->GetCapacity(), surface->GetGpuBytes() / (1024.0 * 1024.0),
+                               surface->GetRequestedCount(), static_cast<unsigned long long>(surface->GetUploadCount()),
+                               pages->GetResidentBytes() / (1024.0 * 1024.0), pages->GetPendingPages());
+                }
+                if (const TileCache* tiles = planet->GetTileCache()) {
+                    ImGui::Text("  Tile cache: %zu/%u tiles, %llu hits, %llu misses, %llu evicted",
+                               tiles->GetCount(), tiles->GetCapacity(),
+                               static_cast<unsigned long long>(tiles->GetHits()),
+                               static_cast<unsigned long long>(tiles->GetMisses()),
+                               static_cast<unsigned long long>(tiles->GetEvictions()));
+                }
+                PrefetchStats prefetch = planet->GetPrefetchStats();
+                ImGui::Text("  LOD prefetch: %.0f%% hit (%llu hits, %llu misses, %llu late), %zu in flight, %zu ready",
+                           prefetch.GetHitRate() * 100.0,
+                           static_cast<unsigned long long>(prefetch.hits),
+                           static_cast<unsigned long long>(prefetch.misses),
+                           static_cast<unsigned long long>(prefetch.late),
+                           prefetch.inFlight, prefetch.stored);
+                ImGui::Text("  Prefetch waste: %llu of %llu builds, %.1f ms worker time",
+                           static_cast<unsigned long long>(prefetch.wasted),
+                           static_cast<unsigned long long>(prefetch.issued), prefetch.wastedMs);
                 
                 if (ImGui::Button(("Go to " + planet->GetData().name).c_str())) {
                     glm::vec3 planetPos = planet->GetPosition();
-                    // Position camera at good viewing distance
-                    float distance = planet->GetRadius() + 10.0f; // 10 units above surface
-                    camera.Position = glm::dvec3(planetPos) + glm::dvec3(distance, 0.0, 0.0);
+                    // Position camera at good viewing distance - 10 units above the terrain along +X
+                    glm::vec3 ground = planet->GetClosestSurfacePoint(planetPos + glm::vec3(1.0f, 0.0f, 0.0f));
+                    glm::dvec3 position = glm::dvec3(ground) + glm::dvec3(10.0, 0.0, 0.0);
                     
                     // Make camera look at the planet
-                    glm::dvec3 direction = glm::normalize(glm::dvec3(planetPos) - camera.Position);
-                    camera.Yaw = glm::degrees(atan2(direction.z, direction.x));
-                    camera.Pitch = glm::degrees(asin(direction.y));
-                    camera.UpdateCameraVectors();
+                    glm::dvec3 direction = glm::normalize(glm::dvec3(planetPos) - position);
+                    setCamera(position,
+                              glm::degrees(atan2(direction.z, direction.x)),
+                              glm::degrees(asin(direction.y)));
+                    camera.ResetMotion();
                 }
                 ImGui::Separator();
             }
             
-            ImGui::Text("Total Triangles: %d", totalTriangles);
-            ImGui::Text("Total Nodes: %d", totalNodes);
+            ImGui::Text("Total Triangles: %zu", totalStats.triangles);
+            ImGui::Text("Total Nodes: %d leaves of %d", totalStats.leaves, totalStats.nodes);
             ImGui::Text("FPS: %.1f", ImGui::GetIO().Framerate);
+            ImGui::Text("Simulation: %.0f Hz fixed step, %llu steps", simulation.GetStepRate(), simulation.GetStepCount());
+            if (replaying) {
+                ImGui::Text("Replaying: frame %zu of %zu", playback.GetFrameIndex(), playback.GetFrameCount());
+            } else if (recorder.IsOpen()) {
+                ImGui::Text("Recording: %u frames", recorder.GetFrameCount());
+            }
+            
+            // Terrain backend
+            if (terrainProgram) {
+                if (ImGui::Checkbox("GPU Tessellation", &tessellationEnabled)) {
+                    for (auto& planet : planets) {
+                        planet->SetTerrainBackend(tessellationEnabled ? TerrainBackend::TESSELLATION : TerrainBackend::MESH);
+                    }
+                }
+                ImGui::SameLine();
+                ImGui::SliderFloat("Edge (px)", &tessEdgePixels, 2.0f, 64.0f, "%.0f");
+            } else {
+                ImGui::Text("GPU Tessellation: unsupported");
+            }
+            
+            // LOD prediction
+            glm::dvec3 cameraVelocity = camera.GetVelocity();
+            ImGui::Checkbox("LOD Prediction", &lodPredictionEnabled);
+            ImGui::SameLine();
+            ImGui::SliderFloat("Lookahead (s)", &lodPredictionSeconds, 0.1f, 2.0f, "%.2f");
+            ImGui::Text("Camera speed: %.1f units/s", glm::length(cameraVelocity));
+            
+            // Frame pacing
+            ImGui::Separator();
+            FramePacer& pacer = DisplayManager::getFramePacer();
+            const FrameStats& frameStats = pacer.GetStats();
+            float targetFps = static_cast<float>(pacer.GetTargetFps());
+            if (ImGui::SliderFloat("Target FPS", &targetFps, 0.0f, 360.0f, targetFps > 0.0f ? "%.0f" : "Uncapped")) {
+                pacer.SetTargetFps(targetFps);
+            }
+            const char* vsyncModes[] = { "Off", "On", "Adaptive" };
+            int vsyncMode = static_cast<int>(pacer.GetVSyncMode());
+            if (ImGui::Combo("VSync", &vsyncMode, vsyncModes, pacer.IsAdaptiveVSyncSupported() ? 3 : 2)) {
+                pacer.SetVSyncMode(static_cast<VSyncMode>(vsyncMode));
+            }
+            ImGui::Text("Frame: %.2f ms (mean %.2f, p99 %.2f, sd %.3f)",
+                       frameStats.lastFrameMs, frameStats.meanMs, frameStats.p99Ms, frameStats.stdDevMs);
+            ImGui::Text("Achieved: %.1f FPS (min %.2f ms, max %.2f ms)",
+                       frameStats.achievedFps, frameStats.minMs, frameStats.maxMs);
+            const std::vector<float>& frameHistory = pacer.GetHistory();
+            if (!frameHistory.empty()) {
+                ImGui::PlotLines("Frame ms", frameHistory.data(), static_cast<int>(frameHistory.size()),
+                                 0, nullptr, 0.0f, 2.0f * static_cast<float>(frameStats.meanMs), ImVec2(0, 60));
+            }
+            
+            // Dynamic resolution
+            ImGui::Checkbox("Dynamic resolution", &dynamicResolutionEnabled);
+            if (dynamicResolution) {
+                float sharpness = dynamicResolution->GetSharpness();
+                if (ImGui::SliderFloat("Sharpening", &sharpness, 0.0f, 1.0f, "%.2f")) {
+                    dynamicResolution->SetSharpness(sharpness);
+                }
+                ImGui::Text("Scale: %.0f%% (%dx%d), scene GPU %.2f ms of %.2f ms target",
+                           dynamicResolution->GetScale() * 100.0f, dynamicResolution->GetRenderWidth(),
+                           dynamicResolution->GetRenderHeight(), dynamicResolution->GetSceneMs(),
+                           dynamicResolution->GetSceneTargetMs());
+                const std::vector<float>& sceneHistory = dynamicResolution->GetSceneHistory();
+                ImGui::Text("Target held: %.0f%% of the last %zu frames",
+                           dynamicResolution->GetHeldFraction() * 100.0f, sceneHistory.size());
+                if (!sceneHistory.empty()) {
+                    const std::vector<float>& scaleHistory = dynamicResolution->GetScaleHistory();
+                    ImGui::PlotLines("Scene ms", sceneHistory.data(), static_cast<int>(sceneHistory.size()),
+                                     0, nullptr, 0.0f, 2.0f * static_cast<float>(dynamicResolution->GetSceneTargetMs()), ImVec2(0, 60));
+                    ImGui::PlotLines("Scale", scaleHistory.data(), static_cast<int>(scaleHistory.size()),
+                                     0, nullptr, DynamicResolution::MIN_SCALE, DynamicResolution::MAX_SCALE, ImVec2(0, 40));
+                }
+            }
             
             // Controls
             ImGui::Separator();
@@ -262,30 +1002,92 @@ int main()
             
             ImGui::End();
 
+#ifdef SPACE_EXPLORER_PROFILER
+            Profiler::Get().DrawWindow();
+#endif
+
             ImGui::Render();
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         }
 
-        DisplayManager::updateDisplay();
-        
-        // Manual FPS limiting to 144 FPS
-        static double lastTime = glfwGetTime();
-        static int frameCount = 0;
-        frameCount++;
+        if (gpuTimer) {
+            gpuTimer->End();
+        }
+        double cpuMs = std::chrono::duration<double, std::milli>(clock::now() - frameStart).count();
+        recorder.Record(frameRecord);
         
-        double currentTime = glfwGetTime();
-        if (currentTime - lastTime >= 1.0/144.0) {
-            lastTime = currentTime;
-        } else {
-            // Sleep to maintain 144 FPS
-            double sleepTime = (1.0/144.0) - (currentTime - lastTime);
-            if (sleepTime > 0) {
-                usleep((int)(sleepTime * 1000000));
+        // Hashing reads back and so stalls on the GPU; it happens after cpu_ms is taken
+        bool hashed = false;
+        if (offscreen) {
+            bool lastFrame = frameIndex == options.headlessFrames - 1;
+            if (options.hashEvery > 0 && (frameIndex % options.hashEvery == 0 || lastFrame)) {
+                offscreen->ReadPixels(pixels);
+                lastImageHash = hashPixels(pixels);
+                hashed = true;
             }
+            Framebuffer::Unbind();
+        }
+
+        // Frame pacing (FPS cap / vsync) happens inside updateDisplay
+        DisplayManager::updateDisplay();
+        
+        if (timed) {
+            double frameMs = DisplayManager::getFramePacer().GetStats().lastFrameMs;
+            QuadTreeStats totalStats = planetManager.GetTotalLODStats();
+            TimingRow row;
+            row.gpuFrame = gpuTimer->GetFrame();
+            row.frame = frameIndex;
+            row.dt = frameRecord.dt;
+            row.cpuMs = cpuMs;
+            row.frameMs = frameMs;
+            row.triangles = totalStats.triangles;
+            row.leaves = totalStats.leaves;
+            row.hashed = hashed;
+            row.imageHash = lastImageHash;
+            timingRows.push_back(row);
+            // GPU times come in a few frames late, each is filed under the frame it measured
+            flushTimingRows(false);
+            timedFrameMs.push_back(headless ? cpuMs : frameMs);
+        }
+        frameIndex++;
+    }
+
+    if (timed) {
+        // The last frames' queries are still in flight; this is after the timed loop, so wait
+        gpuTimer->Finish();
+        flushTimingRows(true);
+    }
+    simulation.Stop();
+    recorder.Close();
+    if (recorder.GetFrameCount() > 0) {
+        std::cout << "Recorded " << recorder.GetFrameCount() << " frames to " << options.recordPath << std::endl;
+    }
+    if (!timedFrameMs.empty()) {
+        // Headless frames are unpaced, so CPU time is the number that matters there
+        auto summarize = [](const char* label, std::vector<double> samples) {
+            if (samples.empty()) return;
+            std::sort(samples.begin(), samples.end());
+            double total = 0.0;
+            for (double ms : samples) total += ms;
+            size_t p99 = std::min(samples.size() - 1, static_cast<size_t>(samples.size() * 0.99));
+            std::cout << "  " << label << ": mean " << total / samples.size() << " ms, p99 " << samples[p99]
+                      << " ms, max " << samples.back() << " ms" << std::endl;
+        };
+        std::cout << (headless ? "Headless: " : "Replay: ") << timedFrameMs.size() << " frames -> "
+                  << options.timingPath << std::endl;
+        summarize(headless ? "CPU" : "Frame", timedFrameMs);
+        summarize("GPU", timedGpuMs);
+        if (options.hashEvery > 0 && headless) {
+            char hashText[17];
+            std::snprintf(hashText, sizeof(hashText), "%016llx", static_cast<unsigned long long>(lastImageHash));
+            std::cout << "  Final image hash: " << hashText << std::endl;
         }
     }
 
     // Cleanup
+    gpuTimer.reset();
+    dynamicResolution.reset();
+    offscreen.reset();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -294,32 +1096,119 @@ int main()
     return 0;
 }
 
+// Command line: [--record <file>] [--replay <file> [--fixed-dt <s>] [--fast]]
+//               [--headless <frames> [--hash-every <n>]] [--timing <csv>] [--tessellation]
+//               [--asteroids <n>] [--gpu-budget <MB>] [--cpu-budget <MB>] [--dynamic-resolution]
+//               [--no-occlusion]
+// --headless with --replay renders the recording offscreen instead of the scripted path
+bool parseOptions(int argc, char** argv, RunOptions& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--record" && hasValue) {
+            options.recordPath = argv[++i];
+        } else if (arg == "--replay" && hasValue) {
+            options.replayPath = argv[++i];
+        } else if (arg == "--timing" && hasValue) {
+            options.timingPath = argv[++i];
+        } else if (arg == "--fixed-dt" && hasValue) {
+            options.fixedDt = std::atof(argv[++i]);
+        } else if (arg == "--fast") {
+            options.fast = true;
+        } else if (arg == "--tessellation") {
+            options.tessellation = true;
+        } else if (arg == "--headless" && hasValue) {
+            options.headlessFrames = std::atoi(argv[++i]);
+        } else if (arg == "--hash-every" && hasValue) {
+            options.hashEvery = std::atoi(argv[++i]);
+        } else if (arg == "--asteroids" && hasValue) {
+            options.asteroids = std::atoi(argv[++i]);
+        } else if (arg == "--dynamic-resolution") {
+            options.dynamicResolution = true;
+        } else if (arg == "--no-occlusion") {
+            options.occlusionCulling = false;
+        } else if (arg == "--gpu-budget" && hasValue) {
+            options.gpuBudgetMB = std::atoi(argv[++i]);
+        } else if (arg == "--cpu-budget" && hasValue) {
+            options.cpuBudgetMB = std::atoi(argv[++i]);
+        } else {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            std::cerr << "Usage: " << argv[0]
+                      << " [--record <file>] [--replay <file> [--fixed-dt <s>] [--fast]]"
+                      << " [--headless <frames> [--hash-every <n>]] [--timing <csv>] [--tessellation] [--asteroids <n>]"
+                      << " [--gpu-budget <MB>] [--cpu-budget <MB>] [--dynamic-resolution] [--no-occlusion]" << std::endl;
+            return false;
+        }
+    }
+    if (!options.recordPath.empty() && !options.replayPath.empty()) {
+        std::cerr << "--record and --replay cannot be used together" << std::endl;
+        return false;
+    }
+    if (options.headlessFrames > 0 && !options.recordPath.empty()) {
+        std::cerr << "--record needs a window to take input from" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// The headless flight: one orbit around the first planet, spiralling from
+// 2.4 radii out down to 5% above the surface, always looking at its centre.
+// Covers both the coarse far view and deep LOD refinement in one run.
+void headlessCameraPath(double t, float planetRadius, glm::dvec3& position, float& yaw, float& pitch)
+{
+    double eased = t * t * (3.0 - 2.0 * t);
+    double distance = planetRadius * glm::mix(2.4, 1.05, eased);
+    double angle = t * 2.0 * glm::pi<double>();
+    double height = 0.3 * std::sin(angle);     // some latitude so the poles get refined too
+    glm::dvec3 direction = glm::normalize(glm::dvec3(std::cos(angle), height, std::sin(angle)));
+    position = direction * distance;
+    glm::dvec3 look = -direction;
+    yaw = static_cast<float>(glm::degrees(std::atan2(look.z, look.x)));
+    pitch = static_cast<float>(glm::degrees(std::asin(look.y)));
+}
+
+// FNV-1a over the raw pixels - a golden value per driver for regression runs
+uint64_t hashPixels(const std::vector<uint8_t>& pixels)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (uint8_t byte : pixels) {
+        hash ^= byte;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void writeTimingRow(std::ostream& out, const TimingRow& row)
+{
+    out << row.frame << ',' << row.dt << ',' << row.cpuMs << ',' << row.frameMs << ',';
+    if (row.gpuMs >= 0.0) out << row.gpuMs;
+    out << ',' << row.triangles << ',' << row.leaves << ',';
+    if (row.hashed) {
+        char hashText[17];
+        std::snprintf(hashText, sizeof(hashText), "%016llx", static_cast<unsigned long long>(row.imageHash));
+        out << hashText;
+    }
+    out << '\n';
+}
+
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+// Camera movement is only sampled here; the simulation thread applies it at its fixed step
 void processInput(GLFWwindow *window)
 {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
     // Camera movement
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.ProcessKeyboard(FORWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.ProcessKeyboard(LEFT, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.ProcessKeyboard(RIGHT, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
-        camera.ProcessKeyboard(UP, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
-        camera.ProcessKeyboard(DOWN, deltaTime);
+    frameInput.forward  = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
+    frameInput.backward = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+    frameInput.left     = glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS;
+    frameInput.right    = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
+    frameInput.up       = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+    frameInput.down     = glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS;
         
     // Speed modifiers
-    if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS) {
-        camera.MovementSpeed = 100.0f;  // Fast movement
-    } else {
-        camera.MovementSpeed = 10.0f;   // Normal movement speed 10
-    }
+    frameInput.fast = glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS;
     
     // Mouse mode toggle with Q key
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS && !mouseTogglePressed) {
@@ -392,11 +1281,12 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
     lastX = xpos;
     lastY = ypos;
 
-    camera.ProcessMouseMovement(xoffset, yoffset);
+    frameInput.mouseDeltaX += xoffset;
+    frameInput.mouseDeltaY += yoffset;
 }
 
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    camera.ProcessMouseScroll(static_cast<float>(yoffset));
+    frameInput.scrollDelta += static_cast<float>(yoffset);
 }
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "memoryBudget.h"
+#include <algorithm>
+
+MemoryBudget& MemoryBudget::Get() {
+    static MemoryBudget budget;
+    return budget;
+}
+
+void MemoryBudget::SetBudget(MemoryKind kind, size_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget[static_cast<int>(kind)] = bytes;
+}
+
+size_t MemoryBudget::GetBudget(MemoryKind kind) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budget[static_cast<int>(kind)];
+}
+
+size_t MemoryBudget::GetUsed(MemoryKind kind) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_used[static_cast<int>(kind)];
+}
+
+size_t MemoryBudget::GetPeak(MemoryKind kind) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_peak[static_cast<int>(kind)];
+}
+
+size_t MemoryBudget::GetExcess(MemoryKind kind) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t budget = m_budget[static_cast<int>(kind)];
+    size_t used = m_used[static_cast<int>(kind)];
+    return budget > 0 && used > budget ? used - budget : 0;
+}
+
+void MemoryBudget::RecordEviction(size_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_evictions++;
+    m_evictedBytes += bytes;
+}
+
+uint64_t MemoryBudget::GetEvictionCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_evictions;
+}
+
+size_t MemoryBudget::GetEvictedBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_evictedBytes;
+}
+
+void MemoryBudget::GetCategories(std::vector<CategoryUsage>& categories) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    categories.clear();
+    for (const Category& category : m_categories) {
+        categories.push_back({ category.name, category.kind, category.bytes, category.peakBytes, category.accounts });
+    }
+}
+
+int MemoryBudget::Open(const char* category, MemoryKind kind) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // A handful of categories, a linear search is fine
+    auto it = std::find_if(m_categories.begin(), m_categories.end(),
+                           [&](const Category& c) { return c.name == category && c.kind == kind; });
+    int index = static_cast<int>(it - m_categories.begin());
+    if (it == m_categories.end()) {
+        Category added;
+        added.name = category;
+        added.kind = kind;
+        m_categories.push_back(added);
+    }
+    m_categories[index].accounts++;
+
+    int id;
+    if (!m_freeAccounts.empty()) {
+        id = m_freeAccounts.back();
+        m_freeAccounts.pop_back();
+    } else {
+        id = static_cast<int>(m_accounts.size());
+        m_accounts.emplace_back();
+    }
+    m_accounts[id].category = index;
+    m_accounts[id].bytes = 0;
+    return id;
+}
+
+void MemoryBudget::Close(int account) {
+    Set(account, 0);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_categories[m_accounts[account].category].accounts--;
+    m_accounts[account].category = -1;
+    m_freeAccounts.push_back(account);
+}
+
+void MemoryBudget::Set(int account, size_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Account& entry = m_accounts[account];
+    Category& category = m_categories[entry.category];
+    int kind = static_cast<int>(category.kind);
+    category.bytes = category.bytes - entry.bytes + bytes;
+    category.peakBytes = std::max(category.peakBytes, category.bytes);
+    m_used[kind] = m_used[kind] - entry.bytes + bytes;
+    m_peak[kind] = std::max(m_peak[kind], m_used[kind]);
+    entry.bytes = bytes;
+}
+
+MemoryAccount::MemoryAccount(const char* category, MemoryKind kind)
+    : m_id(MemoryBudget::Get().Open(category, kind)) {
+}
+
+MemoryAccount::~MemoryAccount() {
+    if (m_id >= 0) {
+        MemoryBudget::Get().Close(m_id);
+    }
+}
+
+MemoryAccount::MemoryAccount(MemoryAccount&& other) noexcept : m_id(other.m_id), m_bytes(other.m_bytes) {
+    other.m_id = -1;
+    other.m_bytes = 0;
+}
+
+MemoryAccount& MemoryAccount::operator=(MemoryAccount&& other) noexcept {
+    if (this != &other) {
+        if (m_id >= 0) {
+            MemoryBudget::Get().Close(m_id);
+        }
+        m_id = other.m_id;
+        m_bytes = other.m_bytes;
+        other.m_id = -1;
+        other.m_bytes = 0;
+    }
+    return *this;
+}
+
+void MemoryAccount::Set(size_t bytes) {
+    if (m_id < 0 || bytes == m_bytes) return;
+    MemoryBudget::Get().Set(m_id, bytes);
+    m_bytes = bytes;
+}
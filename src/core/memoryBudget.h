@@ -0,0 +1,100 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class MemoryKind {
+    GPU,
+    CPU,
+    COUNT
+};
+
+// Central tally of what the renderer holds in VRAM and RAM. Every mesh
+// buffer, node pool and cache owns a MemoryAccount under a category name and
+// keeps it set to its current size; the budget only adds the accounts up and
+// compares them to the configured limits. Freeing memory is up to the owners
+// (PlanetManager releases the least recently used planets while over).
+// Accounts may be set from any thread.
+class MemoryBudget {
+public:
+    static MemoryBudget& Get();
+
+    struct CategoryUsage {
+        std::string name;
+        MemoryKind kind;
+        size_t bytes;
+        size_t peakBytes;
+        int accounts;
+    };
+
+    // 0 = no limit
+    void SetBudget(MemoryKind kind, size_t bytes);
+    size_t GetBudget(MemoryKind kind) const;
+    size_t GetUsed(MemoryKind kind) const;
+    size_t GetPeak(MemoryKind kind) const;
+    // Bytes above the budget, 0 when within it or unlimited
+    size_t GetExcess(MemoryKind kind) const;
+    bool IsOverBudget() const { return GetExcess(MemoryKind::GPU) > 0 || GetExcess(MemoryKind::CPU) > 0; }
+
+    // Owners report what they freed to get back under budget
+    void RecordEviction(size_t bytes);
+    uint64_t GetEvictionCount() const;
+    size_t GetEvictedBytes() const;
+
+    void GetCategories(std::vector<CategoryUsage>& categories) const;
+
+private:
+    friend class MemoryAccount;
+
+    struct Category {
+        std::string name;
+        MemoryKind kind;
+        size_t bytes = 0;
+        size_t peakBytes = 0;
+        int accounts = 0;
+    };
+
+    struct Account {
+        int category = -1;          // -1 = free
+        size_t bytes = 0;
+    };
+
+    mutable std::mutex m_mutex;
+    std::vector<Category> m_categories;
+    std::vector<Account> m_accounts;
+    std::vector<int> m_freeAccounts;
+    size_t m_budget[static_cast<int>(MemoryKind::COUNT)] = {};
+    size_t m_used[static_cast<int>(MemoryKind::COUNT)] = {};
+    size_t m_peak[static_cast<int>(MemoryKind::COUNT)] = {};
+    uint64_t m_evictions = 0;
+    size_t m_evictedBytes = 0;
+
+    MemoryBudget() = default;
+
+    int Open(const char* category, MemoryKind kind);
+    void Close(int account);
+    void Set(int account, size_t bytes);
+};
+
+// One consumer's share of a category. Default-constructed accounts are
+// inert, so owners can open theirs once the resource exists.
+class MemoryAccount {
+public:
+    MemoryAccount() = default;
+    MemoryAccount(const char* category, MemoryKind kind);
+    ~MemoryAccount();
+
+    MemoryAccount(const MemoryAccount&) = delete;
+    MemoryAccount& operator=(const MemoryAccount&) = delete;
+    MemoryAccount(MemoryAccount&& other) noexcept;
+    MemoryAccount& operator=(MemoryAccount&& other) noexcept;
+
+    void Set(size_t bytes);
+    size_t Get() const { return m_bytes; }
+
+private:
+    int m_id = -1;
+    size_t m_bytes = 0;
+};
@@ -0,0 +1,335 @@
+#include "profiler.h"
+
+#ifdef SPACE_EXPLORER_PROFILER
+
+#include "imgui.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+namespace {
+
+thread_local int t_threadIndex = -1;
+thread_local int t_depth = 0;
+
+// Lane index used for GPU zones in the timeline and the trace export
+constexpr int GPU_LANE = 1000;
+
+ImU32 ZoneColor(const char* name, int depth) {
+    // Stable colour per zone name
+    unsigned int hash = 2166136261u;
+    for (const char* c = name; *c; ++c) {
+        hash = (hash ^ static_cast<unsigned char>(*c)) * 16777619u;
+    }
+    int r = 80 + (hash & 0x7f);
+    int g = 80 + ((hash >> 8) & 0x7f);
+    int b = 80 + ((hash >> 16) & 0x7f) - depth * 10;
+    return IM_COL32(r, g, std::max(b, 40), 255);
+}
+
+}
+
+Profiler& Profiler::Get() {
+    static Profiler instance;
+    return instance;
+}
+
+Profiler::Profiler()
+    : m_enabled(true), m_paused(false), m_epoch(std::chrono::steady_clock::now()), m_gpuDepth(0), m_droppedGpuFrames(0) {
+}
+
+Profiler::~Profiler() {
+    // Queries are owned by the GL context, which is gone by the time statics are destroyed
+}
+
+double Profiler::NowUs() const {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+int Profiler::ThreadIndex() {
+    if (t_threadIndex < 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        t_threadIndex = static_cast<int>(m_threadNames.size());
+        m_threadNames.push_back(t_threadIndex == 0 ? "Main" : "Thread " + std::to_string(t_threadIndex));
+    }
+    return t_threadIndex;
+}
+
+void Profiler::SetThreadName(const char* name) {
+    int index = ThreadIndex();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_threadNames[index] = name;
+}
+
+int Profiler::BeginZone() {
+    return t_depth++;
+}
+
+void Profiler::EndZone(const char* name, int depth, double startUs) {
+    t_depth = depth;
+    if (!m_enabled) return;
+
+    ProfileZoneRecord record = { name, startUs, NowUs(), depth, ThreadIndex() };
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_current.cpuZones.push_back(record);
+}
+
+GLuint Profiler::AcquireQuery(GpuQuerySet& set, int& index) {
+    if (set.used == static_cast<int>(set.queries.size())) {
+        // Grow in chunks; only happens during the first frames
+        size_t oldSize = set.queries.size();
+        set.queries.resize(oldSize + 16);
+        glGenQueries(16, set.queries.data() + oldSize);
+    }
+    index = set.used++;
+    return set.queries[index];
+}
+
+int Profiler::BeginGpuZone(const char* name) {
+    if (!m_enabled) return -1;
+
+    GpuQuerySet& set = m_gpuSets[m_current.index % FRAME_LATENCY];
+    GpuPendingZone zone = { name, m_gpuDepth++, -1, -1 };
+    glQueryCounter(AcquireQuery(set, zone.beginQuery), GL_TIMESTAMP);
+    set.zones.push_back(zone);
+    return static_cast<int>(set.zones.size()) - 1;
+}
+
+void Profiler::EndGpuZone(int zone) {
+    if (zone < 0) return;
+
+    GpuQuerySet& set = m_gpuSets[m_current.index % FRAME_LATENCY];
+    // The set was recycled (profiler toggled mid-frame)
+    if (zone >= static_cast<int>(set.zones.size())) return;
+
+    m_gpuDepth--;
+    glQueryCounter(AcquireQuery(set, set.zones[zone].endQuery), GL_TIMESTAMP);
+}
+
+void Profiler::ResolveGpuSet(GpuQuerySet& set) {
+    if (!set.active) return;
+    set.active = false;
+
+    std::vector<ProfileZoneRecord> zones;
+    if (set.used > 0) {
+        // Never wait: if the newest query is not ready the whole frame is dropped
+        GLuint available = 0;
+        glGetQueryObjectuiv(set.queries[set.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            m_droppedGpuFrames++;
+            return;
+        }
+
+        std::vector<GLuint64> timestamps(set.used);
+        for (int i = 0; i < set.used; ++i) {
+            glGetQueryObjectui64v(set.queries[i], GL_QUERY_RESULT, &timestamps[i]);
+        }
+
+        // GPU clock has its own origin, place zones relative to the first query
+        GLuint64 origin = timestamps[0];
+        for (const GpuPendingZone& pending : set.zones) {
+            if (pending.endQuery < 0) continue;
+            ProfileZoneRecord record;
+            record.name = pending.name;
+            record.startUs = (timestamps[pending.beginQuery] - origin) / 1000.0;
+            record.endUs = (timestamps[pending.endQuery] - origin) / 1000.0;
+            record.depth = pending.depth;
+            record.thread = GPU_LANE;
+            zones.push_back(record);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (ProfileFrame& frame : m_history) {
+        if (frame.index == set.frame) {
+            frame.gpuZones = std::move(zones);
+            frame.gpuResolved = true;
+            break;
+        }
+    }
+}
+
+void Profiler::NextFrame() {
+    ThreadIndex();
+    double now = NowUs();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_current.index > 0 && !m_paused) {
+            m_current.endUs = now;
+            m_history.push_back(std::move(m_current));
+            if (m_history.size() > HISTORY_FRAMES) {
+                m_history.pop_front();
+            }
+        }
+        uint64_t next = m_current.index + 1;
+        m_current = ProfileFrame();
+        m_current.index = next;
+        m_current.startUs = now;
+    }
+
+    // Reuse the set from FRAME_LATENCY frames ago, harvesting its results first
+    GpuQuerySet& set = m_gpuSets[m_current.index % FRAME_LATENCY];
+    ResolveGpuSet(set);
+    set.zones.clear();
+    set.used = 0;
+    set.frame = m_current.index;
+    set.active = m_enabled;
+    m_gpuDepth = 0;
+}
+
+const ProfileFrame* Profiler::LatestResolvedFrame() const {
+    for (auto it = m_history.rbegin(); it != m_history.rend(); ++it) {
+        if (it->gpuResolved) return &*it;
+    }
+    return m_history.empty() ? nullptr : &m_history.back();
+}
+
+void Profiler::DrawWindow() {
+    ImGui::Begin("Profiler");
+
+    bool enabled = m_enabled;
+    if (ImGui::Checkbox("Enabled", &enabled)) {
+        m_enabled = enabled;
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("Pause", &m_paused);
+    ImGui::SameLine();
+    if (ImGui::Button("Export Chrome Trace")) {
+        if (ExportChromeTrace("profile_trace.json")) {
+            std::cout << "Profiler trace written to profile_trace.json" << std::endl;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const ProfileFrame* frame = LatestResolvedFrame();
+    if (!frame) {
+        ImGui::Text("No frames captured");
+        ImGui::End();
+        return;
+    }
+
+    double frameUs = frame->endUs - frame->startUs;
+    double gpuUs = 0.0;
+    for (const auto& zone : frame->gpuZones) {
+        if (zone.depth == 0) gpuUs += zone.endUs - zone.startUs;
+    }
+    ImGui::Text("Frame %llu: CPU %.2f ms, GPU %.2f ms, %llu GPU frames dropped",
+               static_cast<unsigned long long>(frame->index), frameUs / 1000.0, gpuUs / 1000.0,
+               static_cast<unsigned long long>(m_droppedGpuFrames));
+
+    // Timeline: one lane per thread plus the GPU, one row per nesting depth
+    std::map<int, int> laneDepth;
+    for (const auto& zone : frame->cpuZones) laneDepth[zone.thread] = std::max(laneDepth[zone.thread], zone.depth + 1);
+    for (const auto& zone : frame->gpuZones) laneDepth[GPU_LANE] = std::max(laneDepth[GPU_LANE], zone.depth + 1);
+
+    const float rowHeight = 18.0f;
+    const float labelWidth = 90.0f;
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    float width = std::max(100.0f, ImGui::GetContentRegionAvail().x - labelWidth);
+    float scale = static_cast<float>(width / std::max(frameUs, 1.0));
+
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    float y = origin.y;
+    std::map<int, float> laneY;
+    for (const auto& lane : laneDepth) {
+        laneY[lane.first] = y;
+        const char* label = lane.first == GPU_LANE ? "GPU"
+            : (lane.first < static_cast<int>(m_threadNames.size()) ? m_threadNames[lane.first].c_str() : "?");
+        drawList->AddText(ImVec2(origin.x, y), IM_COL32(200, 200, 200, 255), label);
+        y += lane.second * rowHeight + 4.0f;
+    }
+
+    auto drawZone = [&](const ProfileZoneRecord& zone, double offsetUs) {
+        float x0 = origin.x + labelWidth + static_cast<float>((zone.startUs - offsetUs) * scale);
+        float x1 = origin.x + labelWidth + static_cast<float>((zone.endUs - offsetUs) * scale);
+        x0 = std::max(x0, origin.x + labelWidth);
+        x1 = std::max(x1, x0 + 1.0f);
+        float y0 = laneY[zone.thread] + zone.depth * rowHeight;
+        ImVec2 a(x0, y0), b(x1, y0 + rowHeight - 1.0f);
+        drawList->AddRectFilled(a, b, ZoneColor(zone.name, zone.depth));
+        if (x1 - x0 > 40.0f) {
+            drawList->PushClipRect(a, b, true);
+            drawList->AddText(ImVec2(x0 + 2.0f, y0 + 2.0f), IM_COL32(0, 0, 0, 255), zone.name);
+            drawList->PopClipRect();
+        }
+        if (ImGui::IsMouseHoveringRect(a, b)) {
+            ImGui::SetTooltip("%s: %.3f ms", zone.name, (zone.endUs - zone.startUs) / 1000.0);
+        }
+    };
+    for (const auto& zone : frame->cpuZones) drawZone(zone, frame->startUs);
+    for (const auto& zone : frame->gpuZones) drawZone(zone, 0.0);
+    ImGui::Dummy(ImVec2(labelWidth + width, y - origin.y));
+
+    // Per-zone totals
+    ImGui::Separator();
+    std::map<std::string, double> cpuTotals, gpuTotals;
+    for (const auto& zone : frame->cpuZones) cpuTotals[zone.name] += zone.endUs - zone.startUs;
+    for (const auto& zone : frame->gpuZones) gpuTotals[zone.name] += zone.endUs - zone.startUs;
+    for (const auto& total : cpuTotals) {
+        auto gpu = gpuTotals.find(total.first);
+        if (gpu != gpuTotals.end()) {
+            ImGui::Text("%-18s CPU %7.3f ms  GPU %7.3f ms", total.first.c_str(), total.second / 1000.0, gpu->second / 1000.0);
+        } else {
+            ImGui::Text("%-18s CPU %7.3f ms", total.first.c_str(), total.second / 1000.0);
+        }
+    }
+
+    ImGui::End();
+}
+
+bool Profiler::ExportChromeTrace(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Failed to open " << path << " for profiler export" << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    auto writeEvent = [&](const char* name, const char* category, double ts, double dur, int tid) {
+        out << (first ? "" : ",\n")
+            << "{\"name\":\"" << name << "\",\"cat\":\"" << category << "\",\"ph\":\"X\",\"ts\":" << ts
+            << ",\"dur\":" << dur << ",\"pid\":1,\"tid\":" << tid << "}";
+        first = false;
+    };
+
+    for (size_t i = 0; i < m_threadNames.size(); ++i) {
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i
+            << ",\"args\":{\"name\":\"" << m_threadNames[i] << "\"}}";
+        first = false;
+    }
+    out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << GPU_LANE
+        << ",\"args\":{\"name\":\"GPU\"}}";
+    first = false;
+
+    for (const ProfileFrame& frame : m_history) {
+        for (const auto& zone : frame.cpuZones) {
+            writeEvent(zone.name, "cpu", zone.startUs, zone.endUs - zone.startUs, zone.thread);
+        }
+        // GPU zones are aligned to the CPU start of the frame that issued them
+        for (const auto& zone : frame.gpuZones) {
+            writeEvent(zone.name, "gpu", frame.startUs + zone.startUs, zone.endUs - zone.startUs, GPU_LANE);
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return true;
+}
+
+ProfileScope::ProfileScope(const char* name) : m_name(name), m_start(0.0), m_depth(-1) {
+    Profiler& profiler = Profiler::Get();
+    if (profiler.IsEnabled()) {
+        m_depth = profiler.BeginZone();
+        m_start = profiler.NowUs();
+    }
+}
+
+ProfileScope::~ProfileScope() {
+    if (m_depth >= 0) {
+        Profiler::Get().EndZone(m_name, m_depth, m_start);
+    }
+}
+
+#endif
@@ -0,0 +1,139 @@
+#pragma once
+
+// Lightweight frame profiler with scoped CPU zones and GL_TIMESTAMP GPU zones.
+// Built when SPACE_EXPLORER_PROFILER is defined (CMake option ENABLE_PROFILER);
+// otherwise every PROFILE_* macro expands to nothing and this header declares
+// no code at all.
+//
+//   PROFILE_FRAME();                 // once per frame, top of the render loop
+//   PROFILE_THREAD("Simulation");    // names the calling thread's lane
+//   PROFILE_ZONE("Quadtree Update"); // CPU time until end of scope
+//   PROFILE_GPU_ZONE("Draw");        // GPU time until end of scope (GL thread only)
+
+#ifdef SPACE_EXPLORER_PROFILER
+
+#include <epoxy/gl.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ProfileZoneRecord {
+    const char* name;
+    double startUs;
+    double endUs;
+    int depth;
+    int thread;
+};
+
+struct ProfileFrame {
+    uint64_t index = 0;
+    double startUs = 0.0;
+    double endUs = 0.0;
+    std::vector<ProfileZoneRecord> cpuZones;
+    std::vector<ProfileZoneRecord> gpuZones;  // placed relative to startUs
+    bool gpuResolved = false;
+};
+
+class Profiler {
+public:
+    static Profiler& Get();
+
+    void SetEnabled(bool enabled) { m_enabled = enabled; }
+    bool IsEnabled() const { return m_enabled; }
+
+    void NextFrame();
+    void SetThreadName(const char* name);
+
+    int BeginZone();
+    void EndZone(const char* name, int depth, double startUs);
+    int BeginGpuZone(const char* name);
+    void EndGpuZone(int zone);
+
+    double NowUs() const;
+
+    // ImGui timeline of the latest resolved frame plus per-zone totals
+    void DrawWindow();
+    // Writes the captured frame history as Chrome trace JSON (chrome://tracing, Perfetto)
+    bool ExportChromeTrace(const std::string& path) const;
+
+private:
+    Profiler();
+    ~Profiler();
+
+    struct GpuPendingZone {
+        const char* name;
+        int depth;
+        int beginQuery;
+        int endQuery;
+    };
+
+    // One query set per in-flight frame, results are read FRAME_LATENCY
+    // frames later so the CPU never waits on the GPU
+    struct GpuQuerySet {
+        std::vector<GLuint> queries;
+        std::vector<GpuPendingZone> zones;
+        int used = 0;
+        uint64_t frame = 0;
+        bool active = false;
+    };
+
+    static constexpr int FRAME_LATENCY = 3;
+    static constexpr size_t HISTORY_FRAMES = 240;
+
+    std::atomic<bool> m_enabled;
+    bool m_paused;
+    std::chrono::steady_clock::time_point m_epoch;
+
+    mutable std::mutex m_mutex;
+    ProfileFrame m_current;
+    std::deque<ProfileFrame> m_history;
+    std::vector<std::string> m_threadNames;
+
+    GpuQuerySet m_gpuSets[FRAME_LATENCY];
+    int m_gpuDepth;
+    uint64_t m_droppedGpuFrames;
+
+    int ThreadIndex();
+    void ResolveGpuSet(GpuQuerySet& set);
+    GLuint AcquireQuery(GpuQuerySet& set, int& index);
+    const ProfileFrame* LatestResolvedFrame() const;
+};
+
+// Scope guards behind the macros
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name);
+    ~ProfileScope();
+private:
+    const char* m_name;
+    double m_start;
+    int m_depth;
+};
+
+class GpuProfileScope {
+public:
+    explicit GpuProfileScope(const char* name) : m_zone(Profiler::Get().BeginGpuZone(name)) {}
+    ~GpuProfileScope() { Profiler::Get().EndGpuZone(m_zone); }
+private:
+    int m_zone;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_FRAME() Profiler::Get().NextFrame()
+#define PROFILE_THREAD(name) Profiler::Get().SetThreadName(name)
+#define PROFILE_ZONE(name) ProfileScope PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_GPU_ZONE(name) GpuProfileScope PROFILE_CONCAT(gpuProfileZone, __LINE__)(name)
+
+#else
+
+#define PROFILE_FRAME() ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_GPU_ZONE(name) ((void)0)
+
+#endif
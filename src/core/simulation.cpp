@@ -0,0 +1,216 @@
+#include "simulation.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+// Blend two angles in degrees along the shortest arc
+float LerpAngle(float a, float b, float t) {
+    float diff = b - a;
+    if (diff > 180.0f) diff -= 360.0f;
+    if (diff < -180.0f) diff += 360.0f;
+    return a + diff * t;
+}
+
+}
+
+Simulation::Simulation(const Camera& camera, const std::vector<PlanetData>& bodies, double stepRate)
+    : m_fixedStep(1.0 / stepRate), m_bodies(bodies), m_camera(camera), m_running(false), m_stepCount(0),
+      m_manual(false), m_accumulator(0.0) {
+    m_working.bodies.resize(m_bodies.size());
+    for (size_t i = 0; i < m_bodies.size(); ++i) {
+        m_working.bodies[i].position = glm::dvec3(m_bodies[i].position);
+        m_working.bodies[i].rotation = 0.0f;
+    }
+    CaptureState(m_working);
+    m_previous = m_working;
+    m_current = m_working;
+    m_currentPublished = std::chrono::steady_clock::now();
+}
+
+Simulation::~Simulation() {
+    Stop();
+}
+
+void Simulation::Start() {
+    if (m_running) return;
+    m_running = true;
+    m_thread = std::thread(&Simulation::Run, this);
+}
+
+void Simulation::Stop() {
+    m_running = false;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void Simulation::Advance(double dt) {
+    if (m_running) {
+        std::cerr << "Simulation::Advance called while the simulation thread is running" << std::endl;
+        return;
+    }
+    m_manual = true;
+    m_accumulator += dt;
+    while (m_accumulator >= m_fixedStep) {
+        Step(m_fixedStep);
+        m_accumulator -= m_fixedStep;
+    }
+}
+
+void Simulation::SubmitInput(const InputState& input) {
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+    // Held keys replace the previous sample, mouse and scroll deltas accumulate
+    // until a step consumes them
+    float mouseX = m_input.mouseDeltaX + input.mouseDeltaX;
+    float mouseY = m_input.mouseDeltaY + input.mouseDeltaY;
+    float scroll = m_input.scrollDelta + input.scrollDelta;
+    m_input = input;
+    m_input.mouseDeltaX = mouseX;
+    m_input.mouseDeltaY = mouseY;
+    m_input.scrollDelta = scroll;
+}
+
+void Simulation::SetCamera(const glm::dvec3& position, float yaw, float pitch) {
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+    m_cameraCommand.pending = true;
+    m_cameraCommand.position = position;
+    m_cameraCommand.yaw = yaw;
+    m_cameraCommand.pitch = pitch;
+}
+
+void Simulation::SubmitGroundRadii(const std::vector<float>& radii) {
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+    m_groundRadii = radii;
+}
+
+void Simulation::Run() {
+    PROFILE_THREAD("Simulation");
+    using clock = std::chrono::steady_clock;
+    const auto step = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(m_fixedStep));
+    // Never try to catch up more than a few steps after a stall (debugger, window drag)
+    const auto maxLag = step * 8;
+
+    auto next = clock::now();
+    while (m_running) {
+        Step(m_fixedStep);
+
+        next += step;
+        auto now = clock::now();
+        if (now - next > maxLag) {
+            next = now;
+        }
+        std::this_thread::sleep_until(next);
+    }
+}
+
+void Simulation::Step(double dt) {
+    PROFILE_ZONE("Simulation Step");
+    InputState input;
+    CameraCommand command;
+    std::vector<float> groundRadii;
+    {
+        std::lock_guard<std::mutex> lock(m_inputMutex);
+        input = m_input;
+        command = m_cameraCommand;
+        groundRadii = m_groundRadii;
+        m_input.mouseDeltaX = 0.0f;
+        m_input.mouseDeltaY = 0.0f;
+        m_input.scrollDelta = 0.0f;
+        m_cameraCommand.pending = false;
+    }
+
+    if (command.pending) {
+        m_camera.Position = command.position;
+        m_camera.Yaw = command.yaw;
+        m_camera.Pitch = command.pitch;
+        m_camera.UpdateCameraVectors();
+    }
+
+    // Camera
+    if (input.mouseDeltaX != 0.0f || input.mouseDeltaY != 0.0f) {
+        m_camera.ProcessMouseMovement(input.mouseDeltaX, input.mouseDeltaY);
+    }
+    if (input.scrollDelta != 0.0f) {
+        m_camera.ProcessMouseScroll(input.scrollDelta);
+    }
+
+    m_camera.MovementSpeed = input.fast ? 100.0f : 10.0f;
+    float stepTime = static_cast<float>(dt);
+    if (input.forward)  m_camera.ProcessKeyboard(FORWARD, stepTime);
+    if (input.backward) m_camera.ProcessKeyboard(BACKWARD, stepTime);
+    if (input.left)     m_camera.ProcessKeyboard(LEFT, stepTime);
+    if (input.right)    m_camera.ProcessKeyboard(RIGHT, stepTime);
+    if (input.up)       m_camera.ProcessKeyboard(UP, stepTime);
+    if (input.down)     m_camera.ProcessKeyboard(DOWN, stepTime);
+
+    // Bodies - rotation in degrees per second, orbits are static for now
+    for (size_t i = 0; i < m_bodies.size(); ++i) {
+        BodyState& body = m_working.bodies[i];
+        body.rotation += m_bodies[i].rotationSpeed * stepTime;
+        if (body.rotation > 360.0f) {
+            body.rotation -= 360.0f;
+        }
+        body.position = glm::dvec3(m_bodies[i].position);
+    }
+    ClampToGround(groundRadii);
+
+    m_working.time += dt;
+    CaptureState(m_working);
+    Publish(command.pending);
+    ++m_stepCount;
+}
+
+void Simulation::ClampToGround(const std::vector<float>& groundRadii) {
+    // Push the camera back out radially. The radii lag a frame behind, but the
+    // terrain radius barely changes over one frame of travel
+    for (size_t i = 0; i < groundRadii.size() && i < m_working.bodies.size(); ++i) {
+        if (groundRadii[i] <= 0.0f) continue;
+        glm::dvec3 offset = m_camera.Position - m_working.bodies[i].position;
+        double distance = glm::length(offset);
+        double minimum = groundRadii[i] + MIN_ALTITUDE;
+        if (distance < minimum && distance > 0.0) {
+            m_camera.Position = m_working.bodies[i].position + offset * (minimum / distance);
+        }
+    }
+}
+
+void Simulation::Publish(bool resetPrevious) {
+    std::lock_guard<std::mutex> lock(m_stateMutex);
+    // A teleport must not be interpolated from the old position
+    m_previous = resetPrevious ? m_working : m_current;
+    m_current = m_working;
+    m_currentPublished = std::chrono::steady_clock::now();
+}
+
+void Simulation::CaptureState(SimulationState& state) const {
+    state.cameraPosition = m_camera.Position;
+    state.cameraYaw = m_camera.Yaw;
+    state.cameraPitch = m_camera.Pitch;
+    state.cameraZoom = m_camera.Zoom;
+}
+
+void Simulation::GetInterpolatedState(SimulationState& out) const {
+    std::lock_guard<std::mutex> lock(m_stateMutex);
+
+    // Render one step behind the simulation: alpha walks from the previous
+    // snapshot to the current one over the duration of a step
+    double elapsed = m_manual ? m_accumulator
+        : std::chrono::duration<double>(std::chrono::steady_clock::now() - m_currentPublished).count();
+    double alpha = std::clamp(elapsed / m_fixedStep, 0.0, 1.0);
+    float t = static_cast<float>(alpha);
+
+    out.time = glm::mix(m_previous.time, m_current.time, alpha);
+    out.cameraPosition = glm::mix(m_previous.cameraPosition, m_current.cameraPosition, alpha);
+    out.cameraYaw = glm::mix(m_previous.cameraYaw, m_current.cameraYaw, t);
+    out.cameraPitch = glm::mix(m_previous.cameraPitch, m_current.cameraPitch, t);
+    out.cameraZoom = glm::mix(m_previous.cameraZoom, m_current.cameraZoom, t);
+
+    out.bodies.resize(m_current.bodies.size());
+    for (size_t i = 0; i < m_current.bodies.size(); ++i) {
+        out.bodies[i].position = glm::mix(m_previous.bodies[i].position, m_current.bodies[i].position, alpha);
+        out.bodies[i].rotation = LerpAngle(m_previous.bodies[i].rotation, m_current.bodies[i].rotation, t);
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "entities/camera.h"
+#include "entities/planet.h"
+#include <glm/glm.hpp>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Input sampled by the render thread once per frame and consumed by the simulation
+struct InputState {
+    bool forward = false;
+    bool backward = false;
+    bool left = false;
+    bool right = false;
+    bool up = false;
+    bool down = false;
+    bool fast = false;          // Ctrl held - fast travel
+    float mouseDeltaX = 0.0f;   // accumulated since the last submit
+    float mouseDeltaY = 0.0f;
+    float scrollDelta = 0.0f;
+};
+
+struct BodyState {
+    glm::dvec3 position;
+    float rotation;             // degrees
+};
+
+// Everything the renderer needs from one simulation step
+struct SimulationState {
+    double time = 0.0;
+    glm::dvec3 cameraPosition = glm::dvec3(0.0);
+    float cameraYaw = YAW;
+    float cameraPitch = PITCH;
+    float cameraZoom = ZOOM;
+    std::vector<BodyState> bodies;
+};
+
+// Steps camera, rotation and orbit state at a fixed rate on its own thread
+// (or, for replays, on the caller's thread via Advance).
+// The two most recent steps are kept so the render thread can interpolate
+// between them, which keeps motion smooth regardless of frame rate and keeps
+// the simulation deterministic regardless of render cost.
+class Simulation {
+public:
+    Simulation(const Camera& camera, const std::vector<PlanetData>& bodies, double stepRate = 120.0);
+    ~Simulation();
+
+    void Start();
+    void Stop();
+    // Deterministic alternative to Start(): the caller advances simulated time
+    // itself. Whole fixed steps run on the calling thread and interpolation uses
+    // the leftover fraction of a step instead of the wall clock.
+    void Advance(double dt);
+
+    // Render thread -> simulation
+    void SubmitInput(const InputState& input);
+    void SetCamera(const glm::dvec3& position, float yaw, float pitch);
+    // Terrain radius under the camera for each body, from the render thread's
+    // LOD; steps keep the camera at least MIN_ALTITUDE above it. 0 = no ground.
+    void SubmitGroundRadii(const std::vector<float>& radii);
+    
+    static constexpr double MIN_ALTITUDE = 0.2;
+
+    // Simulation -> render thread, blended between the last two steps
+    void GetInterpolatedState(SimulationState& out) const;
+
+    double GetStepRate() const { return 1.0 / m_fixedStep; }
+    unsigned long long GetStepCount() const { return m_stepCount.load(); }
+
+private:
+    struct CameraCommand {
+        bool pending = false;
+        glm::dvec3 position;
+        float yaw;
+        float pitch;
+    };
+
+    double m_fixedStep;
+    std::vector<PlanetData> m_bodies;
+    Camera m_camera;
+    SimulationState m_working;
+
+    // input shared with the render thread
+    mutable std::mutex m_inputMutex;
+    InputState m_input;
+    CameraCommand m_cameraCommand;
+    std::vector<float> m_groundRadii;
+
+    // double-buffered snapshots
+    mutable std::mutex m_stateMutex;
+    SimulationState m_previous;
+    SimulationState m_current;
+    std::chrono::steady_clock::time_point m_currentPublished;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<unsigned long long> m_stepCount;
+    bool m_manual;
+    double m_accumulator;           // simulated time not yet stepped, manual mode
+
+    void Run();
+    void Step(double dt);
+    void ClampToGround(const std::vector<float>& groundRadii);
+    void Publish(bool resetPrevious);
+    void CaptureState(SimulationState& state) const;
+};
@@ -0,0 +1,101 @@
+#include "threadPool.h"
+#include "profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool& ThreadPool::Get() {
+    static ThreadPool pool;
+    return pool;
+}
+
+ThreadPool::ThreadPool(unsigned threadCount) : m_stopping(false) {
+    if (threadCount == 0) {
+        unsigned hardware = std::thread::hardware_concurrency();
+        threadCount = hardware > 1 ? hardware - 1 : 1;
+    }
+    for (unsigned i = 0; i < threadCount; ++i) {
+        m_workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_condition.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+    if (count == 0) return;
+    grain = std::max<size_t>(grain, 1);
+    size_t chunks = (count + grain - 1) / grain;
+    if (chunks == 1 || m_workers.empty()) {
+        body(0, count);
+        return;
+    }
+    
+    struct Batch {
+        std::atomic<size_t> next{ 0 };
+        std::atomic<size_t> done{ 0 };
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    auto batch = std::make_shared<Batch>();
+    
+    // Helpers that start after the last chunk was claimed return without touching body
+    auto run = [batch, chunks, grain, count, &body]() {
+        size_t chunk;
+        while ((chunk = batch->next.fetch_add(1)) < chunks) {
+            size_t begin = chunk * grain;
+            body(begin, std::min(begin + grain, count));
+            if (batch->done.fetch_add(1) + 1 == chunks) {
+                std::lock_guard<std::mutex> lock(batch->mutex);
+                batch->finished.notify_all();
+            }
+        }
+    };
+    
+    size_t helpers = std::min(m_workers.size(), chunks - 1);
+    for (size_t i = 0; i < helpers; ++i) {
+        Submit(run);
+    }
+    run();
+    
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->finished.wait(lock, [&batch, chunks] { return batch->done.load() == chunks; });
+}
+
+size_t ThreadPool::GetQueuedCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_tasks.size();
+}
+
+void ThreadPool::WorkerLoop() {
+    PROFILE_THREAD("Worker");
+    
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+            // Queued work still runs on shutdown, owners may be waiting on it
+            if (m_tasks.empty()) return;
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads draining a FIFO of tasks. One shared pool
+// serves all background CPU work so subsystems don't each spawn their own
+// threads. Tasks must not block on each other.
+class ThreadPool {
+public:
+    static ThreadPool& Get();
+
+    // 0 = one worker per hardware thread, minus the render thread
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void Submit(std::function<void()> task);
+    // Runs body over [0, count) in chunks of grain and returns when all are done.
+    // The caller works on chunks too, so this is safe to call from a task.
+    void ParallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& body);
+
+    unsigned GetWorkerCount() const { return static_cast<unsigned>(m_workers.size()); }
+    size_t GetQueuedCount() const;
+
+private:
+    std::vector<std::thread> m_workers;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<std::function<void()>> m_tasks;
+    bool m_stopping;
+
+    void WorkerLoop();
+};
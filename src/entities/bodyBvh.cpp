@@ -0,0 +1,352 @@
+#include "bodyBvh.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+
+namespace {
+
+const int MAX_STACK_DEPTH = 64;
+
+// 0 when the point is inside the box
+double DistanceToBox(const glm::dvec3& point, const glm::dvec3& min, const glm::dvec3& max) {
+    glm::dvec3 clamped = glm::clamp(point, min, max);
+    return glm::length(point - clamped);
+}
+
+double SurfaceArea(const glm::dvec3& min, const glm::dvec3& max) {
+    glm::dvec3 extent = max - min;
+    return 2.0 * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+// Whether the ray passes through the box within maxDistance
+bool RayBox(const glm::dvec3& origin, const glm::dvec3& inverseDirection, double maxDistance,
+            const glm::dvec3& min, const glm::dvec3& max) {
+    double tMin = 0.0;
+    double tMax = maxDistance;
+    for (int axis = 0; axis < 3; ++axis) {
+        double t0 = (min[axis] - origin[axis]) * inverseDirection[axis];
+        double t1 = (max[axis] - origin[axis]) * inverseDirection[axis];
+        if (t0 > t1) std::swap(t0, t1);
+        // NaN (origin on a slab of a parallel ray) leaves the interval unchanged
+        if (t0 > tMin) tMin = t0;
+        if (t1 < tMax) tMax = t1;
+        if (tMin > tMax) return false;
+    }
+    return true;
+}
+
+// Distance at which the ray enters the sphere, 0 when it starts inside
+bool RaySphere(const glm::dvec3& origin, const glm::dvec3& direction, const BodyBounds& body, double& entry) {
+    glm::dvec3 offset = origin - body.center;
+    double b = glm::dot(offset, direction);
+    double c = glm::dot(offset, offset) - body.radius * body.radius;
+    if (c <= 0.0) {
+        entry = 0.0;
+        return true;
+    }
+    double discriminant = b * b - c;
+    if (b > 0.0 || discriminant < 0.0) return false;
+    entry = -b - std::sqrt(discriminant);
+    return true;
+}
+
+} // namespace
+
+Frustum Frustum::FromMatrix(const glm::dmat4& m) {
+    // glm is column-major, row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+    glm::dvec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::dvec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::dvec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::dvec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum frustum;
+    frustum.planes[0] = row3 + row0;    // left
+    frustum.planes[1] = row3 - row0;    // right
+    frustum.planes[2] = row3 + row1;    // bottom
+    frustum.planes[3] = row3 - row1;    // top
+    frustum.planes[4] = row3 + row2;    // near
+    frustum.planes[5] = row3 - row2;    // far
+    for (glm::dvec4& plane : frustum.planes) {
+        double length = glm::length(glm::dvec3(plane));
+        if (length > 0.0) plane /= length;
+    }
+    return frustum;
+}
+
+bool Frustum::IntersectsSphere(const glm::dvec3& center, double radius) const {
+    for (const glm::dvec4& plane : planes) {
+        if (glm::dot(glm::dvec3(plane), center) + plane.w < -radius) return false;
+    }
+    return true;
+}
+
+bool Frustum::IntersectsBox(const glm::dvec3& min, const glm::dvec3& max) const {
+    for (const glm::dvec4& plane : planes) {
+        // The corner furthest along the plane normal
+        glm::dvec3 corner(plane.x >= 0.0 ? max.x : min.x,
+                          plane.y >= 0.0 ? max.y : min.y,
+                          plane.z >= 0.0 ? max.z : min.z);
+        if (glm::dot(glm::dvec3(plane), corner) + plane.w < 0.0) return false;
+    }
+    return true;
+}
+
+void BodyBvh::Build(const std::vector<BodyBounds>& bodies) {
+    m_bodies = bodies;
+    m_order.resize(bodies.size());
+    for (size_t i = 0; i < m_order.size(); ++i) {
+        m_order[i] = static_cast<int>(i);
+    }
+    m_nodes.clear();
+    m_depth = 0;
+    if (!m_bodies.empty()) {
+        // A binary tree with leaves of at least one body has under 2n nodes
+        m_nodes.reserve(2 * m_bodies.size());
+        m_nodes.push_back(Node());
+        BuildNode(0, 0, static_cast<int>(m_bodies.size()), 1);
+    }
+    m_cost = ComputeCost();
+    m_builtCost = m_cost;
+}
+
+void BodyBvh::BuildNode(int index, int begin, int end, int depth) {
+    m_depth = std::max(m_depth, depth);
+    if (end - begin <= MAX_LEAF_BODIES) {
+        m_nodes[index].first = begin;
+        m_nodes[index].count = end - begin;
+        FitLeaf(m_nodes[index]);
+        return;
+    }
+    
+    // Median split along the longest axis of the body centres
+    glm::dvec3 centerMin(std::numeric_limits<double>::max());
+    glm::dvec3 centerMax(-std::numeric_limits<double>::max());
+    for (int i = begin; i < end; ++i) {
+        centerMin = glm::min(centerMin, m_bodies[m_order[i]].center);
+        centerMax = glm::max(centerMax, m_bodies[m_order[i]].center);
+    }
+    glm::dvec3 extent = centerMax - centerMin;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    int middle = begin + (end - begin) / 2;
+    std::nth_element(m_order.begin() + begin, m_order.begin() + middle, m_order.begin() + end,
+                     [this, axis](int a, int b) { return m_bodies[a].center[axis] < m_bodies[b].center[axis]; });
+    
+    int left = static_cast<int>(m_nodes.size());
+    m_nodes.resize(m_nodes.size() + 2);
+    m_nodes[index].first = left;
+    m_nodes[index].count = 0;
+    BuildNode(left, begin, middle, depth + 1);
+    BuildNode(left + 1, middle, end, depth + 1);
+    FitInner(m_nodes[index]);
+}
+
+void BodyBvh::FitLeaf(Node& node) const {
+    node.min = glm::dvec3(std::numeric_limits<double>::max());
+    node.max = glm::dvec3(-std::numeric_limits<double>::max());
+    node.maxRadius = 0.0;
+    for (int i = node.first; i < node.first + node.count; ++i) {
+        const BodyBounds& body = m_bodies[m_order[i]];
+        node.min = glm::min(node.min, body.center - body.radius);
+        node.max = glm::max(node.max, body.center + body.radius);
+        node.maxRadius = std::max(node.maxRadius, body.radius);
+    }
+}
+
+void BodyBvh::FitInner(Node& node) const {
+    const Node& left = m_nodes[node.first];
+    const Node& right = m_nodes[node.first + 1];
+    node.min = glm::min(left.min, right.min);
+    node.max = glm::max(left.max, right.max);
+    node.maxRadius = std::max(left.maxRadius, right.maxRadius);
+}
+
+double BodyBvh::ComputeCost() const {
+    // Summed node area relative to the root, roughly the expected number of
+    // nodes a random query visits. Refitting keeps the root but lets the
+    // inner boxes overlap and grow, which shows up here.
+    if (m_nodes.empty()) return 0.0;
+    double rootArea = SurfaceArea(m_nodes[0].min, m_nodes[0].max);
+    if (rootArea <= 0.0) return 1.0;
+    double total = 0.0;
+    for (const Node& node : m_nodes) {
+        total += SurfaceArea(node.min, node.max);
+    }
+    return total / rootArea;
+}
+
+void BodyBvh::Refit(const std::vector<BodyBounds>& bodies) {
+    if (bodies.size() != m_bodies.size()) {
+        Build(bodies);
+        return;
+    }
+    m_bodies = bodies;
+    // Children always sit after their parent, so one backwards pass fits bottom-up
+    for (size_t i = m_nodes.size(); i-- > 0;) {
+        if (m_nodes[i].count > 0) {
+            FitLeaf(m_nodes[i]);
+        } else {
+            FitInner(m_nodes[i]);
+        }
+    }
+    m_cost = ComputeCost();
+    if (m_cost > m_builtCost * REBUILD_COST_RATIO) {
+        Build(bodies);
+        ++m_rebuilds;
+    }
+}
+
+int BodyBvh::FindNearest(const glm::dvec3& point, double* surfaceDistance) const {
+    std::vector<int> nearest;
+    FindNearest(point, 1, nearest);
+    if (nearest.empty()) return -1;
+    if (surfaceDistance) {
+        const BodyBounds& body = m_bodies[nearest[0]];
+        *surfaceDistance = glm::length(point - body.center) - body.radius;
+    }
+    return nearest[0];
+}
+
+void BodyBvh::FindNearest(const glm::dvec3& point, size_t count, std::vector<int>& out) const {
+    out.clear();
+    if (m_nodes.empty() || count == 0) return;
+    
+    // Best-first over nodes by their box distance. Distances inside a body
+    // clamp to 0 - the box distance is only a lower bound for points outside
+    // every sphere, and bodies do not overlap.
+    using Entry = std::pair<double, int>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+    std::priority_queue<Entry> best;    // the count nearest so far, worst on top
+    open.push(Entry(DistanceToBox(point, m_nodes[0].min, m_nodes[0].max), 0));
+    while (!open.empty()) {
+        Entry entry = open.top();
+        open.pop();
+        if (best.size() == count && entry.first > std::max(best.top().first, 0.0)) break;
+        
+        const Node& node = m_nodes[entry.second];
+        if (node.count == 0) {
+            for (int child = node.first; child <= node.first + 1; ++child) {
+                open.push(Entry(DistanceToBox(point, m_nodes[child].min, m_nodes[child].max), child));
+            }
+            continue;
+        }
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            const BodyBounds& body = m_bodies[m_order[i]];
+            double distance = glm::length(point - body.center) - body.radius;
+            if (best.size() < count) {
+                best.push(Entry(distance, m_order[i]));
+            } else if (distance < best.top().first) {
+                best.pop();
+                best.push(Entry(distance, m_order[i]));
+            }
+        }
+    }
+    
+    out.resize(best.size());
+    for (size_t i = out.size(); i-- > 0;) {
+        out[i] = best.top().second;
+        best.pop();
+    }
+}
+
+void BodyBvh::QuerySphere(const glm::dvec3& center, double radius, std::vector<int>& out) const {
+    out.clear();
+    if (m_nodes.empty()) return;
+    int stack[MAX_STACK_DEPTH];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = m_nodes[stack[--top]];
+        if (DistanceToBox(center, node.min, node.max) > radius) continue;
+        if (node.count == 0) {
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+            continue;
+        }
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            const BodyBounds& body = m_bodies[m_order[i]];
+            if (glm::length(center - body.center) <= radius + body.radius) {
+                out.push_back(m_order[i]);
+            }
+        }
+    }
+}
+
+void BodyBvh::QueryFrustum(const Frustum& frustum, std::vector<int>& out) const {
+    out.clear();
+    if (m_nodes.empty()) return;
+    int stack[MAX_STACK_DEPTH];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = m_nodes[stack[--top]];
+        if (!frustum.IntersectsBox(node.min, node.max)) continue;
+        if (node.count == 0) {
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+            continue;
+        }
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            const BodyBounds& body = m_bodies[m_order[i]];
+            if (frustum.IntersectsSphere(body.center, body.radius)) {
+                out.push_back(m_order[i]);
+            }
+        }
+    }
+}
+
+void BodyBvh::QueryRay(const glm::dvec3& origin, const glm::dvec3& direction, double maxDistance, std::vector<int>& out) const {
+    out.clear();
+    if (m_nodes.empty()) return;
+    glm::dvec3 inverseDirection = 1.0 / direction;
+    std::vector<std::pair<double, int>> hits;
+    int stack[MAX_STACK_DEPTH];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = m_nodes[stack[--top]];
+        if (!RayBox(origin, inverseDirection, maxDistance, node.min, node.max)) continue;
+        if (node.count == 0) {
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+            continue;
+        }
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            double entry;
+            if (RaySphere(origin, direction, m_bodies[m_order[i]], entry) && entry <= maxDistance) {
+                hits.push_back(std::make_pair(entry, m_order[i]));
+            }
+        }
+    }
+    std::sort(hits.begin(), hits.end());
+    out.reserve(hits.size());
+    for (const auto& hit : hits) {
+        out.push_back(hit.second);
+    }
+}
+
+void BodyBvh::QueryApparentSize(const glm::dvec3& point, double minRatio, std::vector<int>& out) const {
+    out.clear();
+    if (m_nodes.empty()) return;
+    int stack[MAX_STACK_DEPTH];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = m_nodes[stack[--top]];
+        // Every centre is inside the box, so no body in it can be nearer than the box
+        if (node.maxRadius < minRatio * DistanceToBox(point, node.min, node.max)) continue;
+        if (node.count == 0) {
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+            continue;
+        }
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            const BodyBounds& body = m_bodies[m_order[i]];
+            if (body.radius >= minRatio * glm::length(point - body.center)) {
+                out.push_back(m_order[i]);
+            }
+        }
+    }
+}
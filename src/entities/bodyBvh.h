@@ -0,0 +1,84 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A body as the index sees it: its bounding sphere in world space
+struct BodyBounds {
+    glm::dvec3 center = glm::dvec3(0.0);
+    double radius = 0.0;
+};
+
+// Six inward-facing planes (a, b, c, d) with a*x + b*y + c*z + d >= 0 inside
+struct Frustum {
+    glm::dvec4 planes[6];
+
+    // Gribb/Hartmann extraction from a clip-from-world matrix
+    static Frustum FromMatrix(const glm::dmat4& viewProjection);
+    bool IntersectsSphere(const glm::dvec3& center, double radius) const;
+    bool IntersectsBox(const glm::dvec3& min, const glm::dvec3& max) const;
+};
+
+// Double-precision bounding volume hierarchy over body spheres. Built top-down
+// with median splits, then refitted in place as orbits move the bodies; when
+// refitting has let the boxes grow too far past the freshly built tree's, the
+// next Refit rebuilds instead. Queries return indices into the bodies array
+// passed to Build. Not thread-safe - owned and queried by the render thread.
+class BodyBvh {
+public:
+    static constexpr int MAX_LEAF_BODIES = 4;
+    // Rebuild once the summed node surface area passes this multiple of the built tree's
+    static constexpr double REBUILD_COST_RATIO = 2.0;
+
+    void Build(const std::vector<BodyBounds>& bodies);
+    // Same bodies in the same order, at new positions. Falls back to Build when the count changed.
+    void Refit(const std::vector<BodyBounds>& bodies);
+
+    // Body whose surface is closest to point, -1 when empty. surfaceDistance
+    // is negative inside the body.
+    int FindNearest(const glm::dvec3& point, double* surfaceDistance = nullptr) const;
+    // Up to count bodies ordered by surface distance, nearest first
+    void FindNearest(const glm::dvec3& point, size_t count, std::vector<int>& out) const;
+    // Bodies whose sphere overlaps the query sphere
+    void QuerySphere(const glm::dvec3& center, double radius, std::vector<int>& out) const;
+    // Bodies whose sphere is at least partly inside the frustum
+    void QueryFrustum(const Frustum& frustum, std::vector<int>& out) const;
+    // Bodies whose sphere the ray enters within maxDistance, ordered by entry distance.
+    // direction must be normalised.
+    void QueryRay(const glm::dvec3& origin, const glm::dvec3& direction, double maxDistance, std::vector<int>& out) const;
+    // Bodies with radius / distance-to-centre >= minRatio, i.e. big enough on screen to need LOD
+    void QueryApparentSize(const glm::dvec3& point, double minRatio, std::vector<int>& out) const;
+
+    size_t GetBodyCount() const { return m_bodies.size(); }
+    size_t GetNodeCount() const { return m_nodes.size(); }
+    int GetDepth() const { return m_depth; }
+    uint64_t GetRebuildCount() const { return m_rebuilds; }
+    // Current summed node area over the built tree's, REBUILD_COST_RATIO triggers a rebuild
+    double GetCostRatio() const { return m_builtCost > 0.0 ? m_cost / m_builtCost : 1.0; }
+
+private:
+    // Leaves hold m_order[first, first + count), inner nodes (count == 0)
+    // have their children at first and first + 1
+    struct Node {
+        glm::dvec3 min;
+        glm::dvec3 max;
+        double maxRadius;
+        int first;
+        int count;
+    };
+
+    std::vector<BodyBounds> m_bodies;
+    std::vector<int> m_order;
+    std::vector<Node> m_nodes;
+    int m_depth = 0;
+    double m_builtCost = 0.0;
+    double m_cost = 0.0;
+    uint64_t m_rebuilds = 0;
+
+    void BuildNode(int index, int begin, int end, int depth);
+    void FitLeaf(Node& node) const;
+    void FitInner(Node& node) const;
+    double ComputeCost() const;
+};
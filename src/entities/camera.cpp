@@ -76,6 +76,46 @@ void Camera::UpdateCameraVectors()
     updateCameraVectors();
 }
 
+void Camera::TrackMotion(double time)
+{
+    // ignore repeated timestamps, the simulation may not have stepped since last frame
+    if (m_motionCount > 0)
+    {
+        int newest = (m_motionHead + MOTION_SAMPLES - 1) % MOTION_SAMPLES;
+        if (time <= m_motionTimes[newest])
+            return;
+    }
+    m_motionPositions[m_motionHead] = Position;
+    m_motionTimes[m_motionHead] = time;
+    m_motionHead = (m_motionHead + 1) % MOTION_SAMPLES;
+    if (m_motionCount < MOTION_SAMPLES)
+        m_motionCount++;
+}
+
+void Camera::ResetMotion()
+{
+    m_motionCount = 0;
+    m_motionHead = 0;
+}
+
+glm::dvec3 Camera::GetVelocity() const
+{
+    if (m_motionCount < 2)
+        return glm::dvec3(0.0);
+    // oldest to newest over the window smooths out per-frame jitter
+    int newest = (m_motionHead + MOTION_SAMPLES - 1) % MOTION_SAMPLES;
+    int oldest = (m_motionHead + MOTION_SAMPLES - m_motionCount) % MOTION_SAMPLES;
+    double elapsed = m_motionTimes[newest] - m_motionTimes[oldest];
+    if (elapsed <= 0.0)
+        return glm::dvec3(0.0);
+    return (m_motionPositions[newest] - m_motionPositions[oldest]) / elapsed;
+}
+
+glm::dvec3 Camera::PredictPosition(double seconds) const
+{
+    return Position + GetVelocity() * seconds;
+}
+
 void Camera::updateCameraVectors()
 {
     // calculate the new Front vector
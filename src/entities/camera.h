@@ -57,7 +57,22 @@ public:
     
     // Updates camera vectors when angles are changed manually - made public for ImGui controls
     void UpdateCameraVectors();
+
+    // records the current position at the given time, call once per frame after the camera moved
+    void TrackMotion(double time);
+    // forgets the recorded motion, for teleports that shouldn't read as velocity
+    void ResetMotion();
+    // average velocity over the last MOTION_SAMPLES tracked frames, in units per second
+    glm::dvec3 GetVelocity() const;
+    // position the camera reaches after the given time if it keeps its current velocity
+    glm::dvec3 PredictPosition(double seconds) const;
 private:
+    static const int MOTION_SAMPLES = 8;
+    glm::dvec3 m_motionPositions[MOTION_SAMPLES];
+    double m_motionTimes[MOTION_SAMPLES];
+    int m_motionCount = 0;
+    int m_motionHead = 0;
+
     // calculates the front vector from the Camera's (updated) Euler Angles
     void updateCameraVectors();
 };
\ No newline at end of file
@@ -1,25 +1,94 @@
 #include "cubesphere.h"
+#include "patchPrefetcher.h"
+#include "core/profiler.h"
+#include "core/threadPool.h"
+#include "graphics/occlusionCuller.h"
+#include "terrain/cubeMapping.h"
+#include "terrain/heightAtlas.h"
+#include "terrain/heightSource.h"
+#include "terrain/normalAtlas.h"
+#include "terrain/tileCache.h"
+#include "terrain/tileKey.h"
 #include <epoxy/gl.h>
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 
-QuadNode::QuadNode(glm::vec2 topLeft, glm::vec2 bottomRight, int level, CubeFace face)
-    : m_topLeft(topLeft), m_bottomRight(bottomRight), m_level(level), m_face(face), m_subdivided(false) {
+namespace {
+
+// Distances along a unit ray inside a sphere, clipped to the part ahead of the origin
+bool RaySphereSpan(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& center, float radius,
+                   float& enter, float& exit) {
+    glm::vec3 toCenter = center - origin;
+    float along = glm::dot(toCenter, direction);
+    float missSquared = glm::dot(toCenter, toCenter) - along * along;
+    if (missSquared > radius * radius) return false;
+    float half = std::sqrt(radius * radius - missSquared);
+    if (along + half < 0.0f) return false;
+    enter = std::max(along - half, 0.0f);
+    exit = along + half;
+    return true;
 }
 
-QuadNode::~QuadNode() = default;
+// Per-frame vectors would otherwise keep their peak capacity for good
+template <typename T>
+void TrimCapacity(std::vector<T>& values) {
+    if (values.capacity() > 2 * values.size() + 64) {
+        values.shrink_to_fit();
+    }
+}
+
+}
+
+QuadTreeStats& QuadTreeStats::operator+=(const QuadTreeStats& other) {
+    nodes += other.nodes;
+    leaves += other.leaves;
+    patchBytes += other.patchBytes;
+    vertices += other.vertices;
+    triangles += other.triangles;
+    gpuBytes += other.gpuBytes;
+    return *this;
+}
+
+QuadNode::QuadNode(glm::vec2 topLeft, glm::vec2 bottomRight, int level, CubeFace face, QuadTreeContext* context)
+    : m_topLeft(topLeft), m_bottomRight(bottomRight), m_level(level), m_face(face), m_subdivided(false), m_context(context), m_patchExact(true), m_patchBytes(0) {
+    glm::vec2 center = (m_topLeft + m_bottomRight) * 0.5f;
+    m_axis = CubeToSphere(GetCubePosition(center.x, center.y));
+    m_coneCos = 1.0f;
+    const glm::vec2 corners[4] = { m_topLeft, glm::vec2(m_bottomRight.x, m_topLeft.y), glm::vec2(m_topLeft.x, m_bottomRight.y), m_bottomRight };
+    for (const glm::vec2& corner : corners) {
+        m_coneCos = std::min(m_coneCos, glm::dot(m_axis, CubeToSphere(GetCubePosition(corner.x, corner.y))));
+    }
+    
+    if (QuadTreeStats* stats = m_context ? m_context->stats : nullptr) {
+        stats->nodes++;
+        stats->leaves++;
+    }
+}
+
+QuadNode::~QuadNode() {
+    // Children are members, they take themselves off the counters as they go
+    if (QuadTreeStats* stats = m_context ? m_context->stats : nullptr) {
+        stats->nodes--;
+        if (!m_subdivided) stats->leaves--;
+        stats->patchBytes -= m_patchBytes;
+    }
+}
 
 void QuadNode::Subdivide() {
     if (m_subdivided) return;
     
     glm::vec2 center = (m_topLeft + m_bottomRight) * 0.5f;
     
-    m_children[0] = std::make_unique<QuadNode>(m_topLeft, center, m_level + 1, m_face);
-    m_children[1] = std::make_unique<QuadNode>(glm::vec2(center.x, m_topLeft.y), glm::vec2(m_bottomRight.x, center.y), m_level + 1, m_face);
-    m_children[2] = std::make_unique<QuadNode>(glm::vec2(m_topLeft.x, center.y), glm::vec2(center.x, m_bottomRight.y), m_level + 1, m_face);
-    m_children[3] = std::make_unique<QuadNode>(center, m_bottomRight, m_level + 1, m_face);
+    m_children[0] = std::make_unique<QuadNode>(m_topLeft, center, m_level + 1, m_face, m_context);
+    m_children[1] = std::make_unique<QuadNode>(glm::vec2(center.x, m_topLeft.y), glm::vec2(m_bottomRight.x, center.y), m_level + 1, m_face, m_context);
+    m_children[2] = std::make_unique<QuadNode>(glm::vec2(m_topLeft.x, center.y), glm::vec2(center.x, m_bottomRight.y), m_level + 1, m_face, m_context);
+    m_children[3] = std::make_unique<QuadNode>(center, m_bottomRight, m_level + 1, m_face, m_context);
     
     m_subdivided = true;
+    if (m_context && m_context->stats) {
+        m_context->stats->leaves--;
+    }
 }
 
 void QuadNode::Update(const glm::vec3& cameraPos, float radius, int maxLevel) {
@@ -32,8 +101,11 @@ void QuadNode::Update(const glm::vec3& cameraPos, float radius, int maxLevel) {
                 child->Update(cameraPos, radius, maxLevel);
             }
         }
-    } else {
+    } else if (m_subdivided) {
         m_subdivided = false;
+        if (m_context && m_context->stats) {
+            m_context->stats->leaves++;
+        }
         for (auto& child : m_children) {
             child.reset();
         }
@@ -54,39 +126,69 @@ bool QuadNode::ShouldSubdivide(const glm::vec3& cameraPos, float radius, int max
 }
 
 glm::vec3 QuadNode::GetCubePosition(float u, float v) const {
-    switch (m_face) {
-        case CubeFace::FRONT:  return glm::vec3(u * 2.0f - 1.0f, v * 2.0f - 1.0f, 1.0f);
-        case CubeFace::BACK:   return glm::vec3(1.0f - u * 2.0f, v * 2.0f - 1.0f, -1.0f);
-        case CubeFace::LEFT:   return glm::vec3(-1.0f, v * 2.0f - 1.0f, 1.0f - u * 2.0f);
-        case CubeFace::RIGHT:  return glm::vec3(1.0f, v * 2.0f - 1.0f, u * 2.0f - 1.0f);
-        case CubeFace::TOP:    return glm::vec3(u * 2.0f - 1.0f, 1.0f, 1.0f - v * 2.0f);
-        case CubeFace::BOTTOM: return glm::vec3(u * 2.0f - 1.0f, -1.0f, v * 2.0f - 1.0f);
-        default: return glm::vec3(0.0f);
-    }
+    return CubeFacePosition(static_cast<int>(m_face), u, v);
 }
 
 glm::vec3 QuadNode::CubeToSphere(const glm::vec3& cubePoint) const {
     return glm::normalize(cubePoint);
 }
 
-void QuadNode::GenerateMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, float radius) {
-    if (m_subdivided) {
-        for (auto& child : m_children) {
-            if (child) {
-                child->GenerateMesh(vertices, indices, radius);
-            }
-        }
-    } else {
-        GenerateQuadMesh(vertices, indices, radius);
-    }
+uint32_t QuadNode::GetTileX() const {
+    return static_cast<uint32_t>(std::lround(m_topLeft.x * static_cast<float>(1u << m_level)));
 }
 
-void QuadNode::GenerateQuadMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, float radius) {
-    unsigned int baseIndex = static_cast<unsigned int>(vertices.size());
-    
+uint32_t QuadNode::GetTileY() const {
+    return static_cast<uint32_t>(std::lround(m_topLeft.y * static_cast<float>(1u << m_level)));
+}
+
+uint64_t QuadNode::GetTileKey() const {
+    TileKey key = { m_context ? m_context->planetId : 0u, static_cast<uint32_t>(m_face),
+                    static_cast<uint32_t>(m_level), GetTileX(), GetTileY() };
+    return key.Pack();
+}
+
+static_assert(CubeSphere::MAX_PATCH_VERTICES >= 81, "level 0 patches are (RESOLUTION + 1)^2 vertices");
+
+int QuadNode::GetResolution() const {
     int resolution = RESOLUTION >> m_level;
     if (resolution < 2) resolution = 2;
+    return resolution;
+}
+
+int QuadNode::GetHeightLevel() const {
+    return GetHeightLevel(GetResolution());
+}
+
+int QuadNode::GetHeightLevel(int cells) const {
+    HeightSource* heights = m_context ? m_context->heights : nullptr;
+    if (!heights) return 0;
     
+    // A height tile spans tileSize cells, this node spans cells at the same extent
+    int spacing = 0;
+    while ((cells << spacing) < heights->GetTileSize()) {
+        spacing++;
+    }
+    return std::clamp(m_level - spacing, 0, heights->GetLevelCount() - 1);
+}
+
+void QuadNode::BuildPatch(float radius) {
+    int resolution = GetResolution();
+    size_t vertexCount = static_cast<size_t>(resolution + 1) * (resolution + 1);
+    m_patch.resize(vertexCount);
+    
+    // Persistent store first, straight out of the mapped file
+    TileCache* cache = m_context ? m_context->tileCache : nullptr;
+    bool cacheable = cache && m_level >= m_context->cacheMinLevel;
+    if (cacheable) {
+        size_t bytes = cache->Read(GetTileKey(), m_patch.data(), vertexCount * sizeof(Vertex));
+        if (bytes == vertexCount * sizeof(Vertex)) {
+            m_patchExact = true;
+            return;
+        }
+    }
+    
+    HeightSource* heights = m_context ? m_context->heights : nullptr;
+    int heightLevel = GetHeightLevel();
     glm::vec2 size = m_bottomRight - m_topLeft;
     
     for (int j = 0; j <= resolution; ++j) {
@@ -97,12 +199,96 @@ void QuadNode::GenerateQuadMesh(std::vector<Vertex>& vertices, std::vector<unsig
             glm::vec3 cubePos = GetCubePosition(u, v);
             glm::vec3 spherePos = CubeToSphere(cubePos);
             
-            Vertex vertex;
-            vertex.position = spherePos * radius;
+            float surfaceRadius = radius;
+            if (heights) {
+                surfaceRadius += heights->SampleHeight(static_cast<int>(m_face), u, v, heightLevel) * m_context->heightScale;
+            }
+            
+            Vertex& vertex = m_patch[j * (resolution + 1) + i];
+            vertex.position = spherePos * surfaceRadius;
             vertex.normal = spherePos;
             vertex.texCoord = glm::vec2(u, v);
+        }
+    }
+    
+    m_patchExact = true;
+    if (heights) {
+        ComputeGridNormals(resolution);
+        glm::vec2 center = (m_topLeft + m_bottomRight) * 0.5f;
+        m_patchExact = heights->ResidentLevel(static_cast<int>(m_face), center.x, center.y, heightLevel) >= heightLevel;
+    }
+    
+    // Only exact patches are worth persisting, fallbacks get rebuilt
+    if (cacheable && m_patchExact) {
+        cache->Write(GetTileKey(), m_patch.data(), vertexCount * sizeof(Vertex));
+    }
+}
+
+void QuadNode::ComputeGridNormals(int resolution) {
+    int stride = resolution + 1;
+    for (int j = 0; j <= resolution; ++j) {
+        for (int i = 0; i <= resolution; ++i) {
+            // Central differences inside the patch, one-sided on its border
+            const glm::vec3& left = m_patch[j * stride + std::max(i - 1, 0)].position;
+            const glm::vec3& right = m_patch[j * stride + std::min(i + 1, resolution)].position;
+            const glm::vec3& down = m_patch[std::max(j - 1, 0) * stride + i].position;
+            const glm::vec3& up = m_patch[std::min(j + 1, resolution) * stride + i].position;
             
-            vertices.push_back(vertex);
+            Vertex& vertex = m_patch[j * stride + i];
+            glm::vec3 n = glm::cross(right - left, up - down);
+            float length = glm::length(n);
+            if (length > 0.0f) {
+                n /= length;
+                // Face parameterisations differ in handedness, keep normals pointing out
+                vertex.normal = glm::dot(n, vertex.position) < 0.0f ? -n : n;
+            }
+        }
+    }
+}
+
+void QuadNode::AccountPatch() {
+    size_t bytes = m_patch.capacity() * sizeof(Vertex);
+    if (bytes != m_patchBytes && m_context && m_context->stats) {
+        m_context->stats->patchBytes += bytes;
+        m_context->stats->patchBytes -= m_patchBytes;
+        m_patchBytes = bytes;
+    }
+}
+
+size_t QuadNode::GetMeshVertexCount() const {
+    size_t stride = static_cast<size_t>(GetResolution()) + 1;
+    return stride * stride;
+}
+
+size_t QuadNode::GetMeshIndexCount() const {
+    size_t resolution = static_cast<size_t>(GetResolution());
+    return resolution * resolution * 6;
+}
+
+void QuadNode::PreparePatch(float radius) {
+    if (m_patch.empty()) {
+        PatchPrefetcher* prefetcher = m_context ? m_context->prefetcher : nullptr;
+        if (!prefetcher || !prefetcher->Take(GetTileKey(), m_patch, m_patchExact)) {
+            BuildPatch(radius);
+        }
+    } else if (!m_patchExact) {
+        // Rebuild once the streamer has delivered the heights this patch wanted
+        glm::vec2 center = (m_topLeft + m_bottomRight) * 0.5f;
+        int heightLevel = GetHeightLevel();
+        if (m_context->heights->ResidentLevel(static_cast<int>(m_face), center.x, center.y, heightLevel) >= heightLevel) {
+            BuildPatch(radius);
+        }
+    }
+}
+
+void QuadNode::WriteMesh(Vertex* vertices, unsigned int* indices, unsigned int baseIndex, float normalLayer) const {
+    int resolution = GetResolution();
+    std::copy(m_patch.begin(), m_patch.end(), vertices);
+    // Where each vertex sits in this frame's normal map, the patch itself doesn't know
+    for (int j = 0; j <= resolution; ++j) {
+        for (int i = 0; i <= resolution; ++i) {
+            vertices[j * (resolution + 1) + i].detailCoord = glm::vec3(static_cast<float>(i) / resolution,
+                                                                        static_cast<float>(j) / resolution, normalLayer);
         }
     }
     
@@ -113,29 +299,74 @@ void QuadNode::GenerateQuadMesh(std::vector<Vertex>& vertices, std::vector<unsig
             unsigned int bottomLeft = topLeft + (resolution + 1);
             unsigned int bottomRight = bottomLeft + 1;
             
-            indices.push_back(topLeft);
-            indices.push_back(bottomLeft);
-            indices.push_back(topRight);
+            *indices++ = topLeft;
+            *indices++ = bottomLeft;
+            *indices++ = topRight;
             
-            indices.push_back(topRight);
-            indices.push_back(bottomLeft);
-            indices.push_back(bottomRight);
+            *indices++ = topRight;
+            *indices++ = bottomLeft;
+            *indices++ = bottomRight;
         }
     }
 }
 
-CubeSphere::CubeSphere(float radius, int maxLevel) : m_radius(radius), m_maxLevel(maxLevel), m_VAO(0), m_VBO(0), m_EBO(0) {
+CubeSphere::CubeSphere(float radius, int maxLevel)
+    : m_radius(radius), m_maxLevel(maxLevel), m_VAO(0), m_VBO(0), m_EBO(0), m_indexCount(0),
+      m_backend(TerrainBackend::MESH), m_patchVAO(0), m_patchVBO(0), m_boundsBuffer(0), m_commandBuffer(0), m_drawBuffer(0),
+      m_commandCount(0), m_commandsDirty(true), m_culled(false), m_synchronous(false),
+      m_bufferMemory("Planet meshes", MemoryKind::GPU), m_treeMemory("Quadtree nodes and patches", MemoryKind::CPU),
+      m_stagingMemory("Mesh staging", MemoryKind::CPU) {
+    m_prefetcher = std::make_unique<PatchPrefetcher>();
+    m_context.prefetcher = m_prefetcher.get();
+    m_context.stats = &m_stats;
     for (int i = 0; i < 6; ++i) {
-        m_faces[i] = std::make_unique<QuadNode>(glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 1.0f), 0, static_cast<CubeFace>(i));
+        m_faces[i] = std::make_unique<QuadNode>(glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 1.0f), 0, static_cast<CubeFace>(i), &m_context);
     }
     
     InitializeGL();
 }
 
 CubeSphere::~CubeSphere() {
+    // Stop background builds before the nodes and context they reference go away
+    m_prefetcher.reset();
+    m_normalAtlas.reset();
     if (m_VAO) glDeleteVertexArrays(1, &m_VAO);
     if (m_VBO) glDeleteBuffers(1, &m_VBO);
     if (m_EBO) glDeleteBuffers(1, &m_EBO);
+    if (m_patchVAO) glDeleteVertexArrays(1, &m_patchVAO);
+    if (m_patchVBO) glDeleteBuffers(1, &m_patchVBO);
+    if (m_boundsBuffer) glDeleteBuffers(1, &m_boundsBuffer);
+    if (m_commandBuffer) glDeleteBuffers(1, &m_commandBuffer);
+    if (m_drawBuffer) glDeleteBuffers(1, &m_drawBuffer);
+}
+
+void CubeSphere::SetHeightSource(HeightSource* heights, float heightScale) {
+    m_context.heights = heights;
+    m_context.heightScale = heightScale;
+    m_heightAtlas.reset();
+    m_normalAtlas.reset();
+    if (heights && m_backend == TerrainBackend::TESSELLATION) {
+        m_heightAtlas = std::make_unique<HeightAtlas>(heights, heightScale);
+    }
+    if (heights) {
+        m_normalAtlas = std::make_unique<NormalAtlas>(heights, m_radius, heightScale);
+        m_normalAtlas->SetSynchronous(m_synchronous);
+    }
+    // Displaced patches are expensive at every level, cache them all
+    m_context.cacheMinLevel = heights ? 0 : 2;
+}
+
+void CubeSphere::SetSynchronous(bool synchronous) {
+    m_synchronous = synchronous;
+    m_prefetcher->SetSynchronous(synchronous);
+    if (m_normalAtlas) {
+        m_normalAtlas->SetSynchronous(synchronous);
+    }
+}
+
+void CubeSphere::SetTileCache(TileCache* cache, uint32_t planetId) {
+    m_context.tileCache = cache;
+    m_context.planetId = planetId;
 }
 
 void CubeSphere::InitializeGL() {
@@ -157,68 +388,860 @@ void CubeSphere::InitializeGL() {
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
     glEnableVertexAttribArray(2);
     
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, detailCoord));
+    glEnableVertexAttribArray(3);
+    
     glBindVertexArray(0);
 }
 
+bool CubeSphere::IsTessellationSupported() {
+    GLint maxLevel = 0;
+    glGetIntegerv(GL_MAX_TESS_GEN_LEVEL, &maxLevel);
+    return maxLevel >= 64;
+}
+
+void CubeSphere::SetBackend(TerrainBackend backend) {
+    if (backend == m_backend) return;
+    m_backend = backend;
+    
+    // The other backend's buffer keeps its last size otherwise
+    if (m_backend == TerrainBackend::TESSELLATION) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, m_EBO);
+        glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        m_indexCount = 0;
+        m_vertexArena = std::vector<Vertex>();
+        m_indexArena = std::vector<unsigned int>();
+        if (!m_patchVAO) {
+            glGenVertexArrays(1, &m_patchVAO);
+            glGenBuffers(1, &m_patchVBO);
+            glBindVertexArray(m_patchVAO);
+            glBindBuffer(GL_ARRAY_BUFFER, m_patchVBO);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TessControlPoint), (void*)offsetof(TessControlPoint, cubePosition));
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(TessControlPoint), (void*)offsetof(TessControlPoint, faceUV));
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(TessControlPoint), (void*)offsetof(TessControlPoint, heightLayer));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(TessControlPoint), (void*)offsetof(TessControlPoint, normalLayer));
+            glEnableVertexAttribArray(3);
+            glBindVertexArray(0);
+        }
+        if (m_context.heights && !m_heightAtlas) {
+            m_heightAtlas = std::make_unique<HeightAtlas>(m_context.heights, m_context.heightScale);
+        }
+    } else {
+        // Shallower nodes keep their patches, the deeper ones are rebuilt as the tree refines
+        m_heightAtlas.reset();
+        m_controlPoints.clear();
+        m_controlPoints.shrink_to_fit();
+        if (m_patchVBO) {
+            glBindBuffer(GL_ARRAY_BUFFER, m_patchVBO);
+            glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+    }
+    m_stats.vertices = 0;
+    m_stats.triangles = 0;
+    m_stats.gpuBytes = 0;
+    m_commandsDirty = true;
+    m_culled = false;
+    AccountMemory();
+}
+
+int CubeSphere::GetActiveMaxLevel() const {
+    if (m_backend == TerrainBackend::TESSELLATION) {
+        return std::max(m_maxLevel - TESS_LEVEL_REDUCTION, 0);
+    }
+    return m_maxLevel;
+}
+
 void CubeSphere::Update(const glm::vec3& cameraPos) {
+    Update(cameraPos, cameraPos);
+}
+
+void CubeSphere::Update(const glm::vec3& cameraPos, const glm::vec3& predictedCameraPos) {
+    // Tessellated leaves never build CPU patches, so there is nothing to prefetch
+    bool tessellated = m_backend == TerrainBackend::TESSELLATION;
+    PrefetchPath(cameraPos, tessellated ? cameraPos : predictedCameraPos);
+    
+    int maxLevel = GetActiveMaxLevel();
+    {
+        PROFILE_ZONE("Quadtree Update");
+        for (auto& face : m_faces) {
+            if (face) {
+                face->Update(cameraPos, m_radius, maxLevel);
+            }
+        }
+    }
+    
+    PrefetchHeights();
+    if (tessellated) {
+        UpdatePatches();
+    } else {
+        UpdateMesh();
+    }
+    m_commandsDirty = true;
+    AccountMemory();
+}
+
+void CubeSphere::AccountMemory() {
+    TrimCapacity(m_leaves);
+    TrimCapacity(m_vertexOffsets);
+    TrimCapacity(m_indexOffsets);
+    TrimCapacity(m_normalLayers);
+    TrimCapacity(m_controlPoints);
+    TrimCapacity(m_leafBounds);
+    TrimCapacity(m_commands);
+    
+    // Bounds, commands, and the draw list with its count
+    size_t cullBytes = m_commandCount * (sizeof(glm::vec4) + 2 * (m_backend == TerrainBackend::TESSELLATION ? 4 : 5) * sizeof(GLuint)) +
+                       (m_commandCount ? sizeof(GLuint) : 0);
+    m_bufferMemory.Set(m_stats.gpuBytes + cullBytes);
+    m_treeMemory.Set(m_stats.patchBytes + static_cast<size_t>(m_stats.nodes) * sizeof(QuadNode));
+    m_stagingMemory.Set(m_vertexArena.capacity() * sizeof(Vertex) + m_indexArena.capacity() * sizeof(unsigned int) +
+                        m_controlPoints.capacity() * sizeof(TessControlPoint) + m_leaves.capacity() * sizeof(QuadNode*) +
+                        (m_vertexOffsets.capacity() + m_indexOffsets.capacity()) * sizeof(size_t) + m_normalLayers.capacity() * sizeof(float) +
+                        m_leafBounds.capacity() * sizeof(glm::vec4) + m_commands.capacity() * sizeof(GLuint));
+}
+
+void CubeSphere::PrefetchHeights() {
+    if (!m_context.heights) return;
+    
+    PROFILE_ZONE("Height Prefetch");
+    m_leaves.clear();
     for (auto& face : m_faces) {
         if (face) {
-            face->Update(cameraPos, m_radius, m_maxLevel);
+            face->CollectLeaves(m_leaves);
+        }
+    }
+    
+    // Each leaf needs its own height tile now, and the next level down as soon as it splits.
+    // Tessellated leaves sample at the atlas resolution rather than their vertex grid's.
+    // Normal maps are baked from finer heights still.
+    bool tessellated = m_backend == TerrainBackend::TESSELLATION;
+    for (QuadNode* leaf : m_leaves) {
+        int face = static_cast<int>(leaf->GetFace());
+        int level = tessellated ? leaf->GetHeightLevel(HeightAtlas::TILE_SIZE - 1) : leaf->GetHeightLevel();
+        int shift = leaf->GetLevel() - level;
+        uint32_t x = leaf->GetTileX() >> shift;
+        uint32_t y = leaf->GetTileY() >> shift;
+        m_context.heights->Prefetch(face, level, x, y);
+        if (level + 1 < m_context.heights->GetLevelCount() && shift > 0) {
+            uint32_t childX = leaf->GetTileX() >> (shift - 1);
+            uint32_t childY = leaf->GetTileY() >> (shift - 1);
+            m_context.heights->Prefetch(face, level + 1, childX, childY);
+        }
+        if (m_normalAtlas) {
+            int detailLevel = leaf->GetHeightLevel(NormalAtlas::TILE_SIZE - 1);
+            if (detailLevel > level) {
+                int detailShift = leaf->GetLevel() - detailLevel;
+                m_context.heights->Prefetch(face, detailLevel, leaf->GetTileX() >> detailShift, leaf->GetTileY() >> detailShift);
+            }
+        }
+    }
+}
+
+void CubeSphere::PrefetchPath(const glm::vec3& cameraPos, const glm::vec3& predictedCameraPos) {
+    // Below a patch worth of travel the reactive update keeps up on its own
+    float travel = glm::length(predictedCameraPos - cameraPos);
+    bool active = travel > m_radius * 0.01f;
+    m_prefetcher->BeginFrame(active);
+    if (!active) return;
+    
+    PROFILE_ZONE("LOD Prediction");
+    // Nearest points first, so the per-frame budget goes to what's needed soonest
+    for (int i = 1; i <= PREDICTION_SAMPLES; ++i) {
+        float t = static_cast<float>(i) / PREDICTION_SAMPLES;
+        glm::vec3 position = cameraPos + (predictedCameraPos - cameraPos) * t;
+        for (auto& face : m_faces) {
+            if (face) {
+                face->PrefetchLeaves(position, m_radius, GetActiveMaxLevel());
+            }
+        }
+    }
+}
+
+void CubeSphere::GetSurfaceShell(float& shellMin, float& shellMax) const {
+    ComputeSurfaceShell(m_radius, m_context.heights, m_context.heightScale, shellMin, shellMax);
+}
+
+void CubeSphere::ComputeSurfaceShell(float radius, const HeightSource* heights, float heightScale,
+                                     float& shellMin, float& shellMax) {
+    shellMin = radius;
+    shellMax = radius;
+    if (heights) {
+        shellMin += std::min(heights->GetMinHeight() * heightScale, 0.0f);
+        shellMax += std::max(heights->GetMaxHeight() * heightScale, 0.0f);
+    }
+    // Patches are flat between vertices, chords dip below the sphere
+    shellMin *= 0.99f;
+    shellMax *= 1.001f;
+}
+
+bool CubeSphere::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const {
+    hit = RayHit();
+    hit.distance = maxDistance;
+    float length = glm::length(direction);
+    if (length <= 0.0f) return false;
+    glm::vec3 unit = direction / length;
+    
+    float shellMin, shellMax;
+    GetSurfaceShell(shellMin, shellMax);
+    
+    std::array<std::pair<float, int>, 6> order;
+    int count = 0;
+    for (int i = 0; i < 6; ++i) {
+        float enter = m_faces[i]->IntersectBounds(origin, unit, shellMin, shellMax);
+        if (enter >= 0.0f && enter < maxDistance) {
+            order[count++] = { enter, i };
         }
     }
+    std::sort(order.begin(), order.begin() + count);
+    for (int k = 0; k < count; ++k) {
+        if (order[k].first >= hit.distance) break;
+        m_faces[order[k].second]->Raycast(origin, unit, shellMin, shellMax, m_radius, hit);
+    }
     
-    UpdateMesh();
+    if (!hit.hit) hit.distance = 0.0f;
+    return hit.hit;
+}
+
+void CubeSphere::RaycastBatch(const glm::vec3* origins, const glm::vec3* directions, size_t count, float maxDistance, RayHit* hits) const {
+    PROFILE_ZONE("Raycast Batch");
+    ThreadPool::Get().ParallelFor(count, 64, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Raycast(origins[i], directions[i], maxDistance, hits[i]);
+        }
+    });
+}
+
+float CubeSphere::GetSurfaceRadius(const glm::vec3& direction) const {
+    if (glm::dot(direction, direction) <= 0.0f) return m_radius;
+    
+    int face;
+    float u, v;
+    DirectionToCubeFace(direction, face, u, v);
+    const QuadNode* leaf = m_faces[face]->FindLeafAt(u, v);
+    return leaf->GetSurfaceRadius(glm::normalize(direction), u, v, m_radius);
+}
+
+glm::vec3 CubeSphere::GetClosestSurfacePoint(const glm::vec3& point) const {
+    // Radial projection: exact on a sphere, close to the true nearest point
+    // wherever the terrain is gentle compared to the distance
+    if (glm::dot(point, point) <= 0.0f) return glm::vec3(m_radius, 0.0f, 0.0f);
+    glm::vec3 direction = glm::normalize(point);
+    return direction * GetSurfaceRadius(direction);
+}
+
+float CubeSphere::GetAltitude(const glm::vec3& point) const {
+    return glm::length(point) - GetSurfaceRadius(point);
+}
+
+PrefetchStats CubeSphere::GetPrefetchStats() const {
+    return m_prefetcher->GetStats();
 }
 
 void CubeSphere::UpdateMesh() {
-    m_vertices.clear();
-    m_indices.clear();
+    // Pass 1: every leaf's exact place in the output, so nothing grows or locks below
+    {
+        PROFILE_ZONE("Mesh Layout");
+        if (!m_context.heights) {
+            m_leaves.clear();
+            for (auto& face : m_faces) {
+                if (face) {
+                    face->CollectLeaves(m_leaves);
+                }
+            }
+        }
+        if (m_normalAtlas) {
+            m_normalAtlas->BeginFrame();
+        }
+        m_vertexOffsets.resize(m_leaves.size() + 1);
+        m_indexOffsets.resize(m_leaves.size() + 1);
+        m_normalLayers.resize(m_leaves.size());
+        m_vertexOffsets[0] = 0;
+        m_indexOffsets[0] = 0;
+        for (size_t i = 0; i < m_leaves.size(); ++i) {
+            m_vertexOffsets[i + 1] = m_vertexOffsets[i] + m_leaves[i]->GetMeshVertexCount();
+            m_indexOffsets[i + 1] = m_indexOffsets[i] + m_leaves[i]->GetMeshIndexCount();
+            m_normalLayers[i] = AcquireNormalLayer(m_leaves[i]);
+        }
+    }
+    size_t vertexCount = m_vertexOffsets.back();
+    size_t indexCount = m_indexOffsets.back();
     
-    for (auto& face : m_faces) {
-        if (face) {
-            face->GenerateMesh(m_vertices, m_indices, m_radius);
+    // Pass 2 writes straight into freshly orphaned buffers
+    Vertex* vertices = nullptr;
+    unsigned int* indices = nullptr;
+    {
+        PROFILE_ZONE("Upload");
+        PROFILE_GPU_ZONE("Upload");
+        const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+        if (vertexCount > 0) {
+            vertices = static_cast<Vertex*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, vertexCount * sizeof(Vertex), access));
+            indices = static_cast<unsigned int*>(glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, indexCount * sizeof(unsigned int), access));
         }
     }
     
-    // Mesh generated
+    // Pass 2: leaves build (or fetch) their patches and write them in parallel.
+    // Each leaf only touches its own node and its own span of the output.
+    auto writeLeaves = [this](Vertex* vertexOut, unsigned int* indexOut) {
+        PROFILE_ZONE("Tessellation");
+        ThreadPool::Get().ParallelFor(m_leaves.size(), MESH_LEAVES_PER_TASK, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                QuadNode* leaf = m_leaves[i];
+                leaf->PreparePatch(m_radius);
+                leaf->WriteMesh(vertexOut + m_vertexOffsets[i], indexOut + m_indexOffsets[i],
+                                static_cast<unsigned int>(m_vertexOffsets[i]), m_normalLayers[i]);
+            }
+        });
+    };
+    
+    bool mapped = vertices && indices;
+    if (mapped) {
+        writeLeaves(vertices, indices);
+    }
+    {
+        PROFILE_ZONE("Upload");
+        PROFILE_GPU_ZONE("Upload");
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        bool vertexUnmapped = !vertices || glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+        bool indexUnmapped = !indices || glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER) == GL_TRUE;
+        // Mapping failed, or the driver lost the contents (display mode change): go through the arena
+        mapped = mapped && vertexUnmapped && indexUnmapped;
+    }
+    if (mapped) {
+        // Only a failed mapping needs the arena, which is rare enough not to keep one around
+        m_vertexArena = std::vector<Vertex>();
+        m_indexArena = std::vector<unsigned int>();
+    } else if (vertexCount > 0) {
+        m_vertexArena.resize(vertexCount);
+        m_indexArena.resize(indexCount);
+        TrimCapacity(m_vertexArena);
+        TrimCapacity(m_indexArena);
+        writeLeaves(m_vertexArena.data(), m_indexArena.data());
+        
+        PROFILE_ZONE("Upload");
+        PROFILE_GPU_ZONE("Upload");
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, vertexCount * sizeof(Vertex), m_vertexArena.data());
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indexCount * sizeof(unsigned int), m_indexArena.data());
+    }
     
-    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
-    glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(Vertex), m_vertices.data(), GL_DYNAMIC_DRAW);
+    // The stats are render-thread only, settle them once the workers are done
+    for (QuadNode* leaf : m_leaves) {
+        leaf->AccountPatch();
+    }
     
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(unsigned int), m_indices.data(), GL_DYNAMIC_DRAW);
+    m_indexCount = indexCount;
+    m_stats.vertices = vertexCount;
+    m_stats.triangles = indexCount / 3;
+    m_stats.gpuBytes = vertexCount * sizeof(Vertex) + indexCount * sizeof(unsigned int);
 }
 
-void CubeSphere::Render() {
-    if (m_indices.empty()) return;
+void CubeSphere::UpdatePatches() {
+    {
+        PROFILE_ZONE("Patch List");
+        if (!m_context.heights) {
+            m_leaves.clear();
+            for (auto& face : m_faces) {
+                if (face) {
+                    face->CollectLeaves(m_leaves);
+                }
+            }
+        }
+        if (m_heightAtlas) {
+            m_heightAtlas->BeginFrame();
+        }
+        if (m_normalAtlas) {
+            m_normalAtlas->BeginFrame();
+        }
+        
+        // Four corners per leaf, in (0,0) (1,0) (1,1) (0,1) order
+        m_controlPoints.clear();
+        m_controlPoints.reserve(m_leaves.size() * 4);
+        for (const QuadNode* leaf : m_leaves) {
+            int face = static_cast<int>(leaf->GetFace());
+            glm::vec2 topLeft = leaf->GetTopLeft();
+            glm::vec2 bottomRight = leaf->GetBottomRight();
+            float layer = -1.0f;
+            if (m_heightAtlas) {
+                int level = leaf->GetHeightLevel(HeightAtlas::TILE_SIZE - 1);
+                layer = static_cast<float>(m_heightAtlas->Acquire(leaf->GetTileKey(), face, topLeft, bottomRight, level));
+            }
+            float normalLayer = AcquireNormalLayer(leaf);
+            const glm::vec2 corners[4] = { topLeft, glm::vec2(bottomRight.x, topLeft.y), bottomRight, glm::vec2(topLeft.x, bottomRight.y) };
+            for (const glm::vec2& corner : corners) {
+                m_controlPoints.push_back({ CubeFacePosition(face, corner.x, corner.y), corner, layer, normalLayer });
+            }
+        }
+    }
     
-    glBindVertexArray(m_VAO);
-    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(m_indices.size()), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    PROFILE_ZONE("Upload");
+    PROFILE_GPU_ZONE("Upload");
+    glBindBuffer(GL_ARRAY_BUFFER, m_patchVBO);
+    glBufferData(GL_ARRAY_BUFFER, m_controlPoints.size() * sizeof(TessControlPoint), m_controlPoints.data(), GL_DYNAMIC_DRAW);
+    
+    // Triangles are generated on the GPU and not counted here
+    m_stats.vertices = m_controlPoints.size();
+    m_stats.triangles = 0;
+    m_stats.gpuBytes = m_controlPoints.size() * sizeof(TessControlPoint);
 }
 
-int CubeSphere::GetTriangleCount() const {
-    return static_cast<int>(m_indices.size() / 3);
+float CubeSphere::AcquireNormalLayer(const QuadNode* leaf) {
+    if (!m_normalAtlas) return -1.0f;
+    int level = leaf->GetHeightLevel(NormalAtlas::TILE_SIZE - 1);
+    return static_cast<float>(m_normalAtlas->Acquire(leaf->GetTileKey(), static_cast<int>(leaf->GetFace()),
+                                                     leaf->GetTopLeft(), leaf->GetBottomRight(), level));
 }
 
-int CubeSphere::GetActiveNodeCount() const {
-    int nodeCount = 0;
-    for (const auto& face : m_faces) {
-        if (face) {
-            face->CountNodes(nodeCount);
+void CubeSphere::UpdateCullCommands() {
+    PROFILE_ZONE("Cull Commands");
+    float shellMin, shellMax;
+    GetSurfaceShell(shellMin, shellMax);
+    
+    // Leaf i draws its own index range (mesh) or its four control points
+    // (tessellation); the cull pass copies the visible ones into the draw list
+    bool tessellated = m_backend == TerrainBackend::TESSELLATION;
+    m_commandCount = tessellated ? m_controlPoints.size() / 4 : m_leaves.size();
+    m_leafBounds.resize(m_commandCount);
+    m_commands.clear();
+    m_commands.reserve(m_commandCount * (tessellated ? 4 : 5));
+    for (size_t i = 0; i < m_commandCount; ++i) {
+        glm::vec3 center;
+        float radius;
+        m_leaves[i]->GetBoundingSphere(shellMin, shellMax, center, radius);
+        m_leafBounds[i] = glm::vec4(center, radius);
+        if (tessellated) {
+            m_commands.insert(m_commands.end(), { 4u, 1u, static_cast<GLuint>(i * 4), 0u });
+        } else {
+            GLuint count = static_cast<GLuint>(m_indexOffsets[i + 1] - m_indexOffsets[i]);
+            m_commands.insert(m_commands.end(), { count, 1u, static_cast<GLuint>(m_indexOffsets[i]), 0u, 0u });
         }
     }
-    return nodeCount;
+    
+    if (!m_boundsBuffer) {
+        glGenBuffers(1, &m_boundsBuffer);
+        glGenBuffers(1, &m_commandBuffer);
+        glGenBuffers(1, &m_drawBuffer);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_boundsBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, m_leafBounds.size() * sizeof(glm::vec4), m_leafBounds.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_commandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, m_commands.size() * sizeof(GLuint), m_commands.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (1 + m_commands.size()) * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    m_commandsDirty = false;
+    AccountMemory();
+}
+
+void CubeSphere::Cull(const Shader& cullProgram, const glm::mat4& model, const glm::vec4& body) {
+    m_culled = false;
+    bool tessellated = m_backend == TerrainBackend::TESSELLATION;
+    if (tessellated ? m_controlPoints.empty() : m_indexCount == 0) return;
+    if (m_commandsDirty) {
+        UpdateCullCommands();
+    }
+    
+    PROFILE_ZONE("Cull");
+    float modelScale = std::max(std::max(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1]))),
+                                glm::length(glm::vec3(model[2])));
+    cullProgram.setMat4("u_model", model);
+    cullProgram.setFloat("u_modelScale", modelScale);
+    cullProgram.setVec4("u_body", body);
+    cullProgram.setInt("u_count", static_cast<int>(m_commandCount));
+    cullProgram.setInt("u_commandStride", tessellated ? 4 : 5);
+    cullProgram.setInt("u_indexed", tessellated ? 0 : 1);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OcclusionCuller::BOUNDS_BINDING, m_boundsBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OcclusionCuller::COMMAND_BINDING, m_commandBuffer);
+    GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OcclusionCuller::DRAW_BINDING, m_drawBuffer);
+    GLuint groups = static_cast<GLuint>((m_commandCount + OcclusionCuller::WORKGROUP_SIZE - 1) / OcclusionCuller::WORKGROUP_SIZE);
+    glDispatchCompute(groups, 1, 1);
+    m_culled = true;
+}
+
+void CubeSphere::Render() {
+    // Culled this frame: one multi-draw over the visible leaves the pass packed,
+    // taking their count from the front of the same buffer
+    bool culled = m_culled;
+    m_culled = false;
+    
+    if (m_backend == TerrainBackend::TESSELLATION) {
+        if (m_controlPoints.empty()) return;
+        
+        PROFILE_ZONE("Draw");
+        PROFILE_GPU_ZONE("Draw");
+        if (m_heightAtlas) {
+            m_heightAtlas->Bind();
+        }
+        if (m_normalAtlas) {
+            m_normalAtlas->Bind();
+        }
+        glPatchParameteri(GL_PATCH_VERTICES, 4);
+        glBindVertexArray(m_patchVAO);
+        if (culled) {
+            // One patch per command, well under the per-draw limit below
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_drawBuffer);
+            glBindBuffer(GL_PARAMETER_BUFFER, m_drawBuffer);
+            glMultiDrawArraysIndirectCount(GL_PATCHES, reinterpret_cast<const void*>(sizeof(GLuint)), 0,
+                                           static_cast<GLsizei>(m_commandCount), 0);
+            glBindBuffer(GL_PARAMETER_BUFFER, 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        } else {
+            GLsizei count = static_cast<GLsizei>(m_controlPoints.size());
+            for (GLsizei first = 0; first < count; first += 4 * MAX_PATCHES_PER_DRAW) {
+                glDrawArrays(GL_PATCHES, first, std::min(4 * MAX_PATCHES_PER_DRAW, count - first));
+            }
+        }
+        glBindVertexArray(0);
+        return;
+    }
+    
+    if (m_indexCount == 0) return;
+    
+    PROFILE_ZONE("Draw");
+    PROFILE_GPU_ZONE("Draw");
+    if (m_normalAtlas) {
+        m_normalAtlas->Bind();
+    }
+    glBindVertexArray(m_VAO);
+    if (culled) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_drawBuffer);
+        glBindBuffer(GL_PARAMETER_BUFFER, m_drawBuffer);
+        glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(sizeof(GLuint)), 0,
+                                         static_cast<GLsizei>(m_commandCount), 0);
+        glBindBuffer(GL_PARAMETER_BUFFER, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    } else {
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(m_indexCount), GL_UNSIGNED_INT, 0);
+    }
+    glBindVertexArray(0);
 }
 
-void QuadNode::CountNodes(int& nodeCount) const {
+void QuadNode::CollectLeaves(std::vector<QuadNode*>& leaves) {
     if (m_subdivided) {
-        for (const auto& child : m_children) {
+        for (auto& child : m_children) {
             if (child) {
-                child->CountNodes(nodeCount);
+                child->CollectLeaves(leaves);
             }
         }
     } else {
-        nodeCount++;
+        leaves.push_back(this);
+    }
+}
+
+const QuadNode* QuadNode::FindLeaf(int level, uint32_t x, uint32_t y) const {
+    if (!m_subdivided) return this;
+    if (m_level >= level) return nullptr;
+    
+    int shift = level - m_level - 1;
+    int child = static_cast<int>(((y >> shift) & 1u) * 2 + ((x >> shift) & 1u));
+    return m_children[child] ? m_children[child]->FindLeaf(level, x, y) : nullptr;
+}
+
+const QuadNode* QuadNode::FindLeafAt(float u, float v) const {
+    if (!m_subdivided) return this;
+    
+    glm::vec2 center = (m_topLeft + m_bottomRight) * 0.5f;
+    int child = (v >= center.y ? 2 : 0) + (u >= center.x ? 1 : 0);
+    return m_children[child] ? m_children[child]->FindLeafAt(u, v) : this;
+}
+
+void QuadNode::GetBoundingSphere(float shellMin, float shellMax, glm::vec3& center, float& radius) const {
+    // Tightest sphere on the axis around the cone/shell section: the farthest
+    // points are the axis and rim at either radius
+    float coneSin = std::sqrt(std::max(0.0f, 1.0f - m_coneCos * m_coneCos));
+    float centerDistance = (shellMin * m_coneCos + shellMax) * 0.5f;
+    radius = std::max(std::max(shellMax - centerDistance, std::abs(shellMin - centerDistance)),
+                      std::max(glm::length(glm::vec2(shellMax * m_coneCos - centerDistance, shellMax * coneSin)),
+                               glm::length(glm::vec2(shellMin * m_coneCos - centerDistance, shellMin * coneSin))));
+    center = m_axis * centerDistance;
+}
+
+float QuadNode::IntersectBounds(const glm::vec3& origin, const glm::vec3& direction, float shellMin, float shellMax) const {
+    glm::vec3 center;
+    float boundsRadius;
+    GetBoundingSphere(shellMin, shellMax, center, boundsRadius);
+    
+    glm::vec3 toCenter = center - origin;
+    float along = glm::dot(toCenter, direction);
+    float missSquared = glm::dot(toCenter, toCenter) - along * along;
+    float radiusSquared = boundsRadius * boundsRadius;
+    if (missSquared > radiusSquared) return -1.0f;
+    
+    float half = std::sqrt(radiusSquared - missSquared);
+    if (along + half < 0.0f) return -1.0f;
+    return std::max(along - half, 0.0f);
+}
+
+bool QuadNode::IntersectPatch(const glm::vec3& origin, const glm::vec3& direction, float shellMin, float shellMax, float radius, RayHit& hit) const {
+    if (m_patch.empty() && m_context && m_context->heights) {
+        return IntersectHeights(origin, direction, shellMin, shellMax, radius, hit);
+    }
+    if (m_patch.empty()) {
+        // Not built yet (created this frame), stand in with the bare sphere
+        float along = -glm::dot(origin, direction);
+        float missSquared = glm::dot(origin, origin) - along * along;
+        if (missSquared > radius * radius) return false;
+        float half = std::sqrt(radius * radius - missSquared);
+        float t = along - half >= 0.0f ? along - half : along + half;
+        if (t < 0.0f || t >= hit.distance) return false;
+        
+        glm::vec3 position = origin + direction * t;
+        int face;
+        float u, v;
+        DirectionToCubeFace(position, face, u, v);
+        if (face != static_cast<int>(m_face) || u < m_topLeft.x || u > m_bottomRight.x || v < m_topLeft.y || v > m_bottomRight.y) {
+            return false;
+        }
+        hit = RayHit{ true, t, position, glm::normalize(position), m_level };
+        return true;
+    }
+    
+    // Moller-Trumbore against both triangles of every grid cell
+    int resolution = GetResolution();
+    int stride = resolution + 1;
+    bool found = false;
+    for (int j = 0; j < resolution; ++j) {
+        for (int i = 0; i < resolution; ++i) {
+            const glm::vec3& p00 = m_patch[j * stride + i].position;
+            const glm::vec3& p10 = m_patch[j * stride + i + 1].position;
+            const glm::vec3& p01 = m_patch[(j + 1) * stride + i].position;
+            const glm::vec3& p11 = m_patch[(j + 1) * stride + i + 1].position;
+            const glm::vec3* triangles[2][3] = { { &p00, &p01, &p10 }, { &p10, &p01, &p11 } };
+            
+            for (const auto& triangle : triangles) {
+                glm::vec3 edge1 = *triangle[1] - *triangle[0];
+                glm::vec3 edge2 = *triangle[2] - *triangle[0];
+                glm::vec3 p = glm::cross(direction, edge2);
+                float determinant = glm::dot(edge1, p);
+                if (std::abs(determinant) < 1e-12f) continue;
+                
+                float inverse = 1.0f / determinant;
+                glm::vec3 s = origin - *triangle[0];
+                float a = glm::dot(s, p) * inverse;
+                if (a < 0.0f || a > 1.0f) continue;
+                glm::vec3 q = glm::cross(s, edge1);
+                float b = glm::dot(direction, q) * inverse;
+                if (b < 0.0f || a + b > 1.0f) continue;
+                
+                float t = glm::dot(edge2, q) * inverse;
+                if (t < 0.0f || t >= hit.distance) continue;
+                
+                glm::vec3 normal = glm::normalize(glm::cross(edge1, edge2));
+                glm::vec3 position = origin + direction * t;
+                hit = RayHit{ true, t, position, glm::dot(normal, position) < 0.0f ? -normal : normal, m_level };
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+bool QuadNode::IntersectHeights(const glm::vec3& origin, const glm::vec3& direction, float shellMin, float shellMax, float radius, RayHit& hit) const {
+    // The part of the ray inside the shell and this node's bounds
+    float enter, exit;
+    if (!RaySphereSpan(origin, direction, glm::vec3(0.0f), shellMax, enter, exit)) return false;
+    float innerEnter, innerExit;
+    if (RaySphereSpan(origin, direction, glm::vec3(0.0f), shellMin, innerEnter, innerExit)) {
+        if (innerEnter > 0.0f) {
+            exit = std::min(exit, innerEnter);
+        } else {
+            enter = std::max(enter, innerExit);
+        }
+    }
+    glm::vec3 center;
+    float boundsRadius, boundsEnter, boundsExit;
+    GetBoundingSphere(shellMin, shellMax, center, boundsRadius);
+    if (!RaySphereSpan(origin, direction, center, boundsRadius, boundsEnter, boundsExit)) return false;
+    enter = std::max(enter, boundsEnter);
+    exit = std::min(std::min(exit, boundsExit), hit.distance);
+    if (enter >= exit) return false;
+    
+    // Above the surface is positive; any sign change is a crossing, from either side like the patch test
+    auto above = [&](float t) {
+        glm::vec3 point = origin + direction * t;
+        int face;
+        float u, v;
+        DirectionToCubeFace(point, face, u, v);
+        return glm::length(point) - SampleSurfaceRadius(face, u, v, radius);
+    };
+    
+    // About one step per height sample of this node
+    float spacing = std::max(radius * std::acos(glm::clamp(m_coneCos, -1.0f, 1.0f)) / GetResolution(), 1e-6f);
+    int steps = glm::clamp(static_cast<int>(std::ceil((exit - enter) / spacing)), 2, MAX_MARCH_STEPS);
+    float step = (exit - enter) / steps;
+    float t0 = enter;
+    float f0 = above(t0);
+    for (int s = 1; s <= steps; ++s) {
+        float t1 = enter + step * s;
+        float f1 = above(t1);
+        if ((f0 > 0.0f) != (f1 > 0.0f)) {
+            float low = t0, high = t1;
+            bool lowAbove = f0 > 0.0f;
+            for (int r = 0; r < REFINE_STEPS; ++r) {
+                float middle = (low + high) * 0.5f;
+                if ((above(middle) > 0.0f) == lowAbove) low = middle; else high = middle;
+            }
+            float t = (low + high) * 0.5f;
+            glm::vec3 position = origin + direction * t;
+            int face;
+            float u, v;
+            DirectionToCubeFace(position, face, u, v);
+            // Crossings over a neighbour are its to report, at its own height level
+            if (face == static_cast<int>(m_face) && u >= m_topLeft.x && u <= m_bottomRight.x && v >= m_topLeft.y && v <= m_bottomRight.y) {
+                // Normal from the surface a sample to either side
+                float du = (m_bottomRight.x - m_topLeft.x) / GetResolution();
+                float dv = (m_bottomRight.y - m_topLeft.y) / GetResolution();
+                auto surface = [&](float su, float sv) {
+                    su = glm::clamp(su, 0.0f, 1.0f);
+                    sv = glm::clamp(sv, 0.0f, 1.0f);
+                    return CubeToSphere(GetCubePosition(su, sv)) * SampleSurfaceRadius(face, su, sv, radius);
+                };
+                glm::vec3 normal = glm::cross(surface(u + du, v) - surface(u - du, v), surface(u, v + dv) - surface(u, v - dv));
+                float length = glm::length(normal);
+                normal = length > 0.0f ? normal / length : glm::normalize(position);
+                if (glm::dot(normal, position) < 0.0f) normal = -normal;
+                hit = RayHit{ true, t, position, normal, m_level };
+                return true;
+            }
+        }
+        t0 = t1;
+        f0 = f1;
+    }
+    return false;
+}
+
+float QuadNode::SampleSurfaceRadius(int face, float u, float v, float radius) const {
+    return radius + m_context->heights->SampleHeight(face, u, v, GetHeightLevel()) * m_context->heightScale;
+}
+
+void QuadNode::Raycast(const glm::vec3& origin, const glm::vec3& direction, float shellMin, float shellMax, float radius, RayHit& hit) const {
+    if (!m_subdivided) {
+        IntersectPatch(origin, direction, shellMin, shellMax, radius, hit);
+        return;
+    }
+    
+    // Front to back, so farther children are usually rejected by the best hit
+    std::array<std::pair<float, int>, 4> order;
+    int count = 0;
+    for (int i = 0; i < 4; ++i) {
+        if (!m_children[i]) continue;
+        float enter = m_children[i]->IntersectBounds(origin, direction, shellMin, shellMax);
+        if (enter >= 0.0f && enter < hit.distance) {
+            order[count++] = { enter, i };
+        }
+    }
+    std::sort(order.begin(), order.begin() + count);
+    for (int k = 0; k < count; ++k) {
+        if (order[k].first >= hit.distance) break;
+        m_children[order[k].second]->Raycast(origin, direction, shellMin, shellMax, radius, hit);
+    }
+}
+
+float QuadNode::GetSurfaceRadius(const glm::vec3& direction, float u, float v, float radius) const {
+    if (m_patch.empty()) {
+        HeightSource* heights = m_context ? m_context->heights : nullptr;
+        if (!heights) return radius;
+        return SampleSurfaceRadius(static_cast<int>(m_face), u, v, radius);
+    }
+    
+    // Grid cell under (u, v), then the ray from the centre through its two triangles
+    int resolution = GetResolution();
+    int stride = resolution + 1;
+    glm::vec2 size = m_bottomRight - m_topLeft;
+    float x = glm::clamp((u - m_topLeft.x) / size.x * resolution, 0.0f, static_cast<float>(resolution));
+    float y = glm::clamp((v - m_topLeft.y) / size.y * resolution, 0.0f, static_cast<float>(resolution));
+    int i = std::min(static_cast<int>(x), resolution - 1);
+    int j = std::min(static_cast<int>(y), resolution - 1);
+    
+    const glm::vec3& p00 = m_patch[j * stride + i].position;
+    const glm::vec3& p10 = m_patch[j * stride + i + 1].position;
+    const glm::vec3& p01 = m_patch[(j + 1) * stride + i].position;
+    const glm::vec3& p11 = m_patch[(j + 1) * stride + i + 1].position;
+    const glm::vec3* triangles[2][3] = { { &p00, &p01, &p10 }, { &p10, &p01, &p11 } };
+    for (const auto& triangle : triangles) {
+        glm::vec3 normal = glm::cross(*triangle[1] - *triangle[0], *triangle[2] - *triangle[0]);
+        float facing = glm::dot(normal, direction);
+        if (std::abs(facing) < 1e-12f) continue;
+        float t = glm::dot(normal, *triangle[0]) / facing;
+        glm::vec3 point = direction * t;
+        // Inside test by edge sidedness, with a little slack for the shared diagonal
+        bool inside = true;
+        for (int e = 0; e < 3 && inside; ++e) {
+            const glm::vec3& a = *triangle[e];
+            const glm::vec3& b = *triangle[(e + 1) % 3];
+            inside = glm::dot(glm::cross(b - a, point - a), normal) >= -1e-6f * glm::dot(normal, normal);
+        }
+        if (inside && t > 0.0f) return t;
+    }
+    
+    // Numerically on an edge, blend the corner radii instead
+    float fx = x - i, fy = y - j;
+    float top = glm::length(p00) * (1.0f - fx) + glm::length(p10) * fx;
+    float bottom = glm::length(p01) * (1.0f - fx) + glm::length(p11) * fx;
+    return top * (1.0f - fy) + bottom * fy;
+}
+
+void QuadNode::PrefetchLeaves(const glm::vec3& cameraPos, float radius, int maxLevel) {
+    if (!ShouldSubdivide(cameraPos, radius, maxLevel)) {
+        // Existing nodes already have (or will lazily build) their own patch
+        return;
+    }
+    
+    glm::vec2 center = (m_topLeft + m_bottomRight) * 0.5f;
+    const glm::vec2 corners[4][2] = {
+        { m_topLeft, center },
+        { glm::vec2(center.x, m_topLeft.y), glm::vec2(m_bottomRight.x, center.y) },
+        { glm::vec2(m_topLeft.x, center.y), glm::vec2(center.x, m_bottomRight.y) },
+        { center, m_bottomRight },
+    };
+    
+    for (int i = 0; i < 4; ++i) {
+        if (m_subdivided && m_children[i]) {
+            m_children[i]->PrefetchLeaves(cameraPos, radius, maxLevel);
+            continue;
+        }
+        
+        // Not refined yet: simulate the child, it's a leaf unless it would refine further
+        QuadNode child(corners[i][0], corners[i][1], m_level + 1, m_face, m_context);
+        if (child.ShouldSubdivide(cameraPos, radius, maxLevel)) {
+            child.PrefetchLeaves(cameraPos, radius, maxLevel);
+            continue;
+        }
+        
+        if (m_context->heights) {
+            int heightLevel = child.GetHeightLevel();
+            int shift = child.m_level - heightLevel;
+            m_context->heights->Prefetch(static_cast<int>(m_face), heightLevel, child.GetTileX() >> shift, child.GetTileY() >> shift);
+        }
+        
+        // Workers build through a detached node with no prefetcher of their own
+        QuadTreeContext context = *m_context;
+        context.prefetcher = nullptr;
+        context.stats = nullptr;
+        glm::vec2 topLeft = corners[i][0], bottomRight = corners[i][1];
+        int level = m_level + 1;
+        CubeFace face = m_face;
+        m_context->prefetcher->Request(child.GetTileKey(), [context, topLeft, bottomRight, level, face, radius](std::vector<Vertex>& patch) mutable {
+            QuadNode node(topLeft, bottomRight, level, face, &context);
+            node.BuildPatch(radius);
+            patch = std::move(node.GetPatch());
+            return node.IsPatchExact();
+        });
     }
 }
\ No newline at end of file
@@ -1,15 +1,40 @@
 #pragma once
 
+#include "core/memoryBudget.h"
 #include <epoxy/gl.h>
 #include <glm/glm.hpp>
 #include <vector>
 #include <array>
 #include <memory>
+#include <cstdint>
+
+class Shader;
+class TileCache;
+class HeightSource;
+class HeightAtlas;
+class NormalAtlas;
+class PatchPrefetcher;
+struct PrefetchStats;
 
 struct Vertex {
     glm::vec3 position;
     glm::vec3 normal;
     glm::vec2 texCoord;
+    glm::vec3 detailCoord = glm::vec3(0.0f, 0.0f, -1.0f);  // xy: within the patch, z: NormalAtlas layer or -1; set per frame
+};
+
+// Patch corner for the tessellation backend (shaders/terrain.vert)
+struct TessControlPoint {
+    glm::vec3 cubePosition;     // on the unit cube, the shaders project it out to the sphere
+    glm::vec2 faceUV;
+    float heightLayer;          // HeightAtlas layer of the patch, -1 without terrain
+    float normalLayer;          // NormalAtlas layer of the patch, -1 while it bakes
+};
+
+// How the quadtree's leaves reach the GPU
+enum class TerrainBackend {
+    MESH,           // CPU-built vertex grid per leaf
+    TESSELLATION    // one patch per leaf, refined and displaced by tessellation shaders
 };
 
 enum class CubeFace {
@@ -21,56 +46,243 @@ enum class CubeFace {
     BOTTOM = 5
 };
 
+// Result of a ray or surface query, in the space the query was made in
+struct RayHit {
+    bool hit = false;
+    float distance = 0.0f;                  // along the (normalised) ray direction
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 normal = glm::vec3(0.0f);
+    int level = -1;                         // quadtree level of the patch that was hit
+};
+
+// Counters kept up to date as nodes split, merge and build patches, so
+// readers never have to walk the tree. Render thread only.
+struct QuadTreeStats {
+    int nodes = 0;              // every live node, interior ones included
+    int leaves = 0;             // nodes drawn this frame
+    size_t patchBytes = 0;      // CPU memory held by cached node patches
+    size_t vertices = 0;        // in the last uploaded mesh
+    size_t triangles = 0;
+    size_t gpuBytes = 0;        // vertex + index buffer size of the last upload
+    
+    QuadTreeStats& operator+=(const QuadTreeStats& other);
+};
+
+// State shared by every node of one CubeSphere's quadtrees
+struct QuadTreeContext {
+    TileCache* tileCache = nullptr;     // persistent patch store, optional
+    uint32_t planetId = 0;
+    int cacheMinLevel = 2;              // coarser patches are cheaper to rebuild than to look up
+    HeightSource* heights = nullptr;    // terrain elevation, optional
+    float heightScale = 0.0f;           // height source units -> world units
+    PatchPrefetcher* prefetcher = nullptr;  // patches built ahead along the predicted camera path
+    QuadTreeStats* stats = nullptr;         // null for detached nodes built off the render thread
+};
+
 class QuadNode {
 public:
-    QuadNode(glm::vec2 topLeft, glm::vec2 bottomRight, int level, CubeFace face);
+    static constexpr float SUBDIVISION_THRESHOLD = 0.1f;  // More aggressive for 25-unit Earth
+    
+    QuadNode(glm::vec2 topLeft, glm::vec2 bottomRight, int level, CubeFace face, QuadTreeContext* context);
     ~QuadNode();
     
     void Subdivide();
     void Update(const glm::vec3& cameraPos, float radius, int maxLevel);
-    void GenerateMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, float radius);
-    void CountNodes(int& nodeCount) const;
+    void CollectLeaves(std::vector<QuadNode*>& leaves);
+    // Leaf covering patch (x, y) at level, nullptr when that patch is subdivided further
+    const QuadNode* FindLeaf(int level, uint32_t x, uint32_t y) const;
+    // Leaf containing face coordinates (u, v)
+    const QuadNode* FindLeafAt(float u, float v) const;
+    
+    // Nearest hit closer than hit.distance, against the drawn patches. Subtrees
+    // whose bounds (the patch's cone between shellMin and shellMax) miss the
+    // ray, or start beyond the best hit so far, are skipped.
+    void Raycast(const glm::vec3& origin, const glm::vec3& direction, float shellMin, float shellMax, float radius, RayHit& hit) const;
+    // Sphere around the patch cone between two radii, planet-local
+    void GetBoundingSphere(float shellMin, float shellMax, glm::vec3& center, float& radius) const;
+    // Entry distance into that sphere, or -1
+    float IntersectBounds(const glm::vec3& origin, const glm::vec3& direction, float shellMin, float shellMax) const;
+    // Distance from the planet centre to this leaf's surface along direction
+    float GetSurfaceRadius(const glm::vec3& direction, float u, float v, float radius) const;
+    // Walks the tree as it would look from cameraPos, asking the prefetcher for every
+    // leaf that doesn't exist yet. Missing nodes are only simulated, never attached.
+    void PrefetchLeaves(const glm::vec3& cameraPos, float radius, int maxLevel);
     
     bool ShouldSubdivide(const glm::vec3& cameraPos, float radius, int maxLevel) const;
     glm::vec3 CubeToSphere(const glm::vec3& cubePoint) const;
     
+    int GetLevel() const { return m_level; }
+    CubeFace GetFace() const { return m_face; }
+    // Integer patch coordinates within the face at this node's level
+    uint32_t GetTileX() const;
+    uint32_t GetTileY() const;
+    uint64_t GetTileKey() const;
+    // Height pyramid level whose sample spacing matches this node's vertex spacing
+    int GetHeightLevel() const;
+    // Same, for a node split into cells samples per side
+    int GetHeightLevel(int cells) const;
+    glm::vec2 GetTopLeft() const { return m_topLeft; }
+    glm::vec2 GetBottomRight() const { return m_bottomRight; }
+    
+    // Fills m_patch from the tile cache or by generating it; normally done lazily on first draw
+    void BuildPatch(float radius);
+    // Mesh output of a leaf: the patch is made ready (prefetched, cached or built, and
+    // rebuilt once finer heights arrive), then copied into caller-sized spans. Safe to run
+    // on different leaves in parallel; AccountPatch afterwards, on the render thread.
+    size_t GetMeshVertexCount() const;
+    size_t GetMeshIndexCount() const;
+    void PreparePatch(float radius);
+    void WriteMesh(Vertex* vertices, unsigned int* indices, unsigned int baseIndex, float normalLayer) const;
+    void AccountPatch();
+    std::vector<Vertex>& GetPatch() { return m_patch; }
+    bool IsPatchExact() const { return m_patchExact; }
+    
 private:
     glm::vec2 m_topLeft, m_bottomRight;
     int m_level;
     CubeFace m_face;
     std::array<std::unique_ptr<QuadNode>, 4> m_children;
     bool m_subdivided;
+    QuadTreeContext* m_context;
+    std::vector<Vertex> m_patch;        // built once per node, reused every frame
+    bool m_patchExact;                  // false while built from coarser fallback heights
+    size_t m_patchBytes;                // m_patch memory as last reported to the stats
+    glm::vec3 m_axis;                   // unit direction to the patch centre
+    float m_coneCos;                    // cosine of the widest angle from m_axis to a corner
     
     static constexpr int RESOLUTION = 8;  // Reduced for better performance
-    static constexpr float SUBDIVISION_THRESHOLD = 0.1f;  // More aggressive for 25-unit Earth
+    static constexpr int MAX_MARCH_STEPS = 256;     // per leaf, for rays against heights without a patch
+    static constexpr int REFINE_STEPS = 16;
     
     glm::vec3 GetCubePosition(float u, float v) const;
-    void GenerateQuadMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, float radius);
+    int GetResolution() const;
+    void ComputeGridNormals(int resolution);
+    bool IntersectPatch(const glm::vec3& origin, const glm::vec3& direction, float shellMin, float shellMax, float radius, RayHit& hit) const;
+    // Patch-less leaves (tessellation backend, or not built yet) with a height source:
+    // marches the ray through the node's shell and refines the crossing by bisection
+    bool IntersectHeights(const glm::vec3& origin, const glm::vec3& direction, float shellMin, float shellMax, float radius, RayHit& hit) const;
+    // The surface at (u, v) of any face sampled at this node's height level, as GetSurfaceRadius sees it
+    float SampleSurfaceRadius(int face, float u, float v, float radius) const;
 };
 
 class CubeSphere {
 public:
+    // Largest patch (level 0) and the version of the patch generator, for sizing and
+    // invalidating persistent tile stores
+    static constexpr int MAX_PATCH_VERTICES = 81;
+    static constexpr uint32_t PATCH_FORMAT_VERSION = 2;
+    
     CubeSphere(float radius = 1.0f, int maxLevel = 8);
     ~CubeSphere();
     
     void Update(const glm::vec3& cameraPos);
+    // predictedCameraPos is where the camera is expected to be shortly; nodes along the way
+    // there are generated in the background so they're ready when the quadtree refines
+    void Update(const glm::vec3& cameraPos, const glm::vec3& predictedCameraPos);
     void Render();
+    // Packs the commands of this frame's visible leaves into the draw list the
+    // next Render draws with. Needs shaders/occlusionCull.comp bound between
+    // OcclusionCuller::BeginCull and EndCull; body is the world-space sphere
+    // around the whole planet.
+    void Cull(const Shader& cullProgram, const glm::mat4& model, const glm::vec4& body);
+    
+    // The tessellation backend needs GL 4.0 and a program built from shaders/terrain.*
+    // bound while rendering. Its CPU tree stops TESS_LEVEL_REDUCTION levels short of
+    // maxLevel; the GPU makes up the detail near the camera.
+    static constexpr int TESS_LEVEL_REDUCTION = 2;
+    static bool IsTessellationSupported();
+    void SetBackend(TerrainBackend backend);
+    TerrainBackend GetBackend() const { return m_backend; }
+    const HeightAtlas* GetHeightAtlas() const { return m_heightAtlas.get(); }
+    const NormalAtlas* GetNormalAtlas() const { return m_normalAtlas.get(); }
     
     void SetRadius(float radius) { m_radius = radius; }
     float GetRadius() const { return m_radius; }
     
-    int GetTriangleCount() const;
-    int GetActiveNodeCount() const;
+    const QuadTreeStats& GetStats() const { return m_stats; }
+    int GetTriangleCount() const { return static_cast<int>(m_stats.triangles); }
+    int GetActiveNodeCount() const { return m_stats.leaves; }
+    
+    // Patches at or below the context's cacheMinLevel are loaded from / saved to this store
+    void SetTileCache(TileCache* cache, uint32_t planetId);
+    // Displace vertices by source heights * heightScale; set before SetTileCache
+    void SetHeightSource(HeightSource* heights, float heightScale);
+    const QuadTreeContext& GetContext() const { return m_context; }
+    PrefetchStats GetPrefetchStats() const;
+    // Prefetch builds and normal map bakes run on the calling thread
+    void SetSynchronous(bool synchronous);
+    
+    // Queries against the current LOD, in planet-local space. Cost grows with
+    // tree depth, not node count. Safe to call from several threads at once,
+    // but not while Update is running.
+    bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const;
+    // Splits the rays across the shared thread pool and waits for all of them
+    void RaycastBatch(const glm::vec3* origins, const glm::vec3* directions, size_t count, float maxDistance, RayHit* hits) const;
+    // Distance from the centre to the surface along direction
+    float GetSurfaceRadius(const glm::vec3& direction) const;
+    // Surface point straight below (or above) point, i.e. along the radial direction
+    glm::vec3 GetClosestSurfacePoint(const glm::vec3& point) const;
+    // Height of point above the terrain, negative below it
+    float GetAltitude(const glm::vec3& point) const;
+    // Radii bounding every possible surface point, from the height source's range
+    void GetSurfaceShell(float& shellMin, float& shellMax) const;
+    // The same without a sphere, for bodies whose quadtree is not built
+    static void ComputeSurfaceShell(float radius, const HeightSource* heights, float heightScale,
+                                    float& shellMin, float& shellMax);
     
 private:
     float m_radius;
     int m_maxLevel;
+    QuadTreeStats m_stats;
+    QuadTreeContext m_context;
     std::array<std::unique_ptr<QuadNode>, 6> m_faces;
     
     unsigned int m_VAO, m_VBO, m_EBO;
-    std::vector<Vertex> m_vertices;
-    std::vector<unsigned int> m_indices;
+    size_t m_indexCount;
+    std::vector<size_t> m_vertexOffsets;            // per leaf, prefix sums with the total last
+    std::vector<size_t> m_indexOffsets;
+    std::vector<Vertex> m_vertexArena;              // only used when the buffers can't be mapped
+    std::vector<unsigned int> m_indexArena;
+    
+    TerrainBackend m_backend;
+    unsigned int m_patchVAO, m_patchVBO;
+    std::vector<TessControlPoint> m_controlPoints;
+    std::unique_ptr<HeightAtlas> m_heightAtlas;     // tessellation backend with a height source only
+    std::unique_ptr<NormalAtlas> m_normalAtlas;     // either backend, with a height source only
+    std::vector<float> m_normalLayers;              // per leaf, this frame's NormalAtlas layer or -1
+    
+    std::vector<QuadNode*> m_leaves;
+    std::unique_ptr<PatchPrefetcher> m_prefetcher;
+    
+    // Occlusion culling: a bounding sphere and an indirect command per leaf,
+    // rebuilt on the first Cull after the leaves change, and the draw list
+    // the pass packs the surviving commands into after their count
+    GLuint m_boundsBuffer, m_commandBuffer, m_drawBuffer;
+    std::vector<glm::vec4> m_leafBounds;
+    std::vector<GLuint> m_commands;
+    size_t m_commandCount;
+    bool m_commandsDirty;
+    bool m_culled;                                  // Cull ran since the last Render
+    bool m_synchronous;
+    
+    // Reported to MemoryBudget after every update
+    MemoryAccount m_bufferMemory;                   // vertex / index or control point buffers, cull buffers
+    MemoryAccount m_treeMemory;                     // nodes and their cached patches
+    MemoryAccount m_stagingMemory;                  // per-frame vectors, by capacity
+    
+    static constexpr int PREDICTION_SAMPLES = 4;    // points checked between now and the prediction
+    // Mesa llvmpipe (the headless runs) silently drops patches from larger
+    // tessellated draws; a few extra draw calls cost nothing on hardware
+    static constexpr int MAX_PATCHES_PER_DRAW = 64;
+    static constexpr size_t MESH_LEAVES_PER_TASK = 32;
     
     void InitializeGL();
     void UpdateMesh();
+    void UpdatePatches();
+    void UpdateCullCommands();
+    float AcquireNormalLayer(const QuadNode* leaf);
+    int GetActiveMaxLevel() const;
+    void PrefetchHeights();
+    void PrefetchPath(const glm::vec3& cameraPos, const glm::vec3& predictedCameraPos);
+    void AccountMemory();
 };
\ No newline at end of file
@@ -0,0 +1,259 @@
+#include "linearQuadTree.h"
+#include "cubesphere.h"
+#include "terrain/cubeMapping.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Spreads the low 32 bits of v over the even bits of the result
+uint64_t DilateBits(uint32_t v) {
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+    x = (x | (x << 8))  & 0x00FF00FF00FF00FFull;
+    x = (x | (x << 4))  & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | (x << 2))  & 0x3333333333333333ull;
+    x = (x | (x << 1))  & 0x5555555555555555ull;
+    return x;
+}
+
+uint32_t CompactBits(uint64_t x) {
+    x &= 0x5555555555555555ull;
+    x = (x | (x >> 1))  & 0x3333333333333333ull;
+    x = (x | (x >> 2))  & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | (x >> 4))  & 0x00FF00FF00FF00FFull;
+    x = (x | (x >> 8))  & 0x0000FFFF0000FFFFull;
+    x = (x | (x >> 16)) & 0x00000000FFFFFFFFull;
+    return static_cast<uint32_t>(x);
+}
+
+const uint64_t X_BITS = 0x5555555555555555ull;
+const uint64_t Y_BITS = 0xAAAAAAAAAAAAAAAAull;
+
+}
+
+uint64_t LinearQuadTree::MakeCode(int face, int level, uint32_t x, uint32_t y) {
+    uint64_t morton = DilateBits(x) | (DilateBits(y) << 1);
+    return (static_cast<uint64_t>(face) << 61) | (1ull << (2 * level)) | morton;
+}
+
+int LinearQuadTree::GetCodeLevel(uint64_t code) {
+    uint64_t body = code & ~FACE_MASK;
+#if defined(__GNUC__) || defined(__clang__)
+    return (63 - __builtin_clzll(body)) / 2;
+#else
+    int marker = 2 * MAX_LEVEL;
+    while (marker > 0 && !(body >> marker & 1ull)) {
+        marker--;
+    }
+    return marker / 2;
+#endif
+}
+
+void LinearQuadTree::DecodeTile(uint64_t code, uint32_t& x, uint32_t& y) {
+    uint64_t morton = code & ((1ull << (2 * GetCodeLevel(code))) - 1);
+    x = CompactBits(morton);
+    y = CompactBits(morton >> 1);
+}
+
+void LinearQuadTree::GetCodeBounds(uint64_t code, glm::vec2& topLeft, glm::vec2& bottomRight) {
+    uint32_t x, y;
+    DecodeTile(code, x, y);
+    float size = 1.0f / static_cast<float>(1u << GetCodeLevel(code));
+    topLeft = glm::vec2(x * size, y * size);
+    bottomRight = topLeft + glm::vec2(size);
+}
+
+uint64_t LinearQuadTree::GetParentCode(uint64_t code) {
+    return ((code & ~FACE_MASK) >> 2) | (code & FACE_MASK);
+}
+
+uint64_t LinearQuadTree::GetAncestorCode(uint64_t code, int codeLevel, int level) {
+    int shift = 2 * (codeLevel - level);
+    return ((code & ~FACE_MASK) >> shift) | (code & FACE_MASK);
+}
+
+uint64_t LinearQuadTree::GetSortKey(uint64_t code, int codeLevel) {
+    uint64_t morton = code & ((1ull << (2 * codeLevel)) - 1);
+    return (code & FACE_MASK) | (morton << (2 * (MAX_LEVEL - codeLevel)));
+}
+
+bool LinearQuadTree::IsDescendantOrSelf(uint64_t code, uint64_t ancestor) {
+    int codeLevel = GetCodeLevel(code);
+    int ancestorLevel = GetCodeLevel(ancestor);
+    return codeLevel >= ancestorLevel && GetAncestorCode(code, codeLevel, ancestorLevel) == ancestor;
+}
+uint64_t LinearQuadTree::GetNeighborCode(uint64_t code, int dx, int dy) {
+    int level = GetCodeLevel(code);
+    uint64_t levelBits = (1ull << (2 * level)) - 1;
+    uint64_t morton = code & levelBits;
+    uint64_t xBits = morton & X_BITS;
+    uint64_t yBits = morton & Y_BITS;
+    uint64_t xMax = X_BITS & levelBits;
+    uint64_t yMax = Y_BITS & levelBits;
+    
+    // Dilated integer arithmetic steps one coordinate without decoding the other,
+    // stepping off the face edge falls through to the cube mapping below
+    bool inside = true;
+    if (dx > 0) { inside = xBits != xMax; xBits = ((xBits | ~X_BITS) + 1) & X_BITS; }
+    if (dx < 0) { inside = xBits != 0;    xBits = (xBits - 1) & X_BITS; }
+    if (dy > 0) { inside = inside && yBits != yMax; yBits = ((yBits | ~Y_BITS) + 1) & Y_BITS; }
+    if (dy < 0) { inside = inside && yBits != 0;    yBits = (yBits - 1) & Y_BITS; }
+    if (inside) {
+        return (code & ~levelBits) | ((xBits | yBits) & levelBits);
+    }
+    
+    // Project the neighbouring cell's centre off the face plane onto the cube
+    uint32_t x, y;
+    DecodeTile(code, x, y);
+    float cells = static_cast<float>(1u << level);
+    float u = (x + 0.5f + dx) / cells;
+    float v = (y + 0.5f + dy) / cells;
+    int face;
+    DirectionToCubeFace(CubeFacePosition(GetCodeFace(code), u, v), face, u, v);
+    uint32_t maxCell = (1u << level) - 1;
+    uint32_t nx = std::min(static_cast<uint32_t>(u * cells), maxCell);
+    uint32_t ny = std::min(static_cast<uint32_t>(v * cells), maxCell);
+    return MakeCode(face, level, nx, ny);
+}
+
+LinearQuadTree::LinearQuadTree(float radius, int maxLevel)
+    : m_radius(radius), m_maxLevel(std::min(maxLevel, MAX_LEVEL)), m_pathDepth(-1) {
+    for (int face = 0; face < 6; ++face) {
+        Emit(MakeCode(face, 0, 0, 0), 0);
+    }
+    m_codes.swap(m_nextCodes);
+    m_levels.swap(m_nextLevels);
+    for (size_t i = 0; i < m_codes.size(); ++i) {
+        m_sortKeys.push_back(GetSortKey(m_codes[i], m_levels[i]));
+    }
+}
+
+bool LinearQuadTree::ShouldSubdivide(uint64_t code, int level, const glm::vec3& cameraPos) const {
+    if (level >= m_maxLevel) return false;
+    
+    // Same test as QuadNode::ShouldSubdivide, from implicit bounds
+    uint64_t morton = code & ((1ull << (2 * level)) - 1);
+    float size = 1.0f / static_cast<float>(1u << level);
+    glm::vec2 center((CompactBits(morton) + 0.5f) * size, (CompactBits(morton >> 1) + 0.5f) * size);
+    glm::vec3 sphereCenter = glm::normalize(CubeFacePosition(GetCodeFace(code), center.x, center.y)) * m_radius;
+    
+    float distance = glm::length(cameraPos - sphereCenter);
+    float nodeSize = glm::length(glm::vec2(size)) * m_radius;
+    
+    return (nodeSize / distance) > QuadNode::SUBDIVISION_THRESHOLD;
+}
+
+bool LinearQuadTree::CachedShouldSubdivide(uint64_t code, int level, const glm::vec3& cameraPos) {
+    // Consecutive leaves share most of their ancestors, remember the current path
+    if (level <= m_pathDepth && m_pathCodes[level] == code) {
+        return m_pathSplit[level];
+    }
+    m_pathCodes[level] = code;
+    m_pathSplit[level] = ShouldSubdivide(code, level, cameraPos);
+    m_pathDepth = level;
+    return m_pathSplit[level];
+}
+
+void LinearQuadTree::Update(const glm::vec3& cameraPos) {
+    m_nextCodes.clear();
+    m_nextLevels.clear();
+    m_pathDepth = -1;
+    
+    size_t i = 0;
+    while (i < m_codes.size()) {
+        uint64_t code = m_codes[i];
+        int level = m_levels[i];
+        
+        // The new leaf is the shallowest ancestor that stops splitting
+        int stop = -1;
+        for (int l = 0; l <= level; ++l) {
+            if (!CachedShouldSubdivide(GetAncestorCode(code, level, l), l, cameraPos)) {
+                stop = l;
+                break;
+            }
+        }
+        
+        if (stop < 0) {
+            // Every ancestor still splits, so this leaf refines further
+            for (int child = 0; child < 4; ++child) {
+                Refine(GetChildCode(code, child), level + 1, cameraPos);
+            }
+            i++;
+        } else {
+            // Merge: one leaf replaces this one and any following siblings below it
+            uint64_t leaf = GetAncestorCode(code, level, stop);
+            Emit(leaf, stop);
+            i++;
+            while (i < m_codes.size() && m_levels[i] >= stop && GetAncestorCode(m_codes[i], m_levels[i], stop) == leaf) {
+                i++;
+            }
+        }
+    }
+    
+    m_codes.swap(m_nextCodes);
+    m_levels.swap(m_nextLevels);
+    m_sortKeys.resize(m_codes.size());
+    for (size_t j = 0; j < m_codes.size(); ++j) {
+        m_sortKeys[j] = GetSortKey(m_codes[j], m_levels[j]);
+    }
+}
+
+void LinearQuadTree::Refine(uint64_t code, int level, const glm::vec3& cameraPos) {
+    if (ShouldSubdivide(code, level, cameraPos)) {
+        for (int child = 0; child < 4; ++child) {
+            Refine(GetChildCode(code, child), level + 1, cameraPos);
+        }
+    } else {
+        Emit(code, level);
+    }
+}
+
+void LinearQuadTree::Emit(uint64_t code, int level) {
+    m_nextCodes.push_back(code);
+    m_nextLevels.push_back(static_cast<uint8_t>(level));
+}
+
+uint64_t LinearQuadTree::FindLeaf(uint64_t code, size_t hint) const {
+    if (m_sortKeys.empty()) return 0;
+    
+    // Leaves don't overlap, so the only candidate is the last one starting at or before code
+    int level = GetCodeLevel(code);
+    uint64_t key = GetSortKey(code, level);
+    
+    // Gallop out from the hint to bracket the key, then binary search the bracket
+    size_t low = 0, high = m_sortKeys.size();
+    hint = std::min(hint, m_sortKeys.size() - 1);
+    if (m_sortKeys[hint] <= key) {
+        size_t step = 1;
+        low = hint;
+        while (low + step < high && m_sortKeys[low + step] <= key) {
+            low += step;
+            step *= 2;
+        }
+        high = std::min(low + step, high);
+    } else {
+        size_t step = 1;
+        high = hint;
+        while (step <= high && m_sortKeys[high - step] > key) {
+            high -= step;
+            step *= 2;
+        }
+        low = step <= high ? high - step : 0;
+    }
+    auto it = std::upper_bound(m_sortKeys.begin() + low, m_sortKeys.begin() + high, key);
+    if (it == m_sortKeys.begin()) return 0;
+    size_t index = static_cast<size_t>(it - m_sortKeys.begin()) - 1;
+    
+    int leafLevel = m_levels[index];
+    if (leafLevel > level || GetAncestorCode(code, level, leafLevel) != m_codes[index]) {
+        return 0;
+    }
+    return m_codes[index];
+}
+
+size_t LinearQuadTree::GetMemoryBytes() const {
+    return m_codes.capacity() * sizeof(uint64_t) + m_sortKeys.capacity() * sizeof(uint64_t)
+         + m_levels.capacity() * sizeof(uint8_t)
+         + m_nextCodes.capacity() * sizeof(uint64_t) + m_nextLevels.capacity() * sizeof(uint8_t);
+}
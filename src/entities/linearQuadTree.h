@@ -0,0 +1,78 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+// Cube-sphere quadtree stored as a flat list of leaf location codes instead
+// of linked QuadNodes. Bounds, parents, children and neighbours all come from
+// arithmetic on the code, so traversals are linear scans over contiguous
+// arrays. Subdivision follows the same distance test as QuadNode, so for the
+// same camera both trees have the same leaves.
+//
+// Location code layout, most significant bit first:
+//   face (3 bits) | unused | 1 (level marker) | level x 2 bits Morton (y, x)
+// so a node's children are (code << 2) | child, where child = y * 2 + x
+// matches QuadNode's child order. Leaves are kept in depth-first order,
+// which is ascending order of their left-aligned codes, so lookups are a
+// binary search over a flat array.
+class LinearQuadTree {
+public:
+    static constexpr int MAX_LEVEL = 29;
+    
+    static uint64_t MakeCode(int face, int level, uint32_t x, uint32_t y);
+    static int GetCodeFace(uint64_t code) { return static_cast<int>(code >> 61); }
+    static int GetCodeLevel(uint64_t code);
+    static void DecodeTile(uint64_t code, uint32_t& x, uint32_t& y);
+    static void GetCodeBounds(uint64_t code, glm::vec2& topLeft, glm::vec2& bottomRight);
+    static uint64_t GetParentCode(uint64_t code);
+    static uint64_t GetChildCode(uint64_t code, int child) { return (code << 2 & ~FACE_MASK) | (code & FACE_MASK) | static_cast<uint64_t>(child); }
+    static uint64_t GetAncestorCode(uint64_t code, int level) { return GetAncestorCode(code, GetCodeLevel(code), level); }
+    static uint64_t GetAncestorCode(uint64_t code, int codeLevel, int level);
+    // Morton bits moved up to the finest level, orders leaves depth first
+    static uint64_t GetSortKey(uint64_t code, int codeLevel);
+    static bool IsDescendantOrSelf(uint64_t code, uint64_t ancestor);
+    // Same-level neighbour one step along x (dx) or y (dy), wrapping onto the
+    // adjacent cube face at the edges. Exact up to float precision (level ~20).
+    static uint64_t GetNeighborCode(uint64_t code, int dx, int dy);
+    
+    LinearQuadTree(float radius = 1.0f, int maxLevel = 8);
+    
+    // Splits and merges leaves for the new camera position in one ordered pass
+    void Update(const glm::vec3& cameraPos);
+    
+    size_t GetLeafCount() const { return m_codes.size(); }
+    const std::vector<uint64_t>& GetLeafCodes() const { return m_codes; }
+    const std::vector<uint8_t>& GetLeafLevels() const { return m_levels; }
+    size_t GetMemoryBytes() const;
+    
+    // Leaf covering code's region (code itself or an ancestor), 0 when that
+    // region is subdivided further than code. hint is a leaf index to search
+    // outwards from; neighbours are usually only a few entries away.
+    uint64_t FindLeaf(uint64_t code, size_t hint = 0) const;
+    // Leaf next to leaf index across one edge, 0 when the neighbours there are finer
+    uint64_t FindNeighbor(size_t leafIndex, int dx, int dy) const { return FindLeaf(GetNeighborCode(m_codes[leafIndex], dx, dy), leafIndex); }
+    
+private:
+    static constexpr uint64_t FACE_MASK = 7ull << 61;
+    
+    float m_radius;
+    int m_maxLevel;
+    
+    // Leaves, structure of arrays in depth-first order
+    std::vector<uint64_t> m_codes;
+    std::vector<uint64_t> m_sortKeys;   // ascending, searched by FindLeaf
+    std::vector<uint8_t> m_levels;
+    
+    // Update scratch, kept to avoid reallocating every frame
+    std::vector<uint64_t> m_nextCodes;
+    std::vector<uint8_t> m_nextLevels;
+    uint64_t m_pathCodes[MAX_LEVEL + 1];
+    bool m_pathSplit[MAX_LEVEL + 1];
+    int m_pathDepth;
+    
+    bool ShouldSubdivide(uint64_t code, int level, const glm::vec3& cameraPos) const;
+    bool CachedShouldSubdivide(uint64_t code, int level, const glm::vec3& cameraPos);
+    void Refine(uint64_t code, int level, const glm::vec3& cameraPos);
+    void Emit(uint64_t code, int level);
+};
@@ -0,0 +1,134 @@
+#include "patchPrefetcher.h"
+#include "core/profiler.h"
+#include "core/threadPool.h"
+
+#include <chrono>
+
+PatchPrefetcher::PatchPrefetcher() : m_frame(0), m_issuedThisFrame(0), m_active(false), m_synchronous(false), m_stopping(false) {
+}
+
+PatchPrefetcher::~PatchPrefetcher() {
+    // Queued builds bail out early, running ones are waited for since they call back into us
+    m_stopping = true;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_inFlight.empty(); });
+}
+
+void PatchPrefetcher::BeginFrame(bool active) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_frame++;
+    m_issuedThisFrame = 0;
+    m_active = active;
+    
+    // Patches the prediction stopped asking for are not coming back
+    for (auto it = m_stored.begin(); it != m_stored.end();) {
+        if (m_frame - it->second.lastWanted > EXPIRY_FRAMES) {
+            auto expired = it++;
+            DropEntry(expired);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool PatchPrefetcher::Request(uint64_t key, std::function<bool(std::vector<Vertex>&)> build) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_stored.find(key);
+        if (it != m_stored.end()) {
+            it->second.lastWanted = m_frame;
+            return false;
+        }
+        if (m_inFlight.count(key)) return false;
+        
+        size_t maxInFlight = static_cast<size_t>(ThreadPool::Get().GetWorkerCount()) * 2;
+        if (m_issuedThisFrame >= MAX_ISSUED_PER_FRAME || m_inFlight.size() >= maxInFlight) {
+            return false;
+        }
+        
+        m_inFlight.insert(key);
+        m_issuedThisFrame++;
+        m_stats.issued++;
+    }
+    
+    if (m_synchronous) {
+        std::vector<Vertex> patch;
+        auto start = std::chrono::steady_clock::now();
+        bool exact = build(patch);
+        Complete(key, std::move(patch), exact, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        return true;
+    }
+    ThreadPool::Get().Submit([this, key, build = std::move(build)]() {
+        std::vector<Vertex> patch;
+        bool exact = false;
+        double buildMs = 0.0;
+        if (!m_stopping) {
+            PROFILE_ZONE("Patch Prefetch");
+            auto start = std::chrono::steady_clock::now();
+            exact = build(patch);
+            buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        Complete(key, std::move(patch), exact, buildMs);
+    });
+    return true;
+}
+
+void PatchPrefetcher::Complete(uint64_t key, std::vector<Vertex>&& patch, bool exact, double buildMs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_inFlight.erase(key);
+    
+    if (m_superseded.erase(key) || patch.empty()) {
+        m_stats.wasted++;
+        m_stats.wastedMs += buildMs;
+    } else {
+        if (m_stored.size() >= MAX_STORED) {
+            // Make room by dropping the entry the prediction wanted least recently
+            auto oldest = m_stored.begin();
+            for (auto it = m_stored.begin(); it != m_stored.end(); ++it) {
+                if (it->second.lastWanted < oldest->second.lastWanted) oldest = it;
+            }
+            DropEntry(oldest);
+        }
+        m_stored[key] = Entry{ std::move(patch), exact, buildMs, m_frame };
+    }
+    
+    if (m_inFlight.empty()) {
+        m_idle.notify_all();
+    }
+}
+
+bool PatchPrefetcher::Take(uint64_t key, std::vector<Vertex>& patch, bool& exact) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_stored.find(key);
+    if (it != m_stored.end()) {
+        patch = std::move(it->second.patch);
+        exact = it->second.exact;
+        m_stored.erase(it);
+        m_stats.hits++;
+        return true;
+    }
+    
+    if (m_inFlight.count(key)) {
+        // The node can't wait, whatever the worker produces is now redundant
+        m_superseded.insert(key);
+        m_stats.late++;
+        m_stats.misses++;
+    } else if (m_active) {
+        m_stats.misses++;
+    }
+    return false;
+}
+
+PrefetchStats PatchPrefetcher::GetStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    PrefetchStats stats = m_stats;
+    stats.inFlight = m_inFlight.size();
+    stats.stored = m_stored.size();
+    return stats;
+}
+
+void PatchPrefetcher::DropEntry(std::unordered_map<uint64_t, Entry>::iterator it) {
+    m_stats.wasted++;
+    m_stats.wastedMs += it->second.buildMs;
+    m_stored.erase(it);
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "cubesphere.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct PrefetchStats {
+    uint64_t issued = 0;        // patch builds started in the background
+    uint64_t hits = 0;          // nodes whose patch was ready when they appeared
+    uint64_t misses = 0;        // nodes built on the render thread while predicting
+    uint64_t late = 0;          // misses whose background build was still in flight
+    uint64_t wasted = 0;        // background builds dropped without being used
+    double wastedMs = 0.0;      // worker time spent on those
+    size_t inFlight = 0;
+    size_t stored = 0;
+    
+    double GetHitRate() const { return hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+};
+
+// Holds patches built ahead of time for nodes the quadtree is predicted to
+// create. Builds run on the shared ThreadPool under a per-frame and an
+// in-flight budget; finished patches wait here until the node appears and
+// takes them, or expire once the prediction stops asking for them.
+class PatchPrefetcher {
+public:
+    static constexpr int MAX_ISSUED_PER_FRAME = 8;
+    static constexpr int MAX_STORED = 256;
+    static constexpr uint64_t EXPIRY_FRAMES = 120;
+    
+    PatchPrefetcher();
+    ~PatchPrefetcher();
+    
+    PatchPrefetcher(const PatchPrefetcher&) = delete;
+    PatchPrefetcher& operator=(const PatchPrefetcher&) = delete;
+    
+    // active = a prediction is running this frame, render-thread builds count as misses
+    void BeginFrame(bool active);
+    // Starts build() in the background unless the key is stored, in flight or over budget.
+    // build fills the patch and returns whether it used exact heights.
+    bool Request(uint64_t key, std::function<bool(std::vector<Vertex>&)> build);
+    // Moves a finished patch out, false when the node has to build it itself
+    bool Take(uint64_t key, std::vector<Vertex>& patch, bool& exact);
+    
+    PrefetchStats GetStats() const;
+    // Run builds inside Request instead of on the pool
+    void SetSynchronous(bool synchronous) { m_synchronous = synchronous; }
+    
+private:
+    struct Entry {
+        std::vector<Vertex> patch;
+        bool exact;
+        double buildMs;
+        uint64_t lastWanted;
+    };
+    
+    mutable std::mutex m_mutex;
+    std::condition_variable m_idle;
+    std::unordered_map<uint64_t, Entry> m_stored;
+    std::unordered_set<uint64_t> m_inFlight;
+    std::unordered_set<uint64_t> m_superseded;  // built by the node while in flight
+    uint64_t m_frame;
+    int m_issuedThisFrame;
+    bool m_active;
+    bool m_synchronous;
+    std::atomic<bool> m_stopping;
+    PrefetchStats m_stats;
+    
+    void Complete(uint64_t key, std::vector<Vertex>&& patch, bool exact, double buildMs);
+    void DropEntry(std::unordered_map<uint64_t, Entry>::iterator it);
+};
@@ -1,15 +1,79 @@
 #include "planet.h"
 #include <epoxy/gl.h>
 #include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
 #include <iostream>
+#include <cstring>
+#include <cmath>
+#include <vector>
 
-Planet::Planet(const PlanetData& data) : m_data(data), m_currentRotation(0.0f) {
+namespace {
+
+// Stands in for the terrain while the quadtree is not built, in planet-local space
+bool IntersectSphere(const glm::vec3& origin, const glm::vec3& direction, float radius, float maxDistance, RayHit& hit) {
+    hit = RayHit();
+    hit.distance = maxDistance;
+    float length = glm::length(direction);
+    if (length <= 0.0f) return false;
+    glm::vec3 unit = direction / length;
+    float b = glm::dot(origin, unit);
+    float c = glm::dot(origin, origin) - radius * radius;
+    float discriminant = b * b - c;
+    if (discriminant < 0.0f) return false;
+    float root = std::sqrt(discriminant);
+    float t = -b - root;
+    if (t < 0.0f) t = -b + root;
+    if (t < 0.0f || t > maxDistance) return false;
+    hit.hit = true;
+    hit.distance = t;
+    hit.position = origin + unit * t;
+    hit.normal = hit.position / radius;
+    return true;
+}
+
+}
+
+Planet::Planet(const PlanetData& data)
+    : m_data(data), m_currentRotation(0.0f), m_heightScale(1.0f), m_backend(TerrainBackend::MESH),
+      m_synchronous(false), m_planetId(0), m_tileCacheCapacity(0) {
+}
+
+Planet::~Planet() = default;
+
+void Planet::Materialize() {
+    if (m_sphere) return;
     // Create cube sphere with appropriate LOD for 25-unit Earth
     m_sphere = std::make_unique<CubeSphere>(m_data.radius, 6); // Max LOD 6 for better performance
+    m_sphere->SetBackend(m_backend);
+    m_sphere->SetSynchronous(m_synchronous);
+    if (m_terrain) {
+        m_sphere->SetHeightSource(m_terrain.get(), m_heightScale);
+    }
+    OpenTileCache();
+    if (m_albedo) {
+        m_virtualTexture = std::make_unique<VirtualTexture>(m_albedo.get());
+        m_virtualTexture->SetSynchronous(m_synchronous);
+    }
 }
 
-Planet::~Planet() = default;
+void Planet::Release() {
+    // The sphere's background builds write into the tile cache, so it goes first
+    m_sphere.reset();
+    m_tileCache.reset();
+    m_virtualTexture.reset();
+    if (m_terrain) {
+        m_terrain->EvictUnpinned();
+    }
+    if (m_albedo) {
+        m_albedo->EvictUnpinned();
+    }
+}
+
+void Planet::SetTerrainBackend(TerrainBackend backend) {
+    m_backend = backend;
+    if (m_sphere) {
+        m_sphere->SetBackend(backend);
+    }
+}
 
 void Planet::Update(const glm::vec3& cameraPos, float deltaTime) {
     // Update rotation based on time (degrees per second)
@@ -18,39 +82,236 @@ void Planet::Update(const glm::vec3& cameraPos, float deltaTime) {
         m_currentRotation -= 360.0f;
     }
     
+    UpdateLOD(cameraPos);
+}
+
+float Planet::GetBoundingRadius() const {
+    float shellMin, shellMax;
+    CubeSphere::ComputeSurfaceShell(m_data.radius, m_terrain.get(), m_heightScale, shellMin, shellMax);
+    return shellMax;
+}
+
+void Planet::UpdateLOD(const glm::vec3& cameraPos) {
+    UpdateLOD(cameraPos, cameraPos);
+}
+
+void Planet::UpdateLOD(const glm::vec3& cameraPos, const glm::vec3& predictedCameraPos) {
+    if (!m_sphere) return;
+    
     // Transform camera position to planet's local coordinate system
     // This accounts for the planet's rotation so LOD stays fixed relative to camera
     glm::vec3 relativePos = cameraPos - m_data.position;
+    glm::vec3 relativePredicted = predictedCameraPos - m_data.position;
     
     // Apply inverse rotation to get camera position in planet's local space
     glm::mat4 inverseRotation = glm::rotate(glm::mat4(1.0f), 
                                           glm::radians(-m_currentRotation), 
                                           glm::vec3(0.0f, 1.0f, 0.0f));
     glm::vec4 localCameraPos = inverseRotation * glm::vec4(relativePos, 1.0f);
+    // The prediction uses today's rotation, the planet turns far less than the camera moves
+    glm::vec4 localPredictedPos = inverseRotation * glm::vec4(relativePredicted, 1.0f);
     
-    m_sphere->Update(glm::vec3(localCameraPos));
+    m_sphere->Update(glm::vec3(localCameraPos), glm::vec3(localPredictedPos));
+    if (m_virtualTexture) {
+        m_virtualTexture->Update();
+    }
 }
 
-void Planet::Render(GLuint shaderProgram, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPos) {
+glm::mat4 Planet::GetModelMatrix() const {
     // Create model matrix with position and rotation
     glm::mat4 model = glm::mat4(1.0f);
     model = glm::translate(model, m_data.position);
     model = glm::rotate(model, glm::radians(m_currentRotation), glm::vec3(0.0f, 1.0f, 0.0f));
+    return model;
+}
+
+ObjectUniforms Planet::GetObjectUniforms() const {
+    glm::mat4 model = GetModelMatrix();
     
-    // Set planet-specific uniforms (lighting is set globally in main)
-    GLint modelLoc = glGetUniformLocation(shaderProgram, "model");
-    GLint colorLoc = glGetUniformLocation(shaderProgram, "objectColor");
+    // Lighting is in the per-frame block, only model and colour are per planet
+    ObjectUniforms uniforms;
+    uniforms.model = model;
+    uniforms.normalMatrix = glm::transpose(glm::inverse(model));
+    uniforms.color = glm::vec4(m_data.color, 1.0f);
+    float surfaceLevels = m_virtualTexture ? static_cast<float>(m_virtualTexture->GetLevelCount()) : 0.0f;
+    uniforms.surface = glm::vec4(m_data.radius, m_atmosphere ? 1.0f : 0.0f, surfaceLevels, 0.0f);
+    return uniforms;
+}
+
+void Planet::Render(const ObjectUniformBuffer& objects, int slot) {
+    if (!m_sphere) return;
+    objects.Bind(slot);
+    if (m_atmosphere) {
+        m_atmosphere->Bind(m_data.position);
+    }
+    if (m_virtualTexture) {
+        m_virtualTexture->Bind();
+    }
+    m_sphere->Render();
+}
+
+void Planet::RenderFeedback(const ObjectUniformBuffer& objects, int slot, const Shader& feedbackProgram, int width, int height) {
+    if (!m_sphere || !m_virtualTexture) return;
+    if (!m_virtualTexture->BeginFeedback(feedbackProgram, width, height)) return;
+    objects.Bind(slot);
+    m_sphere->Render();
+    m_virtualTexture->EndFeedback();
+}
+
+void Planet::RenderSky(const Shader& skyProgram, const glm::mat4& viewProjection) {
+    if (!m_atmosphere) return;
+    m_atmosphere->RenderSky(skyProgram, m_data.position, viewProjection);
+}
+
+void Planet::EnableAtmosphere(const AtmosphereParams& params, const std::string& cacheDirectory) {
+    m_atmosphere = std::make_unique<Atmosphere>(params, m_data.radius / params.bottomRadius, cacheDirectory);
+}
+
+void Planet::Cull(const Shader& cullProgram) {
+    if (!m_sphere) return;
+    m_sphere->Cull(cullProgram, GetModelMatrix(), glm::vec4(m_data.position, GetBoundingRadius()));
+}
+
+bool Planet::EnableTerrain(const std::string& path, float heightScale, size_t residentBudgetBytes) {
+    auto terrain = std::make_unique<DemStreamer>(path, residentBudgetBytes);
+    if (!terrain->IsOpen()) {
+        return false;
+    }
+    terrain->SetSynchronous(m_synchronous);
+    m_terrain = std::move(terrain);
+    m_heightScale = heightScale;
+    if (m_sphere) {
+        m_sphere->SetHeightSource(m_terrain.get(), heightScale);
+    }
+    std::cout << m_data.name << " terrain: " << m_terrain->GetLevelCount() << " levels, heights "
+              << m_terrain->GetMinHeight() << " .. " << m_terrain->GetMaxHeight() << std::endl;
+    return true;
+}
+
+bool Planet::EnableSurfaceTexture(const std::string& path, size_t residentBudgetBytes) {
+    auto albedo = std::make_unique<AlbedoStreamer>(path, residentBudgetBytes);
+    if (!albedo->IsOpen()) {
+        return false;
+    }
+    albedo->SetSynchronous(m_synchronous);
+    // The virtual texture points into the streamer, so it goes first
+    m_virtualTexture.reset();
+    m_albedo = std::move(albedo);
+    if (m_sphere) {
+        m_virtualTexture = std::make_unique<VirtualTexture>(m_albedo.get());
+        m_virtualTexture->SetSynchronous(m_synchronous);
+    }
+    std::cout << m_data.name << " surface texture: " << m_albedo->GetLevelCount() << " levels of "
+              << ALBEDO_PAGE_SIZE << " texel pages" << std::endl;
+    return true;
+}
+
+void Planet::EnableTileCache(const std::string& directory, uint32_t planetId, uint32_t capacity) {
+    m_tileCacheDirectory = directory;
+    m_planetId = planetId;
+    m_tileCacheCapacity = capacity;
+    if (m_sphere) {
+        OpenTileCache();
+    }
+}
+
+void Planet::OpenTileCache() {
+    if (m_tileCacheDirectory.empty()) return;
     
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniform3f(colorLoc, 0.3f, 0.6f, 1.0f); // Force blue color
+    // Patch contents depend on the radius, the generator and the terrain, a change to any resets the store
+    uint32_t radiusBits;
+    std::memcpy(&radiusBits, &m_data.radius, sizeof(radiusBits));
+    uint64_t contentId = (static_cast<uint64_t>(CubeSphere::PATCH_FORMAT_VERSION) << 32) | radiusBits;
+    if (m_terrain) {
+        uint32_t scaleBits;
+        std::memcpy(&scaleBits, &m_heightScale, sizeof(scaleBits));
+        contentId ^= m_terrain->GetContentId() ^ (static_cast<uint64_t>(scaleBits) << 16);
+    }
     
-    m_sphere->Render();
+    // Detach the old store before it closes
+    m_sphere->SetTileCache(nullptr, m_planetId);
+    m_tileCache = std::make_unique<TileCache>(m_tileCacheDirectory + "/" + m_data.name + ".tiles", contentId,
+                                              CubeSphere::MAX_PATCH_VERTICES * sizeof(Vertex), m_tileCacheCapacity);
+    m_sphere->SetTileCache(m_tileCache->IsOpen() ? m_tileCache.get() : nullptr, m_planetId);
+}
+
+glm::mat3 Planet::GetRotationMatrix() const {
+    return glm::mat3(glm::rotate(glm::mat4(1.0f), glm::radians(m_currentRotation), glm::vec3(0.0f, 1.0f, 0.0f)));
+}
+
+RayHit Planet::ToWorld(const RayHit& local, const glm::mat3& rotation) const {
+    RayHit hit = local;
+    if (hit.hit) {
+        hit.position = rotation * local.position + m_data.position;
+        hit.normal = rotation * local.normal;
+    }
+    return hit;
+}
+
+bool Planet::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const {
+    // Rotations preserve length, so distances carry over unchanged
+    glm::mat3 rotation = GetRotationMatrix();
+    glm::mat3 inverse = glm::transpose(rotation);
+    RayHit local;
+    glm::vec3 localOrigin = inverse * (origin - m_data.position);
+    if (m_sphere) {
+        m_sphere->Raycast(localOrigin, inverse * direction, maxDistance, local);
+    } else {
+        IntersectSphere(localOrigin, inverse * direction, m_data.radius, maxDistance, local);
+    }
+    hit = ToWorld(local, rotation);
+    return hit.hit;
+}
+
+void Planet::RaycastBatch(const glm::vec3* origins, const glm::vec3* directions, size_t count, float maxDistance, RayHit* hits) const {
+    glm::mat3 rotation = GetRotationMatrix();
+    glm::mat3 inverse = glm::transpose(rotation);
+    std::vector<glm::vec3> localOrigins(count), localDirections(count);
+    for (size_t i = 0; i < count; ++i) {
+        localOrigins[i] = inverse * (origins[i] - m_data.position);
+        localDirections[i] = inverse * directions[i];
+    }
+    if (m_sphere) {
+        m_sphere->RaycastBatch(localOrigins.data(), localDirections.data(), count, maxDistance, hits);
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            IntersectSphere(localOrigins[i], localDirections[i], m_data.radius, maxDistance, hits[i]);
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        hits[i] = ToWorld(hits[i], rotation);
+    }
+}
+
+glm::vec3 Planet::GetClosestSurfacePoint(const glm::vec3& point) const {
+    glm::mat3 rotation = GetRotationMatrix();
+    glm::vec3 local = glm::transpose(rotation) * (point - m_data.position);
+    if (!m_sphere) {
+        float length = glm::length(local);
+        return length > 0.0f ? m_data.position + (point - m_data.position) * (m_data.radius / length) : point;
+    }
+    return rotation * m_sphere->GetClosestSurfacePoint(local) + m_data.position;
+}
+
+float Planet::GetAltitude(const glm::vec3& point) const {
+    if (!m_sphere) return glm::length(point - m_data.position) - m_data.radius;
+    glm::vec3 local = glm::transpose(GetRotationMatrix()) * (point - m_data.position);
+    return m_sphere->GetAltitude(local);
+}
+
+const QuadTreeStats& Planet::GetLODStats() const {
+    static const QuadTreeStats EMPTY_STATS;
+    return m_sphere ? m_sphere->GetStats() : EMPTY_STATS;
 }
 
 int Planet::GetTriangleCount() const {
-    return m_sphere->GetTriangleCount();
+    return m_sphere ? m_sphere->GetTriangleCount() : 0;
 }
 
 int Planet::GetActiveNodeCount() const {
-    return m_sphere->GetActiveNodeCount();
+    return m_sphere ? m_sphere->GetActiveNodeCount() : 0;
+}
+
+PrefetchStats Planet::GetPrefetchStats() const {
+    return m_sphere ? m_sphere->GetPrefetchStats() : PrefetchStats();
 }
\ No newline at end of file
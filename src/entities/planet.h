@@ -1,6 +1,16 @@
 #pragma once
 
 #include "cubesphere.h"
+#include "patchPrefetcher.h"
+#include "graphics/uniformBuffer.h"
+#include "graphics/shader.h"
+#include "terrain/tileCache.h"
+#include "terrain/demStreamer.h"
+#include "terrain/heightAtlas.h"
+#include "terrain/normalAtlas.h"
+#include "terrain/albedoStreamer.h"
+#include "terrain/virtualTexture.h"
+#include "sky/atmosphere.h"
 #include <epoxy/gl.h>
 #include <glm/glm.hpp>
 #include <string>
@@ -17,24 +27,121 @@ struct PlanetData {
     // Human height ~ 1.7 meters for reference
 };
 
+// A planet starts out as a descriptor: data, terrain source and settings.
+// The quadtree, its GL buffers and the tile cache are only built by
+// Materialize, which PlanetManager calls once the body comes into view, and
+// are dropped again by Release. While not resident, the surface queries
+// answer against a smooth sphere of the base radius and the stats read zero.
 class Planet {
 public:
     Planet(const PlanetData& data);
     ~Planet();
     
+    bool IsResident() const { return m_sphere != nullptr; }
+    // Builds the quadtree and GL resources with the current settings; needs a GL context
+    void Materialize();
+    // Frees the quadtree, GL resources, tile cache and streamed terrain tiles;
+    // settings are kept for the next Materialize
+    void Release();
+    
     void Update(const glm::vec3& cameraPos, float deltaTime);
-    void Render(GLuint shaderProgram, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPos);
+    void UpdateLOD(const glm::vec3& cameraPos);
+    // Also prefetches patches for where the camera is predicted to be
+    void UpdateLOD(const glm::vec3& cameraPos, const glm::vec3& predictedCameraPos);
+    // Model matrix and colour for this frame, pushed into the shared ObjectData buffer
+    ObjectUniforms GetObjectUniforms() const;
+    // Binds this planet's ObjectData slot and draws. The tessellation backend
+    // needs the shaders/terrain.* program bound, the mesh backend shaders/basic.*
+    void Render(const ObjectUniformBuffer& objects, int slot);
+    // Draws the virtual texture's feedback pass for a width x height frame on
+    // the frames it wants one (VirtualTexture::BeginFeedback). Needs the
+    // shaders/virtualFeedback.frag program matching the backend bound.
+    void RenderFeedback(const ObjectUniformBuffer& objects, int slot, const Shader& feedbackProgram, int width, int height);
+    // Occlusion-culls the patches the next Render draws, see CubeSphere::Cull
+    void Cull(const Shader& cullProgram);
+    void SetTerrainBackend(TerrainBackend backend);
+    // Terrain, surface texture and sphere work on the calling thread instead of
+    // in the background. Headless runs compare image hashes across machines, and
+    // with worker threads which tiles, patches and pages had landed by a given
+    // frame varied with load, so the same run drew different frames. Costs
+    // frame time; set before enabling terrain or the surface texture.
+    void SetSynchronousStreaming(bool synchronous) { m_synchronous = synchronous; }
+    TerrainBackend GetTerrainBackend() const { return m_backend; }
+    const HeightAtlas* GetHeightAtlas() const { return m_sphere ? m_sphere->GetHeightAtlas() : nullptr; }
+    const NormalAtlas* GetNormalAtlas() const { return m_sphere ? m_sphere->GetNormalAtlas() : nullptr; }
     
     const PlanetData& GetData() const { return m_data; }
     glm::vec3 GetPosition() const { return m_data.position; }
+    void SetPosition(const glm::vec3& position) { m_data.position = position; }
     float GetRadius() const { return m_data.radius; }  // Already in meters
     float GetRadiusKm() const { return m_data.radius / 1000.0f; }
+    // Radius of a sphere around the centre that contains all terrain
+    float GetBoundingRadius() const;
+    
+    // Rotation in degrees, driven externally when a Simulation owns the state
+    float GetRotation() const { return m_currentRotation; }
+    void SetRotation(float degrees) { m_currentRotation = degrees; }
+    
+    // Surface queries in world space against the geometry currently drawn. See
+    // CubeSphere for the cost and threading rules.
+    bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const;
+    void RaycastBatch(const glm::vec3* origins, const glm::vec3* directions, size_t count, float maxDistance, RayHit* hits) const;
+    glm::vec3 GetClosestSurfacePoint(const glm::vec3& point) const;
+    float GetAltitude(const glm::vec3& point) const;
     
+    // Quadtree counters, maintained as the tree changes - cheap to read every frame
+    const QuadTreeStats& GetLODStats() const;
     int GetTriangleCount() const;
     int GetActiveNodeCount() const;
+    PrefetchStats GetPrefetchStats() const;
+    
+    // Displace the surface with a height pyramid from tools/demConverter.
+    // heightScale converts file heights (metres) into world units. Call before EnableTileCache.
+    bool EnableTerrain(const std::string& path, float heightScale, size_t residentBudgetBytes = 64ull * 1024 * 1024);
+    const DemStreamer* GetTerrain() const { return m_terrain.get(); }
+    
+    // Colour the surface from a page pyramid written by tools/albedoConverter,
+    // streamed through a virtual texture while the planet is resident
+    bool EnableSurfaceTexture(const std::string& path, size_t residentBudgetBytes = 64ull * 1024 * 1024);
+    const AlbedoStreamer* GetSurfaceTexture() const { return m_albedo.get(); }
+    const VirtualTexture* GetVirtualTexture() const { return m_virtualTexture.get(); }
+    
+    // Persist generated patches in <directory>/<name>.tiles, keyed with planetId.
+    // The store is opened while the planet is resident.
+    void EnableTileCache(const std::string& directory, uint32_t planetId, uint32_t capacity = 65536);
+    const TileCache* GetTileCache() const { return m_tileCache.get(); }
+    
+    // Loads or bakes the scattering tables now (see Atmosphere), scaled so the
+    // atmosphere's bottom radius is the planet's. Needs a GL context; the
+    // tables stay resident while the planet is released.
+    void EnableAtmosphere(const AtmosphereParams& params, const std::string& cacheDirectory);
+    Atmosphere* GetAtmosphere() { return m_atmosphere.get(); }
+    // Needs shaders/sky.vert/.frag bound; viewProjection without the camera translation
+    void RenderSky(const Shader& skyProgram, const glm::mat4& viewProjection);
     
 private:
     PlanetData m_data;
-    std::unique_ptr<CubeSphere> m_sphere;
+    std::unique_ptr<DemStreamer> m_terrain;     // data sources are declared first so they outlive the sphere
+    std::unique_ptr<TileCache> m_tileCache;
+    std::unique_ptr<AlbedoStreamer> m_albedo;
+    std::unique_ptr<CubeSphere> m_sphere;       // null until Materialize
+    std::unique_ptr<VirtualTexture> m_virtualTexture;   // with m_albedo, while resident
+    std::unique_ptr<Atmosphere> m_atmosphere;
     float m_currentRotation;
+    
+    // Settings applied to the sphere each time it is built
+    float m_heightScale;
+    TerrainBackend m_backend;
+    bool m_synchronous;
+    std::string m_tileCacheDirectory;           // empty without a tile cache
+    uint32_t m_planetId;
+    uint32_t m_tileCacheCapacity;
+    
+    void OpenTileCache();
+    
+    glm::mat4 GetModelMatrix() const;
+    
+    // World <-> planet-local (unrotated, centred) transforms for the queries
+    glm::mat3 GetRotationMatrix() const;
+    RayHit ToWorld(const RayHit& local, const glm::mat3& rotation) const;
 };
\ No newline at end of file
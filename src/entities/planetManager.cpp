@@ -1,7 +1,21 @@
 #include "planetManager.h"
+#include "core/memoryBudget.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
 
 PlanetManager::PlanetManager() {
     CreatePlanets();
+    GatherBounds();
+    m_bodyIndex.Build(m_bounds);
+}
+
+PlanetManager::PlanetManager(const std::vector<PlanetData>& bodies) {
+    for (const auto& body : bodies) {
+        m_planets.push_back(std::make_unique<Planet>(body));
+    }
+    GatherBounds();
+    m_bodyIndex.Build(m_bounds);
 }
 
 PlanetManager::~PlanetManager() = default;
@@ -48,30 +62,180 @@ void PlanetManager::CreatePlanets() {
     m_planets.push_back(std::make_unique<Planet>(marsData));
 }
 
+void PlanetManager::UpdateResidency(const std::vector<int>& visible, int nearestBody) {
+    ++m_frame;
+    m_lastUsedFrame.resize(m_planets.size(), 0);
+    for (int body : visible) {
+        MarkUsed(body);
+    }
+    // Out of view is not out of use: the ground under a camera looking at the
+    // sky still clamps it, and refining bodies must be able to merge back
+    if (nearestBody >= 0) {
+        MarkUsed(nearestBody);
+    }
+    for (int body : m_lodBodies) {
+        MarkUsed(body);
+    }
+    
+    // Only resident bodies are scanned, so the cost follows what has been in use
+    for (size_t i = 0; i < m_residentBodies.size();) {
+        if (m_frame - m_lastUsedFrame[m_residentBodies[i]] > RELEASE_AFTER_FRAMES) {
+            ReleaseResident(i);
+        } else {
+            ++i;
+        }
+    }
+    EnforceBudget();
+}
+
+void PlanetManager::MarkUsed(int body) {
+    if (!m_planets[body]->IsResident()) {
+        m_planets[body]->Materialize();
+        m_residentBodies.push_back(body);
+        m_materializeCount++;
+    }
+    m_lastUsedFrame[body] = m_frame;
+}
+
+void PlanetManager::ReleaseResident(size_t residentIndex) {
+    m_planets[m_residentBodies[residentIndex]]->Release();
+    m_residentBodies[residentIndex] = m_residentBodies.back();
+    m_residentBodies.pop_back();
+    m_releaseCount++;
+}
+
+void PlanetManager::EnforceBudget() {
+    MemoryBudget& budget = MemoryBudget::Get();
+    auto excess = [&budget] { return budget.GetExcess(MemoryKind::GPU) + budget.GetExcess(MemoryKind::CPU); };
+    while (budget.IsOverBudget()) {
+        // Bodies in use this frame are never taken, whatever the budget says
+        int victim = -1;
+        for (size_t i = 0; i < m_residentBodies.size(); ++i) {
+            uint64_t lastUsed = m_lastUsedFrame[m_residentBodies[i]];
+            if (lastUsed == m_frame) continue;
+            if (victim < 0 || lastUsed < m_lastUsedFrame[m_residentBodies[victim]]) {
+                victim = static_cast<int>(i);
+            }
+        }
+        if (victim < 0) break;
+        
+        size_t before = budget.GetUsed(MemoryKind::GPU) + budget.GetUsed(MemoryKind::CPU);
+        size_t excessBefore = excess();
+        ReleaseResident(static_cast<size_t>(victim));
+        size_t after = budget.GetUsed(MemoryKind::GPU) + budget.GetUsed(MemoryKind::CPU);
+        budget.RecordEviction(before > after ? before - after : 0);
+        // The rest is held by something other than planets (stars, small
+        // bodies, ...); releasing more would only throw away quadtrees
+        if (excess() >= excessBefore) break;
+    }
+    
+    bool unmet = budget.IsOverBudget();
+    if (unmet && !m_budgetUnmet) {
+        std::cerr << "Memory budget exceeded by " << excess() / (1024 * 1024)
+                  << " MB that releasing planets out of use can't free" << std::endl;
+    }
+    m_budgetUnmet = unmet;
+}
+
+void PlanetManager::GatherBounds() {
+    m_bounds.resize(m_planets.size());
+    for (size_t i = 0; i < m_planets.size(); ++i) {
+        m_bounds[i].center = glm::dvec3(m_planets[i]->GetPosition());
+        m_bounds[i].radius = m_planets[i]->GetBoundingRadius();
+    }
+}
+
+void PlanetManager::RefitBodies() {
+    GatherBounds();
+    m_bodyIndex.Refit(m_bounds);
+}
+
 void PlanetManager::Update(const glm::vec3& cameraPos, float deltaTime) {
     for (auto& planet : m_planets) {
-        planet->Update(cameraPos, deltaTime);
+        planet->SetRotation(std::fmod(planet->GetRotation() + planet->GetData().rotationSpeed * deltaTime, 360.0f));
     }
+    RefitBodies();
+    UpdateLOD(cameraPos, cameraPos);
 }
 
-void PlanetManager::Render(GLuint shaderProgram, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPos) {
-    for (auto& planet : m_planets) {
-        planet->Render(shaderProgram, view, projection, viewPos);
+void PlanetManager::UpdateLOD(const glm::vec3& cameraPos, const glm::vec3& predictedCameraPos) {
+    m_bodyIndex.QueryApparentSize(glm::dvec3(cameraPos), LOD_MIN_APPARENT_SIZE, m_queryScratch);
+    // Bodies that just dropped out get one more update to merge back to their roots
+    for (int body : m_lodBodies) {
+        if (std::find(m_queryScratch.begin(), m_queryScratch.end(), body) == m_queryScratch.end()) {
+            m_planets[body]->UpdateLOD(cameraPos, predictedCameraPos);
+        }
+    }
+    for (int body : m_queryScratch) {
+        m_planets[body]->UpdateLOD(cameraPos, predictedCameraPos);
     }
+    m_lodBodies.swap(m_queryScratch);
 }
 
-int PlanetManager::GetTotalTriangleCount() const {
-    int total = 0;
-    for (const auto& planet : m_planets) {
-        total += planet->GetTriangleCount();
+void PlanetManager::CollectVisible(const glm::mat4& viewProjection, std::vector<int>& visible) const {
+    m_bodyIndex.QueryFrustum(Frustum::FromMatrix(glm::dmat4(viewProjection)), visible);
+    std::sort(visible.begin(), visible.end());
+}
+
+void PlanetManager::Render(ObjectUniformBuffer& objects, const glm::mat4& viewProjection) {
+    CollectVisible(viewProjection, m_queryScratch);
+    objects.Begin();
+    for (int body : m_queryScratch) {
+        objects.Push(m_planets[body]->GetObjectUniforms());
+    }
+    objects.Upload();
+    
+    for (size_t i = 0; i < m_queryScratch.size(); ++i) {
+        m_planets[m_queryScratch[i]]->Render(objects, static_cast<int>(i));
     }
-    return total;
 }
 
-int PlanetManager::GetTotalNodeCount() const {
-    int total = 0;
+int PlanetManager::FindNearestBody(const glm::vec3& point, float* surfaceDistance) const {
+    double distance = 0.0;
+    int body = m_bodyIndex.FindNearest(glm::dvec3(point), &distance);
+    if (surfaceDistance) *surfaceDistance = static_cast<float>(distance);
+    return body;
+}
+
+void PlanetManager::FindNearestBodies(const glm::vec3& point, size_t count, std::vector<int>& bodies) const {
+    m_bodyIndex.FindNearest(glm::dvec3(point), count, bodies);
+}
+
+void PlanetManager::FindBodiesInRange(const glm::vec3& center, float radius, std::vector<int>& bodies) const {
+    m_bodyIndex.QuerySphere(glm::dvec3(center), radius, bodies);
+}
+
+int PlanetManager::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const {
+    // Candidates come back by sphere entry distance, so stop at the first one
+    // that starts beyond the best terrain hit
+    m_bodyIndex.QueryRay(glm::dvec3(origin), glm::dvec3(direction), maxDistance, m_queryScratch);
+    int hitBody = -1;
+    for (int body : m_queryScratch) {
+        const BodyBounds& bounds = m_bounds[body];
+        double entry = glm::length(glm::dvec3(origin) - bounds.center) - bounds.radius;
+        if (hitBody >= 0 && entry > hit.distance) break;
+        RayHit candidate;
+        float limit = hitBody >= 0 ? hit.distance : maxDistance;
+        if (m_planets[body]->Raycast(origin, direction, limit, candidate)) {
+            hit = candidate;
+            hitBody = body;
+        }
+    }
+    return hitBody;
+}
+
+QuadTreeStats PlanetManager::GetTotalLODStats() const {
+    QuadTreeStats total;
     for (const auto& planet : m_planets) {
-        total += planet->GetActiveNodeCount();
+        total += planet->GetLODStats();
     }
     return total;
+}
+
+int PlanetManager::GetTotalTriangleCount() const {
+    return static_cast<int>(GetTotalLODStats().triangles);
+}
+
+int PlanetManager::GetTotalNodeCount() const {
+    return GetTotalLODStats().leaves;
 }
\ No newline at end of file
@@ -1,24 +1,79 @@
 #pragma once
 
 #include "planet.h"
+#include "bodyBvh.h"
 #include <vector>
 #include <memory>
 
 class PlanetManager {
 public:
+    // Bodies this small on screen (radius over distance) keep a coarse quadtree
+    static constexpr double LOD_MIN_APPARENT_SIZE = 0.02;
+    // Frames a resident body may stay out of use before its quadtree and GL
+    // resources are released (frames rather than seconds, so replays match)
+    static constexpr uint64_t RELEASE_AFTER_FRAMES = 600;
+    
     PlanetManager();
+    explicit PlanetManager(const std::vector<PlanetData>& bodies);
     ~PlanetManager();
     
     void Update(const glm::vec3& cameraPos, float deltaTime);
-    void Render(GLuint shaderProgram, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPos);
+    // A body is in use while it is visible, the nearest one (FindNearestBody,
+    // -1 for none: the ground under the camera) or refined by last frame's
+    // UpdateLOD. Materializes bodies in use that aren't resident and releases
+    // the ones out of use for RELEASE_AFTER_FRAMES, or sooner, least recently
+    // used first, while MemoryBudget is over and releasing still brings the
+    // excess down. Once per frame with CollectVisible's result, before
+    // UpdateLOD; only resident bodies refine and draw.
+    void UpdateResidency(const std::vector<int>& visible, int nearestBody);
+    // Updates the quadtree of every body big enough on screen to need it,
+    // plus any that were last frame so they can collapse again
+    void UpdateLOD(const glm::vec3& cameraPos, const glm::vec3& predictedCameraPos);
+    // Refits the body index after positions change - once per frame, before any query
+    void RefitBodies();
+    // Fills one ObjectData slot per visible planet, uploads them together, then draws.
+    // Bodies not yet resident are skipped.
+    void Render(ObjectUniformBuffer& objects, const glm::mat4& viewProjection);
+    
+    // Body index queries, all returning indices into GetPlanets()
+    void CollectVisible(const glm::mat4& viewProjection, std::vector<int>& visible) const;
+    // -1 when there are no bodies. surfaceDistance is to the bounding sphere, not the terrain.
+    int FindNearestBody(const glm::vec3& point, float* surfaceDistance = nullptr) const;
+    void FindNearestBodies(const glm::vec3& point, size_t count, std::vector<int>& bodies) const;
+    void FindBodiesInRange(const glm::vec3& center, float radius, std::vector<int>& bodies) const;
+    // Nearest terrain hit over all bodies the ray's bounding spheres reach, -1 on a miss
+    int Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const;
     
     const std::vector<std::unique_ptr<Planet>>& GetPlanets() const { return m_planets; }
+    const BodyBvh& GetBodyIndex() const { return m_bodyIndex; }
     
+    // Sum of every planet's quadtree counters
+    QuadTreeStats GetTotalLODStats() const;
     int GetTotalTriangleCount() const;
     int GetTotalNodeCount() const;
+    size_t GetResidentCount() const { return m_residentBodies.size(); }
+    uint64_t GetMaterializeCount() const { return m_materializeCount; }
+    uint64_t GetReleaseCount() const { return m_releaseCount; }
+    // Still over MemoryBudget after this frame's releases, which stop once they free nothing
+    bool IsBudgetUnmet() const { return m_budgetUnmet; }
     
 private:
     std::vector<std::unique_ptr<Planet>> m_planets;
+    BodyBvh m_bodyIndex;
+    std::vector<BodyBounds> m_bounds;
+    std::vector<int> m_lodBodies;       // updated last frame
+    mutable std::vector<int> m_queryScratch;
+    
+    std::vector<int> m_residentBodies;
+    std::vector<uint64_t> m_lastUsedFrame;      // per body
+    uint64_t m_frame = 0;
+    uint64_t m_materializeCount = 0;
+    uint64_t m_releaseCount = 0;
+    bool m_budgetUnmet = false;
     
     void CreatePlanets();
+    void GatherBounds();
+    void MarkUsed(int body);
+    void ReleaseResident(size_t residentIndex);
+    void EnforceBudget();
 };
\ No newline at end of file
@@ -0,0 +1,306 @@
+#include "smallBodies.h"
+#include "bodyBvh.h"
+#include <glm/gtc/constants.hpp>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <map>
+#include <random>
+#include <utility>
+
+namespace {
+
+// Rock shape as a radius per direction. A smooth function of the direction
+// only, so every LOD samples the same rock and switching LODs barely pops.
+float RockRadius(const glm::vec3& direction) {
+    float bumps = std::sin(direction.x * 3.1f + 1.7f) * std::sin(direction.y * 2.7f + 0.4f) * std::sin(direction.z * 3.3f + 2.2f);
+    float detail = std::sin(direction.x * 7.3f + 0.6f) * std::sin(direction.y * 6.1f + 2.9f) * std::sin(direction.z * 6.7f + 1.1f);
+    return 1.0f + 0.18f * bumps + 0.07f * detail;
+}
+
+// Unit icosphere, each subdivision splits every triangle in four
+void BuildIcosphere(int subdivisions, std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices) {
+    const float t = (1.0f + std::sqrt(5.0f)) * 0.5f;
+    positions = {
+        {-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0},
+        {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t},
+        {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}
+    };
+    for (glm::vec3& position : positions) {
+        position = glm::normalize(position);
+    }
+    indices = {
+        0, 11, 5,  0, 5, 1,  0, 1, 7,  0, 7, 10,  0, 10, 11,
+        1, 5, 9,  5, 11, 4,  11, 10, 2,  10, 7, 6,  7, 1, 8,
+        3, 9, 4,  3, 4, 2,  3, 2, 6,  3, 6, 8,  3, 8, 9,
+        4, 9, 5,  2, 4, 11,  6, 2, 10,  8, 6, 7,  9, 8, 1
+    };
+
+    for (int level = 0; level < subdivisions; ++level) {
+        std::map<std::pair<unsigned int, unsigned int>, unsigned int> midpoints;
+        auto midpoint = [&](unsigned int a, unsigned int b) {
+            std::pair<unsigned int, unsigned int> edge(std::min(a, b), std::max(a, b));
+            auto it = midpoints.find(edge);
+            if (it != midpoints.end()) return it->second;
+            unsigned int index = static_cast<unsigned int>(positions.size());
+            positions.push_back(glm::normalize(positions[a] + positions[b]));
+            midpoints[edge] = index;
+            return index;
+        };
+        std::vector<unsigned int> split;
+        split.reserve(indices.size() * 4);
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            unsigned int ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            split.insert(split.end(), { a, ab, ca,  b, bc, ab,  c, ca, bc,  ab, bc, ca });
+        }
+        indices.swap(split);
+    }
+}
+
+} // namespace
+
+SmallBodySystem::SmallBodySystem(const glm::vec3& center)
+    : m_center(center), m_capacity(0), m_dirty(false), m_readbackNext(0), m_meshBytes(0),
+      m_memory("Small bodies", MemoryKind::GPU) {
+    m_visibleCounts.fill(0);
+    glGenVertexArrays(1, &m_VAO);
+    glGenBuffers(1, &m_VBO);
+    glGenBuffers(1, &m_EBO);
+    glGenBuffers(1, &m_instanceBuffer);
+    glGenBuffers(1, &m_visibleBuffer);
+    glGenBuffers(1, &m_commandBuffer);
+    for (Readback& readback : m_readback) {
+        glGenBuffers(1, &readback.buffer);
+    }
+    BuildMeshes();
+    m_memory.Set(GetGpuBytes());
+}
+
+SmallBodySystem::~SmallBodySystem() {
+    glDeleteVertexArrays(1, &m_VAO);
+    glDeleteBuffers(1, &m_VBO);
+    glDeleteBuffers(1, &m_EBO);
+    glDeleteBuffers(1, &m_instanceBuffer);
+    glDeleteBuffers(1, &m_visibleBuffer);
+    glDeleteBuffers(1, &m_commandBuffer);
+    for (Readback& readback : m_readback) {
+        if (readback.fence) glDeleteSync(readback.fence);
+        glDeleteBuffers(1, &readback.buffer);
+    }
+}
+
+void SmallBodySystem::BuildMeshes() {
+    // Every LOD goes into one vertex and one index buffer, the commands pick
+    // their ranges with firstIndex and baseVertex
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    for (int lod = 0; lod < LOD_COUNT; ++lod) {
+        std::vector<glm::vec3> directions;
+        std::vector<unsigned int> lodIndices;
+        BuildIcosphere(LOD_SUBDIVISIONS[lod], directions, lodIndices);
+
+        size_t baseVertex = vertices.size();
+        for (const glm::vec3& direction : directions) {
+            Vertex vertex;
+            vertex.position = direction * RockRadius(direction);
+            vertex.normal = glm::vec3(0.0f);
+            vertex.texCoord = glm::vec2(0.0f);
+            vertices.push_back(vertex);
+        }
+        // Smooth normals from the displaced faces
+        for (size_t i = 0; i < lodIndices.size(); i += 3) {
+            Vertex& a = vertices[baseVertex + lodIndices[i]];
+            Vertex& b = vertices[baseVertex + lodIndices[i + 1]];
+            Vertex& c = vertices[baseVertex + lodIndices[i + 2]];
+            glm::vec3 normal = glm::cross(b.position - a.position, c.position - a.position);
+            a.normal += normal;
+            b.normal += normal;
+            c.normal += normal;
+        }
+        for (size_t i = baseVertex; i < vertices.size(); ++i) {
+            vertices[i].normal = glm::normalize(vertices[i].normal);
+        }
+
+        DrawCommand& command = m_commands[lod];
+        command.count = static_cast<GLuint>(lodIndices.size());
+        command.instanceCount = 0;
+        command.firstIndex = static_cast<GLuint>(indices.size());
+        command.baseVertex = static_cast<GLint>(baseVertex);
+        command.baseInstance = 0;
+        indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+    }
+    m_meshBytes = vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int);
+
+    glBindVertexArray(m_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glEnableVertexAttribArray(1);
+
+    // One visible-list entry per instance; baseInstance moves each LOD to its own range
+    glBindBuffer(GL_ARRAY_BUFFER, m_visibleBuffer);
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+    glVertexAttribDivisor(3, 1);
+    glEnableVertexAttribArray(3);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void SmallBodySystem::AddBelt(const BeltParams& belt, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::normal_distribution<float> height(0.0f, belt.thickness * 0.25f);
+
+    m_instances.reserve(m_instances.size() + belt.count);
+    float inner2 = belt.innerRadius * belt.innerRadius;
+    float outer2 = belt.outerRadius * belt.outerRadius;
+    for (int i = 0; i < belt.count; ++i) {
+        SmallBodyInstance instance;
+        // Uniform over the ring's area, not its radius
+        float radius = std::sqrt(inner2 + (outer2 - inner2) * unit(random));
+        float angularSpeed = belt.angularSpeed * std::pow(belt.innerRadius / radius, 1.5f);
+        instance.orbit = glm::vec4(radius, unit(random) * glm::two_pi<float>(), angularSpeed,
+                                   glm::clamp(height(random), -belt.thickness * 0.5f, belt.thickness * 0.5f));
+        // Many small rocks, few large ones
+        float size = unit(random);
+        float scale = belt.minScale + (belt.maxScale - belt.minScale) * size * size * size;
+        instance.shape = glm::vec4(scale, (unit(random) - 0.5f) * 2.0f, unit(random) * 1000.0f, 0.0f);
+        float shade = 0.8f + 0.4f * unit(random);
+        instance.color = glm::vec4(belt.color * shade, 1.0f);
+        m_instances.push_back(instance);
+    }
+    m_dirty = true;
+}
+
+void SmallBodySystem::Upload() {
+    m_capacity = m_instances.size();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, m_instances.size() * sizeof(SmallBodyInstance), m_instances.data(), GL_STATIC_DRAW);
+    // Worst case every instance lands in the same LOD
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_visibleBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, LOD_COUNT * m_capacity * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    for (int lod = 0; lod < LOD_COUNT; ++lod) {
+        m_commands[lod].baseInstance = static_cast<GLuint>(lod * m_capacity);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(m_commands), m_commands.data(), GL_DYNAMIC_COPY);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    for (Readback& readback : m_readback) {
+        if (readback.fence) {
+            glDeleteSync(readback.fence);
+            readback.fence = nullptr;
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, sizeof(m_commands), nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    m_dirty = false;
+    m_memory.Set(GetGpuBytes());
+    std::cout << "Small bodies: " << m_capacity << " instances, "
+              << GetGpuBytes() / (1024.0 * 1024.0) << " MB" << std::endl;
+}
+
+void SmallBodySystem::Cull(const Shader& cullProgram, const glm::mat4& viewProjection, const glm::vec3& cameraPos,
+                           float pixelScale, float time) {
+    if (m_instances.empty()) return;
+    if (m_dirty) {
+        Upload();
+    }
+
+    ReadCounts();
+
+    // Zero the instance counts, the pass appends to them
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(m_commands), m_commands.data());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    Frustum frustum = Frustum::FromMatrix(glm::dmat4(viewProjection));
+    glm::vec4 planes[6];
+    for (int i = 0; i < 6; ++i) {
+        planes[i] = glm::vec4(frustum.planes[i]);
+    }
+    glUniform4fv(cullProgram.getUniformLocation("u_planes"), 6, &planes[0][0]);
+    cullProgram.setVec3("u_center", m_center);
+    cullProgram.setVec3("u_cameraPos", cameraPos);
+    cullProgram.setFloat("u_time", time);
+    cullProgram.setFloat("u_pixelScale", pixelScale);
+    cullProgram.setFloat("u_boundingScale", BOUNDING_SCALE);
+    cullProgram.setVec4("u_lodPixels", glm::vec4(LOD_MIN_PIXELS[0], LOD_MIN_PIXELS[1], LOD_MIN_PIXELS[2], LOD_MIN_PIXELS[3]));
+    cullProgram.setInt("u_count", static_cast<int>(m_instances.size()));
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BINDING, m_instanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_BINDING, m_visibleBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, m_commandBuffer);
+    GLuint groups = static_cast<GLuint>((m_instances.size() + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE);
+    glDispatchCompute(groups, 1, 1);
+    // The draw reads the commands and the visible list as an instanced attribute;
+    // the readback copy and the next reset write the commands through the buffer API
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+void SmallBodySystem::ReadCounts() {
+    // Oldest first, so the newest finished copy is the one that stays; copies
+    // still in flight keep the previous counts
+    for (int n = 0; n < READBACK_BUFFERS; ++n) {
+        Readback& readback = m_readback[(m_readbackNext + n) % READBACK_BUFFERS];
+        if (!readback.fence) continue;
+        GLenum status = glClientWaitSync(readback.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+        glDeleteSync(readback.fence);
+        readback.fence = nullptr;
+
+        std::array<DrawCommand, LOD_COUNT> drawn;
+        glBindBuffer(GL_COPY_READ_BUFFER, readback.buffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(drawn), drawn.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        for (int lod = 0; lod < LOD_COUNT; ++lod) {
+            m_visibleCounts[lod] = drawn[lod].instanceCount;
+        }
+    }
+}
+
+void SmallBodySystem::Render(const Shader& drawProgram, float time) {
+    if (m_instances.empty() || m_dirty) return;
+
+    drawProgram.setVec3("u_center", m_center);
+    drawProgram.setFloat("u_time", time);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BINDING, m_instanceBuffer);
+    glBindVertexArray(m_VAO);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, LOD_COUNT, 0);
+    glBindVertexArray(0);
+
+    // Keep the counts for the UI, read back by a later Cull once the fence has
+    // signalled. With every buffer still in flight the GPU is behind, skip it.
+    Readback& readback = m_readback[m_readbackNext];
+    if (!readback.fence) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+        glCopyBufferSubData(GL_DRAW_INDIRECT_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(m_commands));
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_readbackNext = (m_readbackNext + 1) % READBACK_BUFFERS;
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+size_t SmallBodySystem::GetVisibleTriangles() const {
+    size_t triangles = 0;
+    for (int lod = 0; lod < LOD_COUNT; ++lod) {
+        triangles += static_cast<size_t>(m_visibleCounts[lod]) * (m_commands[lod].count / 3);
+    }
+    return triangles;
+}
+
+size_t SmallBodySystem::GetGpuBytes() const {
+    return m_meshBytes + m_capacity * (sizeof(SmallBodyInstance) + LOD_COUNT * sizeof(GLuint));
+}
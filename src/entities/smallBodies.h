@@ -0,0 +1,109 @@
+#pragma once
+#include "cubesphere.h"
+#include "graphics/shader.h"
+#include "core/memoryBudget.h"
+
+#include <epoxy/gl.h>
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// std430 mirror of SmallBody in shaders/smallBodies.comp and .vert
+struct SmallBodyInstance {
+    glm::vec4 orbit;    // x: radius, y: phase (rad), z: angular speed (rad/s), w: height above the ring plane
+    glm::vec4 shape;    // x: scale, y: spin rate (rad/s), z: spin axis seed, w: unused
+    glm::vec4 color;
+};
+
+// A ring of rocks on circular orbits around the system centre, Keplerian
+// speed falloff from angularSpeed at the inner edge
+struct BeltParams {
+    int count = 100000;
+    float innerRadius = 70.0f;
+    float outerRadius = 100.0f;
+    float thickness = 3.0f;
+    float minScale = 0.03f;
+    float maxScale = 0.25f;
+    float angularSpeed = 0.05f;
+    glm::vec3 color = glm::vec3(0.55f, 0.5f, 0.45f);
+};
+
+// Asteroid belts and other small bodies, drawn from LOD_COUNT shared rock
+// meshes instead of a CubeSphere each. Instances live in one SSBO. Every
+// frame a compute pass moves them along their orbits, culls them against the
+// frustum, picks a LOD from projected size and appends the survivors to that
+// LOD's range of the visible list, counting them straight into the indirect
+// commands. One glMultiDrawElementsIndirect then draws all LODs; the visible
+// index reaches the vertex shader as an instanced attribute offset by each
+// command's baseInstance.
+class SmallBodySystem {
+public:
+    static constexpr int LOD_COUNT = 4;
+    static constexpr int WORKGROUP_SIZE = 64;           // local_size_x in shaders/smallBodies.comp
+    static constexpr GLuint INSTANCE_BINDING = 0;       // layout(binding = N) storage blocks in shaders/smallBodies.*
+    static constexpr GLuint VISIBLE_BINDING = 1;
+    static constexpr GLuint COMMAND_BINDING = 2;
+    static constexpr float BOUNDING_SCALE = 1.3f;       // rock radius over its scale, displacement included
+    // Smallest projected diameter in pixels drawn with each LOD, below the last one a body is culled
+    static constexpr float LOD_MIN_PIXELS[LOD_COUNT] = { 48.0f, 16.0f, 4.0f, 0.5f };
+    static constexpr int LOD_SUBDIVISIONS[LOD_COUNT] = { 3, 2, 1, 0 };
+
+    explicit SmallBodySystem(const glm::vec3& center);
+    ~SmallBodySystem();
+
+    SmallBodySystem(const SmallBodySystem&) = delete;
+    SmallBodySystem& operator=(const SmallBodySystem&) = delete;
+
+    // Scatters belt.count bodies, uploaded on the next Cull
+    void AddBelt(const BeltParams& belt, uint32_t seed);
+    // Needs shaders/smallBodies.comp bound. pixelScale is the projected size
+    // in pixels of one unit at distance one.
+    void Cull(const Shader& cullProgram, const glm::mat4& viewProjection, const glm::vec3& cameraPos,
+              float pixelScale, float time);
+    // Needs shaders/smallBodies.vert/.frag bound, draws what the last Cull kept
+    void Render(const Shader& drawProgram, float time);
+
+    size_t GetInstanceCount() const { return m_instances.size(); }
+    // Visible bodies per LOD, read back once the GPU is done so it is never waited on
+    const std::array<uint32_t, LOD_COUNT>& GetVisibleCounts() const { return m_visibleCounts; }
+    size_t GetVisibleTriangles() const;
+    size_t GetGpuBytes() const;
+
+private:
+    // Layout of the GL DrawElementsIndirectCommand
+    struct DrawCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    static constexpr int READBACK_BUFFERS = 3;      // count copies in flight
+
+    struct Readback {
+        GLuint buffer = 0;
+        GLsync fence = nullptr;     // set while the copy into buffer may be unfinished
+    };
+
+    glm::vec3 m_center;
+    std::vector<SmallBodyInstance> m_instances;
+    size_t m_capacity;              // instances the GPU buffers hold
+    bool m_dirty;
+
+    GLuint m_VAO, m_VBO, m_EBO;
+    GLuint m_instanceBuffer;
+    GLuint m_visibleBuffer;         // LOD_COUNT ranges of m_capacity instance indices
+    GLuint m_commandBuffer;
+    Readback m_readback[READBACK_BUFFERS];
+    int m_readbackNext;             // buffer the next Render copies into
+    std::array<DrawCommand, LOD_COUNT> m_commands;     // instanceCount 0, reset before every cull
+    std::array<uint32_t, LOD_COUNT> m_visibleCounts;
+    size_t m_meshBytes;
+    MemoryAccount m_memory;
+
+    void BuildMeshes();
+    void Upload();
+    void ReadCounts();
+};
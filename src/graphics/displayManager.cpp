@@ -1,18 +1,27 @@
 #include "displayManager.h"
+#include "core/profiler.h"
+#include <cstdlib>
 #include <iostream>
-#include <thread>
-#include <chrono>
 
 GLFWwindow* DisplayManager::window = nullptr;
+bool DisplayManager::headless = false;
 const int DisplayManager::WIDTH = 1280;
 const int DisplayManager::HEIGHT = 720;
 const int DisplayManager::FPS_CAP = 144;
 const char* DisplayManager::TITLE = "Space Explorer";
 
-long DisplayManager::lastFrameTime = getCurrentTime();
-float DisplayManager::delta = 0.0f;
+FramePacer DisplayManager::pacer(FPS_CAP);
 
-void DisplayManager::createDisplay() {
+void DisplayManager::createDisplay(bool headlessMode) {
+    headless = headlessMode;
+    bool nullPlatform = false;
+#ifdef GLFW_PLATFORM_NULL
+    // GLFW 3.4+: no X11 or Wayland to talk to, render without a window system
+    if (headless && !std::getenv("DISPLAY") && !std::getenv("WAYLAND_DISPLAY")) {
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+        nullPlatform = true;
+    }
+#endif
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW" << std::endl;
         return;
@@ -22,7 +31,19 @@ void DisplayManager::createDisplay() {
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
+    if (headless) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
+    if (nullPlatform) {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    }
+
     window = glfwCreateWindow(WIDTH, HEIGHT, TITLE, nullptr, nullptr);
+    if (!window && nullPlatform) {
+        // No EGL surfaceless support (or no EGL at all), try Mesa's OSMesa
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+        window = glfwCreateWindow(WIDTH, HEIGHT, TITLE, nullptr, nullptr);
+    }
     if (!window) {
         std::cerr << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -30,8 +51,14 @@ void DisplayManager::createDisplay() {
     }
 
     glfwMakeContextCurrent(window);
-    // Start in flight mode with cursor hidden
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    // VSync off, the frame pacer holds FPS_CAP - headless runs as fast as it can
+    pacer.SetVSyncMode(VSyncMode::OFF);
+    if (headless) {
+        pacer.SetTargetFps(0.0);
+    } else {
+        // Start in flight mode with cursor hidden
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
 
     // Epoxy initializes automatically when first OpenGL function is called
     // No manual initialization needed
@@ -47,13 +74,16 @@ void DisplayManager::createDisplay() {
 }
 
 void DisplayManager::updateDisplay() {
-    glfwSwapBuffers(window);
+    {
+        PROFILE_ZONE("Frame Pacing");
+        pacer.WaitForNextFrame();
+    }
+    {
+        PROFILE_ZONE("Swap");
+        glfwSwapBuffers(window);
+    }
+    pacer.FramePresented();
     glfwPollEvents();
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000 / FPS_CAP));
-
-    long currentFrameTime = getCurrentTime();
-    delta = (currentFrameTime - lastFrameTime)/1000.0f;
-    lastFrameTime = currentFrameTime;
 }
 
 bool DisplayManager::isCloseRequested() {
@@ -61,14 +91,10 @@ bool DisplayManager::isCloseRequested() {
 }
 
 float DisplayManager::getFrameTimeSeconds() {
-    return delta;
+    return pacer.GetFrameTimeSeconds();
 }
 
 void DisplayManager::closeDisplay() {
     glfwDestroyWindow(window);
     glfwTerminate();
 }
-
-long DisplayManager::getCurrentTime() {
-    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
-}
\ No newline at end of file
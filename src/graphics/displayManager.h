@@ -1,27 +1,31 @@
 #pragma once
 #include <epoxy/gl.h>
 #include <GLFW/glfw3.h>
+#include "framePacer.h"
 
 class DisplayManager {
 public:
-    static void createDisplay();
+    // Headless: invisible window, or with no display server at all (build
+    // machines) GLFW's null platform on an EGL surfaceless / OSMesa context.
+    // Rendering is then expected to go to a Framebuffer.
+    static void createDisplay(bool headless = false);
     static void updateDisplay();
     static void closeDisplay();
     static bool isCloseRequested();
+    static bool isHeadless() { return headless; }
     static int getWidth() { return WIDTH; }
     static int getHeight() { return HEIGHT; }
     static GLFWwindow* getWindow() { return window; }
     static float getFrameTimeSeconds();
+    static FramePacer& getFramePacer() { return pacer; }
 
 private:
     static GLFWwindow* window;
+    static bool headless;
     static const int WIDTH;
     static const int HEIGHT;
     static const int FPS_CAP;
     static const char* TITLE;
 
-    static long lastFrameTime;
-    static float delta;
-
-    static long getCurrentTime();
+    static FramePacer pacer;
 };
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include "dynamicResolution.h"
+#include <algorithm>
+#include <cmath>
+
+DynamicResolution::DynamicResolution(int outputWidth, int outputHeight)
+    : m_target(outputWidth, outputHeight), m_VAO(0), m_targetFrameMs(1000.0 / 144.0), m_sharpness(0.3f),
+      m_scale(MAX_SCALE), m_renderWidth(outputWidth), m_renderHeight(outputHeight), m_measurements(0) {
+    glGenVertexArrays(1, &m_VAO);
+}
+
+DynamicResolution::~DynamicResolution() {
+    glDeleteVertexArrays(1, &m_VAO);
+}
+
+void DynamicResolution::BeginScene(int outputWidth, int outputHeight) {
+    m_target.Resize(outputWidth, outputHeight);
+
+    // Begin collects whatever measurements finished since the last frame
+    m_timer.Begin();
+    if (m_timer.GetResolvedCount() != m_measurements) {
+        m_measurements = m_timer.GetResolvedCount();
+        Adjust(m_timer.GetLastMs());
+    }
+
+    m_renderWidth = std::max(1, static_cast<int>(std::lround(outputWidth * m_scale)));
+    m_renderHeight = std::max(1, static_cast<int>(std::lround(outputHeight * m_scale)));
+    m_target.Bind();
+    glViewport(0, 0, m_renderWidth, m_renderHeight);
+}
+
+void DynamicResolution::EndScene() {
+    m_timer.End();
+}
+
+void DynamicResolution::Adjust(double sceneMs) {
+    double target = GetSceneTargetMs();
+    m_sceneHistory.push_back(static_cast<float>(sceneMs));
+    m_scaleHistory.push_back(m_scale);
+    if (m_sceneHistory.size() > HISTORY_SIZE) {
+        m_sceneHistory.erase(m_sceneHistory.begin());
+        m_scaleHistory.erase(m_scaleHistory.begin());
+    }
+    if (target <= 0.0 || sceneMs <= 0.0) return;
+
+    double ratio = target / sceneMs;
+    if (std::abs(ratio - 1.0) < DEADBAND) return;
+    float desired = m_scale * static_cast<float>(std::sqrt(ratio));
+    float step = std::clamp((desired - m_scale) * GAIN, -MAX_STEP, MAX_STEP);
+    m_scale = std::clamp(m_scale + step, MIN_SCALE, MAX_SCALE);
+}
+
+void DynamicResolution::Present(const Shader& program) const {
+    GLint polygonMode[2];
+    glGetIntegerv(GL_POLYGON_MODE, polygonMode);
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glDisable(GL_DEPTH_TEST);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_target.GetColorTexture());
+    program.setInt("u_scene", 0);
+    program.setVec2("u_uvScale", static_cast<float>(m_renderWidth) / m_target.GetWidth(),
+                    static_cast<float>(m_renderHeight) / m_target.GetHeight());
+    program.setVec2("u_texelSize", 1.0f / m_target.GetWidth(), 1.0f / m_target.GetHeight());
+    // Nothing to sharpen at native resolution
+    program.setFloat("u_sharpness", m_scale < MAX_SCALE ? m_sharpness : 0.0f);
+    glBindVertexArray(m_VAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (depthTest) glEnable(GL_DEPTH_TEST);
+    glPolygonMode(GL_FRONT_AND_BACK, polygonMode[0]);
+}
+
+float DynamicResolution::GetHeldFraction() const {
+    if (m_sceneHistory.empty()) return 0.0f;
+    double target = GetSceneTargetMs();
+    size_t held = std::count_if(m_sceneHistory.begin(), m_sceneHistory.end(),
+                                [target](float ms) { return ms <= target; });
+    return static_cast<float>(held) / m_sceneHistory.size();
+}
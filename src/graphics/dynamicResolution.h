@@ -0,0 +1,70 @@
+#pragma once
+#include "framebuffer.h"
+#include "gpuTimer.h"
+#include "shader.h"
+#include <epoxy/gl.h>
+#include <vector>
+
+// Renders the scene into an offscreen target at a fraction of the output
+// size, then upscales it (optionally sharpened) into whatever framebuffer is
+// bound next, so the UI drawn afterwards stays at native resolution.
+//
+// The fraction is steered from the scene pass's own GPU time towards a share
+// of the target frame time. Pixel cost follows the area, so the scale moves
+// by the square root of the time ratio; the step is damped and capped since
+// each measurement is a few frames old by the time it arrives. The target
+// is allocated at full output size once, lower scales only shrink the viewport.
+class DynamicResolution {
+public:
+    static constexpr float MIN_SCALE = 0.5f;
+    static constexpr float MAX_SCALE = 1.0f;
+    static constexpr double SCENE_SHARE = 0.85;     // of the frame; UI, upscale and present take the rest
+    static constexpr double DEADBAND = 0.05;        // relative error left alone, so the scale settles
+    static constexpr float GAIN = 0.5f;
+    static constexpr float MAX_STEP = 0.05f;        // per measurement
+    static constexpr int HISTORY_SIZE = 256;
+
+    DynamicResolution(int outputWidth, int outputHeight);
+    ~DynamicResolution();
+
+    DynamicResolution(const DynamicResolution&) = delete;
+    DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+    void SetTargetFrameMs(double ms) { m_targetFrameMs = ms; }
+    double GetTargetFrameMs() const { return m_targetFrameMs; }
+    double GetSceneTargetMs() const { return m_targetFrameMs * SCENE_SHARE; }
+    void SetSharpness(float sharpness) { m_sharpness = sharpness; }
+    float GetSharpness() const { return m_sharpness; }
+
+    // Follows the output size, adjusts the scale from the latest measurement,
+    // binds the scene target with the scaled viewport and starts timing
+    void BeginScene(int outputWidth, int outputHeight);
+    void EndScene();
+    // Needs shaders/upscale.vert/.frag bound; covers the bound framebuffer's viewport
+    void Present(const Shader& program) const;
+
+    float GetScale() const { return m_scale; }
+    int GetRenderWidth() const { return m_renderWidth; }
+    int GetRenderHeight() const { return m_renderHeight; }
+    double GetSceneMs() const { return m_timer.GetLastMs(); }
+    // Share of the measured frames in the history at or under the scene target
+    float GetHeldFraction() const;
+    // Scene GPU ms and scale per measurement, oldest first, for plotting
+    const std::vector<float>& GetSceneHistory() const { return m_sceneHistory; }
+    const std::vector<float>& GetScaleHistory() const { return m_scaleHistory; }
+
+private:
+    Framebuffer m_target;
+    GpuTimer m_timer;
+    GLuint m_VAO;                   // empty, the full-screen triangle comes from gl_VertexID
+    double m_targetFrameMs;
+    float m_sharpness;
+    float m_scale;
+    int m_renderWidth;
+    int m_renderHeight;
+    unsigned long long m_measurements;
+    std::vector<float> m_sceneHistory;
+    std::vector<float> m_scaleHistory;
+
+    void Adjust(double sceneMs);
+};
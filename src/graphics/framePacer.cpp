@@ -0,0 +1,129 @@
+#include "framePacer.h"
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace {
+
+// Never spin for less than this, OS sleeps regularly overshoot by ~1 ms
+constexpr std::chrono::microseconds MIN_SPIN_MARGIN(500);
+constexpr std::chrono::microseconds MAX_SPIN_MARGIN(4000);
+
+}
+
+FramePacer::FramePacer(double targetFps)
+    : m_spinMargin(std::chrono::microseconds(1500)), m_started(false), m_vsyncMode(VSyncMode::OFF),
+      m_lastFrameSeconds(0.0), m_ring(HISTORY_SIZE, 0.0f), m_ringHead(0) {
+    SetTargetFps(targetFps);
+    m_history.reserve(HISTORY_SIZE);
+}
+
+void FramePacer::SetTargetFps(double fps) {
+    m_targetFps = fps;
+    if (fps > 0.0) {
+        m_period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps));
+    } else {
+        m_period = Clock::duration::zero();
+    }
+    // Re-anchor so a rate change does not burst or stall to catch up
+    m_deadline = Clock::now() + m_period;
+}
+
+bool FramePacer::IsAdaptiveVSyncSupported() const {
+    return glfwExtensionSupported("WGL_EXT_swap_control_tear") ||
+           glfwExtensionSupported("GLX_EXT_swap_control_tear");
+}
+
+void FramePacer::SetVSyncMode(VSyncMode mode) {
+    if (mode == VSyncMode::ADAPTIVE && !IsAdaptiveVSyncSupported()) {
+        mode = VSyncMode::ON;
+    }
+    m_vsyncMode = mode;
+
+    switch (mode) {
+        case VSyncMode::OFF:      glfwSwapInterval(0); break;
+        case VSyncMode::ON:       glfwSwapInterval(1); break;
+        case VSyncMode::ADAPTIVE: glfwSwapInterval(-1); break;
+    }
+    m_deadline = Clock::now() + m_period;
+}
+
+void FramePacer::WaitForNextFrame() {
+    // With vsync the swap itself paces the frame
+    if (m_vsyncMode != VSyncMode::OFF || m_period == Clock::duration::zero()) {
+        return;
+    }
+
+    Clock::time_point now = Clock::now();
+    if (!m_started) {
+        m_started = true;
+        m_deadline = now + m_period;
+    }
+
+    // Missed the deadline by more than a frame: start over instead of
+    // rushing a burst of short frames to catch up
+    if (now > m_deadline + m_period) {
+        m_deadline = now;
+    }
+
+    Clock::time_point sleepUntil = m_deadline - m_spinMargin;
+    if (now < sleepUntil) {
+        std::this_thread::sleep_until(sleepUntil);
+        Clock::time_point woke = Clock::now();
+        // Track the OS overshoot so the spin margin covers it next frame
+        auto overshoot = woke - sleepUntil;
+        auto target = std::clamp<Clock::duration>(overshoot * 2, MIN_SPIN_MARGIN, MAX_SPIN_MARGIN);
+        m_spinMargin = (m_spinMargin * 7 + target) / 8;
+    }
+
+    while (Clock::now() < m_deadline) {
+        std::this_thread::yield();
+    }
+
+    m_deadline += m_period;
+}
+
+void FramePacer::FramePresented() {
+    Clock::time_point now = Clock::now();
+    if (m_lastPresent.time_since_epoch().count() != 0) {
+        m_lastFrameSeconds = std::chrono::duration<double>(now - m_lastPresent).count();
+        m_ring[m_ringHead] = static_cast<float>(m_lastFrameSeconds * 1000.0);
+        m_ringHead = (m_ringHead + 1) % HISTORY_SIZE;
+        if (m_stats.sampleCount < HISTORY_SIZE) {
+            m_stats.sampleCount++;
+        }
+        UpdateStats();
+    }
+    m_lastPresent = now;
+}
+
+void FramePacer::UpdateStats() {
+    int count = m_stats.sampleCount;
+    int start = (m_ringHead - count + HISTORY_SIZE) % HISTORY_SIZE;
+
+    m_history.clear();
+    for (int i = 0; i < count; ++i) {
+        m_history.push_back(m_ring[(start + i) % HISTORY_SIZE]);
+    }
+
+    double sum = 0.0;
+    double sumSq = 0.0;
+    for (float ms : m_history) {
+        sum += ms;
+        sumSq += static_cast<double>(ms) * ms;
+    }
+    double mean = sum / count;
+
+    std::vector<float> sorted(m_history);
+    std::sort(sorted.begin(), sorted.end());
+    int p99Index = std::min(count - 1, static_cast<int>(std::ceil(count * 0.99)) - 1);
+
+    m_stats.lastFrameMs = m_lastFrameSeconds * 1000.0;
+    m_stats.meanMs = mean;
+    m_stats.stdDevMs = std::sqrt(std::max(0.0, sumSq / count - mean * mean));
+    m_stats.minMs = sorted.front();
+    m_stats.maxMs = sorted.back();
+    m_stats.p99Ms = sorted[std::max(0, p99Index)];
+    m_stats.achievedFps = mean > 0.0 ? 1000.0 / mean : 0.0;
+}
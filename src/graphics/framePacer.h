@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+enum class VSyncMode {
+    OFF = 0,        // pacer alone holds the target
+    ON = 1,         // swap waits for vblank, pacer does not sleep
+    ADAPTIVE = 2    // late frames tear instead of waiting a whole extra vblank
+};
+
+struct FrameStats {
+    double lastFrameMs = 0.0;
+    double meanMs = 0.0;
+    double stdDevMs = 0.0;
+    double minMs = 0.0;
+    double maxMs = 0.0;
+    double p99Ms = 0.0;
+    double achievedFps = 0.0;
+    int sampleCount = 0;
+};
+
+// Holds frames to a target rate with a sleep-then-spin wait: the OS sleep
+// covers most of the gap and a short spin lands on the deadline, avoiding
+// the millisecond-scale oversleep of a plain sleep. Also keeps a rolling
+// window of frame times for variance stats.
+class FramePacer {
+public:
+    FramePacer(double targetFps = 144.0);
+
+    void SetTargetFps(double fps);            // <= 0 means uncapped
+    double GetTargetFps() const { return m_targetFps; }
+
+    // Needs a current GL context; falls back to ON when adaptive is unsupported
+    void SetVSyncMode(VSyncMode mode);
+    VSyncMode GetVSyncMode() const { return m_vsyncMode; }
+    bool IsAdaptiveVSyncSupported() const;
+
+    // Blocks until the next frame deadline, call right before swapping buffers
+    void WaitForNextFrame();
+    // Records the frame interval, call right after swapping buffers
+    void FramePresented();
+
+    float GetFrameTimeSeconds() const { return static_cast<float>(m_lastFrameSeconds); }
+    const FrameStats& GetStats() const { return m_stats; }
+    // Frame times in ms, oldest first, for plotting
+    const std::vector<float>& GetHistory() const { return m_history; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr int HISTORY_SIZE = 512;
+
+    double m_targetFps;
+    Clock::duration m_period;
+    Clock::duration m_spinMargin;     // adapts to the observed sleep overshoot
+    Clock::time_point m_deadline;
+    Clock::time_point m_lastPresent;
+    bool m_started;
+    VSyncMode m_vsyncMode;
+
+    double m_lastFrameSeconds;
+    std::vector<float> m_ring;
+    int m_ringHead;
+    std::vector<float> m_history;
+    FrameStats m_stats;
+
+    void UpdateStats();
+};
@@ -0,0 +1,75 @@
+#include "framebuffer.h"
+#include <iostream>
+
+Framebuffer::Framebuffer(int width, int height)
+    : m_FBO(0), m_colorTexture(0), m_depthBuffer(0), m_width(width), m_height(height), m_complete(false),
+      m_memory("Render targets", MemoryKind::GPU) {
+    Allocate();
+}
+
+Framebuffer::~Framebuffer() {
+    Release();
+}
+
+void Framebuffer::Resize(int width, int height) {
+    if (width == m_width && height == m_height) return;
+    Release();
+    m_width = width;
+    m_height = height;
+    Allocate();
+}
+
+void Framebuffer::Bind() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+    glViewport(0, 0, m_width, m_height);
+}
+
+void Framebuffer::Unbind() {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Framebuffer::ReadPixels(std::vector<uint8_t>& pixels) const {
+    pixels.resize(static_cast<size_t>(m_width) * m_height * 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_FBO);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+void Framebuffer::Allocate() {
+    glGenTextures(1, &m_colorTexture);
+    glBindTexture(GL_TEXTURE_2D, m_colorTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, m_width, m_height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &m_depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_width, m_height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &m_FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_colorTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    m_complete = status == GL_FRAMEBUFFER_COMPLETE;
+    if (!m_complete) {
+        std::cerr << "Framebuffer " << m_width << "x" << m_height << " incomplete: 0x" << std::hex << status << std::dec << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // RGBA8 colour plus 24-bit depth, which drivers pad to 32
+    m_memory.Set(static_cast<size_t>(m_width) * m_height * 8);
+}
+
+void Framebuffer::Release() {
+    if (m_FBO) glDeleteFramebuffers(1, &m_FBO);
+    if (m_depthBuffer) glDeleteRenderbuffers(1, &m_depthBuffer);
+    if (m_colorTexture) glDeleteTextures(1, &m_colorTexture);
+    m_FBO = m_depthBuffer = m_colorTexture = 0;
+    m_complete = false;
+    m_memory.Set(0);
+}
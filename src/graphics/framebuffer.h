@@ -0,0 +1,41 @@
+#pragma once
+#include "core/memoryBudget.h"
+#include <epoxy/gl.h>
+#include <cstdint>
+#include <vector>
+
+// Offscreen render target - RGBA8 colour texture plus a 24-bit depth buffer
+class Framebuffer {
+public:
+    Framebuffer(int width, int height);
+    ~Framebuffer();
+
+    Framebuffer(const Framebuffer&) = delete;
+    Framebuffer& operator=(const Framebuffer&) = delete;
+
+    // Reallocates the attachments, contents are lost
+    void Resize(int width, int height);
+    // Binds for drawing and sets the viewport to the full target
+    void Bind() const;
+    static void Unbind();
+
+    // Tightly packed RGBA8 rows, bottom row first. Stalls until the GPU is done.
+    void ReadPixels(std::vector<uint8_t>& pixels) const;
+
+    bool IsComplete() const { return m_complete; }
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+    GLuint GetColorTexture() const { return m_colorTexture; }
+
+private:
+    GLuint m_FBO;
+    GLuint m_colorTexture;
+    GLuint m_depthBuffer;
+    int m_width;
+    int m_height;
+    bool m_complete;
+    MemoryAccount m_memory;
+
+    void Allocate();
+    void Release();
+};
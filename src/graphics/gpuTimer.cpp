@@ -0,0 +1,56 @@
+#include "gpuTimer.h"
+
+GpuTimer::GpuTimer() : m_current(0), m_active(false), m_lastMs(-1.0), m_resolved(0), m_frame(0) {
+    glGenQueries(2 * LATENCY, &m_queries[0][0]);
+    for (bool& pending : m_pending) pending = false;
+    for (unsigned long long& frame : m_frames) frame = 0;
+}
+
+GpuTimer::~GpuTimer() {
+    glDeleteQueries(2 * LATENCY, &m_queries[0][0]);
+}
+
+void GpuTimer::Begin() {
+    if (m_active) return;
+    Collect(false);
+
+    // A slot still in flight after LATENCY frames is dropped rather than waited on
+    m_current = (m_current + 1) % LATENCY;
+    m_pending[m_current] = false;
+    m_frames[m_current] = m_frame++;
+    glQueryCounter(m_queries[m_current][0], GL_TIMESTAMP);
+    m_active = true;
+}
+
+void GpuTimer::End() {
+    if (!m_active) return;
+    glQueryCounter(m_queries[m_current][1], GL_TIMESTAMP);
+    m_pending[m_current] = true;
+    m_active = false;
+}
+
+void GpuTimer::Finish() {
+    if (m_active) return;
+    Collect(true);
+}
+
+void GpuTimer::Collect(bool wait) {
+    m_results.clear();
+    // Oldest first, the slot after the current one was issued longest ago
+    for (int i = 1; i <= LATENCY; ++i) {
+        int slot = (m_current + i) % LATENCY;
+        if (!m_pending[slot]) continue;
+        if (!wait) {
+            GLuint available = 0;
+            glGetQueryObjectuiv(m_queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) continue;
+        }
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(m_queries[slot][0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(m_queries[slot][1], GL_QUERY_RESULT, &end);
+        m_lastMs = (end - begin) / 1.0e6;
+        m_resolved++;
+        m_pending[slot] = false;
+        m_results.push_back({ m_frames[slot], m_lastMs });
+    }
+}
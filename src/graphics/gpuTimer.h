@@ -0,0 +1,50 @@
+#pragma once
+#include <epoxy/gl.h>
+#include <vector>
+
+// GPU time between Begin and End from a pair of GL_TIMESTAMP queries, so
+// timers may nest (the whole frame around the scene pass). Results are read
+// a few frames late so the CPU never waits on the GPU; independent of the
+// profiler so release builds can measure it too.
+class GpuTimer {
+public:
+    static constexpr int LATENCY = 3;   // a Begin/End pair still unresolved this many Begins later is dropped
+
+    struct Result {
+        unsigned long long frame;       // GetFrame() of the Begin it measured
+        double ms;
+    };
+
+    GpuTimer();
+    ~GpuTimer();
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    void Begin();
+    void End();
+    // Waits for every pair still in flight, e.g. before reporting the last frames
+    void Finish();
+
+    // Most recent resolved frame, -1 until the first result arrives
+    double GetLastMs() const { return m_lastMs; }
+    // Results read so far; a change means GetLastMs is a new measurement
+    unsigned long long GetResolvedCount() const { return m_resolved; }
+    // Begins so far, minus one: the frame the pair being timed belongs to
+    unsigned long long GetFrame() const { return m_frame - 1; }
+    // Everything read by the last Begin or Finish, oldest first
+    const std::vector<Result>& GetResults() const { return m_results; }
+
+private:
+    GLuint m_queries[LATENCY][2];       // begin, end
+    bool m_pending[LATENCY];
+    unsigned long long m_frames[LATENCY];
+    int m_current;
+    bool m_active;
+    double m_lastMs;
+    unsigned long long m_resolved;
+    unsigned long long m_frame;
+    std::vector<Result> m_results;
+
+    void Collect(bool wait);
+};
@@ -0,0 +1,171 @@
+#include "occlusionCuller.h"
+#include "entities/bodyBvh.h"
+#include <algorithm>
+
+OcclusionCuller::OcclusionCuller()
+    : m_depthTexture(0), m_pyramidTexture(0), m_capacityWidth(0), m_capacityHeight(0), m_capacityLevels(0),
+      m_width(0), m_height(0), m_levels(0), m_viewProjection(1.0f), m_readbackNext(0),
+      m_memory("Occlusion pyramid", MemoryKind::GPU) {
+    glGenBuffers(1, &m_counterBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_counterBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(OcclusionStats), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    for (Readback& readback : m_readback) {
+        glGenBuffers(1, &readback.buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, sizeof(OcclusionStats), nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+OcclusionCuller::~OcclusionCuller() {
+    Release();
+    glDeleteBuffers(1, &m_counterBuffer);
+    for (Readback& readback : m_readback) {
+        if (readback.fence) glDeleteSync(readback.fence);
+        glDeleteBuffers(1, &readback.buffer);
+    }
+}
+
+void OcclusionCuller::Allocate(int width, int height) {
+    Release();
+    m_capacityWidth = width;
+    m_capacityHeight = height;
+    m_capacityLevels = 1;
+    while ((std::max(width, height) >> m_capacityLevels) > 0) {
+        m_capacityLevels++;
+    }
+
+    // Same format as the render targets' depth, so the copy needs no conversion
+    glGenTextures(1, &m_depthTexture);
+    glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenTextures(1, &m_pyramidTexture);
+    glBindTexture(GL_TEXTURE_2D, m_pyramidTexture);
+    glTexStorage2D(GL_TEXTURE_2D, m_capacityLevels, GL_R32F, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_memory.Set(GetGpuBytes());
+}
+
+void OcclusionCuller::Release() {
+    if (m_depthTexture) glDeleteTextures(1, &m_depthTexture);
+    if (m_pyramidTexture) glDeleteTextures(1, &m_pyramidTexture);
+    m_depthTexture = m_pyramidTexture = 0;
+    m_capacityWidth = m_capacityHeight = m_capacityLevels = 0;
+    m_levels = 0;
+    m_memory.Set(0);
+}
+
+size_t OcclusionCuller::GetGpuBytes() const {
+    // Depth padded to 32 bits, plus a full mip chain at a third on top of level 0
+    size_t pixels = static_cast<size_t>(m_capacityWidth) * m_capacityHeight;
+    return pixels * 4 + pixels * 4 * 4 / 3 + (1 + READBACK_BUFFERS) * sizeof(OcclusionStats);
+}
+
+void OcclusionCuller::CaptureDepth(const Shader& pyramidProgram, int width, int height, const glm::mat4& viewProjection) {
+    if (width <= 0 || height <= 0) {
+        Invalidate();
+        return;
+    }
+    // Grow only, dynamic resolution moves the captured size every few frames
+    if (width > m_capacityWidth || height > m_capacityHeight) {
+        Allocate(std::max(width, m_capacityWidth), std::max(height, m_capacityHeight));
+    }
+
+    glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_width = width;
+    m_height = height;
+    m_levels = 1;
+    while ((std::max(width, height) >> m_levels) > 0) {
+        m_levels++;
+    }
+    m_viewProjection = viewProjection;
+
+    // Level 0 straight from the depth, then each level the max of the one below
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+    pyramidProgram.setInt("u_depth", 0);
+    for (int level = 0; level < m_levels; ++level) {
+        glm::ivec2 source(std::max(width >> std::max(level - 1, 0), 1), std::max(height >> std::max(level - 1, 0), 1));
+        glm::ivec2 destination(std::max(width >> level, 1), std::max(height >> level, 1));
+        if (level > 0) {
+            glBindImageTexture(0, m_pyramidTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        }
+        glBindImageTexture(1, m_pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        pyramidProgram.setInt("u_firstLevel", level == 0 ? 1 : 0);
+        glUniform2i(pyramidProgram.getUniformLocation("u_sourceSize"), source.x, source.y);
+        glUniform2i(pyramidProgram.getUniformLocation("u_destinationSize"), destination.x, destination.y);
+        glDispatchCompute((destination.x + PYRAMID_WORKGROUP_SIZE - 1) / PYRAMID_WORKGROUP_SIZE,
+                          (destination.y + PYRAMID_WORKGROUP_SIZE - 1) / PYRAMID_WORKGROUP_SIZE, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    // The cull pass reads it with texelFetch
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void OcclusionCuller::BeginCull(const Shader& cullProgram, const glm::mat4& viewProjection) {
+    ReadStats();
+    OcclusionStats zero;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_counterBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COUNTER_BINDING, m_counterBuffer);
+
+    Frustum frustum = Frustum::FromMatrix(glm::dmat4(viewProjection));
+    glm::vec4 planes[6];
+    for (int i = 0; i < 6; ++i) {
+        planes[i] = glm::vec4(frustum.planes[i]);
+    }
+    glUniform4fv(cullProgram.getUniformLocation("u_planes"), 6, &planes[0][0]);
+    cullProgram.setMat4("u_pyramidViewProjection", m_viewProjection);
+    glUniform2i(cullProgram.getUniformLocation("u_pyramidSize"), m_width, m_height);
+    cullProgram.setInt("u_pyramidLevels", m_levels);
+    cullProgram.setInt("u_pyramid", PYRAMID_UNIT);
+    glActiveTexture(GL_TEXTURE0 + PYRAMID_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_pyramidTexture);
+}
+
+void OcclusionCuller::EndCull() {
+    glActiveTexture(GL_TEXTURE0 + PYRAMID_UNIT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    // The draws read the commands and counts written by the passes
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    // Keep the counters for the UI, read back by a later BeginCull once the
+    // fence has signalled. With every buffer still in flight the GPU is behind, skip it.
+    Readback& readback = m_readback[m_readbackNext];
+    if (readback.fence) return;
+    glBindBuffer(GL_COPY_READ_BUFFER, m_counterBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(OcclusionStats));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_readbackNext = (m_readbackNext + 1) % READBACK_BUFFERS;
+}
+
+void OcclusionCuller::ReadStats() {
+    // Oldest first, so the newest finished copy is the one that stays; copies
+    // still in flight keep the previous counters
+    for (int n = 0; n < READBACK_BUFFERS; ++n) {
+        Readback& readback = m_readback[(m_readbackNext + n) % READBACK_BUFFERS];
+        if (!readback.fence) continue;
+        GLenum status = glClientWaitSync(readback.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+        glDeleteSync(readback.fence);
+        readback.fence = nullptr;
+        glBindBuffer(GL_COPY_READ_BUFFER, readback.buffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(OcclusionStats), &m_stats);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "shader.h"
+#include "core/memoryBudget.h"
+#include <epoxy/gl.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+
+// Culled work over all bodies in a frame, read back once the GPU has finished it
+struct OcclusionStats {
+    uint32_t patchesTested = 0;
+    uint32_t patchesFrustumCulled = 0;
+    uint32_t patchesOccluded = 0;       // including every patch of an occluded body
+    uint32_t trianglesCulled = 0;       // mesh backend only, tessellated triangles are never counted
+    uint32_t bodiesTested = 0;
+    uint32_t bodiesOccluded = 0;
+};
+
+// Hierarchical-Z occlusion culling for the planet quadtrees. After the scene
+// is drawn its depth is copied out and reduced into a max-depth mip chain
+// (shaders/occlusionPyramid.comp). Next frame every body dispatches
+// shaders/occlusionCull.comp over its leaves: a leaf survives when its
+// bounding sphere is inside the current frustum and not behind the pyramid,
+// and the pass appends the leaf's indirect draw command to the body's draw
+// list with an atomic counter. The body then draws that list with one
+// glMultiDraw*IndirectCount, so hidden leaves cost no commands. The body's own
+// sphere is tested once per workgroup first, so a planet hidden behind
+// another costs no patch tests.
+//
+// The pyramid is a frame old and tested with that frame's view-projection, so
+// geometry that was hidden last frame and comes into view during fast motion
+// may be missing for one frame. Bounds partly off last frame's screen, or
+// crossing its camera plane, are never treated as occluded.
+class OcclusionCuller {
+public:
+    static constexpr int WORKGROUP_SIZE = 64;           // local_size_x in shaders/occlusionCull.comp
+    static constexpr int PYRAMID_WORKGROUP_SIZE = 8;    // local_size_x/y in shaders/occlusionPyramid.comp
+    static constexpr GLuint BOUNDS_BINDING = 0;         // layout(binding = N) storage blocks in shaders/occlusionCull.comp
+    static constexpr GLuint COMMAND_BINDING = 1;
+    static constexpr GLuint COUNTER_BINDING = 2;
+    static constexpr GLuint DRAW_BINDING = 3;
+    static constexpr GLuint PYRAMID_UNIT = 0;           // texture unit of the pyramid while culling
+    static constexpr int READBACK_BUFFERS = 3;          // counter copies in flight
+
+    OcclusionCuller();
+    ~OcclusionCuller();
+
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    // Needs shaders/occlusionCull.comp bound; sets the per-frame uniforms and
+    // zeroes the counters. The bodies' Cull calls follow with the program still
+    // bound, then EndCull before anything draws.
+    void BeginCull(const Shader& cullProgram, const glm::mat4& viewProjection);
+    void EndCull();
+
+    // Copies the depth of the bound read framebuffer's (0, 0, width, height)
+    // region and rebuilds the pyramid, for the next frame's BeginCull. Needs
+    // shaders/occlusionPyramid.comp bound.
+    void CaptureDepth(const Shader& pyramidProgram, int width, int height, const glm::mat4& viewProjection);
+    // Drops the pyramid, culling falls back to the frustum until the next capture
+    void Invalidate() { m_levels = 0; }
+    bool HasPyramid() const { return m_levels > 0; }
+
+    const OcclusionStats& GetStats() const { return m_stats; }
+    size_t GetGpuBytes() const;
+
+private:
+    struct Readback {
+        GLuint buffer = 0;
+        GLsync fence = nullptr;     // set while the copy into buffer may be unfinished
+    };
+
+    GLuint m_depthTexture;
+    GLuint m_pyramidTexture;        // R32F, level 0 at the depth's resolution
+    GLuint m_counterBuffer;
+    int m_capacityWidth;            // allocated size; the captured region may be smaller
+    int m_capacityHeight;
+    int m_capacityLevels;
+    int m_width;                    // captured region
+    int m_height;
+    int m_levels;                   // 0 = no pyramid
+    glm::mat4 m_viewProjection;     // of the captured frame
+    OcclusionStats m_stats;
+    Readback m_readback[READBACK_BUFFERS];
+    int m_readbackNext;             // buffer the next EndCull copies into
+    MemoryAccount m_memory;
+
+    void Allocate(int width, int height);
+    void Release();
+    void ReadStats();
+};
@@ -0,0 +1,298 @@
+#include "shaderCache.h"
+#include <GLFW/glfw3.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+constexpr uint32_t CACHE_MAGIC = 0x42505853;   // "SXPB"
+constexpr uint32_t CACHE_VERSION = 1;
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t binaryFormat;
+    uint32_t length;
+};
+
+uint64_t Fnv1a(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string GLString(GLenum name) {
+    const GLubyte* value = glGetString(name);
+    return value ? reinterpret_cast<const char*>(value) : "";
+}
+
+}
+
+ShaderCache& ShaderCache::Get() {
+    static ShaderCache instance;
+    return instance;
+}
+
+ShaderCache::ShaderCache() : m_directory("shader_cache"), m_hits(0), m_misses(0), m_workerWindow(nullptr) {
+}
+
+std::string ShaderCache::ReadSource(const std::string& path) {
+    std::ifstream file;
+    file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    try
+    {
+        file.open(path);
+        std::stringstream stream;
+        stream << file.rdbuf();
+        return stream.str();
+    }
+    catch (std::ifstream::failure& e)
+    {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+        std::cout << "Path: " << path << std::endl;
+        return "";
+    }
+}
+
+std::vector<ShaderStageSource> ShaderCache::LoadStages(const std::vector<std::string>& paths) {
+    std::vector<ShaderStageSource> stages;
+    for (const std::string& path : paths) {
+        std::string extension = std::filesystem::path(path).extension().string();
+        ShaderStageSource stage;
+        if (extension == ".vert")      { stage.type = GL_VERTEX_SHADER; stage.name = "VERTEX"; }
+        else if (extension == ".frag") { stage.type = GL_FRAGMENT_SHADER; stage.name = "FRAGMENT"; }
+        else if (extension == ".geom") { stage.type = GL_GEOMETRY_SHADER; stage.name = "GEOMETRY"; }
+        else if (extension == ".tesc") { stage.type = GL_TESS_CONTROL_SHADER; stage.name = "TESS_CONTROL"; }
+        else if (extension == ".tese") { stage.type = GL_TESS_EVALUATION_SHADER; stage.name = "TESS_EVALUATION"; }
+        else if (extension == ".comp") { stage.type = GL_COMPUTE_SHADER; stage.name = "COMPUTE"; }
+        else {
+            std::cout << "ERROR::SHADER::UNKNOWN_STAGE: " << path << std::endl;
+            continue;
+        }
+        stage.code = ReadSource(path);
+        stages.push_back(stage);
+    }
+    return stages;
+}
+
+uint64_t ShaderCache::ComputeKey(const std::vector<ShaderStageSource>& stages) const {
+    uint64_t hash = 14695981039346656037ull;
+    std::string driver = GLString(GL_VENDOR) + "|" + GLString(GL_RENDERER) + "|" + GLString(GL_VERSION);
+    hash = Fnv1a(hash, driver.data(), driver.size());
+    for (const ShaderStageSource& stage : stages) {
+        hash = Fnv1a(hash, &stage.type, sizeof(stage.type));
+        hash = Fnv1a(hash, stage.code.data(), stage.code.size());
+    }
+    return hash;
+}
+
+std::string ShaderCache::PathForKey(uint64_t key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+    return (std::filesystem::path(m_directory) / name).string();
+}
+
+GLuint ShaderCache::LoadBinary(uint64_t key) {
+    std::string path = PathForKey(key);
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return 0;
+
+    CacheHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        header.magic != CACHE_MAGIC || header.version != CACHE_VERSION) {
+        return 0;
+    }
+    std::vector<char> binary(header.length);
+    if (!file.read(binary.data(), header.length)) return 0;
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.binaryFormat, binary.data(), static_cast<GLsizei>(header.length));
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        // Driver rejected the binary (format no longer supported), recompile
+        glDeleteProgram(program);
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        return 0;
+    }
+    return program;
+}
+
+void ShaderCache::StoreBinary(uint64_t key, GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+    std::error_code ec;
+    std::filesystem::create_directories(m_directory, ec);
+
+    // Write to a temp file and rename so a crash never leaves a torn entry
+    std::string path = PathForKey(key);
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Failed to write shader cache entry " << tempPath << std::endl;
+            return;
+        }
+        CacheHeader header = { CACHE_MAGIC, CACHE_VERSION, format, static_cast<uint32_t>(length) };
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), length);
+    }
+    std::filesystem::rename(tempPath, path, ec);
+}
+
+GLuint ShaderCache::CompileProgram(const std::vector<ShaderStageSource>& stages) {
+    std::vector<GLuint> shaders;
+    for (const ShaderStageSource& stage : stages) {
+        const char* code = stage.code.c_str();
+        GLuint shader = glCreateShader(stage.type);
+        glShaderSource(shader, 1, &code, NULL);
+        glCompileShader(shader);
+        CheckCompileErrors(shader, stage.name);
+        shaders.push_back(shader);
+    }
+
+    GLuint program = glCreateProgram();
+    // Ask the driver to keep a retrievable binary around for StoreBinary
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    for (GLuint shader : shaders) {
+        glAttachShader(program, shader);
+    }
+    glLinkProgram(program);
+    CheckCompileErrors(program, "PROGRAM");
+
+    // delete the shaders as they're linked into our program now and no longer necessary
+    for (GLuint shader : shaders) {
+        glDeleteShader(shader);
+    }
+    return program;
+}
+
+GLuint ShaderCache::LoadOrCompile(uint64_t key, const std::vector<ShaderStageSource>& stages) {
+    GLuint program = LoadBinary(key);
+    if (program) {
+        m_hits++;
+        return program;
+    }
+
+    m_misses++;
+    program = CompileProgram(stages);
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (success) {
+        StoreBinary(key, program);
+    }
+    return program;
+}
+
+GLuint ShaderCache::GetProgram(const std::vector<ShaderStageSource>& stages) {
+    uint64_t key = ComputeKey(stages);
+
+    {
+        // Take the worker's program if this one was prewarmed
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto it = m_prewarmed.find(key);
+        if (it != m_prewarmed.end()) {
+            m_ready.wait(lock, [&] { return m_prewarmed[key] != 0; });
+            GLuint program = m_prewarmed[key];
+            m_prewarmed.erase(key);
+            return program;
+        }
+    }
+
+    return LoadOrCompile(key, stages);
+}
+
+void ShaderCache::PrewarmAsync(GLFWwindow* shareWith, const std::vector<std::vector<std::string>>& programPaths) {
+    // Only misses are worth a worker; hits load faster than a thread starts
+    std::vector<std::pair<uint64_t, std::vector<ShaderStageSource>>> misses;
+    for (const auto& paths : programPaths) {
+        std::vector<ShaderStageSource> stages = LoadStages(paths);
+        uint64_t key = ComputeKey(stages);
+        if (!std::filesystem::exists(PathForKey(key))) {
+            misses.emplace_back(key, std::move(stages));
+        }
+    }
+    if (misses.empty()) return;
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    m_workerWindow = glfwCreateWindow(1, 1, "Shader Prewarm", nullptr, shareWith);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (!m_workerWindow) {
+        std::cerr << "Failed to create shared context for shader prewarm" << std::endl;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& miss : misses) {
+            m_prewarmed[miss.first] = 0;
+        }
+    }
+
+    m_worker = std::thread([this, misses]() {
+        glfwMakeContextCurrent(m_workerWindow);
+        for (const auto& miss : misses) {
+            GLuint program = LoadOrCompile(miss.first, miss.second);
+            // Make sure the link is complete before another context uses the program
+            glFinish();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_prewarmed[miss.first] = program;
+            m_ready.notify_all();
+        }
+        glfwMakeContextCurrent(nullptr);
+    });
+}
+
+void ShaderCache::FinishPrewarm() {
+    if (m_worker.joinable()) {
+        m_worker.join();
+    }
+    if (m_workerWindow) {
+        glfwDestroyWindow(m_workerWindow);
+        m_workerWindow = nullptr;
+    }
+    // Prewarmed programs nobody asked for
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& entry : m_prewarmed) {
+        if (entry.second) glDeleteProgram(entry.second);
+    }
+    m_prewarmed.clear();
+}
+
+bool ShaderCache::CheckCompileErrors(GLuint object, const std::string& type) {
+    GLint success;
+    GLchar infoLog[1024];
+    if (type != "PROGRAM")
+    {
+        glGetShaderiv(object, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            glGetShaderInfoLog(object, 1024, NULL, infoLog);
+            std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+        }
+    }
+    else
+    {
+        glGetProgramiv(object, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glGetProgramInfoLog(object, 1024, NULL, infoLog);
+            std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+        }
+    }
+    return success != 0;
+}
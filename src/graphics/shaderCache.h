@@ -0,0 +1,70 @@
+#pragma once
+#include <epoxy/gl.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct GLFWwindow;
+
+struct ShaderStageSource {
+    GLenum type;            // GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, ...
+    std::string name;       // "VERTEX", "FRAGMENT", ... for error messages
+    std::string code;
+};
+
+// On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary).
+// Entries are keyed by a hash of every stage's source plus the GL vendor,
+// renderer and version strings, so a driver update simply misses. Misses can
+// be compiled ahead of time on a worker thread with a shared context; program
+// objects are shared between the contexts, so the main thread adopts them
+// directly.
+class ShaderCache {
+public:
+    static ShaderCache& Get();
+
+    void SetDirectory(const std::string& directory) { m_directory = directory; }
+
+    // Cached, prewarmed or freshly compiled program; needs a current GL context
+    GLuint GetProgram(const std::vector<ShaderStageSource>& stages);
+
+    // Compiles any uncached programs on a hidden shared-context window.
+    // Must be called from the main thread (GLFW window creation), as must
+    // FinishPrewarm, which joins the worker and destroys the window.
+    void PrewarmAsync(GLFWwindow* shareWith, const std::vector<std::vector<std::string>>& programPaths);
+    void FinishPrewarm();
+
+    static std::string ReadSource(const std::string& path);
+    // Stage type follows the file extension (.vert, .frag, .geom, .tesc, .tese, .comp)
+    static std::vector<ShaderStageSource> LoadStages(const std::vector<std::string>& paths);
+
+    int GetHitCount() const { return m_hits; }
+    int GetMissCount() const { return m_misses; }
+
+private:
+    ShaderCache();
+
+    std::string m_directory;
+    std::atomic<int> m_hits;
+    std::atomic<int> m_misses;
+
+    // Prewarm worker state
+    std::mutex m_mutex;
+    std::condition_variable m_ready;
+    std::map<uint64_t, GLuint> m_prewarmed;     // key -> linked program, 0 while pending
+    GLFWwindow* m_workerWindow;
+    std::thread m_worker;
+
+    uint64_t ComputeKey(const std::vector<ShaderStageSource>& stages) const;
+    std::string PathForKey(uint64_t key) const;
+    GLuint LoadBinary(uint64_t key);
+    void StoreBinary(uint64_t key, GLuint program);
+    GLuint LoadOrCompile(uint64_t key, const std::vector<ShaderStageSource>& stages);
+    static GLuint CompileProgram(const std::vector<ShaderStageSource>& stages);
+    static bool CheckCompileErrors(GLuint object, const std::string& type);
+};
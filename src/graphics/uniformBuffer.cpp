@@ -0,0 +1,77 @@
+#include "uniformBuffer.h"
+#include <cstdlib>
+#include <cstring>
+
+UniformBuffer::UniformBuffer(GLuint binding, GLsizeiptr size) : m_UBO(0), m_binding(binding), m_size(size) {
+    glGenBuffers(1, &m_UBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_UBO);
+    glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    Bind();
+}
+
+UniformBuffer::~UniformBuffer() {
+    if (m_UBO) glDeleteBuffers(1, &m_UBO);
+}
+
+void UniformBuffer::Update(const void* data, GLsizeiptr size, GLintptr offset) {
+    glBindBuffer(GL_UNIFORM_BUFFER, m_UBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::Bind() const {
+    glBindBufferBase(GL_UNIFORM_BUFFER, m_binding, m_UBO);
+}
+
+void UniformBuffer::BindRange(GLintptr offset, GLsizeiptr size) const {
+    glBindBufferRange(GL_UNIFORM_BUFFER, m_binding, m_UBO, offset, size);
+}
+
+ObjectUniformBuffer::ObjectUniformBuffer(int capacity) : m_UBO(0), m_capacity(0), m_count(0), m_staging(nullptr) {
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    GLsizeiptr size = sizeof(ObjectUniforms);
+    m_stride = (size + alignment - 1) / alignment * alignment;
+
+    glGenBuffers(1, &m_UBO);
+    Allocate(capacity);
+}
+
+ObjectUniformBuffer::~ObjectUniformBuffer() {
+    if (m_UBO) glDeleteBuffers(1, &m_UBO);
+    std::free(m_staging);
+}
+
+void ObjectUniformBuffer::Allocate(int capacity) {
+    m_capacity = capacity;
+    m_staging = static_cast<unsigned char*>(std::realloc(m_staging, m_stride * capacity));
+    glBindBuffer(GL_UNIFORM_BUFFER, m_UBO);
+    glBufferData(GL_UNIFORM_BUFFER, m_stride * capacity, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void ObjectUniformBuffer::Begin() {
+    m_count = 0;
+}
+
+int ObjectUniformBuffer::Push(const ObjectUniforms& data) {
+    if (m_count == m_capacity) {
+        Allocate(m_capacity * 2);
+    }
+    std::memcpy(m_staging + m_stride * m_count, &data, sizeof(ObjectUniforms));
+    return m_count++;
+}
+
+void ObjectUniformBuffer::Upload() {
+    if (m_count == 0) return;
+    glBindBuffer(GL_UNIFORM_BUFFER, m_UBO);
+    // Orphan last frame's storage so the upload never waits on in-flight draws
+    glBufferData(GL_UNIFORM_BUFFER, m_stride * m_capacity, nullptr, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, m_stride * m_count, m_staging);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void ObjectUniformBuffer::Bind(int slot) const {
+    glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BLOCK_BINDING, m_UBO, m_stride * slot, sizeof(ObjectUniforms));
+}
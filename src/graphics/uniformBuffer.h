@@ -0,0 +1,78 @@
+#pragma once
+#include <epoxy/gl.h>
+#include <glm/glm.hpp>
+
+// Binding points, must match the layout(binding = N) qualifiers in shaders/
+enum UniformBlockBinding {
+    FRAME_BLOCK_BINDING = 0,
+    OBJECT_BLOCK_BINDING = 1,
+    ATMOSPHERE_BLOCK_BINDING = 2
+};
+
+// std140 mirror of the FrameData block - only vec4/mat4 members so the
+// C++ and GLSL layouts match without manual padding
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 lightPos;         // w = 0: direction towards the sun, w = 1: point light position
+    glm::vec4 lightColor;
+    glm::vec4 viewPos;
+    glm::vec4 viewport;         // xy: render target size in pixels, z: tessellated edge length in pixels
+};
+
+// std140 mirror of the ObjectData block
+struct ObjectUniforms {
+    glm::mat4 model;
+    glm::mat4 normalMatrix;     // inverse-transpose of model, computed on the CPU
+    glm::vec4 color;
+    glm::vec4 surface;          // x: radius before displacement, for the tessellation backend; y: 1 with an atmosphere (shaders/atmosphere.frag);
+                                // z: virtual texture levels, 0 without one (shaders/virtualTexture.frag)
+};
+
+class UniformBuffer {
+public:
+    UniformBuffer(GLuint binding, GLsizeiptr size);
+    ~UniformBuffer();
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    void Update(const void* data, GLsizeiptr size, GLintptr offset = 0);
+    void Bind() const;
+    void BindRange(GLintptr offset, GLsizeiptr size) const;
+
+    GLuint GetID() const { return m_UBO; }
+    GLsizeiptr GetSize() const { return m_size; }
+
+private:
+    GLuint m_UBO;
+    GLuint m_binding;
+    GLsizeiptr m_size;
+};
+
+// Per-object blocks packed into one buffer. Slots are filled for the whole
+// frame, uploaded once, and each draw only rebinds its range.
+class ObjectUniformBuffer {
+public:
+    ObjectUniformBuffer(int capacity = 64);
+    ~ObjectUniformBuffer();
+
+    ObjectUniformBuffer(const ObjectUniformBuffer&) = delete;
+    ObjectUniformBuffer& operator=(const ObjectUniformBuffer&) = delete;
+
+    void Begin();
+    int Push(const ObjectUniforms& data);
+    void Upload();
+    void Bind(int slot) const;
+
+    int GetCount() const { return m_count; }
+
+private:
+    GLuint m_UBO;
+    GLsizeiptr m_stride;        // sizeof(ObjectUniforms) rounded to the offset alignment
+    int m_capacity;
+    int m_count;
+    unsigned char* m_staging;
+
+    void Allocate(int capacity);
+};
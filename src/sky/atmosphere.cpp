@@ -0,0 +1,129 @@
+#include "atmosphere.h"
+#include "core/profiler.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+namespace {
+
+GLuint CreateTexture2D(int width, int height, GLenum internalFormat, const std::vector<glm::vec4>& texels) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_FLOAT, texels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+}
+
+Atmosphere::Atmosphere(const AtmosphereParams& params, float unitsPerKm, const std::string& cacheDirectory)
+    : m_params(params), m_unitsPerKm(unitsPerKm), m_exposure(10.0f), m_baked(false), m_bakeSeconds(0.0),
+      m_transmittanceTexture(0), m_scatteringTexture(0), m_irradianceTexture(0), m_VAO(0),
+      m_uniforms(ATMOSPHERE_BLOCK_BINDING, sizeof(AtmosphereUniforms)),
+      m_memory("Atmosphere LUTs", MemoryKind::GPU) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.atmosphere", static_cast<unsigned long long>(params.GetKey()));
+    std::string path = cacheDirectory + "/" + name;
+
+    AtmosphereTables tables(params);
+    if (!tables.Load(path)) {
+        PROFILE_ZONE("Atmosphere Bake");
+        auto start = std::chrono::steady_clock::now();
+        tables.Bake();
+        m_bakeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        m_baked = true;
+        std::cout << "Baked atmosphere tables in " << m_bakeSeconds << " s" << std::endl;
+        tables.Save(path);
+    }
+    Upload(tables);
+    glGenVertexArrays(1, &m_VAO);
+}
+
+Atmosphere::~Atmosphere() {
+    glDeleteTextures(1, &m_transmittanceTexture);
+    glDeleteTextures(1, &m_scatteringTexture);
+    glDeleteTextures(1, &m_irradianceTexture);
+    glDeleteVertexArrays(1, &m_VAO);
+}
+
+void Atmosphere::Upload(const AtmosphereTables& tables) {
+    // Transmittance divides by itself near the horizon, so it keeps full precision
+    m_transmittanceTexture = CreateTexture2D(AtmosphereTables::TRANSMITTANCE_WIDTH, AtmosphereTables::TRANSMITTANCE_HEIGHT,
+                                             GL_RGBA32F, tables.GetTransmittance());
+    m_irradianceTexture = CreateTexture2D(AtmosphereTables::IRRADIANCE_WIDTH, AtmosphereTables::IRRADIANCE_HEIGHT,
+                                          GL_RGBA32F, tables.GetIrradiance());
+
+    glGenTextures(1, &m_scatteringTexture);
+    glBindTexture(GL_TEXTURE_3D, m_scatteringTexture);
+    glTexStorage3D(GL_TEXTURE_3D, 1, GL_RGBA16F, AtmosphereTables::SCATTERING_WIDTH,
+                   AtmosphereTables::SCATTERING_HEIGHT, AtmosphereTables::SCATTERING_DEPTH);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, AtmosphereTables::SCATTERING_WIDTH, AtmosphereTables::SCATTERING_HEIGHT,
+                    AtmosphereTables::SCATTERING_DEPTH, GL_RGBA, GL_FLOAT, tables.GetScattering().data());
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_memory.Set(GetGpuBytes());
+}
+
+size_t Atmosphere::GetGpuBytes() const {
+    size_t transmittance = AtmosphereTables::TRANSMITTANCE_WIDTH * AtmosphereTables::TRANSMITTANCE_HEIGHT * 16;
+    size_t irradiance = AtmosphereTables::IRRADIANCE_WIDTH * AtmosphereTables::IRRADIANCE_HEIGHT * 16;
+    size_t scattering = static_cast<size_t>(AtmosphereTables::SCATTERING_WIDTH) * AtmosphereTables::SCATTERING_HEIGHT *
+                        AtmosphereTables::SCATTERING_DEPTH * 8;
+    return transmittance + irradiance + scattering + sizeof(AtmosphereUniforms);
+}
+
+void Atmosphere::Bind(const glm::vec3& center) {
+    AtmosphereUniforms uniforms;
+    uniforms.center = glm::vec4(center, m_unitsPerKm);
+    uniforms.radii = glm::vec4(m_params.bottomRadius, m_params.topRadius, m_params.muSMin, m_params.miePhaseG);
+    uniforms.rayleighScattering = glm::vec4(m_params.rayleighScattering, m_params.sunAngularRadius);
+    uniforms.mieScattering = glm::vec4(m_params.mieScattering, 0.0f);
+    uniforms.solarIrradiance = glm::vec4(m_params.solarIrradiance, m_exposure);
+    m_uniforms.Update(&uniforms, sizeof(uniforms));
+    m_uniforms.Bind();
+
+    glActiveTexture(GL_TEXTURE0 + TRANSMITTANCE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_transmittanceTexture);
+    glActiveTexture(GL_TEXTURE0 + SCATTERING_UNIT);
+    glBindTexture(GL_TEXTURE_3D, m_scatteringTexture);
+    glActiveTexture(GL_TEXTURE0 + IRRADIANCE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_irradianceTexture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void Atmosphere::RenderSky(const Shader& program, const glm::vec3& center, const glm::mat4& viewProjection) {
+    Bind(center);
+
+    GLint polygonMode[2];
+    glGetIntegerv(GL_POLYGON_MODE, polygonMode);
+    GLint depthFunc;
+    glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    // The triangle sits on the far plane, so only pixels nothing was drawn on pass
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    // Whatever is behind (stars) is dimmed by the sky's transmittance in alpha
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_SRC_ALPHA);
+
+    program.setMat4("u_inverseViewProjection", glm::inverse(viewProjection));
+    glBindVertexArray(m_VAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(depthFunc);
+    glPolygonMode(GL_FRONT_AND_BACK, polygonMode[0]);
+}
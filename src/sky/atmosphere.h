@@ -0,0 +1,65 @@
+#pragma once
+#include "atmosphereTables.h"
+#include "graphics/shader.h"
+#include "graphics/uniformBuffer.h"
+#include "core/memoryBudget.h"
+#include <epoxy/gl.h>
+#include <glm/glm.hpp>
+#include <string>
+
+// std140 mirror of the AtmosphereData block in shaders/atmosphere.frag
+struct AtmosphereUniforms {
+    glm::vec4 center;               // xyz: planet centre in world space, w: world units per km
+    glm::vec4 radii;                // x: bottom, y: top (km), z: mu_s min, w: Mie g
+    glm::vec4 rayleighScattering;   // w: sun angular radius
+    glm::vec4 mieScattering;
+    glm::vec4 solarIrradiance;      // w: exposure
+};
+
+// GPU side of one planet's atmosphere. The tables come from
+// <cacheDirectory>/<parameter key>.atmosphere when present and are baked and
+// written there otherwise, so only the first run with a set of parameters
+// pays for the bake. Shading is a few lookups in shaders/atmosphere.frag:
+// aerial perspective and sun/sky light for surfaces, and a full-screen sky
+// pass behind them.
+class Atmosphere {
+public:
+    static constexpr GLuint TRANSMITTANCE_UNIT = 4;    // layout(binding = N) samplers in shaders/atmosphere.frag
+    static constexpr GLuint SCATTERING_UNIT = 5;
+    static constexpr GLuint IRRADIANCE_UNIT = 6;
+
+    // unitsPerKm converts the tables' km into world units. Needs a GL context.
+    Atmosphere(const AtmosphereParams& params, float unitsPerKm, const std::string& cacheDirectory);
+    ~Atmosphere();
+
+    Atmosphere(const Atmosphere&) = delete;
+    Atmosphere& operator=(const Atmosphere&) = delete;
+
+    // Binds the tables and the AtmosphereData block for a planet centred at center
+    void Bind(const glm::vec3& center);
+    // Needs shaders/sky.vert/.frag bound; blends the sky over what is behind
+    // the scene's far plane and leaves the depth alone
+    void RenderSky(const Shader& program, const glm::vec3& center, const glm::mat4& viewProjection);
+
+    void SetExposure(float exposure) { m_exposure = exposure; }
+    float GetExposure() const { return m_exposure; }
+    const AtmosphereParams& GetParams() const { return m_params; }
+    bool WasBaked() const { return m_baked; }
+    double GetBakeSeconds() const { return m_bakeSeconds; }
+    size_t GetGpuBytes() const;
+
+private:
+    AtmosphereParams m_params;
+    float m_unitsPerKm;
+    float m_exposure;
+    bool m_baked;                   // false when the tables came from the cache
+    double m_bakeSeconds;
+    GLuint m_transmittanceTexture;
+    GLuint m_scatteringTexture;
+    GLuint m_irradianceTexture;
+    GLuint m_VAO;                   // empty, the full-screen triangle comes from gl_VertexID
+    UniformBuffer m_uniforms;
+    MemoryAccount m_memory;
+
+    void Upload(const AtmosphereTables& tables);
+};
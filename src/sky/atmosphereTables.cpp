@@ -0,0 +1,556 @@
+#include "atmosphereTables.h"
+#include "core/threadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+constexpr uint32_t ATMOSPHERE_CACHE_MAGIC = 0x54414553;    // "SEAT"
+constexpr float PI = 3.14159265358979f;
+
+// Integration steps, as in the reference implementation where it has them
+constexpr int TRANSMITTANCE_SAMPLES = 500;
+constexpr int SCATTERING_SAMPLES = 50;
+constexpr int MULTIPLE_SCATTERING_DIRECTIONS = 8;   // per axis, 64 directions
+constexpr int MULTIPLE_SCATTERING_SAMPLES = 20;
+constexpr int IRRADIANCE_THETA_SAMPLES = 16;
+constexpr int IRRADIANCE_PHI_SAMPLES = 32;
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t transmittanceTexels;
+    uint32_t scatteringTexels;
+    uint32_t irradianceTexels;
+    uint32_t reserved;
+};
+
+uint64_t Fnv1a(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+float ClampCosine(float mu) {
+    return std::clamp(mu, -1.0f, 1.0f);
+}
+
+float SafeSqrt(float a) {
+    return std::sqrt(std::max(a, 0.0f));
+}
+
+// Texel centres at both ends of the unit range, so lookups never blend in the border
+float CoordFromUnitRange(float x, int size) {
+    return 0.5f / size + x * (1.0f - 1.0f / size);
+}
+
+float UnitRangeFromCoord(float u, int size) {
+    return (u - 0.5f / size) / (1.0f - 1.0f / size);
+}
+
+float RayleighPhase(float nu) {
+    return 3.0f / (16.0f * PI) * (1.0f + nu * nu);
+}
+
+float MiePhase(float g, float nu) {
+    float k = 3.0f / (8.0f * PI) * (1.0f - g * g) / (2.0f + g * g);
+    return k * (1.0f + nu * nu) / std::pow(1.0f + g * g - 2.0f * g * nu, 1.5f);
+}
+
+float SmoothStep(float edge0, float edge1, float x) {
+    float t = std::clamp((x - edge0) / (edge1 - edge0), 0.0f, 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+// Bilinear with clamp-to-edge, like a GL_LINEAR texture lookup
+template <typename T>
+T Sample2D(const std::vector<T>& table, int width, int height, float u, float v) {
+    float x = std::clamp(u * width - 0.5f, 0.0f, static_cast<float>(width - 1));
+    float y = std::clamp(v * height - 0.5f, 0.0f, static_cast<float>(height - 1));
+    int x0 = static_cast<int>(x), y0 = static_cast<int>(y);
+    int x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+    float fx = x - x0, fy = y - y0;
+    T top = table[y0 * width + x0] * (1.0f - fx) + table[y0 * width + x1] * fx;
+    T bottom = table[y1 * width + x0] * (1.0f - fx) + table[y1 * width + x1] * fx;
+    return top * (1.0f - fy) + bottom * fy;
+}
+
+glm::vec4 Sample3D(const std::vector<glm::vec4>& table, int width, int height, int depth, const glm::vec3& uvw) {
+    float z = std::clamp(uvw.z * depth - 0.5f, 0.0f, static_cast<float>(depth - 1));
+    int z0 = static_cast<int>(z);
+    int z1 = std::min(z0 + 1, depth - 1);
+    float fz = z - z0;
+    size_t slice = static_cast<size_t>(width) * height;
+    auto sampleSlice = [&](int layer) {
+        float x = std::clamp(uvw.x * width - 0.5f, 0.0f, static_cast<float>(width - 1));
+        float y = std::clamp(uvw.y * height - 0.5f, 0.0f, static_cast<float>(height - 1));
+        int x0 = static_cast<int>(x), y0 = static_cast<int>(y);
+        int x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+        float fx = x - x0, fy = y - y0;
+        const glm::vec4* base = table.data() + layer * slice;
+        glm::vec4 top = base[y0 * width + x0] * (1.0f - fx) + base[y0 * width + x1] * fx;
+        glm::vec4 bottom = base[y1 * width + x0] * (1.0f - fx) + base[y1 * width + x1] * fx;
+        return top * (1.0f - fy) + bottom * fy;
+    };
+    return sampleSlice(z0) * (1.0f - fz) + sampleSlice(z1) * fz;
+}
+
+// Ray / shell distances for a ray starting at radius r with cos(zenith) mu
+struct Shells {
+    float bottom;
+    float top;
+
+    float ClampRadius(float r) const { return std::clamp(r, bottom, top); }
+    float DistanceToTop(float r, float mu) const {
+        return std::max(0.0f, -r * mu + SafeSqrt(r * r * (mu * mu - 1.0f) + top * top));
+    }
+    float DistanceToBottom(float r, float mu) const {
+        return std::max(0.0f, -r * mu - SafeSqrt(r * r * (mu * mu - 1.0f) + bottom * bottom));
+    }
+    float DistanceToNearestBoundary(float r, float mu, bool rayIntersectsGround) const {
+        return rayIntersectsGround ? DistanceToBottom(r, mu) : DistanceToTop(r, mu);
+    }
+    bool RayIntersectsGround(float r, float mu) const {
+        return mu < 0.0f && r * r * (mu * mu - 1.0f) + bottom * bottom >= 0.0f;
+    }
+};
+
+}
+
+AtmosphereParams AtmosphereParams::Earth() {
+    // Values of Bruneton's reference demo
+    AtmosphereParams params;
+    params.bottomRadius = 6360.0f;
+    params.topRadius = 6420.0f;
+    params.rayleighScattering = glm::vec3(5.802e-3f, 13.558e-3f, 33.1e-3f);
+    params.rayleighScaleHeight = 8.0f;
+    params.mieScattering = glm::vec3(3.996e-3f);
+    params.mieExtinction = glm::vec3(4.440e-3f);
+    params.mieScaleHeight = 1.2f;
+    params.miePhaseG = 0.8f;
+    params.absorptionExtinction = glm::vec3(0.650e-3f, 1.881e-3f, 0.085e-3f);
+    params.absorptionCenter = 25.0f;
+    params.absorptionWidth = 30.0f;
+    params.solarIrradiance = glm::vec3(1.474f, 1.8504f, 1.91198f);
+    params.sunAngularRadius = 0.004675f;
+    params.groundAlbedo = glm::vec3(0.1f);
+    params.muSMin = std::cos(102.0f / 180.0f * PI);
+    return params;
+}
+
+AtmosphereParams AtmosphereParams::Mars() {
+    // Thin CO2 with suspended dust: a weak Rayleigh term and a thick dust
+    // layer with the scale height of the gas that absorbs more of the blue,
+    // which gives the butterscotch day sky. No ozone.
+    AtmosphereParams params;
+    params.bottomRadius = 3389.5f;
+    params.topRadius = 3469.5f;
+    params.rayleighScattering = glm::vec3(5.802e-3f, 13.558e-3f, 33.1e-3f) * 0.05f;
+    params.rayleighScaleHeight = 11.1f;
+    params.mieScattering = glm::vec3(4.8e-3f, 3.6e-3f, 2.4e-3f);
+    params.mieExtinction = glm::vec3(5.0e-3f);
+    params.mieScaleHeight = 11.1f;
+    params.miePhaseG = 0.76f;
+    params.absorptionExtinction = glm::vec3(0.0f);
+    params.absorptionCenter = 0.0f;
+    params.absorptionWidth = 1.0f;
+    // Earth's sun from 1.524 AU
+    params.solarIrradiance = glm::vec3(1.474f, 1.8504f, 1.91198f) * 0.43f;
+    params.sunAngularRadius = 0.004675f / 1.524f;
+    params.groundAlbedo = glm::vec3(0.25f);
+    params.muSMin = std::cos(102.0f / 180.0f * PI);
+    return params;
+}
+
+uint64_t AtmosphereParams::GetKey() const {
+    uint64_t hash = 14695981039346656037ull;
+    const float fields[] = {
+        bottomRadius, topRadius,
+        rayleighScattering.x, rayleighScattering.y, rayleighScattering.z, rayleighScaleHeight,
+        mieScattering.x, mieScattering.y, mieScattering.z,
+        mieExtinction.x, mieExtinction.y, mieExtinction.z, mieScaleHeight, miePhaseG,
+        absorptionExtinction.x, absorptionExtinction.y, absorptionExtinction.z, absorptionCenter, absorptionWidth,
+        solarIrradiance.x, solarIrradiance.y, solarIrradiance.z, sunAngularRadius,
+        groundAlbedo.x, groundAlbedo.y, groundAlbedo.z, muSMin
+    };
+    hash = Fnv1a(hash, fields, sizeof(fields));
+    const int layout[] = {
+        static_cast<int>(AtmosphereTables::FORMAT_VERSION),
+        AtmosphereTables::TRANSMITTANCE_WIDTH, AtmosphereTables::TRANSMITTANCE_HEIGHT,
+        AtmosphereTables::SCATTERING_R_SIZE, AtmosphereTables::SCATTERING_MU_SIZE,
+        AtmosphereTables::SCATTERING_MU_S_SIZE, AtmosphereTables::SCATTERING_NU_SIZE,
+        AtmosphereTables::IRRADIANCE_WIDTH, AtmosphereTables::IRRADIANCE_HEIGHT,
+        AtmosphereTables::MULTIPLE_SCATTERING_SIZE
+    };
+    return Fnv1a(hash, layout, sizeof(layout));
+}
+
+AtmosphereTables::AtmosphereTables(const AtmosphereParams& params) : m_params(params) {
+}
+
+size_t AtmosphereTables::GetByteSize() const {
+    return (m_transmittance.size() + m_scattering.size() + m_irradiance.size()) * sizeof(glm::vec4);
+}
+
+void AtmosphereTables::Bake() {
+    // Each table reads only the ones before it
+    BakeTransmittance();
+    BakeMultipleScattering();
+    BakeScattering();
+    BakeIrradiance();
+    m_multipleScattering = std::vector<glm::vec3>();
+}
+
+glm::vec3 AtmosphereTables::GetExtinction(float altitude) const {
+    float absorption = std::max(0.0f, 1.0f - std::abs(altitude - m_params.absorptionCenter) / (m_params.absorptionWidth * 0.5f));
+    return m_params.rayleighScattering * std::exp(-altitude / m_params.rayleighScaleHeight) +
+           m_params.mieExtinction * std::exp(-altitude / m_params.mieScaleHeight) +
+           m_params.absorptionExtinction * absorption;
+}
+
+glm::vec3 AtmosphereTables::GetScatteringCoefficient(float altitude) const {
+    return m_params.rayleighScattering * std::exp(-altitude / m_params.rayleighScaleHeight) +
+           m_params.mieScattering * std::exp(-altitude / m_params.mieScaleHeight);
+}
+
+glm::vec3 AtmosphereTables::GetTransmittanceToTop(float r, float mu) const {
+    Shells shells = { m_params.bottomRadius, m_params.topRadius };
+    float H = std::sqrt(shells.top * shells.top - shells.bottom * shells.bottom);
+    float rho = SafeSqrt(r * r - shells.bottom * shells.bottom);
+    float d = shells.DistanceToTop(r, mu);
+    float dMin = shells.top - r;
+    float dMax = rho + H;
+    float xMu = dMax > dMin ? (d - dMin) / (dMax - dMin) : 0.0f;
+    float xR = rho / H;
+    return glm::vec3(Sample2D(m_transmittance, TRANSMITTANCE_WIDTH, TRANSMITTANCE_HEIGHT,
+                              CoordFromUnitRange(xMu, TRANSMITTANCE_WIDTH), CoordFromUnitRange(xR, TRANSMITTANCE_HEIGHT)));
+}
+
+glm::vec3 AtmosphereTables::GetTransmittance(float r, float mu, float d, bool rayIntersectsGround) const {
+    Shells shells = { m_params.bottomRadius, m_params.topRadius };
+    float rD = shells.ClampRadius(std::sqrt(d * d + 2.0f * r * mu * d + r * r));
+    float muD = ClampCosine((r * mu + d) / rD);
+    if (rayIntersectsGround) {
+        return glm::min(GetTransmittanceToTop(rD, -muD) / GetTransmittanceToTop(r, -mu), glm::vec3(1.0f));
+    }
+    return glm::min(GetTransmittanceToTop(r, mu) / GetTransmittanceToTop(rD, muD), glm::vec3(1.0f));
+}
+
+glm::vec3 AtmosphereTables::GetTransmittanceToSun(float r, float muS) const {
+    // The sun disc sinking below the horizon
+    float sinThetaH = m_params.bottomRadius / r;
+    float cosThetaH = -SafeSqrt(1.0f - sinThetaH * sinThetaH);
+    float visible = SmoothStep(-sinThetaH * m_params.sunAngularRadius, sinThetaH * m_params.sunAngularRadius, muS - cosThetaH);
+    return GetTransmittanceToTop(r, muS) * visible;
+}
+
+glm::vec3 AtmosphereTables::GetMultipleScattering(float r, float muS) const {
+    float u = CoordFromUnitRange(muS * 0.5f + 0.5f, MULTIPLE_SCATTERING_SIZE);
+    float v = CoordFromUnitRange((r - m_params.bottomRadius) / (m_params.topRadius - m_params.bottomRadius), MULTIPLE_SCATTERING_SIZE);
+    return Sample2D(m_multipleScattering, MULTIPLE_SCATTERING_SIZE, MULTIPLE_SCATTERING_SIZE, u, v);
+}
+
+glm::vec4 AtmosphereTables::GetScattering(float r, float mu, float muS, float nu, bool rayIntersectsGround) const {
+    Shells shells = { m_params.bottomRadius, m_params.topRadius };
+    float bottom = shells.bottom, top = shells.top;
+    float H = std::sqrt(top * top - bottom * bottom);
+    float rho = SafeSqrt(r * r - bottom * bottom);
+    float uR = CoordFromUnitRange(rho / H, SCATTERING_R_SIZE);
+
+    float rMu = r * mu;
+    float discriminant = rMu * rMu - r * r + bottom * bottom;
+    float uMu;
+    if (rayIntersectsGround) {
+        float d = -rMu - SafeSqrt(discriminant);
+        float dMin = r - bottom;
+        float dMax = rho;
+        uMu = 0.5f - 0.5f * CoordFromUnitRange(dMax == dMin ? 0.0f : (d - dMin) / (dMax - dMin), SCATTERING_MU_SIZE / 2);
+    } else {
+        float d = -rMu + SafeSqrt(discriminant + H * H);
+        float dMin = top - r;
+        float dMax = rho + H;
+        uMu = 0.5f + 0.5f * CoordFromUnitRange((d - dMin) / (dMax - dMin), SCATTERING_MU_SIZE / 2);
+    }
+
+    float d = shells.DistanceToTop(bottom, muS);
+    float dMin = top - bottom;
+    float dMax = H;
+    float a = (d - dMin) / (dMax - dMin);
+    float A = (shells.DistanceToTop(bottom, m_params.muSMin) - dMin) / (dMax - dMin);
+    float uMuS = CoordFromUnitRange(std::max(1.0f - a / A, 0.0f) / (1.0f + a), SCATTERING_MU_S_SIZE);
+    float uNu = (nu + 1.0f) * 0.5f;
+
+    // nu is not a texture axis of its own, blend the two slices around it
+    float texCoordX = uNu * (SCATTERING_NU_SIZE - 1);
+    float texX = std::floor(texCoordX);
+    float lerp = texCoordX - texX;
+    glm::vec3 uvw0((texX + uMuS) / SCATTERING_NU_SIZE, uMu, uR);
+    glm::vec3 uvw1((texX + 1.0f + uMuS) / SCATTERING_NU_SIZE, uMu, uR);
+    return Sample3D(m_scattering, SCATTERING_WIDTH, SCATTERING_HEIGHT, SCATTERING_DEPTH, uvw0) * (1.0f - lerp) +
+           Sample3D(m_scattering, SCATTERING_WIDTH, SCATTERING_HEIGHT, SCATTERING_DEPTH, uvw1) * lerp;
+}
+
+void AtmosphereTables::BakeTransmittance() {
+    Shells shells = { m_params.bottomRadius, m_params.topRadius };
+    float H = std::sqrt(shells.top * shells.top - shells.bottom * shells.bottom);
+    m_transmittance.assign(static_cast<size_t>(TRANSMITTANCE_WIDTH) * TRANSMITTANCE_HEIGHT, glm::vec4(0.0f));
+    ThreadPool::Get().ParallelFor(TRANSMITTANCE_HEIGHT, 4, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            float xR = UnitRangeFromCoord((y + 0.5f) / TRANSMITTANCE_HEIGHT, TRANSMITTANCE_HEIGHT);
+            float rho = H * xR;
+            float r = std::sqrt(rho * rho + shells.bottom * shells.bottom);
+            for (int x = 0; x < TRANSMITTANCE_WIDTH; ++x) {
+                float xMu = UnitRangeFromCoord((x + 0.5f) / TRANSMITTANCE_WIDTH, TRANSMITTANCE_WIDTH);
+                float dMin = shells.top - r;
+                float dMax = rho + H;
+                float d = dMin + xMu * (dMax - dMin);
+                float mu = d == 0.0f ? 1.0f : ClampCosine((H * H - rho * rho - d * d) / (2.0f * r * d));
+
+                // Trapezoidal optical depth to the top
+                float dx = shells.DistanceToTop(r, mu) / TRANSMITTANCE_SAMPLES;
+                glm::vec3 depth(0.0f);
+                for (int i = 0; i <= TRANSMITTANCE_SAMPLES; ++i) {
+                    float t = i * dx;
+                    float rI = std::sqrt(t * t + 2.0f * r * mu * t + r * r);
+                    float weight = (i == 0 || i == TRANSMITTANCE_SAMPLES) ? 0.5f : 1.0f;
+                    depth += GetExtinction(rI - shells.bottom) * weight * dx;
+                }
+                m_transmittance[y * TRANSMITTANCE_WIDTH + x] = glm::vec4(glm::exp(-depth), 1.0f);
+            }
+        }
+    });
+}
+
+void AtmosphereTables::BakeMultipleScattering() {
+    // Hillaire's psi_ms: second-order light reaching a point from every
+    // direction under an isotropic phase, scaled by the geometric series
+    // 1 / (1 - f_ms) that stands in for all further orders
+    Shells shells = { m_params.bottomRadius, m_params.topRadius };
+    m_multipleScattering.assign(MULTIPLE_SCATTERING_SIZE * MULTIPLE_SCATTERING_SIZE, glm::vec3(0.0f));
+    const int directions = MULTIPLE_SCATTERING_DIRECTIONS * MULTIPLE_SCATTERING_DIRECTIONS;
+    const float isotropic = 1.0f / (4.0f * PI);
+    ThreadPool::Get().ParallelFor(MULTIPLE_SCATTERING_SIZE, 1, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            float xR = UnitRangeFromCoord((y + 0.5f) / MULTIPLE_SCATTERING_SIZE, MULTIPLE_SCATTERING_SIZE);
+            float r = shells.ClampRadius(shells.bottom + xR * (shells.top - shells.bottom));
+            for (int x = 0; x < MULTIPLE_SCATTERING_SIZE; ++x) {
+                float xMuS = UnitRangeFromCoord((x + 0.5f) / MULTIPLE_SCATTERING_SIZE, MULTIPLE_SCATTERING_SIZE);
+                float muS = ClampCosine(xMuS * 2.0f - 1.0f);
+                glm::vec3 sun(SafeSqrt(1.0f - muS * muS), muS, 0.0f);
+
+                glm::vec3 secondOrder(0.0f);
+                glm::vec3 transfer(0.0f);
+                for (int i = 0; i < directions; ++i) {
+                    float mu = 1.0f - 2.0f * ((i / MULTIPLE_SCATTERING_DIRECTIONS) + 0.5f) / MULTIPLE_SCATTERING_DIRECTIONS;
+                    float phi = 2.0f * PI * ((i % MULTIPLE_SCATTERING_DIRECTIONS) + 0.5f) / MULTIPLE_SCATTERING_DIRECTIONS;
+                    float sinTheta = SafeSqrt(1.0f - mu * mu);
+                    glm::vec3 direction(sinTheta * std::cos(phi), mu, sinTheta * std::sin(phi));
+                    float nu = glm::dot(direction, sun);
+                    bool ground = shells.RayIntersectsGround(r, mu);
+                    float length = shells.DistanceToNearestBoundary(r, mu, ground);
+                    float dt = length / MULTIPLE_SCATTERING_SAMPLES;
+
+                    for (int s = 0; s < MULTIPLE_SCATTERING_SAMPLES; ++s) {
+                        float t = (s + 0.5f) * dt;
+                        float rT = shells.ClampRadius(std::sqrt(t * t + 2.0f * r * mu * t + r * r));
+                        float muST = ClampCosine((r * muS + t * nu) / rT);
+                        glm::vec3 transmittance = GetTransmittance(r, mu, t, ground);
+                        glm::vec3 scattering = GetScatteringCoefficient(rT - shells.bottom);
+                        secondOrder += transmittance * scattering * GetTransmittanceToSun(rT, muST) * isotropic * dt;
+                        transfer += transmittance * scattering * dt;
+                    }
+                    if (ground) {
+                        // Lambertian ground lit by the sun
+                        float muSGround = ClampCosine((r * muS + length * nu) / shells.bottom);
+                        secondOrder += GetTransmittance(r, mu, length, true) * m_params.groundAlbedo / PI *
+                                       GetTransmittanceToSun(shells.bottom, muSGround) * std::max(muSGround, 0.0f);
+                    }
+                }
+                secondOrder /= static_cast<float>(directions);
+                transfer /= static_cast<float>(directions);
+                m_multipleScattering[y * MULTIPLE_SCATTERING_SIZE + x] =
+                    m_params.solarIrradiance * secondOrder / (glm::vec3(1.0f) - glm::min(transfer, glm::vec3(0.99f)));
+            }
+        }
+    });
+}
+
+void AtmosphereTables::ComputeInscatter(float r, float mu, float muS, float nu, bool rayIntersectsGround,
+                                        glm::vec3& rayleigh, glm::vec3& mie, glm::vec3& multiple) const {
+    Shells shells = { m_params.bottomRadius, m_params.topRadius };
+    float dx = shells.DistanceToNearestBoundary(r, mu, rayIntersectsGround) / SCATTERING_SAMPLES;
+    rayleigh = mie = multiple = glm::vec3(0.0f);
+    for (int i = 0; i <= SCATTERING_SAMPLES; ++i) {
+        float d = i * dx;
+        float rD = shells.ClampRadius(std::sqrt(d * d + 2.0f * r * mu * d + r * r));
+        float muSD = ClampCosine((r * muS + d * nu) / rD);
+        float altitude = rD - shells.bottom;
+        float weight = (i == 0 || i == SCATTERING_SAMPLES) ? 0.5f : 1.0f;
+        glm::vec3 transmittance = GetTransmittance(r, mu, d, rayIntersectsGround) * weight;
+        glm::vec3 lit = transmittance * GetTransmittanceToSun(rD, muSD);
+        rayleigh += lit * std::exp(-altitude / m_params.rayleighScaleHeight);
+        mie += lit * std::exp(-altitude / m_params.mieScaleHeight);
+        multiple += transmittance * GetScatteringCoefficient(altitude) * GetMultipleScattering(rD, muSD);
+    }
+    rayleigh *= dx * m_params.solarIrradiance * m_params.rayleighScattering;
+    mie *= dx * m_params.solarIrradiance * m_params.mieScattering;
+    multiple *= dx;
+}
+
+void AtmosphereTables::BakeScattering() {
+    Shells shells = { m_params.bottomRadius, m_params.topRadius };
+    float bottom = shells.bottom, top = shells.top;
+    float H = std::sqrt(top * top - bottom * bottom);
+    float dMinS = top - bottom;
+    float dMaxS = H;
+    float A = (shells.DistanceToTop(bottom, m_params.muSMin) - dMinS) / (dMaxS - dMinS);
+
+    m_scattering.assign(static_cast<size_t>(SCATTERING_WIDTH) * SCATTERING_HEIGHT * SCATTERING_DEPTH, glm::vec4(0.0f));
+    // One row of (nu, mu_s) per task item
+    ThreadPool::Get().ParallelFor(static_cast<size_t>(SCATTERING_HEIGHT) * SCATTERING_DEPTH, 8, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row) {
+            int y = static_cast<int>(row % SCATTERING_HEIGHT);
+            int z = static_cast<int>(row / SCATTERING_HEIGHT);
+
+            float rho = H * UnitRangeFromCoord((z + 0.5f) / SCATTERING_R_SIZE, SCATTERING_R_SIZE);
+            float r = std::sqrt(rho * rho + bottom * bottom);
+            float uMu = (y + 0.5f) / SCATTERING_MU_SIZE;
+            float mu;
+            bool ground;
+            if (uMu < 0.5f) {
+                float dMin = r - bottom;
+                float dMax = rho;
+                float d = dMin + (dMax - dMin) * UnitRangeFromCoord(1.0f - 2.0f * uMu, SCATTERING_MU_SIZE / 2);
+                mu = d == 0.0f ? -1.0f : ClampCosine(-(rho * rho + d * d) / (2.0f * r * d));
+                ground = true;
+            } else {
+                float dMin = top - r;
+                float dMax = rho + H;
+                float d = dMin + (dMax - dMin) * UnitRangeFromCoord(2.0f * uMu - 1.0f, SCATTERING_MU_SIZE / 2);
+                mu = d == 0.0f ? 1.0f : ClampCosine((H * H - rho * rho - d * d) / (2.0f * r * d));
+                ground = false;
+            }
+
+            for (int x = 0; x < SCATTERING_WIDTH; ++x) {
+                int nuIndex = x / SCATTERING_MU_S_SIZE;
+                float uMuS = ((x % SCATTERING_MU_S_SIZE) + 0.5f) / SCATTERING_MU_S_SIZE;
+                float xMuS = UnitRangeFromCoord(uMuS, SCATTERING_MU_S_SIZE);
+                float a = (A - xMuS * A) / (1.0f + xMuS * A);
+                float d = dMinS + std::min(a, A) * (dMaxS - dMinS);
+                float muS = d == 0.0f ? 1.0f : ClampCosine((H * H - d * d) / (2.0f * bottom * d));
+                float nu = ClampCosine(static_cast<float>(nuIndex) / (SCATTERING_NU_SIZE - 1) * 2.0f - 1.0f);
+                // Only directions that exist for this view and sun
+                float spread = std::sqrt((1.0f - mu * mu) * (1.0f - muS * muS));
+                nu = std::clamp(nu, mu * muS - spread, mu * muS + spread);
+
+                glm::vec3 rayleigh, mie, multiple;
+                ComputeInscatter(r, mu, muS, nu, ground, rayleigh, mie, multiple);
+                // Multiple scattering is isotropic; stored over the Rayleigh phase the lookup multiplies back in
+                glm::vec3 combined = rayleigh + multiple / RayleighPhase(nu);
+                m_scattering[(static_cast<size_t>(z) * SCATTERING_HEIGHT + y) * SCATTERING_WIDTH + x] = glm::vec4(combined, mie.r);
+            }
+        }
+    });
+}
+
+void AtmosphereTables::BakeIrradiance() {
+    // Sky light on a horizontal surface, over the upper hemisphere
+    Shells shells = { m_params.bottomRadius, m_params.topRadius };
+    const float dTheta = PI / (2.0f * IRRADIANCE_THETA_SAMPLES);
+    const float dPhi = 2.0f * PI / IRRADIANCE_PHI_SAMPLES;
+    glm::vec3 mieRatio = m_params.mieScattering / m_params.rayleighScattering;
+    float redRatio = m_params.rayleighScattering.r / m_params.mieScattering.r;
+    m_irradiance.assign(static_cast<size_t>(IRRADIANCE_WIDTH) * IRRADIANCE_HEIGHT, glm::vec4(0.0f));
+    ThreadPool::Get().ParallelFor(IRRADIANCE_HEIGHT, 1, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            float xR = UnitRangeFromCoord((y + 0.5f) / IRRADIANCE_HEIGHT, IRRADIANCE_HEIGHT);
+            float r = shells.bottom + xR * (shells.top - shells.bottom);
+            for (int x = 0; x < IRRADIANCE_WIDTH; ++x) {
+                float xMuS = UnitRangeFromCoord((x + 0.5f) / IRRADIANCE_WIDTH, IRRADIANCE_WIDTH);
+                float muS = ClampCosine(2.0f * xMuS - 1.0f);
+                glm::vec3 sun(SafeSqrt(1.0f - muS * muS), 0.0f, muS);
+
+                glm::vec3 irradiance(0.0f);
+                for (int j = 0; j < IRRADIANCE_THETA_SAMPLES; ++j) {
+                    float theta = (j + 0.5f) * dTheta;
+                    float mu = std::cos(theta);
+                    for (int i = 0; i < IRRADIANCE_PHI_SAMPLES; ++i) {
+                        float phi = (i + 0.5f) * dPhi;
+                        glm::vec3 direction(std::cos(phi) * std::sin(theta), std::sin(phi) * std::sin(theta), mu);
+                        float nu = glm::dot(direction, sun);
+                        glm::vec4 scattering = GetScattering(r, mu, muS, nu, false);
+                        glm::vec3 rayleigh(scattering);
+                        glm::vec3 mie = rayleigh.r > 0.0f ? rayleigh * scattering.a / rayleigh.r * redRatio * mieRatio : glm::vec3(0.0f);
+                        glm::vec3 radiance = rayleigh * RayleighPhase(nu) + mie * MiePhase(m_params.miePhaseG, nu);
+                        irradiance += radiance * mu * std::sin(theta) * dTheta * dPhi;
+                    }
+                }
+                m_irradiance[y * IRRADIANCE_WIDTH + x] = glm::vec4(irradiance, 0.0f);
+            }
+        }
+    });
+}
+
+bool AtmosphereTables::Load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    CacheHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        header.magic != ATMOSPHERE_CACHE_MAGIC || header.version != FORMAT_VERSION || header.key != m_params.GetKey() ||
+        header.transmittanceTexels != static_cast<uint32_t>(TRANSMITTANCE_WIDTH * TRANSMITTANCE_HEIGHT) ||
+        header.scatteringTexels != static_cast<uint32_t>(SCATTERING_WIDTH * SCATTERING_HEIGHT * SCATTERING_DEPTH) ||
+        header.irradianceTexels != static_cast<uint32_t>(IRRADIANCE_WIDTH * IRRADIANCE_HEIGHT)) {
+        return false;
+    }
+    m_transmittance.resize(header.transmittanceTexels);
+    m_scattering.resize(header.scatteringTexels);
+    m_irradiance.resize(header.irradianceTexels);
+    if (!file.read(reinterpret_cast<char*>(m_transmittance.data()), m_transmittance.size() * sizeof(glm::vec4)) ||
+        !file.read(reinterpret_cast<char*>(m_scattering.data()), m_scattering.size() * sizeof(glm::vec4)) ||
+        !file.read(reinterpret_cast<char*>(m_irradiance.data()), m_irradiance.size() * sizeof(glm::vec4))) {
+        m_transmittance.clear();
+        m_scattering.clear();
+        m_irradiance.clear();
+        return false;
+    }
+    return true;
+}
+
+bool AtmosphereTables::Save(const std::string& path) const {
+    std::error_code ec;
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, ec);
+    }
+
+    // Write to a temp file and rename so a crash never leaves a torn entry
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Failed to write atmosphere cache entry " << tempPath << std::endl;
+            return false;
+        }
+        CacheHeader header = { ATMOSPHERE_CACHE_MAGIC, FORMAT_VERSION, m_params.GetKey(),
+                               static_cast<uint32_t>(m_transmittance.size()), static_cast<uint32_t>(m_scattering.size()),
+                               static_cast<uint32_t>(m_irradiance.size()), 0 };
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(m_transmittance.data()), m_transmittance.size() * sizeof(glm::vec4));
+        file.write(reinterpret_cast<const char*>(m_scattering.data()), m_scattering.size() * sizeof(glm::vec4));
+        file.write(reinterpret_cast<const char*>(m_irradiance.data()), m_irradiance.size() * sizeof(glm::vec4));
+        if (!file) {
+            std::cerr << "Failed to write atmosphere cache entry " << tempPath << std::endl;
+            return false;
+        }
+    }
+    std::filesystem::rename(tempPath, path, ec);
+    return !ec;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Physical description of an atmosphere, lengths in km and coefficients per
+// km at ground level. Densities fall off exponentially with altitude; the
+// absorbing layer (ozone) is a tent around absorptionCenter.
+struct AtmosphereParams {
+    float bottomRadius;
+    float topRadius;
+    glm::vec3 rayleighScattering;
+    float rayleighScaleHeight;
+    glm::vec3 mieScattering;
+    glm::vec3 mieExtinction;
+    float mieScaleHeight;
+    float miePhaseG;
+    glm::vec3 absorptionExtinction;
+    float absorptionCenter;
+    float absorptionWidth;
+    glm::vec3 solarIrradiance;
+    float sunAngularRadius;     // radians
+    glm::vec3 groundAlbedo;
+    float muSMin;               // cosine of the lowest sun the tables cover (below the horizon)
+
+    static AtmosphereParams Earth();
+    static AtmosphereParams Mars();
+
+    // Hash of every field plus the table layout, names the cache entry
+    uint64_t GetKey() const;
+};
+
+// Precomputed lookup tables in the layout of Bruneton's "Precomputed
+// Atmospheric Scattering" (2008, 2017 reference): transmittance to the top of
+// the atmosphere over (r, mu), inscattered radiance over (r, mu, mu_s, nu)
+// packed into a 3D texture, and sky irradiance over (r, mu_s). The scattering
+// table stores Rayleigh plus multiple scattering divided by the Rayleigh
+// phase in rgb and single Mie red in alpha; phases are applied at lookup.
+//
+// Multiple scattering is not iterated order by order. Each point gets
+// Hillaire's isotropic estimate of all higher orders ("A Scalable and
+// Production Ready Sky and Atmosphere Rendering Technique", 2020) from a
+// small (r, mu_s) table, which keeps the bake to one pass over the 4D table.
+class AtmosphereTables {
+public:
+    static constexpr int TRANSMITTANCE_WIDTH = 256;     // mu
+    static constexpr int TRANSMITTANCE_HEIGHT = 64;     // r
+    static constexpr int SCATTERING_R_SIZE = 32;
+    static constexpr int SCATTERING_MU_SIZE = 128;
+    static constexpr int SCATTERING_MU_S_SIZE = 32;
+    static constexpr int SCATTERING_NU_SIZE = 8;
+    static constexpr int SCATTERING_WIDTH = SCATTERING_NU_SIZE * SCATTERING_MU_S_SIZE;
+    static constexpr int SCATTERING_HEIGHT = SCATTERING_MU_SIZE;
+    static constexpr int SCATTERING_DEPTH = SCATTERING_R_SIZE;
+    static constexpr int IRRADIANCE_WIDTH = 64;         // mu_s
+    static constexpr int IRRADIANCE_HEIGHT = 16;        // r
+    static constexpr int MULTIPLE_SCATTERING_SIZE = 32; // r and mu_s, bake only
+    static constexpr uint32_t FORMAT_VERSION = 1;
+
+    explicit AtmosphereTables(const AtmosphereParams& params);
+
+    // Computes every table, spread over the shared thread pool
+    void Bake();
+    // Cache entries carry the parameter key; a mismatch or a short file fails the load
+    bool Load(const std::string& path);
+    bool Save(const std::string& path) const;
+
+    const AtmosphereParams& GetParams() const { return m_params; }
+    // Row-major, rgba per texel, as uploaded
+    const std::vector<glm::vec4>& GetTransmittance() const { return m_transmittance; }
+    const std::vector<glm::vec4>& GetScattering() const { return m_scattering; }
+    const std::vector<glm::vec4>& GetIrradiance() const { return m_irradiance; }
+    size_t GetByteSize() const;
+
+private:
+    AtmosphereParams m_params;
+    std::vector<glm::vec4> m_transmittance;
+    std::vector<glm::vec4> m_scattering;
+    std::vector<glm::vec4> m_irradiance;
+    std::vector<glm::vec3> m_multipleScattering;
+
+    void BakeTransmittance();
+    void BakeMultipleScattering();
+    void BakeScattering();
+    void BakeIrradiance();
+
+    // The same parameterizations and lookups the shaders use (shaders/atmosphere.frag)
+    glm::vec3 GetTransmittanceToTop(float r, float mu) const;
+    glm::vec3 GetTransmittance(float r, float mu, float d, bool rayIntersectsGround) const;
+    glm::vec3 GetTransmittanceToSun(float r, float muS) const;
+    glm::vec3 GetMultipleScattering(float r, float muS) const;
+    glm::vec4 GetScattering(float r, float mu, float muS, float nu, bool rayIntersectsGround) const;
+    glm::vec3 GetScatteringCoefficient(float altitude) const;
+    glm::vec3 GetExtinction(float altitude) const;
+    void ComputeInscatter(float r, float mu, float muS, float nu, bool rayIntersectsGround,
+                          glm::vec3& rayleigh, glm::vec3& mie, glm::vec3& multiple) const;
+};
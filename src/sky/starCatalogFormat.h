@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// On-disk layout of a star catalog, written by tools/starConverter and
+// memory-mapped by StarField.
+//
+//   StarCatalogHeader
+//   StarNode[StarNodeCount(levelCount)], level-major like the height pyramid:
+//       for level L, face F, row y, column x (2^L x 2^L per cube face)
+//   StarRecord[starCount], grouped by node
+//
+// The sky is a cube-face quadtree over directions. Stars go in brightest
+// first: each node keeps the brightest nodeCapacity stars of its patch that
+// no ancestor took, so records within a node are sorted by magnitude and every
+// star below a node is fainter than the node's faintest. Paging down to a
+// magnitude limit therefore never needs a node whose parent's faintest star is
+// already past the limit. Directions are quantized to 16 bits across the
+// node's own patch, magnitude = sample * magnitudeScale + magnitudeOffset.
+
+constexpr uint32_t STAR_CATALOG_MAGIC = 0x43534553;    // "SESC"
+constexpr uint32_t STAR_CATALOG_VERSION = 1;
+
+struct StarCatalogHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t levelCount;
+    uint32_t nodeCapacity;      // most stars in one node
+    uint64_t starCount;
+    float magnitudeScale;
+    float magnitudeOffset;
+    float minMagnitude;         // brightest star
+    float maxMagnitude;         // faintest star
+    uint64_t nodeOffset;
+    uint64_t starOffset;
+    uint64_t reserved[4];
+};
+
+struct StarNode {
+    uint64_t firstStar;         // index into the StarRecord array
+    uint32_t count;
+    float minMagnitude;         // brightest star in this node
+    float maxMagnitude;         // faintest star in this node
+    uint32_t reserved;
+};
+
+struct StarRecord {
+    uint16_t u;                 // across the node's patch, 0..65535
+    uint16_t v;
+    uint16_t magnitude;
+    uint8_t colorIndex;         // B-V, see StarColorIndex
+    uint8_t reserved;
+};
+
+// B-V colour index <-> 8 bits, covering -0.4 (blue) .. 2.0 (red)
+inline uint8_t QuantizeStarColorIndex(float bv) {
+    float t = (bv + 0.4f) / 2.4f * 255.0f + 0.5f;
+    return static_cast<uint8_t>(t < 0.0f ? 0.0f : (t > 255.0f ? 255.0f : t));
+}
+
+inline float StarColorIndex(uint8_t quantized) {
+    return quantized / 255.0f * 2.4f - 0.4f;
+}
+
+// Nodes before level: 6 faces * (1 + 4 + ... + 4^(level-1))
+inline uint64_t StarNodeLevelBase(uint32_t level) {
+    return 6ull * (((1ull << (2 * level)) - 1) / 3);
+}
+
+inline uint64_t StarNodeIndex(uint32_t face, uint32_t level, uint32_t x, uint32_t y) {
+    uint64_t nodesPerAxis = 1ull << level;
+    return StarNodeLevelBase(level) + (face * nodesPerAxis + y) * nodesPerAxis + x;
+}
+
+inline uint64_t StarNodeCount(uint32_t levelCount) {
+    return StarNodeLevelBase(levelCount);
+}
+
+// Inverse of StarNodeIndex
+inline void StarNodeCoordinates(uint64_t index, uint32_t& face, uint32_t& level, uint32_t& x, uint32_t& y) {
+    level = 0;
+    while (StarNodeLevelBase(level + 1) <= index) ++level;
+    uint64_t nodesPerAxis = 1ull << level;
+    uint64_t offset = index - StarNodeLevelBase(level);
+    face = static_cast<uint32_t>(offset / (nodesPerAxis * nodesPerAxis));
+    y = static_cast<uint32_t>(offset / nodesPerAxis % nodesPerAxis);
+    x = static_cast<uint32_t>(offset % nodesPerAxis);
+}
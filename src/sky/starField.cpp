@@ -0,0 +1,302 @@
+#include "starField.h"
+#include "entities/bodyBvh.h"
+#include "terrain/cubeMapping.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t PAGE_SIZE = 4096;
+
+// Node patch against the frustum, as a sphere around its directions on the unit sphere
+bool NodeVisible(const Frustum& frustum, uint32_t face, uint32_t level, uint32_t x, uint32_t y) {
+    float size = 1.0f / static_cast<float>(1u << level);
+    float u0 = x * size;
+    float v0 = y * size;
+    glm::vec3 center = glm::normalize(CubeFacePosition(static_cast<int>(face), u0 + size * 0.5f, v0 + size * 0.5f));
+    float radius = 0.0f;
+    for (int corner = 0; corner < 4; ++corner) {
+        glm::vec3 direction = glm::normalize(CubeFacePosition(static_cast<int>(face),
+                                                              u0 + (corner & 1) * size, v0 + (corner >> 1) * size));
+        radius = std::max(radius, glm::length(direction - center));
+    }
+    return frustum.IntersectsSphere(glm::dvec3(center), radius * 1.05);
+}
+
+}
+
+StarField::StarField(const std::string& path, int residentNodes, size_t pointBudget)
+    : m_header(), m_mappingSize(0), m_mapping(nullptr), m_pointBudget(pointBudget), m_VAO(0), m_VBO(0),
+      m_frame(0), m_nodesLoaded(0), m_memory("Stars", MemoryKind::GPU), m_drawnStars(0), m_drawnMagnitude(0.0f), m_stopping(false), m_synchronous(false) {
+    if (!Open(path)) {
+        std::cerr << "Failed to open star catalog " << path << std::endl;
+        return;
+    }
+
+    // One fixed-size range of the point buffer per resident node
+    m_slots.resize(residentNodes);
+    glGenVertexArrays(1, &m_VAO);
+    glGenBuffers(1, &m_VBO);
+    glBindVertexArray(m_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+    glBufferData(GL_ARRAY_BUFFER, GetGpuBytes(), nullptr, GL_DYNAMIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(StarVertex), (void*)offsetof(StarVertex, direction));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(StarVertex), (void*)offsetof(StarVertex, magnitude));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(StarVertex), (void*)offsetof(StarVertex, colorIndex));
+    glEnableVertexAttribArray(2);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_memory.Set(GetGpuBytes());
+
+    m_loader = std::thread(&StarField::LoaderLoop, this);
+}
+
+StarField::~StarField() {
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_stopping = true;
+    }
+    m_queueCondition.notify_all();
+    if (m_loader.joinable()) {
+        m_loader.join();
+    }
+    if (m_mapping) {
+        munmap(m_mapping, m_mappingSize);
+    }
+    glDeleteVertexArrays(1, &m_VAO);
+    glDeleteBuffers(1, &m_VBO);
+}
+
+bool StarField::Open(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(StarCatalogHeader)) {
+        close(fd);
+        return false;
+    }
+    m_mappingSize = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, m_mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    std::memcpy(&m_header, mapping, sizeof(m_header));
+    uint64_t nodeEnd = m_header.nodeOffset + StarNodeCount(m_header.levelCount) * sizeof(StarNode);
+    uint64_t expected = m_header.starOffset + m_header.starCount * sizeof(StarRecord);
+    if (m_header.magic != STAR_CATALOG_MAGIC || m_header.version != STAR_CATALOG_VERSION ||
+        m_header.levelCount == 0 || m_header.levelCount > 12 || m_header.nodeCapacity == 0 ||
+        nodeEnd > m_header.starOffset || m_mappingSize < expected) {
+        std::cerr << "Star catalog " << path << " is not a version " << STAR_CATALOG_VERSION << " catalog" << std::endl;
+        munmap(mapping, m_mappingSize);
+        return false;
+    }
+
+    // Access is node by node in view order, readahead would only pull in other nodes
+    madvise(mapping, m_mappingSize, MADV_RANDOM);
+    m_mapping = static_cast<unsigned char*>(mapping);
+    return true;
+}
+
+const StarNode& StarField::GetNode(uint64_t index) const {
+    return reinterpret_cast<const StarNode*>(m_mapping + m_header.nodeOffset)[index];
+}
+
+StarField::DecodedNode StarField::DecodeNode(uint64_t index) const {
+    DecodedNode decoded;
+    decoded.node = index;
+    const StarNode& node = GetNode(index);
+    uint32_t face, level, x, y;
+    StarNodeCoordinates(index, face, level, x, y);
+    float nodesPerAxis = static_cast<float>(1u << level);
+
+    uint32_t count = std::min(node.count, m_header.nodeCapacity);
+    decoded.stars.resize(count);
+    const unsigned char* src = m_mapping + m_header.starOffset + node.firstStar * sizeof(StarRecord);
+    for (uint32_t i = 0; i < count; ++i) {
+        StarRecord record;
+        std::memcpy(&record, src + i * sizeof(StarRecord), sizeof(StarRecord));
+        float u = (x + record.u / 65535.0f) / nodesPerAxis;
+        float v = (y + record.v / 65535.0f) / nodesPerAxis;
+        StarVertex& star = decoded.stars[i];
+        star.direction = glm::normalize(CubeFacePosition(static_cast<int>(face), u, v));
+        star.magnitude = record.magnitude * m_header.magnitudeScale + m_header.magnitudeOffset;
+        star.colorIndex = StarColorIndex(record.colorIndex);
+    }
+
+    // The GPU copy is what stays resident, let the kernel drop the file pages
+    uintptr_t begin = reinterpret_cast<uintptr_t>(src);
+    uintptr_t end = begin + count * sizeof(StarRecord);
+    uintptr_t alignedBegin = (begin + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    uintptr_t alignedEnd = end / PAGE_SIZE * PAGE_SIZE;
+    if (alignedEnd > alignedBegin) {
+        madvise(reinterpret_cast<void*>(alignedBegin), alignedEnd - alignedBegin, MADV_DONTNEED);
+    }
+    return decoded;
+}
+
+void StarField::LoaderLoop() {
+    while (true) {
+        uint64_t index;
+        {
+            std::unique_lock<std::mutex> lock(m_queueMutex);
+            m_queueCondition.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_stopping) return;
+            // Newest requests first: they belong to what the camera sees now
+            index = m_queue.back();
+            m_queue.pop_back();
+        }
+
+        DecodedNode decoded = DecodeNode(index);
+
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_decoded.push_back(std::move(decoded));
+    }
+}
+
+void StarField::Request(uint64_t index) {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    if (!m_queued.insert(index).second) return;
+    if (m_synchronous) {
+        m_decoded.push_back(DecodeNode(index));
+        return;
+    }
+    m_queue.push_back(index);
+    m_queueCondition.notify_one();
+}
+
+int StarField::AllocateSlot() {
+    // A free slot, else the least recently drawn one not drawn last frame
+    int best = -1;
+    for (int i = 0; i < static_cast<int>(m_slots.size()); ++i) {
+        const Slot& slot = m_slots[i];
+        if (!slot.used) return i;
+        if (slot.lastUsed + 1 >= m_frame) continue;
+        if (best < 0 || slot.lastUsed < m_slots[best].lastUsed) best = i;
+    }
+    return best;
+}
+
+void StarField::UploadDecoded() {
+    std::vector<DecodedNode> ready;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        size_t count = std::min<size_t>(m_decoded.size(), MAX_UPLOADS_PER_FRAME);
+        for (size_t i = 0; i < count; ++i) {
+            ready.push_back(std::move(m_decoded[i]));
+        }
+        m_decoded.erase(m_decoded.begin(), m_decoded.begin() + count);
+    }
+    if (ready.empty()) return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+    for (DecodedNode& decoded : ready) {
+        int index = AllocateSlot();
+        if (index >= 0) {
+            Slot& slot = m_slots[index];
+            if (slot.used) {
+                m_lookup.erase(slot.node);
+            }
+            GLintptr offset = static_cast<GLintptr>(index) * m_header.nodeCapacity * sizeof(StarVertex);
+            glBufferSubData(GL_ARRAY_BUFFER, offset, decoded.stars.size() * sizeof(StarVertex), decoded.stars.data());
+            slot.used = true;
+            slot.node = decoded.node;
+            slot.count = static_cast<uint32_t>(decoded.stars.size());
+            slot.lastUsed = m_frame;
+            slot.magnitudes.resize(decoded.stars.size());
+            for (size_t i = 0; i < decoded.stars.size(); ++i) {
+                slot.magnitudes[i] = decoded.stars[i].magnitude;
+            }
+            m_lookup[decoded.node] = index;
+            m_nodesLoaded++;
+        }
+        // Without a slot the node is simply requested again while it stays in view
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_queued.erase(decoded.node);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void StarField::Update(const glm::mat4& skyViewProjection, float magnitudeLimit) {
+    m_drawFirst.clear();
+    m_drawCount.clear();
+    m_drawnStars = 0;
+    m_drawnMagnitude = magnitudeLimit;
+    if (!m_mapping) return;
+
+    ++m_frame;
+    UploadDecoded();
+
+    // Breadth first, so coarse (bright) nodes claim the budget before fine ones
+    Frustum frustum = Frustum::FromMatrix(glm::dmat4(skyViewProjection));
+    std::deque<uint64_t> open;
+    for (uint32_t face = 0; face < 6; ++face) {
+        open.push_back(StarNodeIndex(face, 0, 0, 0));
+    }
+    while (!open.empty()) {
+        uint64_t index = open.front();
+        open.pop_front();
+        const StarNode& node = GetNode(index);
+        if (node.count == 0 || node.minMagnitude > magnitudeLimit) continue;
+        uint32_t face, level, x, y;
+        StarNodeCoordinates(index, face, level, x, y);
+        if (!NodeVisible(frustum, face, level, x, y)) continue;
+
+        auto it = m_lookup.find(index);
+        if (it == m_lookup.end()) {
+            Request(index);
+            continue;
+        }
+        Slot& slot = m_slots[it->second];
+        slot.lastUsed = m_frame;
+
+        size_t count = std::upper_bound(slot.magnitudes.begin(), slot.magnitudes.end(), magnitudeLimit) - slot.magnitudes.begin();
+        bool budgetReached = m_drawnStars + count >= m_pointBudget;
+        if (budgetReached) {
+            count = m_pointBudget - m_drawnStars;
+            if (count > 0) m_drawnMagnitude = slot.magnitudes[count - 1];
+        }
+        if (count > 0) {
+            m_drawFirst.push_back(static_cast<GLint>(static_cast<size_t>(it->second) * m_header.nodeCapacity));
+            m_drawCount.push_back(static_cast<GLsizei>(count));
+            m_drawnStars += count;
+        }
+        if (budgetReached) break;
+
+        // Everything below is fainter than this node's faintest star
+        if (node.count >= m_header.nodeCapacity && node.maxMagnitude <= magnitudeLimit && level + 1 < m_header.levelCount) {
+            for (uint32_t child = 0; child < 4; ++child) {
+                open.push_back(StarNodeIndex(face, level + 1, x * 2 + (child & 1), y * 2 + (child >> 1)));
+            }
+        }
+    }
+}
+
+void StarField::Render(const Shader& program, float magnitudeLimit) {
+    if (m_drawCount.empty()) return;
+
+    program.setFloat("u_magnitudeLimit", magnitudeLimit);
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    glBindVertexArray(m_VAO);
+    glMultiDrawArrays(GL_POINTS, m_drawFirst.data(), m_drawCount.data(), static_cast<GLsizei>(m_drawCount.size()));
+    glBindVertexArray(0);
+    glDisable(GL_PROGRAM_POINT_SIZE);
+    glDepthMask(GL_TRUE);
+    if (depthTest) glEnable(GL_DEPTH_TEST);
+}
+
+size_t StarField::GetPendingNodes() const {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    return m_queued.size();
+}
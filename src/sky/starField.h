@@ -0,0 +1,114 @@
+#pragma once
+#include "starCatalogFormat.h"
+#include "graphics/shader.h"
+#include "core/memoryBudget.h"
+
+#include <epoxy/gl.h>
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Decoded star as the point shaders see it (shaders/stars.vert)
+struct StarVertex {
+    glm::vec3 direction;
+    float magnitude;
+    float colorIndex;       // B-V
+};
+
+// Streams a star catalog written by tools/starConverter. Nothing is read at
+// start-up beyond the header: the file is memory-mapped, and each frame the
+// node quadtree is walked from the six roots, down through nodes in view
+// whose stars are still brighter than the magnitude limit. Missing nodes are
+// decoded on a loader thread and uploaded into fixed slots of one point
+// buffer, a few per frame, recycling the least recently drawn. A node is only
+// descended into once it is resident, so the sky fills in brightest first.
+// Coarse levels are drawn first, and once pointBudget stars are queued the
+// remaining nodes are dropped, which trims the faintest first.
+class StarField {
+public:
+    static constexpr int MAX_UPLOADS_PER_FRAME = 16;
+
+    StarField(const std::string& path, int residentNodes = 512, size_t pointBudget = 300000);
+    ~StarField();
+
+    StarField(const StarField&) = delete;
+    StarField& operator=(const StarField&) = delete;
+
+    bool IsOpen() const { return m_mapping != nullptr; }
+
+    // skyViewProjection is projection * rotation-only view: stars sit at infinity
+    void Update(const glm::mat4& skyViewProjection, float magnitudeLimit);
+    // Needs shaders/stars.vert/.frag bound. Draws behind everything without
+    // touching depth, so call it right after the clear.
+    void Render(const Shader& program, float magnitudeLimit);
+
+    void SetPointBudget(size_t budget) { m_pointBudget = budget; }
+    // Decode requested nodes on the calling thread instead of the loader, see Planet::SetSynchronousStreaming
+    void SetSynchronous(bool synchronous) { m_synchronous = synchronous; }
+    size_t GetPointBudget() const { return m_pointBudget; }
+    uint64_t GetCatalogStars() const { return m_header.starCount; }
+    float GetFaintestMagnitude() const { return m_header.maxMagnitude; }
+    size_t GetDrawnStars() const { return m_drawnStars; }
+    // Magnitude where the point budget cut in, the limit itself when it did not
+    float GetDrawnMagnitude() const { return m_drawnMagnitude; }
+    size_t GetResidentNodes() const { return m_lookup.size(); }
+    int GetSlotCount() const { return static_cast<int>(m_slots.size()); }
+    size_t GetPendingNodes() const;
+    uint64_t GetNodesLoaded() const { return m_nodesLoaded; }
+    size_t GetGpuBytes() const { return m_slots.size() * m_header.nodeCapacity * sizeof(StarVertex); }
+
+private:
+    struct Slot {
+        bool used = false;
+        uint64_t node = 0;
+        uint32_t count = 0;
+        uint64_t lastUsed = 0;
+        std::vector<float> magnitudes;      // ascending, for the per-node cut at the limit
+    };
+
+    struct DecodedNode {
+        uint64_t node;
+        std::vector<StarVertex> stars;
+    };
+
+    StarCatalogHeader m_header;
+    size_t m_mappingSize;
+    unsigned char* m_mapping;
+    size_t m_pointBudget;
+
+    GLuint m_VAO, m_VBO;
+    std::vector<Slot> m_slots;
+    std::unordered_map<uint64_t, int> m_lookup;     // node -> slot
+    uint64_t m_frame;
+    uint64_t m_nodesLoaded;
+    MemoryAccount m_memory;
+
+    // This frame's draw, one range per node
+    std::vector<GLint> m_drawFirst;
+    std::vector<GLsizei> m_drawCount;
+    size_t m_drawnStars;
+    float m_drawnMagnitude;
+
+    mutable std::mutex m_queueMutex;
+    std::condition_variable m_queueCondition;
+    std::deque<uint64_t> m_queue;
+    std::unordered_set<uint64_t> m_queued;          // queued or decoded, not yet uploaded
+    std::vector<DecodedNode> m_decoded;
+    std::thread m_loader;
+    bool m_stopping;
+    bool m_synchronous;
+
+    bool Open(const std::string& path);
+    const StarNode& GetNode(uint64_t index) const;
+    DecodedNode DecodeNode(uint64_t index) const;
+    void LoaderLoop();
+    void Request(uint64_t index);
+    void UploadDecoded();
+    int AllocateSlot();
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include "heightTileFormat.h"
+#include <cstdint>
+#include <cstddef>
+
+// On-disk layout of a cube-sphere surface colour pyramid, written by
+// tools/albedoConverter and memory-mapped by AlbedoStreamer.
+//
+//   AlbedoPageHeader
+//   pages, in the height pyramid's order (HeightTileIndex)
+//
+// A page is ALBEDO_PAGE_SIZE^2 sRGB texels plus a border of ALBEDO_PAGE_BORDER
+// texels copied from the neighbouring pages (clamped at the face edges), so
+// bilinear filtering inside the physical atlas never reaches another page.
+// Texels are cell-centred: texel i of a page covers [i, i + 1) / ALBEDO_PAGE_SIZE.
+// Stored as RGB8, rows bottom to top in v.
+
+constexpr uint32_t ALBEDO_PAGE_MAGIC = 0x50414553;     // "SEAP"
+constexpr uint32_t ALBEDO_PAGE_VERSION = 1;
+constexpr uint32_t ALBEDO_PAGE_SIZE = 128;
+constexpr uint32_t ALBEDO_PAGE_BORDER = 1;
+constexpr uint32_t ALBEDO_MAX_LEVELS = 10;             // page coordinates must fit the feedback encoding
+
+struct AlbedoPageHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pageSize;          // texels per page edge, without the border
+    uint32_t border;
+    uint32_t levelCount;
+    uint32_t reserved0;
+    uint64_t dataOffset;
+    uint64_t reserved[4];
+};
+
+// Texels per stored page edge, border included
+inline uint32_t AlbedoPageStride() {
+    return ALBEDO_PAGE_SIZE + 2 * ALBEDO_PAGE_BORDER;
+}
+
+inline size_t AlbedoPageBytes() {
+    return static_cast<size_t>(AlbedoPageStride()) * AlbedoPageStride() * 3;
+}
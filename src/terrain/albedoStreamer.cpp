@@ -0,0 +1,219 @@
+#include "albedoStreamer.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t PAGE_SIZE = 4096;
+
+}
+
+AlbedoStreamer::AlbedoStreamer(const std::string& path, size_t residentBudgetBytes)
+    : m_header(), m_mappingSize(0), m_mapping(nullptr), m_residentBytes(0), m_budget(residentBudgetBytes),
+      m_memory("Surface texture pages", MemoryKind::CPU), m_pagesLoaded(0), m_pagesEvicted(0), m_stopping(false), m_synchronous(false) {
+    if (!Open(path)) {
+        std::cerr << "Failed to open albedo pages " << path << std::endl;
+        return;
+    }
+
+    // Pin level 0 so every lookup has something to fall back on
+    for (uint32_t face = 0; face < 6; ++face) {
+        uint64_t index = HeightTileIndex(face, 0, 0, 0);
+        InsertPage(index, DecodePage(index), true);
+    }
+
+    m_loader = std::thread(&AlbedoStreamer::LoaderLoop, this);
+}
+
+AlbedoStreamer::~AlbedoStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_stopping = true;
+    }
+    m_queueCondition.notify_all();
+    if (m_loader.joinable()) {
+        m_loader.join();
+    }
+    if (m_mapping) {
+        munmap(m_mapping, m_mappingSize);
+    }
+}
+
+bool AlbedoStreamer::Open(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(AlbedoPageHeader)) {
+        close(fd);
+        return false;
+    }
+    m_mappingSize = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, m_mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    std::memcpy(&m_header, mapping, sizeof(m_header));
+    size_t expected = m_header.dataOffset + HeightTileCount(m_header.levelCount) * AlbedoPageBytes();
+    if (m_header.magic != ALBEDO_PAGE_MAGIC || m_header.version != ALBEDO_PAGE_VERSION ||
+        m_header.pageSize != ALBEDO_PAGE_SIZE || m_header.border != ALBEDO_PAGE_BORDER ||
+        m_header.levelCount == 0 || m_mappingSize < expected) {
+        std::cerr << "Albedo page file " << path << " is not a version " << ALBEDO_PAGE_VERSION << " pyramid of "
+                  << ALBEDO_PAGE_SIZE << " texel pages" << std::endl;
+        munmap(mapping, m_mappingSize);
+        return false;
+    }
+    // Deeper levels would not fit the feedback encoding, the texture stops there
+    m_header.levelCount = std::min(m_header.levelCount, ALBEDO_MAX_LEVELS);
+
+    // Access is page by page, readahead would only pull in unrelated pages
+    madvise(mapping, m_mappingSize, MADV_RANDOM);
+    m_mapping = static_cast<unsigned char*>(mapping);
+    return true;
+}
+
+AlbedoStreamer::Page AlbedoStreamer::DecodePage(uint64_t index) const {
+    size_t texels = static_cast<size_t>(AlbedoPageStride()) * AlbedoPageStride();
+    auto rgba = std::make_shared<std::vector<uint32_t>>(texels);
+    const unsigned char* src = m_mapping + m_header.dataOffset + index * AlbedoPageBytes();
+    for (size_t i = 0; i < texels; ++i) {
+        const unsigned char* rgb = src + i * 3;
+        (*rgba)[i] = rgb[0] | (rgb[1] << 8) | (rgb[2] << 16) | 0xff000000u;
+    }
+
+    // The decoded copy is what stays resident, let the kernel drop the file pages
+    uintptr_t begin = reinterpret_cast<uintptr_t>(src);
+    uintptr_t end = begin + AlbedoPageBytes();
+    uintptr_t alignedBegin = (begin + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    uintptr_t alignedEnd = end / PAGE_SIZE * PAGE_SIZE;
+    if (alignedEnd > alignedBegin) {
+        madvise(reinterpret_cast<void*>(alignedBegin), alignedEnd - alignedBegin, MADV_DONTNEED);
+    }
+    return rgba;
+}
+
+void AlbedoStreamer::InsertPage(uint64_t index, Page texels, bool pinned) {
+    std::lock_guard<std::mutex> lock(m_pagesMutex);
+    if (m_pages.count(index)) return;
+
+    size_t bytes = texels->size() * sizeof(uint32_t);
+    ResidentPage& page = m_pages[index];
+    page.texels = std::move(texels);
+    page.pinned = pinned;
+    page.lru = m_lru.insert(m_lru.begin(), index);
+    m_residentBytes += bytes;
+    m_pagesLoaded++;
+
+    // Enforce the budget, oldest unpinned pages first
+    auto it = m_lru.end();
+    while (m_residentBytes > m_budget && it != m_lru.begin()) {
+        --it;
+        auto victim = m_pages.find(*it);
+        if (victim->second.pinned || victim->first == index) continue;
+        m_residentBytes -= victim->second.texels->size() * sizeof(uint32_t);
+        m_pages.erase(victim);
+        it = m_lru.erase(it);
+        m_pagesEvicted++;
+    }
+    m_memory.Set(m_residentBytes);
+}
+
+void AlbedoStreamer::LoaderLoop() {
+    while (true) {
+        uint64_t index;
+        {
+            std::unique_lock<std::mutex> lock(m_queueMutex);
+            m_queueCondition.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_stopping) return;
+            // Newest requests first: they belong to what the camera sees now
+            index = m_queue.back();
+            m_queue.pop_back();
+        }
+
+        InsertPage(index, DecodePage(index), false);
+
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_queued.erase(index);
+    }
+}
+
+AlbedoStreamer::Page AlbedoStreamer::FindPage(int face, int level, uint32_t x, uint32_t y) {
+    if (!m_mapping) return nullptr;
+    uint64_t index = HeightTileIndex(static_cast<uint32_t>(face), static_cast<uint32_t>(level), x, y);
+
+    std::lock_guard<std::mutex> lock(m_pagesMutex);
+    auto it = m_pages.find(index);
+    if (it == m_pages.end()) return nullptr;
+    m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+    return it->second.texels;
+}
+
+void AlbedoStreamer::Request(int face, int level, uint32_t x, uint32_t y) {
+    if (!m_mapping || level < 0 || level >= GetLevelCount()) return;
+    uint64_t index = HeightTileIndex(static_cast<uint32_t>(face), static_cast<uint32_t>(level), x, y);
+
+    {
+        std::lock_guard<std::mutex> lock(m_pagesMutex);
+        auto it = m_pages.find(index);
+        if (it != m_pages.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+            return;
+        }
+    }
+    if (m_synchronous) {
+        InsertPage(index, DecodePage(index), false);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    if (m_queued.insert(index).second) {
+        m_queue.push_back(index);
+        // The oldest requests are for views long gone, and feedback asks again for what is still missing
+        if (m_queue.size() > MAX_QUEUED) {
+            m_queued.erase(m_queue.front());
+            m_queue.pop_front();
+        }
+        m_queueCondition.notify_one();
+    }
+}
+
+void AlbedoStreamer::EvictUnpinned() {
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_queue.clear();
+        m_queued.clear();
+    }
+    std::lock_guard<std::mutex> lock(m_pagesMutex);
+    for (auto it = m_lru.begin(); it != m_lru.end();) {
+        auto page = m_pages.find(*it);
+        if (page->second.pinned) {
+            ++it;
+            continue;
+        }
+        m_residentBytes -= page->second.texels->size() * sizeof(uint32_t);
+        m_pages.erase(page);
+        it = m_lru.erase(it);
+        m_pagesEvicted++;
+    }
+    m_memory.Set(m_residentBytes);
+}
+
+size_t AlbedoStreamer::GetResidentBytes() const {
+    std::lock_guard<std::mutex> lock(m_pagesMutex);
+    return m_residentBytes;
+}
+
+size_t AlbedoStreamer::GetResidentPages() const {
+    std::lock_guard<std::mutex> lock(m_pagesMutex);
+    return m_pages.size();
+}
+
+size_t AlbedoStreamer::GetPendingPages() const {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    return m_queued.size();
+}
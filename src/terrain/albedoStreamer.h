@@ -0,0 +1,87 @@
+#pragma once
+#include "albedoPageFormat.h"
+#include "core/memoryBudget.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Streams a surface colour pyramid written by tools/albedoConverter, the CPU
+// half of a planet's virtual texture. Like DemStreamer, the file is
+// memory-mapped and a loader thread takes the page faults, expanding
+// requested pages to RGBA8 into a cache that is evicted least recently used
+// first once over its byte budget. Level 0 (six pages) is pinned, so the
+// virtual texture always has something to show.
+class AlbedoStreamer {
+public:
+    using Page = std::shared_ptr<const std::vector<uint32_t>>;
+
+    AlbedoStreamer(const std::string& path, size_t residentBudgetBytes = 64ull * 1024 * 1024);
+    ~AlbedoStreamer();
+
+    AlbedoStreamer(const AlbedoStreamer&) = delete;
+    AlbedoStreamer& operator=(const AlbedoStreamer&) = delete;
+
+    bool IsOpen() const { return m_mapping != nullptr; }
+    int GetLevelCount() const { return static_cast<int>(m_header.levelCount); }
+
+    // Decoded page (AlbedoPageStride()^2 RGBA8 texels), null when not resident.
+    // The page stays valid for the holder even if the cache drops it.
+    Page FindPage(int face, int level, uint32_t x, uint32_t y);
+    // Queues a page for decoding unless it is resident or already queued
+    void Request(int face, int level, uint32_t x, uint32_t y);
+
+    // Drops every page but the pinned level 0, for a planet that has left the view
+    void EvictUnpinned();
+    // Decode requested pages on the calling thread instead of the loader
+    void SetSynchronous(bool synchronous) { m_synchronous = synchronous; }
+
+    size_t GetResidentBytes() const;
+    size_t GetResidentPages() const;
+    size_t GetPendingPages() const;
+    uint64_t GetPagesLoaded() const { return m_pagesLoaded; }
+    uint64_t GetPagesEvicted() const { return m_pagesEvicted; }
+
+private:
+    static constexpr size_t MAX_QUEUED = 512;
+
+    struct ResidentPage {
+        Page texels;
+        std::list<uint64_t>::iterator lru;
+        bool pinned;
+    };
+
+    AlbedoPageHeader m_header;
+    size_t m_mappingSize;
+    unsigned char* m_mapping;
+
+    mutable std::mutex m_pagesMutex;
+    std::unordered_map<uint64_t, ResidentPage> m_pages;
+    std::list<uint64_t> m_lru;                      // front = most recently requested
+    size_t m_residentBytes;
+    size_t m_budget;
+    MemoryAccount m_memory;
+    std::atomic<uint64_t> m_pagesLoaded;
+    std::atomic<uint64_t> m_pagesEvicted;
+
+    mutable std::mutex m_queueMutex;
+    std::condition_variable m_queueCondition;
+    std::deque<uint64_t> m_queue;
+    std::unordered_set<uint64_t> m_queued;
+    std::thread m_loader;
+    bool m_stopping;
+    bool m_synchronous;
+
+    bool Open(const std::string& path);
+    Page DecodePage(uint64_t index) const;
+    void InsertPage(uint64_t index, Page texels, bool pinned);
+    void LoaderLoop();
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cmath>
+
+// Cube face <-> direction mapping shared by the quadtree, the terrain
+// streamers and the offline converters. Faces are numbered like CubeFace:
+// FRONT, BACK, LEFT, RIGHT, TOP, BOTTOM. (u, v) run 0..1 across a face.
+
+inline glm::vec3 CubeFacePosition(int face, float u, float v) {
+    switch (face) {
+        case 0: return glm::vec3(u * 2.0f - 1.0f, v * 2.0f - 1.0f, 1.0f);     // FRONT
+        case 1: return glm::vec3(1.0f - u * 2.0f, v * 2.0f - 1.0f, -1.0f);    // BACK
+        case 2: return glm::vec3(-1.0f, v * 2.0f - 1.0f, 1.0f - u * 2.0f);    // LEFT
+        case 3: return glm::vec3(1.0f, v * 2.0f - 1.0f, u * 2.0f - 1.0f);     // RIGHT
+        case 4: return glm::vec3(u * 2.0f - 1.0f, 1.0f, 1.0f - v * 2.0f);     // TOP
+        case 5: return glm::vec3(u * 2.0f - 1.0f, -1.0f, v * 2.0f - 1.0f);    // BOTTOM
+        default: return glm::vec3(0.0f);
+    }
+}
+
+// Inverse of CubeFacePosition for any non-zero direction
+inline void DirectionToCubeFace(const glm::vec3& dir, int& face, float& u, float& v) {
+    glm::vec3 a = glm::abs(dir);
+    if (a.z >= a.x && a.z >= a.y) {
+        glm::vec3 p = dir / a.z;
+        if (dir.z > 0.0f) { face = 0; u = (p.x + 1.0f) * 0.5f; }
+        else              { face = 1; u = (1.0f - p.x) * 0.5f; }
+        v = (p.y + 1.0f) * 0.5f;
+    } else if (a.x >= a.y) {
+        glm::vec3 p = dir / a.x;
+        if (dir.x < 0.0f) { face = 2; u = (1.0f - p.z) * 0.5f; }
+        else              { face = 3; u = (p.z + 1.0f) * 0.5f; }
+        v = (p.y + 1.0f) * 0.5f;
+    } else {
+        glm::vec3 p = dir / a.y;
+        if (dir.y > 0.0f) { face = 4; v = (1.0f - p.z) * 0.5f; }
+        else              { face = 5; v = (p.z + 1.0f) * 0.5f; }
+        u = (p.x + 1.0f) * 0.5f;
+    }
+    u = glm::clamp(u, 0.0f, 1.0f);
+    v = glm::clamp(v, 0.0f, 1.0f);
+}
+
+// Equirectangular convention used by the converters: longitude 0 on +X,
+// increasing towards +Z, latitude +90 at +Y
+inline void DirectionToLatLon(const glm::vec3& dir, double& latitude, double& longitude) {
+    glm::vec3 n = glm::normalize(dir);
+    latitude = std::asin(glm::clamp(static_cast<double>(n.y), -1.0, 1.0));
+    longitude = std::atan2(static_cast<double>(n.z), static_cast<double>(n.x));
+}
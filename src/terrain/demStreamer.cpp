@@ -0,0 +1,257 @@
+#include "demStreamer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t PAGE_SIZE = 4096;
+
+}
+
+DemStreamer::DemStreamer(const std::string& path, size_t residentBudgetBytes)
+    : m_header(), m_contentId(0), m_tileBytes(0), m_mappingSize(0), m_mapping(nullptr),
+      m_residentBytes(0), m_budget(residentBudgetBytes), m_memory("Terrain tiles", MemoryKind::CPU),
+      m_tilesLoaded(0), m_tilesEvicted(0), m_stopping(false), m_synchronous(false) {
+    if (!Open(path)) {
+        std::cerr << "Failed to open height tiles " << path << std::endl;
+        return;
+    }
+
+    // Pin level 0 so every sample has something to fall back on
+    for (uint32_t face = 0; face < 6; ++face) {
+        uint64_t index = HeightTileIndex(face, 0, 0, 0);
+        InsertTile(index, DecodeTile(index), true);
+    }
+
+    m_loader = std::thread(&DemStreamer::LoaderLoop, this);
+}
+
+DemStreamer::~DemStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_stopping = true;
+    }
+    m_queueCondition.notify_all();
+    if (m_loader.joinable()) {
+        m_loader.join();
+    }
+    if (m_mapping) {
+        munmap(m_mapping, m_mappingSize);
+    }
+}
+
+bool DemStreamer::Open(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(HeightTileHeader)) {
+        close(fd);
+        return false;
+    }
+    m_mappingSize = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, m_mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    std::memcpy(&m_header, mapping, sizeof(m_header));
+    m_tileBytes = HeightTileBytes(m_header.tileSize);
+    size_t expected = m_header.dataOffset + HeightTileCount(m_header.levelCount) * m_tileBytes;
+    if (m_header.magic != HEIGHT_TILE_MAGIC || m_header.version != HEIGHT_TILE_VERSION ||
+        m_header.levelCount == 0 || m_mappingSize < expected) {
+        std::cerr << "Height tile file " << path << " is not a version " << HEIGHT_TILE_VERSION << " pyramid" << std::endl;
+        munmap(mapping, m_mappingSize);
+        return false;
+    }
+
+    // Access is tile by tile, readahead would only pull in unrelated tiles
+    madvise(mapping, m_mappingSize, MADV_RANDOM);
+    m_mapping = static_cast<unsigned char*>(mapping);
+
+    // Identity for derived caches: header contents plus file size
+    uint64_t hash = 14695981039346656037ull;
+    const unsigned char* bytes = m_mapping;
+    for (size_t i = 0; i < sizeof(HeightTileHeader); ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    m_contentId = hash ^ m_mappingSize;
+    return true;
+}
+
+std::vector<float> DemStreamer::DecodeTile(uint64_t index) const {
+    size_t samples = HeightTileSampleCount(m_header.tileSize);
+    std::vector<float> heights(samples);
+    const unsigned char* src = m_mapping + m_header.dataOffset + index * m_tileBytes;
+    for (size_t i = 0; i < samples; ++i) {
+        int16_t raw;
+        std::memcpy(&raw, src + i * sizeof(int16_t), sizeof(int16_t));
+        heights[i] = raw * m_header.heightScale + m_header.heightOffset;
+    }
+
+    // The decoded copy is what stays resident, let the kernel drop the file pages
+    uintptr_t begin = reinterpret_cast<uintptr_t>(src);
+    uintptr_t end = begin + m_tileBytes;
+    uintptr_t alignedBegin = (begin + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    uintptr_t alignedEnd = end / PAGE_SIZE * PAGE_SIZE;
+    if (alignedEnd > alignedBegin) {
+        madvise(reinterpret_cast<void*>(alignedBegin), alignedEnd - alignedBegin, MADV_DONTNEED);
+    }
+    return heights;
+}
+
+void DemStreamer::InsertTile(uint64_t index, std::vector<float>&& heights, bool pinned) {
+    std::unique_lock<std::shared_mutex> lock(m_tilesMutex);
+    if (m_tiles.count(index)) return;
+
+    size_t bytes = heights.size() * sizeof(float);
+    ResidentTile& tile = m_tiles[index];
+    tile.heights = std::move(heights);
+    tile.pinned = pinned;
+    tile.lru = m_lru.insert(m_lru.begin(), index);
+    m_residentBytes += bytes;
+    m_tilesLoaded++;
+
+    // Enforce the budget, oldest unpinned tiles first
+    auto it = m_lru.end();
+    while (m_residentBytes > m_budget && it != m_lru.begin()) {
+        --it;
+        auto victim = m_tiles.find(*it);
+        if (victim->second.pinned || victim->first == index) continue;
+        m_residentBytes -= victim->second.heights.size() * sizeof(float);
+        m_tiles.erase(victim);
+        it = m_lru.erase(it);
+        m_tilesEvicted++;
+    }
+    m_memory.Set(m_residentBytes);
+}
+
+void DemStreamer::LoaderLoop() {
+    while (true) {
+        uint64_t index;
+        {
+            std::unique_lock<std::mutex> lock(m_queueMutex);
+            m_queueCondition.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_stopping) return;
+            // Newest requests first: they belong to what the camera sees now
+            index = m_queue.back();
+            m_queue.pop_back();
+        }
+
+        InsertTile(index, DecodeTile(index), false);
+
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_queued.erase(index);
+    }
+}
+
+void DemStreamer::Prefetch(int face, int level, uint32_t x, uint32_t y) {
+    if (!m_mapping) return;
+    level = std::clamp(level, 0, GetLevelCount() - 1);
+    uint64_t index = HeightTileIndex(static_cast<uint32_t>(face), static_cast<uint32_t>(level), x, y);
+
+    {
+        std::unique_lock<std::shared_mutex> lock(m_tilesMutex);
+        auto it = m_tiles.find(index);
+        if (it != m_tiles.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+            return;
+        }
+    }
+    if (m_synchronous) {
+        InsertTile(index, DecodeTile(index), false);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    if (m_queued.insert(index).second) {
+        m_queue.push_back(index);
+        m_queueCondition.notify_one();
+    }
+}
+
+const DemStreamer::ResidentTile* DemStreamer::FindTile(int face, float u, float v, int level, float& localU, float& localV) const {
+    uint32_t tilesPerAxis = 1u << level;
+    float fu = std::clamp(u, 0.0f, 1.0f) * tilesPerAxis;
+    float fv = std::clamp(v, 0.0f, 1.0f) * tilesPerAxis;
+    uint32_t x = std::min(static_cast<uint32_t>(fu), tilesPerAxis - 1);
+    uint32_t y = std::min(static_cast<uint32_t>(fv), tilesPerAxis - 1);
+    auto it = m_tiles.find(HeightTileIndex(static_cast<uint32_t>(face), static_cast<uint32_t>(level), x, y));
+    if (it == m_tiles.end()) return nullptr;
+    localU = fu - x;
+    localV = fv - y;
+    return &it->second;
+}
+
+float DemStreamer::SampleHeight(int face, float u, float v, int level) {
+    if (!m_mapping) return 0.0f;
+
+    std::shared_lock<std::shared_mutex> lock(m_tilesMutex);
+    for (int l = std::clamp(level, 0, GetLevelCount() - 1); l >= 0; --l) {
+        float localU, localV;
+        const ResidentTile* tile = FindTile(face, u, v, l, localU, localV);
+        if (!tile) continue;
+
+        // Bilinear within the tile, the duplicated last row/column covers the edge
+        int size = GetTileSize();
+        float px = localU * size;
+        float py = localV * size;
+        int x0 = std::min(static_cast<int>(px), size - 1);
+        int y0 = std::min(static_cast<int>(py), size - 1);
+        float tx = px - x0;
+        float ty = py - y0;
+        int stride = size + 1;
+        const std::vector<float>& h = tile->heights;
+        float top = h[y0 * stride + x0] * (1.0f - tx) + h[y0 * stride + x0 + 1] * tx;
+        float bottom = h[(y0 + 1) * stride + x0] * (1.0f - tx) + h[(y0 + 1) * stride + x0 + 1] * tx;
+        return top * (1.0f - ty) + bottom * ty;
+    }
+    return 0.0f;
+}
+
+int DemStreamer::ResidentLevel(int face, float u, float v, int level) {
+    if (!m_mapping) return -1;
+
+    std::shared_lock<std::shared_mutex> lock(m_tilesMutex);
+    for (int l = std::clamp(level, 0, GetLevelCount() - 1); l >= 0; --l) {
+        float localU, localV;
+        if (FindTile(face, u, v, l, localU, localV)) return l;
+    }
+    return -1;
+}
+
+void DemStreamer::EvictUnpinned() {
+    std::unique_lock<std::shared_mutex> lock(m_tilesMutex);
+    for (auto it = m_lru.begin(); it != m_lru.end();) {
+        auto tile = m_tiles.find(*it);
+        if (tile->second.pinned) {
+            ++it;
+            continue;
+        }
+        m_residentBytes -= tile->second.heights.size() * sizeof(float);
+        m_tiles.erase(tile);
+        it = m_lru.erase(it);
+        m_tilesEvicted++;
+    }
+    m_memory.Set(m_residentBytes);
+}
+
+size_t DemStreamer::GetResidentBytes() const {
+    std::shared_lock<std::shared_mutex> lock(m_tilesMutex);
+    return m_residentBytes;
+}
+
+size_t DemStreamer::GetResidentTiles() const {
+    std::shared_lock<std::shared_mutex> lock(m_tilesMutex);
+    return m_tiles.size();
+}
+
+size_t DemStreamer::GetPendingTiles() const {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    return m_queued.size();
+}
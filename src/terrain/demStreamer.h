@@ -0,0 +1,91 @@
+#pragma once
+#include "heightSource.h"
+#include "heightTileFormat.h"
+#include "core/memoryBudget.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Streams a height pyramid written by tools/demConverter. The file is
+// memory-mapped, but tiles are only decoded into resident memory when a
+// quadtree leaf asks for them. A loader thread takes the page faults, and
+// resident tiles are evicted least recently used first once the byte budget
+// is exceeded. Level 0 (six tiles) is pinned, so a sample always resolves,
+// falling back to coarser data while finer tiles are in flight.
+class DemStreamer : public HeightSource {
+public:
+    DemStreamer(const std::string& path, size_t residentBudgetBytes = 64ull * 1024 * 1024);
+    ~DemStreamer() override;
+
+    DemStreamer(const DemStreamer&) = delete;
+    DemStreamer& operator=(const DemStreamer&) = delete;
+
+    bool IsOpen() const { return m_mapping != nullptr; }
+
+    float SampleHeight(int face, float u, float v, int level) override;
+    int ResidentLevel(int face, float u, float v, int level) override;
+    void Prefetch(int face, int level, uint32_t x, uint32_t y) override;
+
+    int GetLevelCount() const override { return static_cast<int>(m_header.levelCount); }
+    int GetTileSize() const override { return static_cast<int>(m_header.tileSize); }
+    float GetMaxHeight() const override { return m_header.maxHeight; }
+    float GetMinHeight() const override { return m_header.minHeight; }
+    uint64_t GetContentId() const override { return m_contentId; }
+
+    // Drops every tile but the pinned level 0, for a planet that has left the view
+    void EvictUnpinned();
+    // Decode prefetched tiles on the calling thread instead of the loader
+    void SetSynchronous(bool synchronous) { m_synchronous = synchronous; }
+    
+    size_t GetResidentBytes() const;
+    size_t GetResidentTiles() const;
+    size_t GetPendingTiles() const;
+    uint64_t GetTilesLoaded() const { return m_tilesLoaded; }
+    uint64_t GetTilesEvicted() const { return m_tilesEvicted; }
+
+private:
+    struct ResidentTile {
+        std::vector<float> heights;
+        std::list<uint64_t>::iterator lru;
+        bool pinned;
+    };
+
+    HeightTileHeader m_header;
+    uint64_t m_contentId;
+    size_t m_tileBytes;
+    size_t m_mappingSize;
+    unsigned char* m_mapping;
+
+    mutable std::shared_mutex m_tilesMutex;
+    std::unordered_map<uint64_t, ResidentTile> m_tiles;
+    std::list<uint64_t> m_lru;                      // front = most recently requested
+    size_t m_residentBytes;
+    size_t m_budget;
+    MemoryAccount m_memory;
+    std::atomic<uint64_t> m_tilesLoaded;
+    std::atomic<uint64_t> m_tilesEvicted;
+
+    mutable std::mutex m_queueMutex;
+    std::condition_variable m_queueCondition;
+    std::deque<uint64_t> m_queue;
+    std::unordered_set<uint64_t> m_queued;
+    std::thread m_loader;
+    bool m_stopping;
+    bool m_synchronous;
+
+    bool Open(const std::string& path);
+    std::vector<float> DecodeTile(uint64_t index) const;
+    void InsertTile(uint64_t index, std::vector<float>&& heights, bool pinned);
+    void LoaderLoop();
+    // Tile covering (u, v) at level, returns nullptr when not resident (caller holds the lock)
+    const ResidentTile* FindTile(int face, float u, float v, int level, float& localU, float& localV) const;
+};
@@ -0,0 +1,106 @@
+#include "heightAtlas.h"
+#include "heightSource.h"
+#include "core/profiler.h"
+
+HeightAtlas::HeightAtlas(HeightSource* heights, float heightScale, int capacity)
+    : m_heights(heights), m_heightScale(heightScale), m_capacity(capacity), m_texture(0),
+      m_slots(capacity), m_frame(0), m_refreshes(0), m_uploads(0), m_memory("Height atlas", MemoryKind::GPU) {
+    m_staging.resize(TILE_SIZE * TILE_SIZE);
+    m_lookup.reserve(capacity);
+    
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R32F, TILE_SIZE, TILE_SIZE, capacity);
+    // Linear between samples, the TES offsets coordinates onto texel centres
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    m_memory.Set(GetGpuBytes());
+}
+
+HeightAtlas::~HeightAtlas() {
+    if (m_texture) glDeleteTextures(1, &m_texture);
+}
+
+void HeightAtlas::BeginFrame() {
+    m_frame++;
+    m_refreshes = 0;
+}
+
+int HeightAtlas::Acquire(uint64_t key, int face, const glm::vec2& topLeft, const glm::vec2& bottomRight, int level) {
+    auto it = m_lookup.find(key);
+    if (it != m_lookup.end()) {
+        int layer = it->second;
+        Slot& slot = m_slots[layer];
+        slot.lastUsed = m_frame;
+        if (!slot.exact && m_refreshes < MAX_REFRESHES_PER_FRAME) {
+            glm::vec2 center = (topLeft + bottomRight) * 0.5f;
+            if (m_heights->ResidentLevel(face, center.x, center.y, level) >= level) {
+                m_refreshes++;
+                Upload(layer);
+            }
+        }
+        return layer;
+    }
+    
+    int layer = FindVictim();
+    if (layer < 0) return -1;
+    
+    Slot& slot = m_slots[layer];
+    if (slot.used) {
+        m_lookup.erase(slot.key);
+    }
+    slot.key = key;
+    slot.lastUsed = m_frame;
+    slot.face = face;
+    slot.topLeft = topLeft;
+    slot.bottomRight = bottomRight;
+    slot.level = level;
+    slot.used = true;
+    m_lookup[key] = layer;
+    Upload(layer);
+    return layer;
+}
+
+void HeightAtlas::Bind() const {
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+}
+
+int HeightAtlas::FindVictim() const {
+    // Free slot first, otherwise the stalest one not needed this frame
+    int victim = -1;
+    uint64_t oldest = m_frame;
+    for (int i = 0; i < m_capacity; ++i) {
+        const Slot& slot = m_slots[i];
+        if (!slot.used) return i;
+        if (slot.lastUsed < oldest) {
+            oldest = slot.lastUsed;
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+void HeightAtlas::Upload(int layer) {
+    PROFILE_ZONE("Height Atlas Upload");
+    Slot& slot = m_slots[layer];
+    glm::vec2 size = slot.bottomRight - slot.topLeft;
+    for (int j = 0; j < TILE_SIZE; ++j) {
+        for (int i = 0; i < TILE_SIZE; ++i) {
+            float u = slot.topLeft.x + (static_cast<float>(i) / (TILE_SIZE - 1)) * size.x;
+            float v = slot.topLeft.y + (static_cast<float>(j) / (TILE_SIZE - 1)) * size.y;
+            m_staging[j * TILE_SIZE + i] = m_heights->SampleHeight(slot.face, u, v, slot.level) * m_heightScale;
+        }
+    }
+    glm::vec2 center = (slot.topLeft + slot.bottomRight) * 0.5f;
+    slot.exact = m_heights->ResidentLevel(slot.face, center.x, center.y, slot.level) >= slot.level;
+    
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, TILE_SIZE, TILE_SIZE, 1, GL_RED, GL_FLOAT, m_staging.data());
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    m_uploads++;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "core/memoryBudget.h"
+#include <epoxy/gl.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class HeightSource;
+
+// GPU copy of the heights under the patches drawn by the tessellation
+// backend. One TILE_SIZE^2 R32F layer of a texture array per patch, already
+// scaled to world units and covering exactly the patch's extent; layers are
+// recycled least recently used first. The default capacity (2.4 MB) covers
+// the ~1300 leaves of the shortened tree near the surface with room to spare.
+class HeightAtlas {
+public:
+    static constexpr int TILE_SIZE = 17;                // 16 cells, samples on the patch edges
+    static constexpr GLuint TEXTURE_UNIT = 0;           // layout(binding = 0) in shaders/terrain.tese
+    static constexpr int MAX_REFRESHES_PER_FRAME = 32;  // fallback layers redone once finer heights arrive
+
+    HeightAtlas(HeightSource* heights, float heightScale, int capacity = 2048);
+    ~HeightAtlas();
+
+    HeightAtlas(const HeightAtlas&) = delete;
+    HeightAtlas& operator=(const HeightAtlas&) = delete;
+
+    void BeginFrame();
+    // Layer holding the heights of one patch at level, uploading them if needed.
+    // -1 when every layer is already in use this frame.
+    int Acquire(uint64_t key, int face, const glm::vec2& topLeft, const glm::vec2& bottomRight, int level);
+    void Bind() const;
+
+    int GetCapacity() const { return m_capacity; }
+    size_t GetResidentCount() const { return m_lookup.size(); }
+    uint64_t GetUploadCount() const { return m_uploads; }
+    size_t GetGpuBytes() const { return static_cast<size_t>(m_capacity) * TILE_SIZE * TILE_SIZE * sizeof(float); }
+
+private:
+    struct Slot {
+        uint64_t key = 0;
+        uint64_t lastUsed = 0;
+        int face = 0;
+        glm::vec2 topLeft = glm::vec2(0.0f);
+        glm::vec2 bottomRight = glm::vec2(0.0f);
+        int level = 0;
+        bool used = false;
+        bool exact = false;         // built from heights at the level it asked for
+    };
+
+    HeightSource* m_heights;
+    float m_heightScale;
+    int m_capacity;
+    GLuint m_texture;
+    std::vector<Slot> m_slots;
+    std::unordered_map<uint64_t, int> m_lookup;
+    std::vector<float> m_staging;
+    uint64_t m_frame;
+    int m_refreshes;
+    uint64_t m_uploads;
+    MemoryAccount m_memory;
+
+    int FindVictim() const;
+    void Upload(int layer);
+};
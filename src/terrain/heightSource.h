@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+
+// Elevation provider for a cube-sphere planet. Heights are in the source's
+// own units (metres for DEMs); the CubeSphere scales them into world units.
+// Implementations must be safe to call from multiple threads.
+class HeightSource {
+public:
+    virtual ~HeightSource() = default;
+
+    // Height at (u, v) on a cube face, using data no finer than level
+    virtual float SampleHeight(int face, float u, float v, int level) = 0;
+
+    // Finest level whose data is resident for the tile containing (u, v),
+    // callers compare against the level they asked for to spot fallbacks
+    virtual int ResidentLevel(int face, float u, float v, int level) = 0;
+
+    // Hint that data for this region at this level will be needed soon
+    virtual void Prefetch(int face, int level, uint32_t x, uint32_t y) = 0;
+
+    virtual int GetLevelCount() const = 0;
+    virtual int GetTileSize() const = 0;
+    virtual float GetMaxHeight() const = 0;
+    virtual float GetMinHeight() const = 0;
+    // Changes whenever the underlying data changes, for derived caches
+    virtual uint64_t GetContentId() const = 0;
+};
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// On-disk layout of a cube-sphere height pyramid, written by tools/demConverter
+// and memory-mapped by DemStreamer.
+//
+//   HeightTileHeader
+//   tiles, level-major: for level L, face F, row y, column x (2^L x 2^L per face)
+//
+// Every tile has the same size, so a tile's offset is pure arithmetic and no
+// index table is needed. A tile stores (tileSize + 1)^2 int16 samples: the
+// extra row and column duplicate the neighbour's first samples so bilinear
+// filtering never has to cross a tile. height = sample * heightScale + heightOffset.
+
+constexpr uint32_t HEIGHT_TILE_MAGIC = 0x54484553;    // "SEHT"
+constexpr uint32_t HEIGHT_TILE_VERSION = 1;
+
+struct HeightTileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t tileSize;          // cells per tile edge, samples are tileSize + 1
+    uint32_t levelCount;
+    float heightScale;
+    float heightOffset;
+    float minHeight;
+    float maxHeight;
+    uint64_t dataOffset;
+    uint64_t reserved[4];
+};
+
+inline size_t HeightTileSampleCount(uint32_t tileSize) {
+    return static_cast<size_t>(tileSize + 1) * (tileSize + 1);
+}
+
+inline size_t HeightTileBytes(uint32_t tileSize) {
+    return HeightTileSampleCount(tileSize) * sizeof(int16_t);
+}
+
+// Tiles before level: 6 faces * (1 + 4 + ... + 4^(level-1))
+inline uint64_t HeightTileLevelBase(uint32_t level) {
+    return 6ull * (((1ull << (2 * level)) - 1) / 3);
+}
+
+inline uint64_t HeightTileIndex(uint32_t face, uint32_t level, uint32_t x, uint32_t y) {
+    uint64_t tilesPerAxis = 1ull << level;
+    return HeightTileLevelBase(level) + (face * tilesPerAxis + y) * tilesPerAxis + x;
+}
+
+inline uint64_t HeightTileCount(uint32_t levelCount) {
+    return HeightTileLevelBase(levelCount);
+}
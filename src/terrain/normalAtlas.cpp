@@ -0,0 +1,231 @@
+#include "normalAtlas.h"
+#include "heightSource.h"
+#include "cubeMapping.h"
+#include "core/profiler.h"
+#include "core/threadPool.h"
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+uint16_t PackUnorm16(float value) {
+    return static_cast<uint16_t>(std::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+// normal in the tangent frame basic.frag rebuilds: up is the radial direction,
+// the tangent the face's u axis projected onto the plane around it
+void PackTexel(const glm::vec3& normal, const glm::vec3& up, const glm::vec3& faceTangent, int face, float height,
+               uint16_t* texel) {
+    glm::vec3 tangent = glm::normalize(faceTangent - up * glm::dot(faceTangent, up));
+    glm::vec3 bitangent = glm::cross(up, tangent);
+    texel[0] = PackUnorm16(glm::dot(normal, tangent) * 0.5f + 0.5f);
+    texel[1] = PackUnorm16(glm::dot(normal, bitangent) * 0.5f + 0.5f);
+    texel[2] = PackUnorm16(height);
+    texel[3] = static_cast<uint16_t>(face * (65535 / 5));
+}
+
+}
+
+NormalAtlas::NormalAtlas(HeightSource* heights, float radius, float heightScale, int capacity)
+    : m_heights(heights), m_radius(radius), m_heightScale(heightScale), m_capacity(capacity), m_texture(0),
+      m_slots(capacity), m_frame(0), m_issued(0), m_refreshes(0), m_bakes(0), m_synchronous(false),
+      m_memory("Normal atlas", MemoryKind::GPU), m_inFlight(0), m_stopping(false) {
+    m_lookup.reserve(capacity);
+
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA16, TILE_SIZE, TILE_SIZE, capacity);
+    // Linear between samples, basic.frag offsets coordinates onto texel centres
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    m_memory.Set(GetGpuBytes());
+}
+
+NormalAtlas::~NormalAtlas() {
+    // Bakes in flight reference this atlas, wait them out
+    m_stopping = true;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this] { return m_inFlight == 0; });
+    }
+    if (m_texture) glDeleteTextures(1, &m_texture);
+}
+
+void NormalAtlas::BeginFrame() {
+    m_frame++;
+    m_issued = 0;
+    m_refreshes = 0;
+
+    std::vector<Bake> finished;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t count = std::min(m_finished.size(), static_cast<size_t>(MAX_UPLOADS_PER_FRAME));
+        finished.assign(std::make_move_iterator(m_finished.begin()), std::make_move_iterator(m_finished.begin() + count));
+        m_finished.erase(m_finished.begin(), m_finished.begin() + count);
+    }
+    if (finished.empty()) return;
+
+    PROFILE_ZONE("Normal Atlas Upload");
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (const Bake& bake : finished) {
+        Slot& slot = m_slots[bake.layer];
+        // The layer went to another patch while this one was baking
+        if (bake.generation != slot.generation) continue;
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, bake.layer, TILE_SIZE, TILE_SIZE, 1,
+                        GL_RGBA, GL_UNSIGNED_SHORT, bake.texels.data());
+        slot.ready = true;
+        slot.baking = false;
+        slot.exact = bake.exact;
+        m_bakes++;
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+int NormalAtlas::Acquire(uint64_t key, int face, const glm::vec2& topLeft, const glm::vec2& bottomRight, int level) {
+    auto it = m_lookup.find(key);
+    if (it != m_lookup.end()) {
+        int layer = it->second;
+        Slot& slot = m_slots[layer];
+        slot.lastUsed = m_frame;
+        // The fallback map stays in use while the finer one bakes
+        if (slot.ready && !slot.exact && !slot.baking && m_refreshes < MAX_REFRESHES_PER_FRAME) {
+            glm::vec2 center = (topLeft + bottomRight) * 0.5f;
+            if (m_heights->ResidentLevel(face, center.x, center.y, level) >= level) {
+                m_refreshes++;
+                Submit(layer);
+            }
+        }
+        return slot.ready ? layer : -1;
+    }
+
+    if (m_issued >= MAX_ISSUED_PER_FRAME) return -1;
+    int layer = FindVictim();
+    if (layer < 0) return -1;
+
+    Slot& slot = m_slots[layer];
+    if (slot.used) {
+        m_lookup.erase(slot.key);
+    }
+    slot.key = key;
+    slot.lastUsed = m_frame;
+    slot.generation++;
+    slot.face = face;
+    slot.topLeft = topLeft;
+    slot.bottomRight = bottomRight;
+    slot.level = level;
+    slot.used = true;
+    slot.ready = false;
+    slot.exact = false;
+    m_lookup[key] = layer;
+    m_issued++;
+    Submit(layer);
+    return -1;
+}
+
+void NormalAtlas::Bind() const {
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+size_t NormalAtlas::GetPendingCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<size_t>(m_inFlight) + m_finished.size();
+}
+
+int NormalAtlas::FindVictim() const {
+    // Free slot first, otherwise the stalest one not needed this frame
+    int victim = -1;
+    uint64_t oldest = m_frame;
+    for (int i = 0; i < m_capacity; ++i) {
+        const Slot& slot = m_slots[i];
+        if (!slot.used) return i;
+        if (slot.lastUsed < oldest) {
+            oldest = slot.lastUsed;
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+void NormalAtlas::Submit(int layer) {
+    Slot& slot = m_slots[layer];
+    slot.baking = true;
+    if (m_synchronous) {
+        Bake bake{ layer, slot.generation, false, {} };
+        BakeTexels(slot, bake.texels, bake.exact);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finished.push_back(std::move(bake));
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_inFlight++;
+    }
+    // The worker gets its own copy, the slot may be reused before it finishes
+    Slot request = slot;
+    ThreadPool::Get().Submit([this, request, layer] {
+        Bake bake{ layer, request.generation, false, {} };
+        if (!m_stopping) {
+            PROFILE_ZONE("Normal Map Bake");
+            BakeTexels(request, bake.texels, bake.exact);
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_stopping) {
+            m_finished.push_back(std::move(bake));
+        }
+        m_inFlight--;
+        m_idle.notify_all();
+    });
+}
+
+void NormalAtlas::BakeTexels(const Slot& slot, std::vector<uint16_t>& texels, bool& exact) const {
+    // Checked first, heights arriving mid-bake only make the map better than claimed
+    glm::vec2 middle = (slot.topLeft + slot.bottomRight) * 0.5f;
+    exact = m_heights->ResidentLevel(slot.face, middle.x, middle.y, slot.level) >= slot.level;
+
+    // Surface points one cell past the patch on every side, so the edge
+    // normals are central differences too and match the neighbour's
+    constexpr int GRID = TILE_SIZE + 2;
+    std::vector<glm::vec3> positions(GRID * GRID);
+    std::vector<float> heights(GRID * GRID);
+    glm::vec2 cell = (slot.bottomRight - slot.topLeft) / static_cast<float>(TILE_SIZE - 1);
+    for (int j = 0; j < GRID; ++j) {
+        for (int i = 0; i < GRID; ++i) {
+            float u = slot.topLeft.x + static_cast<float>(i - 1) * cell.x;
+            float v = slot.topLeft.y + static_cast<float>(j - 1) * cell.y;
+            // Past the face edge the cube plane still gives the right direction,
+            // only the heights have to come from inside the face
+            float height = m_heights->SampleHeight(slot.face, std::clamp(u, 0.0f, 1.0f), std::clamp(v, 0.0f, 1.0f), slot.level);
+            glm::vec3 direction = glm::normalize(CubeFacePosition(slot.face, u, v));
+            positions[j * GRID + i] = direction * (m_radius + height * m_heightScale);
+            heights[j * GRID + i] = height;
+        }
+    }
+
+    float minHeight = m_heights->GetMinHeight();
+    float range = std::max(m_heights->GetMaxHeight() - minHeight, 1e-6f);
+    glm::vec3 faceTangent = glm::normalize(CubeFacePosition(slot.face, 1.0f, 0.0f) - CubeFacePosition(slot.face, 0.0f, 0.0f));
+    texels.resize(TILE_SIZE * TILE_SIZE * 4);
+    for (int j = 0; j < TILE_SIZE; ++j) {
+        for (int i = 0; i < TILE_SIZE; ++i) {
+            int center = (j + 1) * GRID + (i + 1);
+            glm::vec3 n = glm::cross(positions[center + 1] - positions[center - 1],
+                                     positions[center + GRID] - positions[center - GRID]);
+            float length = glm::length(n);
+            glm::vec3 up = glm::normalize(positions[center]);
+            if (length > 0.0f) {
+                n /= length;
+                // Face parameterisations differ in handedness, keep normals pointing out
+                if (glm::dot(n, up) < 0.0f) n = -n;
+            } else {
+                n = up;
+            }
+            PackTexel(n, up, faceTangent, slot.face, (heights[center] - minHeight) / range, &texels[(j * TILE_SIZE + i) * 4]);
+        }
+    }
+}
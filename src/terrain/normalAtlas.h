@@ -0,0 +1,101 @@
+#pragma once
+#include "core/memoryBudget.h"
+#include <epoxy/gl.h>
+#include <glm/glm.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class HeightSource;
+
+// Per-patch normal and height maps, so shading detail comes from texels
+// rather than quadtree depth. One TILE_SIZE^2 RGBA16 layer of a texture array
+// per leaf, samples on the patch edges: the surface normal in rg, in a tangent
+// frame around the radial direction with the face's u axis as reference (see
+// SurfaceNormal in shaders/basic.frag), the height between the source's
+// minimum and maximum in b, and the cube face / 5 in a. 16 bits keep the
+// normals within a few hundredths of a degree, where planet-local 8-bit ones
+// stepped by almost half a degree and banded. Maps are baked from the height
+// source on the shared ThreadPool and uploaded by BeginFrame as they finish;
+// until a leaf's map is in (or when every layer is busy) it shades with its
+// vertex normals. Layers are recycled least recently used first. The default
+// capacity is 32 MB.
+class NormalAtlas {
+public:
+    static constexpr int TILE_SIZE = 64;                // 63 cells, samples on the patch edges
+    static constexpr GLuint TEXTURE_UNIT = 1;           // layout(binding = 1) in shaders/basic.frag
+    static constexpr int MAX_ISSUED_PER_FRAME = 32;
+    static constexpr int MAX_UPLOADS_PER_FRAME = 64;
+    static constexpr int MAX_REFRESHES_PER_FRAME = 16;  // fallback maps rebaked once finer heights arrive
+
+    NormalAtlas(HeightSource* heights, float radius, float heightScale, int capacity = 1024);
+    ~NormalAtlas();
+
+    NormalAtlas(const NormalAtlas&) = delete;
+    NormalAtlas& operator=(const NormalAtlas&) = delete;
+
+    // Uploads the maps baked since the last frame
+    void BeginFrame();
+    // Layer holding the map of one patch baked from heights at level, -1 while
+    // it is still baking or when every layer is in use this frame. Render thread only.
+    int Acquire(uint64_t key, int face, const glm::vec2& topLeft, const glm::vec2& bottomRight, int level);
+    void Bind() const;
+    // Bake on the calling thread instead of the pool
+    void SetSynchronous(bool synchronous) { m_synchronous = synchronous; }
+
+    int GetCapacity() const { return m_capacity; }
+    size_t GetResidentCount() const { return m_lookup.size(); }
+    size_t GetPendingCount() const;
+    uint64_t GetBakeCount() const { return m_bakes; }
+    size_t GetGpuBytes() const { return static_cast<size_t>(m_capacity) * TILE_SIZE * TILE_SIZE * 4 * sizeof(uint16_t); }
+
+private:
+    struct Slot {
+        uint64_t key = 0;
+        uint64_t lastUsed = 0;
+        uint32_t generation = 0;    // bumped on reuse, stale bakes are dropped
+        int face = 0;
+        glm::vec2 topLeft = glm::vec2(0.0f);
+        glm::vec2 bottomRight = glm::vec2(0.0f);
+        int level = 0;
+        bool used = false;
+        bool ready = false;         // the layer holds this key's map
+        bool baking = false;
+        bool exact = false;         // baked from heights at the level it asked for
+    };
+
+    struct Bake {
+        int layer;
+        uint32_t generation;
+        bool exact;
+        std::vector<uint16_t> texels;   // RGBA per texel
+    };
+
+    HeightSource* m_heights;
+    float m_radius;
+    float m_heightScale;
+    int m_capacity;
+    GLuint m_texture;
+    std::vector<Slot> m_slots;
+    std::unordered_map<uint64_t, int> m_lookup;
+    uint64_t m_frame;
+    int m_issued;
+    int m_refreshes;
+    uint64_t m_bakes;
+    bool m_synchronous;
+    MemoryAccount m_memory;
+
+    // Shared with the workers
+    mutable std::mutex m_mutex;
+    std::condition_variable m_idle;
+    std::vector<Bake> m_finished;
+    int m_inFlight;
+    std::atomic<bool> m_stopping;
+
+    int FindVictim() const;
+    void Submit(int layer);
+    void BakeTexels(const Slot& slot, std::vector<uint16_t>& texels, bool& exact) const;
+};
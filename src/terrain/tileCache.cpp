@@ -0,0 +1,217 @@
+#include "tileCache.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint32_t TILE_CACHE_MAGIC = 0x43544553;  // "SETC"
+constexpr uint32_t TILE_CACHE_VERSION = 1;
+
+// Start of the record region; records follow every recordSize bytes
+constexpr size_t PAGE_ALIGNMENT = 4096;
+
+size_t AlignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+TileCache::TileCache(const std::string& path, uint64_t contentId, uint32_t recordSize, uint32_t capacity)
+    : m_path(path), m_recordSize(static_cast<uint32_t>(AlignUp(recordSize, 16))), m_capacity(capacity),
+      m_fd(-1), m_mappingSize(0), m_mapping(nullptr), m_header(nullptr), m_index(nullptr), m_records(nullptr),
+      m_hits(0), m_misses(0), m_evictions(0), m_stopping(false) {
+    if (!Open(contentId)) {
+        std::cerr << "Tile cache disabled, could not open " << path << std::endl;
+        return;
+    }
+    m_writer = std::thread(&TileCache::WriterLoop, this);
+}
+
+TileCache::~TileCache() {
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_stopping = true;
+    }
+    m_queueCondition.notify_all();
+    if (m_writer.joinable()) {
+        m_writer.join();
+    }
+
+    if (m_mapping) {
+        msync(m_mapping, m_mappingSize, MS_ASYNC);
+        munmap(m_mapping, m_mappingSize);
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool TileCache::Open(uint64_t contentId) {
+    std::error_code ec;
+    std::filesystem::path parent = std::filesystem::path(m_path).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, ec);
+    }
+
+    m_fd = open(m_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (m_fd < 0) return false;
+
+    size_t indexOffset = AlignUp(sizeof(Header), 64);
+    size_t recordsOffset = AlignUp(indexOffset + sizeof(IndexEntry) * m_capacity, PAGE_ALIGNMENT);
+    m_mappingSize = recordsOffset + static_cast<size_t>(m_recordSize) * m_capacity;
+
+    struct stat info;
+    bool fresh = fstat(m_fd, &info) != 0 || static_cast<size_t>(info.st_size) != m_mappingSize;
+    if (fresh && ftruncate(m_fd, static_cast<off_t>(m_mappingSize)) != 0) {
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, m_mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    m_mapping = static_cast<unsigned char*>(mapping);
+    m_header = reinterpret_cast<Header*>(m_mapping);
+    m_index = reinterpret_cast<IndexEntry*>(m_mapping + indexOffset);
+    m_records = m_mapping + recordsOffset;
+
+    if (fresh || m_header->magic != TILE_CACHE_MAGIC || m_header->version != TILE_CACHE_VERSION ||
+        m_header->contentId != contentId || m_header->recordSize != m_recordSize ||
+        m_header->capacity != m_capacity) {
+        Reset(contentId);
+    }
+    RebuildIndex();
+    return true;
+}
+
+void TileCache::Reset(uint64_t contentId) {
+    std::memset(m_index, 0, sizeof(IndexEntry) * m_capacity);
+    m_header->magic = TILE_CACHE_MAGIC;
+    m_header->version = TILE_CACHE_VERSION;
+    m_header->contentId = contentId;
+    m_header->recordSize = m_recordSize;
+    m_header->capacity = m_capacity;
+    m_header->useCounter = 1;
+}
+
+void TileCache::RebuildIndex() {
+    m_slots.clear();
+    m_lru.clear();
+    m_freeSlots.clear();
+    m_lruPosition.assign(m_capacity, m_lru.end());
+
+    // Order occupied slots by last use so eviction survives restarts
+    std::vector<uint32_t> used;
+    for (uint32_t slot = 0; slot < m_capacity; ++slot) {
+        if (m_index[slot].lastUsed != 0) {
+            used.push_back(slot);
+        } else {
+            m_freeSlots.push_back(slot);
+        }
+    }
+    std::sort(used.begin(), used.end(), [this](uint32_t a, uint32_t b) {
+        return m_index[a].lastUsed > m_index[b].lastUsed;
+    });
+    for (uint32_t slot : used) {
+        m_slots[m_index[slot].key] = slot;
+        m_lruPosition[slot] = m_lru.insert(m_lru.end(), slot);
+    }
+}
+
+void TileCache::Touch(uint32_t slot) {
+    m_index[slot].lastUsed = ++m_header->useCounter;
+    m_lru.splice(m_lru.begin(), m_lru, m_lruPosition[slot]);
+}
+
+size_t TileCache::Read(uint64_t key, void* dst, size_t maxSize) {
+    if (!m_mapping) return 0;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_slots.find(key);
+    if (it == m_slots.end()) {
+        m_misses++;
+        return 0;
+    }
+
+    uint32_t slot = it->second;
+    size_t size = std::min<size_t>(m_index[slot].size, maxSize);
+    std::memcpy(dst, m_records + static_cast<size_t>(slot) * m_recordSize, size);
+    Touch(slot);
+    m_hits++;
+    return size;
+}
+
+bool TileCache::Contains(uint64_t key) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_slots.count(key) != 0;
+}
+
+size_t TileCache::GetCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_slots.size();
+}
+
+void TileCache::Write(uint64_t key, const void* data, size_t size) {
+    if (!m_mapping || size > m_recordSize) return;
+
+    PendingWrite write;
+    write.key = key;
+    write.data.assign(static_cast<const unsigned char*>(data), static_cast<const unsigned char*>(data) + size);
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_queue.push_back(std::move(write));
+    }
+    m_queueCondition.notify_one();
+}
+
+uint32_t TileCache::AcquireSlot(uint64_t key) {
+    auto it = m_slots.find(key);
+    if (it != m_slots.end()) {
+        return it->second;
+    }
+
+    uint32_t slot;
+    if (!m_freeSlots.empty()) {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        m_lruPosition[slot] = m_lru.insert(m_lru.begin(), slot);
+    } else {
+        // Evict the least recently used record
+        slot = m_lru.back();
+        m_slots.erase(m_index[slot].key);
+        m_evictions++;
+    }
+    m_slots[key] = slot;
+    return slot;
+}
+
+void TileCache::WriterLoop() {
+    while (true) {
+        PendingWrite write;
+        {
+            std::unique_lock<std::mutex> lock(m_queueMutex);
+            m_queueCondition.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty()) return;     // stopping and drained
+            write = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint32_t slot = AcquireSlot(write.key);
+        std::memcpy(m_records + static_cast<size_t>(slot) * m_recordSize, write.data.data(), write.data.size());
+        m_index[slot].key = write.key;
+        m_index[slot].size = static_cast<uint32_t>(write.data.size());
+        Touch(slot);
+    }
+}
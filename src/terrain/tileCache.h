@@ -0,0 +1,103 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Persistent store of generated patch data, one file per planet.
+//
+// File layout (all fixed size, so the whole file is mmapped once):
+//   Header   - magic, version, content id, record size, capacity
+//   Index    - capacity x { key, lastUsed, size }
+//   Records  - capacity x recordSize bytes, recordSize rounded up to 16; the
+//              region starts on a page boundary, the records inside it don't
+//
+// Reads are one memcpy from the mapping into the caller's buffer, not a view:
+// a node keeps its patch for as long as it lives, while the writer may reuse
+// the record for another key at any time. Writes are queued and applied by a
+// background writer thread. When the store is full, the least recently used
+// record is overwritten. A content id mismatch (for example a different
+// radius or generator version) resets the file.
+class TileCache {
+public:
+    TileCache(const std::string& path, uint64_t contentId, uint32_t recordSize, uint32_t capacity);
+    ~TileCache();
+
+    TileCache(const TileCache&) = delete;
+    TileCache& operator=(const TileCache&) = delete;
+
+    bool IsOpen() const { return m_mapping != nullptr; }
+
+    // Copies the record into dst (at most maxSize bytes), returns bytes copied or 0 on miss
+    size_t Read(uint64_t key, void* dst, size_t maxSize);
+    bool Contains(uint64_t key) const;
+    // Queues a record for the writer thread, ignored if larger than the record size
+    void Write(uint64_t key, const void* data, size_t size);
+
+    uint32_t GetCapacity() const { return m_capacity; }
+    size_t GetCount() const;
+    uint64_t GetHits() const { return m_hits; }
+    uint64_t GetMisses() const { return m_misses; }
+    uint64_t GetEvictions() const { return m_evictions; }
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t contentId;
+        uint32_t recordSize;
+        uint32_t capacity;
+        uint64_t useCounter;
+    };
+
+    struct IndexEntry {
+        uint64_t key;
+        uint64_t lastUsed;      // 0 = free slot
+        uint32_t size;
+        uint32_t reserved;
+    };
+
+    struct PendingWrite {
+        uint64_t key;
+        std::vector<unsigned char> data;
+    };
+
+    std::string m_path;
+    uint32_t m_recordSize;
+    uint32_t m_capacity;
+    int m_fd;
+    size_t m_mappingSize;
+    unsigned char* m_mapping;
+    Header* m_header;
+    IndexEntry* m_index;
+    unsigned char* m_records;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<uint64_t, uint32_t> m_slots;     // key -> slot
+    std::list<uint32_t> m_lru;                          // front = most recent
+    std::vector<std::list<uint32_t>::iterator> m_lruPosition;
+    std::vector<uint32_t> m_freeSlots;
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+    std::atomic<uint64_t> m_evictions;
+
+    // writer thread
+    std::mutex m_queueMutex;
+    std::condition_variable m_queueCondition;
+    std::deque<PendingWrite> m_queue;
+    std::thread m_writer;
+    bool m_stopping;
+
+    bool Open(uint64_t contentId);
+    void Reset(uint64_t contentId);
+    void RebuildIndex();
+    void Touch(uint32_t slot);
+    uint32_t AcquireSlot(uint64_t key);
+    void WriterLoop();
+};
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+
+// Identifies one quadtree patch: (planet, cube face, level, x, y).
+// Packs into 64 bits: planet 8 | face 3 | level 5 | x 24 | y 24.
+struct TileKey {
+    uint32_t planet;
+    uint32_t face;
+    uint32_t level;
+    uint32_t x;
+    uint32_t y;
+
+    uint64_t Pack() const {
+        return (static_cast<uint64_t>(planet & 0xff) << 56) |
+               (static_cast<uint64_t>(face & 0x7) << 53) |
+               (static_cast<uint64_t>(level & 0x1f) << 48) |
+               (static_cast<uint64_t>(x & 0xffffff) << 24) |
+               static_cast<uint64_t>(y & 0xffffff);
+    }
+
+    static TileKey Unpack(uint64_t packed) {
+        TileKey key;
+        key.planet = static_cast<uint32_t>(packed >> 56) & 0xff;
+        key.face = static_cast<uint32_t>(packed >> 53) & 0x7;
+        key.level = static_cast<uint32_t>(packed >> 48) & 0x1f;
+        key.x = static_cast<uint32_t>(packed >> 24) & 0xffffff;
+        key.y = static_cast<uint32_t>(packed) & 0xffffff;
+        return key;
+    }
+};
@@ -0,0 +1,403 @@
+#include "virtualTexture.h"
+#include "albedoStreamer.h"
+#include "core/profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+// Feedback code written by shaders/virtualFeedback.frag, 0 where nothing was drawn:
+// bit 31 set, face in 28..30, level in 24..27, page y in 12..23 and x in 0..11
+uint32_t FeedbackCode(int face, int level, uint32_t x, uint32_t y) {
+    return 0x80000000u | (static_cast<uint32_t>(face) << 28) | (static_cast<uint32_t>(level) << 24) | (y << 12) | x;
+}
+
+int CodeFace(uint32_t code) { return static_cast<int>((code >> 28) & 7u); }
+int CodeLevel(uint32_t code) { return static_cast<int>((code >> 24) & 15u); }
+uint32_t CodeY(uint32_t code) { return (code >> 12) & 0xfffu; }
+uint32_t CodeX(uint32_t code) { return code & 0xfffu; }
+
+// Page table entry as the RGBA8UI texel shaders/virtualTexture.frag reads
+uint32_t TableEntry(int slot, int level) {
+    uint32_t slotX = static_cast<uint32_t>(slot % VirtualTexture::ATLAS_PAGES);
+    uint32_t slotY = static_cast<uint32_t>(slot / VirtualTexture::ATLAS_PAGES);
+    return slotX | (slotY << 8) | (static_cast<uint32_t>(level) << 16) | 0xff000000u;
+}
+
+int EntryLevel(uint32_t entry) { return static_cast<int>((entry >> 16) & 0xffu); }
+bool EntryValid(uint32_t entry) { return (entry >> 24) != 0; }
+
+constexpr GLuint64 SYNC_TIMEOUT_NS = 1000000000ull;  // a synchronous readback waits at most a second
+
+}
+
+VirtualTexture::VirtualTexture(AlbedoStreamer* pages)
+    : m_pages(pages), m_levels(pages->GetLevelCount()), m_atlas(0), m_table(0),
+      m_slots(ATLAS_PAGES * ATLAS_PAGES), m_frame(0), m_uploads(0),
+      m_feedbackFBO(0), m_feedbackTexture(0), m_feedbackDepth(0), m_feedbackWidth(0), m_feedbackHeight(0),
+      m_feedbackNext(0), m_synchronous(false), m_savedFramebuffer(0), m_savedViewport{ 0, 0, 0, 0 }, m_savedPolygonMode{ GL_FILL, GL_FILL },
+      m_memory("Surface virtual texture", MemoryKind::GPU) {
+    m_resident.reserve(m_slots.size());
+    int atlasSize = ATLAS_PAGES * static_cast<int>(AlbedoPageStride());
+
+    // Colour imagery is sRGB, sampling converts it to the linear albedo the lighting wants
+    glGenTextures(1, &m_atlas);
+    glBindTexture(GL_TEXTURE_2D, m_atlas);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_SRGB8_ALPHA8, atlasSize, atlasSize);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Mip m of the table holds level (m_levels - 1 - m); integer textures only sample nearest
+    int tableSize = 1 << (m_levels - 1);
+    glGenTextures(1, &m_table);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_table);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, m_levels, GL_RGBA8UI, tableSize, tableSize, 6);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    m_tables.resize(6 * m_levels);
+    m_dirty.resize(6 * m_levels);
+    for (int face = 0; face < 6; ++face) {
+        for (int level = 0; level < m_levels; ++level) {
+            int size = 1 << level;
+            m_tables[face * m_levels + level].assign(static_cast<size_t>(size) * size, 0u);
+            m_dirty[face * m_levels + level] = glm::ivec4(0, 0, size, size);
+        }
+    }
+
+    for (FeedbackBuffer& feedback : m_feedback) {
+        glGenBuffers(1, &feedback.buffer);
+    }
+
+    // Pinned in the streamer, so always there
+    for (int face = 0; face < 6; ++face) {
+        AlbedoStreamer::Page page = m_pages->FindPage(face, 0, 0, 0);
+        if (!page) continue;
+        MapPage(face, face, 0, 0, 0, *page);
+        m_slots[face].pinned = true;
+    }
+    UploadTables();
+    m_memory.Set(GetGpuBytes());
+}
+
+VirtualTexture::~VirtualTexture() {
+    for (FeedbackBuffer& feedback : m_feedback) {
+        if (feedback.fence) glDeleteSync(feedback.fence);
+        if (feedback.buffer) glDeleteBuffers(1, &feedback.buffer);
+    }
+    if (m_feedbackFBO) glDeleteFramebuffers(1, &m_feedbackFBO);
+    if (m_feedbackTexture) glDeleteTextures(1, &m_feedbackTexture);
+    if (m_feedbackDepth) glDeleteRenderbuffers(1, &m_feedbackDepth);
+    if (m_atlas) glDeleteTextures(1, &m_atlas);
+    if (m_table) glDeleteTextures(1, &m_table);
+}
+
+size_t VirtualTexture::GetGpuBytes() const {
+    size_t atlasSize = static_cast<size_t>(ATLAS_PAGES) * AlbedoPageStride();
+    size_t table = 0;
+    for (int level = 0; level < m_levels; ++level) {
+        table += (static_cast<size_t>(1) << (2 * level)) * 6 * 4;
+    }
+    // Colour and depth of the target, plus the readback buffers
+    size_t feedback = static_cast<size_t>(m_feedbackWidth) * m_feedbackHeight * (8 + 4 * FEEDBACK_BUFFERS);
+    return atlasSize * atlasSize * 4 + table + feedback;
+}
+
+void VirtualTexture::Bind() const {
+    glActiveTexture(GL_TEXTURE0 + ATLAS_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_atlas);
+    glActiveTexture(GL_TEXTURE0 + TABLE_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_table);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void VirtualTexture::Update() {
+    PROFILE_ZONE("Virtual Texture");
+    m_frame++;
+    ReadFeedback();
+
+    // Pages still on screen stay, so mark them before any slot is recycled
+    std::vector<uint32_t> absent;
+    for (uint32_t code : m_requests) {
+        if (CodeLevel(code) >= m_levels) continue;
+        auto it = m_resident.find(HeightTileIndex(CodeFace(code), CodeLevel(code), CodeX(code), CodeY(code)));
+        if (it != m_resident.end()) {
+            m_slots[it->second].lastUsed = m_frame;
+        } else {
+            absent.push_back(code);
+        }
+    }
+
+    // The others come from the streamer's cache or are asked of it. Coarse
+    // levels go first, they cover the most pixels.
+    std::vector<uint32_t> missing;
+    int uploads = 0;
+    for (uint32_t code : absent) {
+        if (uploads >= MAX_UPLOADS_PER_FRAME) break;
+        int face = CodeFace(code);
+        int level = CodeLevel(code);
+        uint32_t x = CodeX(code);
+        uint32_t y = CodeY(code);
+
+        AlbedoStreamer::Page page = m_pages->FindPage(face, level, x, y);
+        if (!page) {
+            missing.push_back(code);
+            continue;
+        }
+        int slot = FindVictim();
+        if (slot < 0) continue;     // every slot holds a page on screen
+        if (m_slots[slot].used) {
+            UnmapPage(slot);
+        }
+        MapPage(slot, face, level, x, y, *page);
+        uploads++;
+    }
+
+    // Finest first: the streamer decodes its newest requests first
+    for (auto it = missing.rbegin(); it != missing.rend(); ++it) {
+        m_pages->Request(CodeFace(*it), CodeLevel(*it), CodeX(*it), CodeY(*it));
+    }
+    UploadTables();
+}
+
+int VirtualTexture::FindVictim() const {
+    // Free slot first, otherwise the stalest one not wanted this frame
+    int victim = -1;
+    uint64_t oldest = m_frame;
+    for (int i = 0; i < static_cast<int>(m_slots.size()); ++i) {
+        const Slot& slot = m_slots[i];
+        if (!slot.used) return i;
+        if (!slot.pinned && slot.lastUsed < oldest) {
+            oldest = slot.lastUsed;
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+void VirtualTexture::MapPage(int slot, int face, int level, uint32_t x, uint32_t y, const std::vector<uint32_t>& texels) {
+    PROFILE_ZONE("Virtual Texture Upload");
+    GLint stride = static_cast<GLint>(AlbedoPageStride());
+    glBindTexture(GL_TEXTURE_2D, m_atlas);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % ATLAS_PAGES) * stride, (slot / ATLAS_PAGES) * stride, stride, stride,
+                    GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_uploads++;
+
+    Slot& target = m_slots[slot];
+    target.key = HeightTileIndex(face, level, x, y);
+    target.lastUsed = m_frame;
+    target.face = face;
+    target.level = level;
+    target.x = x;
+    target.y = y;
+    target.used = true;
+    m_resident[target.key] = slot;
+
+    // The page and everything under it that only had coarser data now points here
+    uint32_t entry = TableEntry(slot, level);
+    for (int k = level; k < m_levels; ++k) {
+        int shift = k - level;
+        int size = 1 << k;
+        int x0 = static_cast<int>(x) << shift, x1 = static_cast<int>(x + 1) << shift;
+        int y0 = static_cast<int>(y) << shift, y1 = static_cast<int>(y + 1) << shift;
+        std::vector<uint32_t>& table = m_tables[face * m_levels + k];
+        bool changed = false;
+        for (int j = y0; j < y1; ++j) {
+            for (int i = x0; i < x1; ++i) {
+                uint32_t& current = table[j * size + i];
+                if (!EntryValid(current) || EntryLevel(current) < level) {
+                    current = entry;
+                    changed = true;
+                }
+            }
+        }
+        if (changed) {
+            glm::ivec4& dirty = m_dirty[face * m_levels + k];
+            dirty = dirty.x >= dirty.z ? glm::ivec4(x0, y0, x1, y1)
+                                       : glm::ivec4(std::min(dirty.x, x0), std::min(dirty.y, y0),
+                                                    std::max(dirty.z, x1), std::max(dirty.w, y1));
+        }
+    }
+}
+
+void VirtualTexture::UnmapPage(int slot) {
+    Slot& target = m_slots[slot];
+    int face = target.face;
+    int level = target.level;
+
+    // Entries that pointed here fall back to their parent's, which going
+    // down level by level has already fallen back itself
+    uint32_t entry = TableEntry(slot, level);
+    for (int k = level; k < m_levels; ++k) {
+        int shift = k - level;
+        int size = 1 << k;
+        int x0 = static_cast<int>(target.x) << shift, x1 = static_cast<int>(target.x + 1) << shift;
+        int y0 = static_cast<int>(target.y) << shift, y1 = static_cast<int>(target.y + 1) << shift;
+        std::vector<uint32_t>& table = m_tables[face * m_levels + k];
+        const std::vector<uint32_t>* parent = k > 0 ? &m_tables[face * m_levels + k - 1] : nullptr;
+        bool changed = false;
+        for (int j = y0; j < y1; ++j) {
+            for (int i = x0; i < x1; ++i) {
+                uint32_t& current = table[j * size + i];
+                if (current == entry) {
+                    current = parent ? (*parent)[(j / 2) * (size / 2) + i / 2] : 0u;
+                    changed = true;
+                }
+            }
+        }
+        if (changed) {
+            glm::ivec4& dirty = m_dirty[face * m_levels + k];
+            dirty = dirty.x >= dirty.z ? glm::ivec4(x0, y0, x1, y1)
+                                       : glm::ivec4(std::min(dirty.x, x0), std::min(dirty.y, y0),
+                                                    std::max(dirty.z, x1), std::max(dirty.w, y1));
+        }
+    }
+
+    m_resident.erase(target.key);
+    target.used = false;
+}
+
+void VirtualTexture::UploadTables() {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_table);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (int face = 0; face < 6; ++face) {
+        for (int level = 0; level < m_levels; ++level) {
+            glm::ivec4& dirty = m_dirty[face * m_levels + level];
+            if (dirty.x >= dirty.z) continue;
+            int size = 1 << level;
+            const uint32_t* data = m_tables[face * m_levels + level].data() + dirty.y * size + dirty.x;
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, size);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, m_levels - 1 - level, dirty.x, dirty.y, face,
+                            dirty.z - dirty.x, dirty.w - dirty.y, 1, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, data);
+            dirty = glm::ivec4(0);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void VirtualTexture::AllocateFeedback(int width, int height) {
+    if (!m_feedbackFBO) {
+        glGenFramebuffers(1, &m_feedbackFBO);
+        glGenTextures(1, &m_feedbackTexture);
+        glGenRenderbuffers(1, &m_feedbackDepth);
+    }
+    m_feedbackWidth = width;
+    m_feedbackHeight = height;
+
+    glBindTexture(GL_TEXTURE_2D, m_feedbackTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, width, height, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_feedbackDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_feedbackFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_feedbackTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_feedbackDepth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Virtual texture feedback target is incomplete" << std::endl;
+    }
+    m_memory.Set(GetGpuBytes());
+}
+
+bool VirtualTexture::BeginFeedback(const Shader& feedbackProgram, int width, int height) {
+    if (m_frame % FEEDBACK_INTERVAL != 0 || width <= 0 || height <= 0) return false;
+    // All buffers still in flight, the GPU is behind
+    if (m_feedback[m_feedbackNext].fence) return false;
+
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_savedFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, m_savedViewport);
+    glGetIntegerv(GL_POLYGON_MODE, m_savedPolygonMode);
+
+    int feedbackWidth = std::max(width / FEEDBACK_DIVISOR, 1);
+    int feedbackHeight = std::max(height / FEEDBACK_DIVISOR, 1);
+    if (feedbackWidth != m_feedbackWidth || feedbackHeight != m_feedbackHeight) {
+        AllocateFeedback(feedbackWidth, feedbackHeight);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_feedbackFBO);
+    glViewport(0, 0, m_feedbackWidth, m_feedbackHeight);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    const GLuint nothing[4] = { 0, 0, 0, 0 };
+    glClearBufferuiv(GL_COLOR, 0, nothing);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    // Pixels are FEEDBACK_DIVISOR times larger, ask for the pages the full-size ones will sample
+    feedbackProgram.setFloat("u_levelBias", std::log2(static_cast<float>(width) / m_feedbackWidth));
+    return true;
+}
+
+void VirtualTexture::EndFeedback() {
+    FeedbackBuffer& feedback = m_feedback[m_feedbackNext];
+    size_t bytes = static_cast<size_t>(m_feedbackWidth) * m_feedbackHeight * sizeof(uint32_t);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback.buffer);
+    if (feedback.bytes != bytes) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+        feedback.bytes = bytes;
+    }
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, m_feedbackWidth, m_feedbackHeight, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    feedback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_feedbackNext = (m_feedbackNext + 1) % FEEDBACK_BUFFERS;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(m_savedFramebuffer));
+    glViewport(m_savedViewport[0], m_savedViewport[1], m_savedViewport[2], m_savedViewport[3]);
+    glPolygonMode(GL_FRONT_AND_BACK, m_savedPolygonMode[0]);
+}
+
+void VirtualTexture::ReadFeedback() {
+    // Oldest first, so the newest finished readback is the one that stays
+    for (int n = 0; n < FEEDBACK_BUFFERS; ++n) {
+        FeedbackBuffer& feedback = m_feedback[(m_feedbackNext + n) % FEEDBACK_BUFFERS];
+        if (!feedback.fence) continue;
+        GLenum status = m_synchronous ? glClientWaitSync(feedback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, SYNC_TIMEOUT_NS)
+                                      : glClientWaitSync(feedback.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+        glDeleteSync(feedback.fence);
+        feedback.fence = nullptr;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback.buffer);
+        const uint32_t* codes = static_cast<const uint32_t*>(
+            glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, feedback.bytes, GL_MAP_READ_BIT));
+        if (codes) {
+            m_requests.clear();
+            size_t count = feedback.bytes / sizeof(uint32_t);
+            for (size_t i = 0; i < count; ++i) {
+                if (codes[i]) m_requests.push_back(codes[i]);
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if (!codes) continue;
+
+        // Every ancestor too: they are the fallback while the page streams in
+        std::sort(m_requests.begin(), m_requests.end());
+        m_requests.erase(std::unique(m_requests.begin(), m_requests.end()), m_requests.end());
+        size_t visible = m_requests.size();
+        for (size_t i = 0; i < visible; ++i) {
+            uint32_t code = m_requests[i];
+            int face = CodeFace(code);
+            uint32_t x = CodeX(code), y = CodeY(code);
+            for (int level = CodeLevel(code) - 1; level >= 0; --level) {
+                x >>= 1;
+                y >>= 1;
+                m_requests.push_back(FeedbackCode(face, level, x, y));
+            }
+        }
+        std::sort(m_requests.begin(), m_requests.end(), [](uint32_t a, uint32_t b) {
+            return CodeLevel(a) != CodeLevel(b) ? CodeLevel(a) < CodeLevel(b) : a < b;
+        });
+        m_requests.erase(std::unique(m_requests.begin(), m_requests.end()), m_requests.end());
+    }
+}
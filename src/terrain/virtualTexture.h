@@ -0,0 +1,115 @@
+#pragma once
+#include "albedoPageFormat.h"
+#include "graphics/shader.h"
+#include "core/memoryBudget.h"
+#include <epoxy/gl.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class AlbedoStreamer;
+
+// GPU half of a planet's virtual surface texture. Pages of the cube-face
+// quadtree pyramid live in a fixed atlas of ATLAS_PAGES^2 slots, and a page
+// table (one RGBA8UI texel per page, a mip level per quadtree level, a layer
+// per face) points every page at its finest resident ancestor's slot, so
+// GPU memory stays the same whatever the size of the dataset.
+//
+// Which pages are wanted comes from a feedback pass: the planet is drawn
+// again at 1/FEEDBACK_DIVISOR resolution with shaders/virtualFeedback.frag,
+// every pixel writing the page it would sample, and the result is read back
+// through pixel buffers a frame or two later. Update turns the latest
+// readback into uploads from the AlbedoStreamer's cache, coarse levels
+// first, and requests for the pages it doesn't have yet. Slots are recycled
+// least recently requested first; level 0 stays resident.
+class VirtualTexture {
+public:
+    static constexpr int ATLAS_PAGES = 16;              // slots per atlas edge
+    static constexpr GLuint ATLAS_UNIT = 2;             // layout(binding = N) samplers in shaders/virtualTexture.frag
+    static constexpr GLuint TABLE_UNIT = 3;
+    static constexpr int FEEDBACK_DIVISOR = 8;
+    static constexpr int FEEDBACK_INTERVAL = 2;         // frames between feedback passes
+    static constexpr int FEEDBACK_BUFFERS = 3;          // readbacks in flight
+    static constexpr int MAX_UPLOADS_PER_FRAME = 16;
+
+    // Needs a GL context; the level 0 pages go up straight away
+    explicit VirtualTexture(AlbedoStreamer* pages);
+    ~VirtualTexture();
+
+    VirtualTexture(const VirtualTexture&) = delete;
+    VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+    // Takes in finished feedback, then uploads and requests pages for it
+    void Update();
+    void Bind() const;
+
+    // Feedback pass for a width x height target. BeginFeedback binds the
+    // low-resolution target and returns false on frames without a pass; draw
+    // with a shaders/virtualFeedback.frag program bound, then EndFeedback
+    // queues the readback and restores the framebuffer and viewport.
+    bool BeginFeedback(const Shader& feedbackProgram, int width, int height);
+    void EndFeedback();
+    // Wait for each feedback readback instead of taking whichever finished, see Planet::SetSynchronousStreaming
+    void SetSynchronous(bool synchronous) { m_synchronous = synchronous; }
+
+    int GetLevelCount() const { return m_levels; }
+    int GetCapacity() const { return ATLAS_PAGES * ATLAS_PAGES; }
+    size_t GetResidentCount() const { return m_resident.size(); }
+    size_t GetRequestedCount() const { return m_requests.size(); }
+    uint64_t GetUploadCount() const { return m_uploads; }
+    size_t GetGpuBytes() const;
+
+private:
+    struct Slot {
+        uint64_t key = 0;
+        uint64_t lastUsed = 0;
+        int face = 0;
+        int level = 0;
+        uint32_t x = 0;
+        uint32_t y = 0;
+        bool used = false;
+        bool pinned = false;
+    };
+
+    struct FeedbackBuffer {
+        GLuint buffer = 0;
+        GLsync fence = nullptr;
+        size_t bytes = 0;
+    };
+
+    AlbedoStreamer* m_pages;
+    int m_levels;
+    GLuint m_atlas;
+    GLuint m_table;
+    std::vector<Slot> m_slots;
+    std::unordered_map<uint64_t, int> m_resident;   // page -> slot
+    // Page table contents per face and level, (2^level)^2 entries of slot x,
+    // slot y, resident level and 255 (valid), with the region changed since
+    // the last upload as (x0, y0, x1, y1), empty when x0 >= x1
+    std::vector<std::vector<uint32_t>> m_tables;
+    std::vector<glm::ivec4> m_dirty;
+    std::vector<uint32_t> m_requests;               // feedback codes from the latest readback, coarse first
+    uint64_t m_frame;
+    uint64_t m_uploads;
+
+    GLuint m_feedbackFBO;
+    GLuint m_feedbackTexture;                       // R32UI, 0 where no page was drawn
+    GLuint m_feedbackDepth;
+    int m_feedbackWidth;
+    int m_feedbackHeight;
+    FeedbackBuffer m_feedback[FEEDBACK_BUFFERS];
+    int m_feedbackNext;                             // buffer the next pass reads back into
+    bool m_synchronous;
+    GLint m_savedFramebuffer;
+    GLint m_savedViewport[4];
+    GLint m_savedPolygonMode[2];
+    MemoryAccount m_memory;
+
+    int FindVictim() const;
+    void MapPage(int slot, int face, int level, uint32_t x, uint32_t y, const std::vector<uint32_t>& texels);
+    void UnmapPage(int slot);
+    void UploadTables();
+    void ReadFeedback();
+    void AllocateFeedback(int width, int height);
+};
@@ -0,0 +1,256 @@
+// Offline converter: equirectangular RGB image -> cube-sphere surface colour pages.
+//
+//   AlbedoConverter <input.rgb> <width> <height> <output.pages> [--levels N]
+//
+// The input is raw 8-bit RGB, rows from the north pole down. Like
+// DemConverter, the input is memory-mapped and the output is written page by
+// page into a mapped file. The finest level is resampled from the source,
+// each coarser level is a 2x2 box filter (in linear light) of the level below,
+// and then every page gets its border from its neighbours on the same face.
+
+#include "terrain/albedoPageFormat.h"
+#include "terrain/cubeMapping.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+struct Options {
+    std::string input;
+    std::string output;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t levels = 6;
+};
+
+class SourceImage {
+public:
+    SourceImage(const Options& options) : m_options(options), m_data(nullptr), m_size(0) {}
+
+    ~SourceImage() {
+        if (m_data) munmap(const_cast<unsigned char*>(m_data), m_size);
+    }
+
+    bool Open() {
+        int fd = open(m_options.input.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        m_size = static_cast<size_t>(m_options.width) * m_options.height * 3;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < m_size) {
+            std::cerr << "Input is smaller than " << m_options.width << "x" << m_options.height << " RGB" << std::endl;
+            close(fd);
+            return false;
+        }
+        void* mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) return false;
+        m_data = static_cast<const unsigned char*>(mapping);
+        return true;
+    }
+
+    glm::vec3 At(uint32_t x, uint32_t y) const {
+        const unsigned char* rgb = m_data + (static_cast<size_t>(y) * m_options.width + x) * 3;
+        return glm::vec3(rgb[0], rgb[1], rgb[2]);
+    }
+
+    // Bilinear on the sRGB values, wrapping in longitude and clamping at the poles
+    glm::vec3 Sample(double latitude, double longitude) const {
+        double px = (longitude + M_PI) / (2.0 * M_PI) * m_options.width - 0.5;
+        double py = (M_PI * 0.5 - latitude) / M_PI * m_options.height - 0.5;
+        py = std::clamp(py, 0.0, static_cast<double>(m_options.height - 1));
+
+        double fx = std::floor(px);
+        double fy = std::floor(py);
+        float tx = static_cast<float>(px - fx);
+        float ty = static_cast<float>(py - fy);
+        int64_t w = m_options.width;
+        uint32_t x0 = static_cast<uint32_t>(((static_cast<int64_t>(fx) % w) + w) % w);
+        uint32_t x1 = (x0 + 1) % m_options.width;
+        uint32_t y0 = static_cast<uint32_t>(fy);
+        uint32_t y1 = std::min(y0 + 1, m_options.height - 1);
+
+        glm::vec3 top = At(x0, y0) * (1.0f - tx) + At(x1, y0) * tx;
+        glm::vec3 bottom = At(x0, y1) * (1.0f - tx) + At(x1, y1) * tx;
+        return top * (1.0f - ty) + bottom * ty;
+    }
+
+private:
+    const Options& m_options;
+    const unsigned char* m_data;
+    size_t m_size;
+};
+
+float SrgbToLinear(float value) {
+    float c = value / 255.0f;
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+unsigned char LinearToSrgb(float c) {
+    c = std::clamp(c, 0.0f, 1.0f);
+    float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    return static_cast<unsigned char>(std::lround(s * 255.0f));
+}
+
+bool ParseOptions(int argc, char** argv, Options& options) {
+    if (argc < 5) return false;
+    options.input = argv[1];
+    options.width = static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10));
+    options.height = static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10));
+    options.output = argv[4];
+    for (int i = 5; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--levels" && i + 1 < argc) options.levels = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else return false;
+    }
+    return options.width > 0 && options.height > 0 && options.levels > 0 && options.levels <= ALBEDO_MAX_LEVELS;
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cerr << "Usage: AlbedoConverter <input.rgb> <width> <height> <output.pages> [--levels N]"
+                     " (N at most " << ALBEDO_MAX_LEVELS << ")" << std::endl;
+        return 1;
+    }
+
+    SourceImage source(options);
+    if (!source.Open()) {
+        std::cerr << "Failed to map " << options.input << std::endl;
+        return 1;
+    }
+
+    AlbedoPageHeader header = {};
+    header.magic = ALBEDO_PAGE_MAGIC;
+    header.version = ALBEDO_PAGE_VERSION;
+    header.pageSize = ALBEDO_PAGE_SIZE;
+    header.border = ALBEDO_PAGE_BORDER;
+    header.levelCount = options.levels;
+    header.dataOffset = 4096;
+
+    const uint32_t P = ALBEDO_PAGE_SIZE;
+    const uint32_t B = ALBEDO_PAGE_BORDER;
+    const uint32_t S = AlbedoPageStride();
+    const size_t pageBytes = AlbedoPageBytes();
+    const size_t fileSize = header.dataOffset + HeightTileCount(options.levels) * pageBytes;
+
+    int fd = open(options.output.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, static_cast<off_t>(fileSize)) != 0) {
+        std::cerr << "Failed to create " << options.output << std::endl;
+        return 1;
+    }
+    void* mapping = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Failed to map " << options.output << std::endl;
+        return 1;
+    }
+    unsigned char* out = static_cast<unsigned char*>(mapping);
+    std::memcpy(out, &header, sizeof(header));
+
+    auto pageData = [&](uint32_t face, uint32_t level, uint32_t x, uint32_t y) {
+        return out + header.dataOffset + HeightTileIndex(face, level, x, y) * pageBytes;
+    };
+    // Interior texel (gx, gy) of a whole face at a level, clamped to the face
+    auto faceTexel = [&](uint32_t face, uint32_t level, int gx, int gy) {
+        int size = static_cast<int>(P << level);
+        gx = std::clamp(gx, 0, size - 1);
+        gy = std::clamp(gy, 0, size - 1);
+        const unsigned char* page = pageData(face, level, gx / P, gy / P);
+        return page + ((gy % P + B) * S + (gx % P + B)) * 3;
+    };
+    // Interiors first, then the borders from the finished neighbours
+    auto fillBorders = [&](uint32_t level) {
+        uint32_t pagesPerAxis = 1u << level;
+        for (uint32_t face = 0; face < 6; ++face) {
+            for (uint32_t py = 0; py < pagesPerAxis; ++py) {
+                for (uint32_t px = 0; px < pagesPerAxis; ++px) {
+                    unsigned char* page = pageData(face, level, px, py);
+                    for (uint32_t j = 0; j < S; ++j) {
+                        for (uint32_t i = 0; i < S; ++i) {
+                            if (i >= B && i < B + P && j >= B && j < B + P) continue;
+                            int gx = static_cast<int>(px * P + i) - static_cast<int>(B);
+                            int gy = static_cast<int>(py * P + j) - static_cast<int>(B);
+                            std::memcpy(page + (j * S + i) * 3, faceTexel(face, level, gx, gy), 3);
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    // Finest level straight from the source, at texel centres
+    uint32_t finest = options.levels - 1;
+    uint32_t pagesPerAxis = 1u << finest;
+    for (uint32_t face = 0; face < 6; ++face) {
+        for (uint32_t py = 0; py < pagesPerAxis; ++py) {
+            for (uint32_t px = 0; px < pagesPerAxis; ++px) {
+                unsigned char* page = pageData(face, finest, px, py);
+                for (uint32_t j = 0; j < P; ++j) {
+                    for (uint32_t i = 0; i < P; ++i) {
+                        float u = (px + (i + 0.5f) / P) / pagesPerAxis;
+                        float v = (py + (j + 0.5f) / P) / pagesPerAxis;
+                        double latitude, longitude;
+                        DirectionToLatLon(CubeFacePosition(static_cast<int>(face), u, v), latitude, longitude);
+                        glm::vec3 rgb = source.Sample(latitude, longitude);
+                        unsigned char* texel = page + ((j + B) * S + (i + B)) * 3;
+                        for (int c = 0; c < 3; ++c) {
+                            texel[c] = static_cast<unsigned char>(std::clamp(std::lround(rgb[c]), 0l, 255l));
+                        }
+                    }
+                }
+            }
+        }
+        std::cout << "Level " << finest << " face " << face << " done" << std::endl;
+    }
+    fillBorders(finest);
+
+    // Coarser levels: each parent texel covers 2x2 texels of the level below
+    float toLinear[256];
+    for (int i = 0; i < 256; ++i) {
+        toLinear[i] = SrgbToLinear(static_cast<float>(i));
+    }
+    for (int level = static_cast<int>(finest) - 1; level >= 0; --level) {
+        uint32_t parentPages = 1u << level;
+        for (uint32_t face = 0; face < 6; ++face) {
+            for (uint32_t py = 0; py < parentPages; ++py) {
+                for (uint32_t px = 0; px < parentPages; ++px) {
+                    unsigned char* page = pageData(face, level, px, py);
+                    for (uint32_t j = 0; j < P; ++j) {
+                        for (uint32_t i = 0; i < P; ++i) {
+                            int gx = static_cast<int>(2 * (px * P + i));
+                            int gy = static_cast<int>(2 * (py * P + j));
+                            float sum[3] = { 0.0f, 0.0f, 0.0f };
+                            for (int dy = 0; dy < 2; ++dy) {
+                                for (int dx = 0; dx < 2; ++dx) {
+                                    const unsigned char* child = faceTexel(face, level + 1, gx + dx, gy + dy);
+                                    for (int c = 0; c < 3; ++c) sum[c] += toLinear[child[c]];
+                                }
+                            }
+                            unsigned char* texel = page + ((j + B) * S + (i + B)) * 3;
+                            for (int c = 0; c < 3; ++c) texel[c] = LinearToSrgb(sum[c] * 0.25f);
+                        }
+                    }
+                }
+            }
+        }
+        fillBorders(static_cast<uint32_t>(level));
+        std::cout << "Level " << level << " done" << std::endl;
+    }
+
+    msync(mapping, fileSize, MS_SYNC);
+    munmap(mapping, fileSize);
+    std::cout << "Wrote " << HeightTileCount(options.levels) << " pages (" << P << "x" << P << " texels each, "
+              << fileSize / (1024 * 1024) << " MB) to " << options.output << std::endl;
+    return 0;
+}
@@ -0,0 +1,261 @@
+// Offline converter: equirectangular raw heightmap -> cube-sphere height pyramid.
+//
+//   DemConverter <input.raw> <width> <height> <output.tiles>
+//                [--float32] [--big-endian] [--levels N] [--tile-size N]
+//
+// The input is memory-mapped and the output is written tile by tile into a
+// mapped file, so neither has to fit in RAM. The finest level is resampled
+// from the source. Each coarser level is filtered from the level below it.
+
+#include "terrain/cubeMapping.h"
+#include "terrain/heightTileFormat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+struct Options {
+    std::string input;
+    std::string output;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    bool float32 = false;
+    bool bigEndian = false;
+    uint32_t levels = 6;
+    uint32_t tileSize = 64;
+};
+
+class SourceRaster {
+public:
+    SourceRaster(const Options& options) : m_options(options), m_data(nullptr), m_size(0) {}
+
+    ~SourceRaster() {
+        if (m_data) munmap(const_cast<unsigned char*>(m_data), m_size);
+    }
+
+    bool Open() {
+        int fd = open(m_options.input.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        size_t sampleBytes = m_options.float32 ? 4 : 2;
+        m_size = static_cast<size_t>(m_options.width) * m_options.height * sampleBytes;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < m_size) {
+            std::cerr << "Input is smaller than " << m_options.width << "x" << m_options.height << std::endl;
+            close(fd);
+            return false;
+        }
+        void* mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) return false;
+        m_data = static_cast<const unsigned char*>(mapping);
+        return true;
+    }
+
+    float At(uint32_t x, uint32_t y) const {
+        size_t index = static_cast<size_t>(y) * m_options.width + x;
+        if (m_options.float32) {
+            uint32_t bits;
+            std::memcpy(&bits, m_data + index * 4, 4);
+            if (m_options.bigEndian) bits = __builtin_bswap32(bits);
+            float value;
+            std::memcpy(&value, &bits, 4);
+            return value;
+        }
+        uint16_t bits;
+        std::memcpy(&bits, m_data + index * 2, 2);
+        if (m_options.bigEndian) bits = __builtin_bswap16(bits);
+        return static_cast<float>(static_cast<int16_t>(bits));
+    }
+
+    // Bilinear, wrapping in longitude and clamping at the poles
+    float Sample(double latitude, double longitude) const {
+        double px = (longitude + M_PI) / (2.0 * M_PI) * m_options.width - 0.5;
+        double py = (M_PI * 0.5 - latitude) / M_PI * m_options.height - 0.5;
+        py = std::clamp(py, 0.0, static_cast<double>(m_options.height - 1));
+
+        double fx = std::floor(px);
+        double fy = std::floor(py);
+        double tx = px - fx;
+        double ty = py - fy;
+        int64_t w = m_options.width;
+        uint32_t x0 = static_cast<uint32_t>(((static_cast<int64_t>(fx) % w) + w) % w);
+        uint32_t x1 = (x0 + 1) % m_options.width;
+        uint32_t y0 = static_cast<uint32_t>(fy);
+        uint32_t y1 = std::min(y0 + 1, m_options.height - 1);
+
+        double top = At(x0, y0) * (1.0 - tx) + At(x1, y0) * tx;
+        double bottom = At(x0, y1) * (1.0 - tx) + At(x1, y1) * tx;
+        return static_cast<float>(top * (1.0 - ty) + bottom * ty);
+    }
+
+    void Range(float& minHeight, float& maxHeight) const {
+        minHeight = std::numeric_limits<float>::max();
+        maxHeight = std::numeric_limits<float>::lowest();
+        for (uint32_t y = 0; y < m_options.height; ++y) {
+            for (uint32_t x = 0; x < m_options.width; ++x) {
+                float h = At(x, y);
+                if (!std::isfinite(h)) continue;
+                minHeight = std::min(minHeight, h);
+                maxHeight = std::max(maxHeight, h);
+            }
+        }
+    }
+
+private:
+    const Options& m_options;
+    const unsigned char* m_data;
+    size_t m_size;
+};
+
+bool ParseOptions(int argc, char** argv, Options& options) {
+    if (argc < 5) return false;
+    options.input = argv[1];
+    options.width = static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10));
+    options.height = static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10));
+    options.output = argv[4];
+    for (int i = 5; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--float32") options.float32 = true;
+        else if (arg == "--big-endian") options.bigEndian = true;
+        else if (arg == "--levels" && i + 1 < argc) options.levels = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (arg == "--tile-size" && i + 1 < argc) options.tileSize = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else return false;
+    }
+    return options.width > 0 && options.height > 0 && options.levels > 0 && options.levels <= 16 &&
+           options.tileSize >= 2;
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cerr << "Usage: DemConverter <input.raw> <width> <height> <output.tiles>"
+                     " [--float32] [--big-endian] [--levels N] [--tile-size N]" << std::endl;
+        return 1;
+    }
+
+    SourceRaster source(options);
+    if (!source.Open()) {
+        std::cerr << "Failed to map " << options.input << std::endl;
+        return 1;
+    }
+
+    float minHeight, maxHeight;
+    source.Range(minHeight, maxHeight);
+    std::cout << "Height range " << minHeight << " .. " << maxHeight << std::endl;
+
+    // Quantize the full range into int16
+    HeightTileHeader header = {};
+    header.magic = HEIGHT_TILE_MAGIC;
+    header.version = HEIGHT_TILE_VERSION;
+    header.tileSize = options.tileSize;
+    header.levelCount = options.levels;
+    header.heightScale = std::max((maxHeight - minHeight) / 65535.0f, 1e-6f);
+    header.heightOffset = minHeight + 32768.0f * header.heightScale;
+    header.minHeight = minHeight;
+    header.maxHeight = maxHeight;
+    header.dataOffset = 4096;
+
+    const uint32_t T = options.tileSize;
+    const size_t tileSamples = HeightTileSampleCount(T);
+    const size_t tileBytes = HeightTileBytes(T);
+    const size_t fileSize = header.dataOffset + HeightTileCount(options.levels) * tileBytes;
+
+    int fd = open(options.output.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, static_cast<off_t>(fileSize)) != 0) {
+        std::cerr << "Failed to create " << options.output << std::endl;
+        return 1;
+    }
+    void* mapping = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Failed to map " << options.output << std::endl;
+        return 1;
+    }
+    unsigned char* out = static_cast<unsigned char*>(mapping);
+    std::memcpy(out, &header, sizeof(header));
+
+    auto tileData = [&](uint32_t face, uint32_t level, uint32_t x, uint32_t y) {
+        return reinterpret_cast<int16_t*>(out + header.dataOffset + HeightTileIndex(face, level, x, y) * tileBytes);
+    };
+    auto quantize = [&](float h) {
+        float q = std::round((h - header.heightOffset) / header.heightScale);
+        return static_cast<int16_t>(std::clamp(q, -32768.0f, 32767.0f));
+    };
+
+    // Finest level straight from the source
+    uint32_t finest = options.levels - 1;
+    uint32_t tilesPerAxis = 1u << finest;
+    for (uint32_t face = 0; face < 6; ++face) {
+        for (uint32_t ty = 0; ty < tilesPerAxis; ++ty) {
+            for (uint32_t tx = 0; tx < tilesPerAxis; ++tx) {
+                int16_t* tile = tileData(face, finest, tx, ty);
+                for (uint32_t j = 0; j <= T; ++j) {
+                    for (uint32_t i = 0; i <= T; ++i) {
+                        float u = (tx + static_cast<float>(i) / T) / tilesPerAxis;
+                        float v = (ty + static_cast<float>(j) / T) / tilesPerAxis;
+                        double latitude, longitude;
+                        DirectionToLatLon(CubeFacePosition(static_cast<int>(face), u, v), latitude, longitude);
+                        tile[j * (T + 1) + i] = quantize(source.Sample(latitude, longitude));
+                    }
+                }
+            }
+        }
+        std::cout << "Level " << finest << " face " << face << " done" << std::endl;
+    }
+
+    // Coarser levels: each parent sample sits on every other sample of its
+    // 2x2 children, filtered with a 3x3 tent
+    for (int level = static_cast<int>(finest) - 1; level >= 0; --level) {
+        uint32_t parentTiles = 1u << level;
+        for (uint32_t face = 0; face < 6; ++face) {
+            for (uint32_t ty = 0; ty < parentTiles; ++ty) {
+                for (uint32_t tx = 0; tx < parentTiles; ++tx) {
+                    auto fine = [&](int gx, int gy) {
+                        gx = std::clamp(gx, 0, static_cast<int>(2 * T));
+                        gy = std::clamp(gy, 0, static_cast<int>(2 * T));
+                        uint32_t cx = std::min<uint32_t>(gx / T, 1);
+                        uint32_t cy = std::min<uint32_t>(gy / T, 1);
+                        const int16_t* child = tileData(face, level + 1, tx * 2 + cx, ty * 2 + cy);
+                        return static_cast<float>(child[(gy - cy * T) * (T + 1) + (gx - cx * T)]);
+                    };
+                    int16_t* tile = tileData(face, level, tx, ty);
+                    for (uint32_t j = 0; j <= T; ++j) {
+                        for (uint32_t i = 0; i <= T; ++i) {
+                            int gx = static_cast<int>(2 * i);
+                            int gy = static_cast<int>(2 * j);
+                            float sum = 0.0f;
+                            float weight = 0.0f;
+                            for (int dy = -1; dy <= 1; ++dy) {
+                                for (int dx = -1; dx <= 1; ++dx) {
+                                    float w = (2.0f - std::abs(dx)) * (2.0f - std::abs(dy));
+                                    sum += fine(gx + dx, gy + dy) * w;
+                                    weight += w;
+                                }
+                            }
+                            tile[j * (T + 1) + i] = static_cast<int16_t>(std::lround(sum / weight));
+                        }
+                    }
+                }
+            }
+        }
+        std::cout << "Level " << level << " done" << std::endl;
+    }
+
+    msync(mapping, fileSize, MS_SYNC);
+    munmap(mapping, fileSize);
+    std::cout << "Wrote " << HeightTileCount(options.levels) << " tiles (" << tileSamples << " samples each, "
+              << fileSize / (1024 * 1024) << " MB) to " << options.output << std::endl;
+    return 0;
+}
@@ -0,0 +1,182 @@
+// Benchmark: pointer QuadNode tree vs LinearQuadTree on the same camera path.
+//
+//   QuadtreeBenchmark [--frames N] [--max-level N] [--radius R]
+//
+// The camera spirals from four radii out down to just above the surface and
+// back, so both trees see splits and merges every frame. Per frame it times
+// the LOD update, a full leaf traversal, and four edge-neighbour lookups per
+// leaf, and checks both trees end up with the same leaves. No GL context is
+// needed, nothing here builds patches.
+
+#include "entities/cubesphere.h"
+#include "entities/linearQuadTree.h"
+
+#include <glm/glm.hpp>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+    int frames = 2000;
+    int maxLevel = 12;
+    float radius = 25.0f;
+};
+
+struct Timings {
+    double updateUs = 0.0;
+    double traverseUs = 0.0;
+    double neighborUs = 0.0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double MicrosecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+bool ParseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) return false;
+        if (std::strcmp(argv[i], "--frames") == 0) options.frames = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--max-level") == 0) options.maxLevel = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--radius") == 0) options.radius = static_cast<float>(std::atof(argv[++i]));
+        else return false;
+    }
+    return options.frames > 0 && options.maxLevel > 0 && options.maxLevel <= LinearQuadTree::MAX_LEVEL && options.radius > 0.0f;
+}
+
+glm::vec3 CameraAt(int frame, const Options& options) {
+    // Down and back up once over the run while circling the planet twice
+    float t = static_cast<float>(frame) / options.frames;
+    float descent = 0.5f - 0.5f * std::cos(t * 6.2831853f);
+    float altitude = options.radius * (3.0f * (1.0f - descent) + 0.02f);
+    float angle = t * 12.566371f;
+    glm::vec3 direction = glm::normalize(glm::vec3(std::cos(angle), 0.3f * std::sin(angle * 0.5f), std::sin(angle)));
+    return direction * (options.radius + altitude);
+}
+
+void PrintRow(const char* name, const Timings& timings, double frames, double leaves) {
+    std::cout << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(12) << timings.updateUs / frames
+              << std::setw(14) << timings.traverseUs / frames
+              << std::setw(14) << timings.neighborUs / frames
+              << std::setw(16) << (timings.traverseUs + timings.neighborUs) * 1000.0 / leaves << std::endl;
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cerr << "Usage: QuadtreeBenchmark [--frames N] [--max-level N] [--radius R]" << std::endl;
+        return 1;
+    }
+    
+    QuadTreeStats pointerStats;
+    QuadTreeContext context;
+    context.stats = &pointerStats;
+    std::array<std::unique_ptr<QuadNode>, 6> faces;
+    for (int i = 0; i < 6; ++i) {
+        faces[i] = std::make_unique<QuadNode>(glm::vec2(0.0f), glm::vec2(1.0f), 0, static_cast<CubeFace>(i), &context);
+    }
+    LinearQuadTree linear(options.radius, options.maxLevel);
+    
+    Timings pointerTime, linearTime;
+    std::vector<QuadNode*> leaves;
+    uint64_t checksum = 0;
+    double leafTotal = 0.0;
+    size_t maxLeaves = 0, maxNodes = 0, maxLinearBytes = 0;
+    int mismatches = 0;
+    
+    for (int frame = 0; frame < options.frames; ++frame) {
+        glm::vec3 camera = CameraAt(frame, options);
+        
+        // Update
+        Clock::time_point start = Clock::now();
+        for (auto& face : faces) {
+            face->Update(camera, options.radius, options.maxLevel);
+        }
+        pointerTime.updateUs += MicrosecondsSince(start);
+        
+        start = Clock::now();
+        linear.Update(camera);
+        linearTime.updateUs += MicrosecondsSince(start);
+        
+        // Traversal: visit every leaf and read its patch coordinates
+        start = Clock::now();
+        leaves.clear();
+        for (auto& face : faces) {
+            face->CollectLeaves(leaves);
+        }
+        for (const QuadNode* leaf : leaves) {
+            checksum += leaf->GetTileX() ^ leaf->GetTileY();
+        }
+        pointerTime.traverseUs += MicrosecondsSince(start);
+        
+        start = Clock::now();
+        for (uint64_t code : linear.GetLeafCodes()) {
+            uint32_t x, y;
+            LinearQuadTree::DecodeTile(code, x, y);
+            checksum += x ^ y;
+        }
+        linearTime.traverseUs += MicrosecondsSince(start);
+        
+        // Neighbours across all four edges. The pointer tree has no links
+        // sideways, so it descends from the face root to the neighbour's patch.
+        static const int steps[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+        start = Clock::now();
+        for (const QuadNode* leaf : leaves) {
+            uint64_t code = LinearQuadTree::MakeCode(static_cast<int>(leaf->GetFace()), leaf->GetLevel(), leaf->GetTileX(), leaf->GetTileY());
+            for (const auto& step : steps) {
+                uint64_t neighbor = LinearQuadTree::GetNeighborCode(code, step[0], step[1]);
+                uint32_t x, y;
+                LinearQuadTree::DecodeTile(neighbor, x, y);
+                const QuadNode* found = faces[LinearQuadTree::GetCodeFace(neighbor)]->FindLeaf(leaf->GetLevel(), x, y);
+                checksum += found ? static_cast<uint64_t>(found->GetLevel()) : 0u;
+            }
+        }
+        pointerTime.neighborUs += MicrosecondsSince(start);
+        
+        start = Clock::now();
+        for (size_t i = 0; i < linear.GetLeafCount(); ++i) {
+            for (const auto& step : steps) {
+                uint64_t found = linear.FindNeighbor(i, step[0], step[1]);
+                checksum += found ? static_cast<uint64_t>(LinearQuadTree::GetCodeLevel(found)) : 0u;
+            }
+        }
+        linearTime.neighborUs += MicrosecondsSince(start);
+        
+        if (leaves.size() != linear.GetLeafCount()) {
+            mismatches++;
+        }
+        leafTotal += static_cast<double>(leaves.size());
+        maxLeaves = std::max(maxLeaves, leaves.size());
+        maxNodes = std::max(maxNodes, static_cast<size_t>(pointerStats.nodes));
+        maxLinearBytes = std::max(maxLinearBytes, linear.GetMemoryBytes());
+    }
+    
+    double frames = static_cast<double>(options.frames);
+    std::cout << options.frames << " frames, max level " << options.maxLevel << ", "
+              << std::fixed << std::setprecision(0) << leafTotal / frames << " leaves on average (peak "
+              << maxLeaves << ")" << std::endl << std::endl;
+    std::cout << std::left << std::setw(10) << "tree" << std::right
+              << std::setw(12) << "update us" << std::setw(14) << "traverse us"
+              << std::setw(14) << "neighbor us" << std::setw(16) << "query ns/leaf" << std::endl;
+    PrintRow("pointer", pointerTime, frames, leafTotal);
+    PrintRow("linear", linearTime, frames, leafTotal);
+    
+    std::cout << std::endl << "Peak memory: pointer " << maxNodes * sizeof(QuadNode) / 1024 << " KB ("
+              << maxNodes << " nodes, excluding allocator overhead), linear "
+              << maxLinearBytes / 1024 << " KB" << std::endl;
+    std::cout << "Leaf count mismatches: " << mismatches << " (checksum " << checksum << ")" << std::endl;
+    return mismatches == 0 ? 0 : 1;
+}
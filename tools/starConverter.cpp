@@ -0,0 +1,289 @@
+// Offline converter: star list -> brightness-paged star catalog.
+//
+//   StarConverter <input.csv> <output.stars> [--levels N] [--node-capacity N]
+//   StarConverter --synthetic <count> <output.stars> [--levels N] [--node-capacity N] [--seed N]
+//
+// Input lines are "ra,dec,magnitude[,b-v]" with ra and dec in degrees; lines
+// that do not start with a number (headers, comments) are skipped. The input
+// is memory-mapped and the output written into a mapped file. --synthetic
+// makes a random catalog, denser towards a galactic plane, for testing
+// without a real one.
+
+#include "sky/starCatalogFormat.h"
+#include "terrain/cubeMapping.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+struct Options {
+    std::string input;
+    std::string output;
+    uint64_t synthetic = 0;
+    uint32_t levels = 6;
+    uint32_t nodeCapacity = 1024;
+    uint32_t seed = 1;
+};
+
+struct Star {
+    glm::vec3 direction;
+    float magnitude;
+    float colorIndex;
+};
+
+// Equatorial -> direction in the converters' convention: +Y towards the
+// north pole, right ascension 0 on +X increasing towards +Z
+glm::vec3 RaDecToDirection(double raDegrees, double decDegrees) {
+    double ra = raDegrees * M_PI / 180.0;
+    double dec = decDegrees * M_PI / 180.0;
+    return glm::vec3(static_cast<float>(std::cos(dec) * std::cos(ra)),
+                     static_cast<float>(std::sin(dec)),
+                     static_cast<float>(std::cos(dec) * std::sin(ra)));
+}
+
+bool ReadStars(const std::string& path, std::vector<Star>& stars) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    const char* text = static_cast<const char*>(mapping);
+    const char* end = text + size;
+    uint64_t skipped = 0;
+    // Lines are copied out so strtod can never run past the mapping
+    std::string line;
+    for (const char* cursor = text; cursor < end;) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+        if (!lineEnd) lineEnd = end;
+        line.assign(cursor, lineEnd);
+        cursor = lineEnd + 1;
+
+        const char* p = line.c_str();
+        double values[4];
+        int count = 0;
+        while (count < 4) {
+            char* next;
+            values[count] = std::strtod(p, &next);
+            if (next == p) break;
+            ++count;
+            p = next;
+            while (*p == ',' || *p == ' ' || *p == '\t') ++p;
+        }
+        if (count < 3) {
+            if (!line.empty()) ++skipped;
+            continue;
+        }
+        Star star;
+        star.direction = RaDecToDirection(values[0], values[1]);
+        star.magnitude = static_cast<float>(values[2]);
+        star.colorIndex = count > 3 ? static_cast<float>(values[3]) : 0.6f;
+        stars.push_back(star);
+    }
+    munmap(mapping, size);
+    if (skipped > 0) {
+        std::cout << "Skipped " << skipped << " lines without ra,dec,magnitude" << std::endl;
+    }
+    return true;
+}
+
+void MakeSyntheticStars(uint64_t count, uint32_t seed, std::vector<Star>& stars) {
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::normal_distribution<float> color(0.6f, 0.35f);
+    const float brightest = -1.5f;
+    const float faintest = 16.0f;
+    // Star counts grow about 10^0.5 per magnitude; invert that distribution
+    const float growth = std::pow(10.0f, 0.5f * (faintest - brightest)) - 1.0f;
+    const float tilt = 1.05f;  // galactic plane against the equator, radians
+
+    stars.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        float z = unit(random) * 2.0f - 1.0f;
+        float phi = unit(random) * 2.0f * static_cast<float>(M_PI);
+        // Most stars crowd towards the plane
+        if (unit(random) < 0.7f) z *= 0.15f;
+        float r = std::sqrt(1.0f - z * z);
+        glm::vec3 galactic(r * std::cos(phi), z, r * std::sin(phi));
+        Star star;
+        star.direction = glm::normalize(glm::vec3(galactic.x,
+                                                  galactic.y * std::cos(tilt) - galactic.z * std::sin(tilt),
+                                                  galactic.y * std::sin(tilt) + galactic.z * std::cos(tilt)));
+        star.magnitude = brightest + std::log10(1.0f + unit(random) * growth) / 0.5f;
+        star.colorIndex = std::clamp(color(random), -0.4f, 2.0f);
+        stars.push_back(star);
+    }
+}
+
+bool ParseOptions(int argc, char** argv, Options& options) {
+    if (argc < 3) return false;
+    int i = 1;
+    std::string first = argv[1];
+    if (first == "--synthetic") {
+        if (argc < 4) return false;
+        options.synthetic = std::strtoull(argv[2], nullptr, 10);
+        options.output = argv[3];
+        i = 4;
+    } else {
+        options.input = argv[1];
+        options.output = argv[2];
+        i = 3;
+    }
+    for (; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--levels" && i + 1 < argc) options.levels = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (arg == "--node-capacity" && i + 1 < argc) options.nodeCapacity = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (arg == "--seed" && i + 1 < argc) options.seed = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else return false;
+    }
+    return (options.synthetic > 0 || !options.input.empty()) && options.levels > 0 && options.levels <= 12 &&
+           options.nodeCapacity > 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cerr << "Usage: StarConverter <input.csv> <output.stars> [--levels N] [--node-capacity N]\n"
+                     "       StarConverter --synthetic <count> <output.stars> [--levels N] [--node-capacity N] [--seed N]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::vector<Star> stars;
+    if (options.synthetic > 0) {
+        MakeSyntheticStars(options.synthetic, options.seed, stars);
+    } else if (!ReadStars(options.input, stars)) {
+        std::cerr << "Failed to read " << options.input << std::endl;
+        return 1;
+    }
+    if (stars.empty()) {
+        std::cerr << "No stars in " << options.input << std::endl;
+        return 1;
+    }
+
+    // Brightest first, so each node fills with the brightest stars of its patch
+    std::stable_sort(stars.begin(), stars.end(), [](const Star& a, const Star& b) { return a.magnitude < b.magnitude; });
+
+    const uint64_t nodeCount = StarNodeCount(options.levels);
+    std::vector<uint32_t> nodeStars(nodeCount, 0);
+    std::vector<uint32_t> assignment(stars.size());
+    const uint32_t unassigned = std::numeric_limits<uint32_t>::max();
+    uint64_t dropped = 0;
+    for (size_t i = 0; i < stars.size(); ++i) {
+        int face;
+        float u, v;
+        DirectionToCubeFace(stars[i].direction, face, u, v);
+        assignment[i] = unassigned;
+        for (uint32_t level = 0; level < options.levels; ++level) {
+            uint32_t nodesPerAxis = 1u << level;
+            uint32_t x = std::min(static_cast<uint32_t>(u * nodesPerAxis), nodesPerAxis - 1);
+            uint32_t y = std::min(static_cast<uint32_t>(v * nodesPerAxis), nodesPerAxis - 1);
+            uint64_t node = StarNodeIndex(static_cast<uint32_t>(face), level, x, y);
+            if (nodeStars[node] < options.nodeCapacity) {
+                nodeStars[node]++;
+                assignment[i] = static_cast<uint32_t>(node);
+                break;
+            }
+        }
+        if (assignment[i] == unassigned) dropped++;
+    }
+    if (dropped > 0) {
+        std::cout << "Dropped " << dropped << " of the faintest stars, the deepest nodes are full"
+                  << " (raise --levels or --node-capacity)" << std::endl;
+    }
+
+    StarCatalogHeader header = {};
+    header.magic = STAR_CATALOG_MAGIC;
+    header.version = STAR_CATALOG_VERSION;
+    header.levelCount = options.levels;
+    header.nodeCapacity = options.nodeCapacity;
+    header.starCount = stars.size() - dropped;
+    header.minMagnitude = stars.front().magnitude;
+    header.maxMagnitude = stars.back().magnitude;
+    header.magnitudeScale = std::max((header.maxMagnitude - header.minMagnitude) / 65535.0f, 1e-6f);
+    header.magnitudeOffset = header.minMagnitude;
+    header.nodeOffset = 4096;
+    header.starOffset = header.nodeOffset + nodeCount * sizeof(StarNode);
+    const size_t fileSize = header.starOffset + header.starCount * sizeof(StarRecord);
+
+    int fd = open(options.output.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, static_cast<off_t>(fileSize)) != 0) {
+        std::cerr << "Failed to create " << options.output << std::endl;
+        return 1;
+    }
+    void* mapping = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Failed to map " << options.output << std::endl;
+        return 1;
+    }
+    unsigned char* out = static_cast<unsigned char*>(mapping);
+    std::memcpy(out, &header, sizeof(header));
+
+    // Node table: each node's run starts where the previous one ended
+    StarNode* nodes = reinterpret_cast<StarNode*>(out + header.nodeOffset);
+    uint64_t first = 0;
+    for (uint64_t node = 0; node < nodeCount; ++node) {
+        nodes[node] = StarNode();
+        nodes[node].firstStar = first;
+        nodes[node].minMagnitude = std::numeric_limits<float>::max();
+        nodes[node].maxMagnitude = std::numeric_limits<float>::lowest();
+        first += nodeStars[node];
+    }
+
+    // Stars are still brightest first, so appending keeps every node sorted
+    StarRecord* records = reinterpret_cast<StarRecord*>(out + header.starOffset);
+    for (size_t i = 0; i < stars.size(); ++i) {
+        if (assignment[i] == unassigned) continue;
+        StarNode& node = nodes[assignment[i]];
+
+        // Coordinates across the node's own patch
+        uint32_t nodeFace, level, x, y;
+        StarNodeCoordinates(assignment[i], nodeFace, level, x, y);
+        uint32_t nodesPerAxis = 1u << level;
+        int face;
+        float u, v;
+        DirectionToCubeFace(stars[i].direction, face, u, v);
+        float localU = std::clamp(u * nodesPerAxis - x, 0.0f, 1.0f);
+        float localV = std::clamp(v * nodesPerAxis - y, 0.0f, 1.0f);
+
+        StarRecord record = {};
+        record.u = static_cast<uint16_t>(std::lround(localU * 65535.0f));
+        record.v = static_cast<uint16_t>(std::lround(localV * 65535.0f));
+        float sample = std::round((stars[i].magnitude - header.magnitudeOffset) / header.magnitudeScale);
+        record.magnitude = static_cast<uint16_t>(std::clamp(sample, 0.0f, 65535.0f));
+        record.colorIndex = QuantizeStarColorIndex(stars[i].colorIndex);
+        records[node.firstStar + node.count] = record;
+        node.count++;
+        node.minMagnitude = std::min(node.minMagnitude, stars[i].magnitude);
+        node.maxMagnitude = std::max(node.maxMagnitude, stars[i].magnitude);
+    }
+
+    msync(mapping, fileSize, MS_SYNC);
+    munmap(mapping, fileSize);
+    std::cout << "Wrote " << header.starCount << " stars, magnitude " << header.minMagnitude << " .. "
+              << header.maxMagnitude << ", in " << nodeCount << " nodes (" << fileSize / (1024 * 1024)
+              << " MB) to " << options.output << std::endl;
+    return 0;
+}